@@ -0,0 +1,515 @@
+/* analytics.c - Columnar in-memory snapshot for tree-wide statistics */
+
+#include "family_tree.h"
+
+/*
+ * Statistics read every person, so instead of a Person with heap strings
+ * per row the snapshot keeps one array per attribute (structure of
+ * arrays), row i of each describing the same person:
+ *
+ *   ids            person id
+ *   birth, death   packed dates (pack_date_day), 0 when unknown
+ *   male, female   one bit per row
+ *   surname        interned id (intern.c), 0 for none
+ *
+ * plus the couples and, for every child with two parents, the pair of
+ * parents, each as a sorted (lower id << 32 | higher id) key. A statistic
+ * is a tight loop over one or two of these arrays: no pointers chased, no
+ * strings compared, and branch-free bodies the compiler vectorizes (the
+ * Makefile builds this file with -O3). The histograms scatter into small
+ * arrays that stay in L1.
+ *
+ * The snapshot is not kept up to date; serve mode loads one up front and
+ * reloads it at most every ANALYTICS_REFRESH_SECONDS once the data has
+ * changed.
+ */
+
+struct AnalyticsSnapshot {
+    int count;
+    int *ids;
+    int *birth;
+    int *death;
+    uint64_t *male;
+    uint64_t *female;
+    uint32_t *surname;
+    uint64_t *couples;          // Unique spouse pairs
+    int couple_count;
+    uint64_t *parent_pairs;     // One per child with two parents
+    int parent_pair_count;
+    time_t loaded_at;
+    double load_seconds;
+};
+
+static double analytics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t pair_key(int a, int b) {
+    return a < b ? (uint64_t)a << 32 | (uint32_t)b : (uint64_t)b << 32 | (uint32_t)a;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Loading
+
+static int analytics_load_people(AnalyticsSnapshot *snapshot, sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *count_sql = "SELECT COUNT(*) FROM people;";
+    if (sqlite3_prepare_v2(db, count_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    int capacity = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+
+    int words = capacity / 64 + 1;
+    snapshot->ids = malloc(sizeof(int) * (capacity + 1));
+    snapshot->birth = malloc(sizeof(int) * (capacity + 1));
+    snapshot->death = malloc(sizeof(int) * (capacity + 1));
+    snapshot->surname = malloc(sizeof(uint32_t) * (capacity + 1));
+    snapshot->male = calloc(words, sizeof(uint64_t));
+    snapshot->female = calloc(words, sizeof(uint64_t));
+    if (!snapshot->ids || !snapshot->birth || !snapshot->death || !snapshot->surname ||
+        !snapshot->male || !snapshot->female) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    const char *sql =
+        "SELECT id, gender, last_name, birth_day, birth_precision, death_day, death_precision FROM people;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    int n = 0;
+    while (n < capacity && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *gender = (const char*)sqlite3_column_text(stmt, 1);
+        snapshot->ids[n] = sqlite3_column_int(stmt, 0);
+        snapshot->surname[n] = intern_column(stmt, 2);
+        snapshot->birth[n] = sqlite3_column_type(stmt, 3) == SQLITE_NULL ? 0
+            : pack_date_day(sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4));
+        snapshot->death[n] = sqlite3_column_type(stmt, 5) == SQLITE_NULL ? 0
+            : pack_date_day(sqlite3_column_int(stmt, 5), sqlite3_column_int(stmt, 6));
+        if (gender && *gender == 'M') snapshot->male[n / 64] |= 1ULL << (n % 64);
+        if (gender && *gender == 'F') snapshot->female[n / 64] |= 1ULL << (n % 64);
+        n++;
+    }
+    sqlite3_finalize(stmt);
+    snapshot->count = n;
+    return 0;
+}
+
+static int analytics_load_families(AnalyticsSnapshot *snapshot, sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT person1_id, person2_id, relationship_type = 'spouse' FROM relationships;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    // Parent links as (child << 32 | parent), grouped by child below
+    int couple_capacity = 1024, link_capacity = 1024, links = 0;
+    uint64_t *couples = malloc(sizeof(uint64_t) * couple_capacity);
+    uint64_t *parents = malloc(sizeof(uint64_t) * link_capacity);
+    snapshot->couples = couples;
+    int ok = couples && parents;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        int a = sqlite3_column_int(stmt, 0), b = sqlite3_column_int(stmt, 1);
+        if (sqlite3_column_int(stmt, 2)) {
+            if (snapshot->couple_count == couple_capacity) {
+                couple_capacity *= 2;
+                uint64_t *grown = realloc(couples, sizeof(uint64_t) * couple_capacity);
+                if (!(ok = grown != NULL)) break;
+                snapshot->couples = couples = grown;
+            }
+            couples[snapshot->couple_count++] = pair_key(a, b);
+        } else {
+            if (links == link_capacity) {
+                link_capacity *= 2;
+                uint64_t *grown = realloc(parents, sizeof(uint64_t) * link_capacity);
+                if (!(ok = grown != NULL)) break;
+                parents = grown;
+            }
+            parents[links++] = (uint64_t)b << 32 | (uint32_t)a;
+        }
+    }
+    sqlite3_finalize(stmt);
+    if (!ok) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(parents);
+        return 1;
+    }
+
+    // A couple married twice is still one couple
+    qsort(couples, snapshot->couple_count, sizeof(uint64_t), compare_keys);
+    int unique = 0;
+    for (int i = 0; i < snapshot->couple_count; i++) {
+        if (unique == 0 || couples[i] != couples[unique - 1]) couples[unique++] = couples[i];
+    }
+    snapshot->couple_count = unique;
+
+    // Children with exactly two parents give their parents' pair; reuse the array
+    qsort(parents, links, sizeof(uint64_t), compare_keys);
+    int pairs = 0;
+    for (int i = 0; i < links;) {
+        int j = i;
+        while (j < links && parents[j] >> 32 == parents[i] >> 32) j++;
+        if (j - i == 2) parents[pairs++] = pair_key((int)(uint32_t)parents[i], (int)(uint32_t)parents[i + 1]);
+        i = j;
+    }
+    qsort(parents, pairs, sizeof(uint64_t), compare_keys);
+    snapshot->parent_pairs = parents;
+    snapshot->parent_pair_count = pairs;
+    return 0;
+}
+
+AnalyticsSnapshot *analytics_snapshot_load(sqlite3 *db) {
+    double start = analytics_now();
+    AnalyticsSnapshot *snapshot = calloc(1, sizeof(AnalyticsSnapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+
+    // One read transaction so people and relationships agree
+    sqlite3_exec(db, "SAVEPOINT analytics_load;", NULL, NULL, NULL);
+    int rc = analytics_load_people(snapshot, db);
+    if (rc == 0) rc = analytics_load_families(snapshot, db);
+    sqlite3_exec(db, "RELEASE analytics_load;", NULL, NULL, NULL);
+
+    if (rc != 0) {
+        analytics_snapshot_free(snapshot);
+        return NULL;
+    }
+    snapshot->loaded_at = time(NULL);
+    snapshot->load_seconds = analytics_now() - start;
+    return snapshot;
+}
+
+void analytics_snapshot_free(AnalyticsSnapshot *snapshot) {
+    if (!snapshot) return;
+    free(snapshot->ids);
+    free(snapshot->birth);
+    free(snapshot->death);
+    free(snapshot->male);
+    free(snapshot->female);
+    free(snapshot->surname);
+    free(snapshot->couples);
+    free(snapshot->parent_pairs);
+    free(snapshot);
+}
+
+// Kernels
+
+static int count_bits(const uint64_t *bits, int rows) {
+    int count = 0;
+    for (int i = 0; i < rows / 64 + 1; i++) count += __builtin_popcountll(bits[i]);
+    return count;
+}
+
+static int count_known(const int *dates, int rows) {
+    int count = 0;
+    for (int i = 0; i < rows; i++) count += dates[i] != 0;
+    return count;
+}
+
+// Earliest and latest year in a date column, unknowns skipped; *low > *high if none
+static void year_range(const int *dates, int rows, int *low, int *high) {
+    int min = INT32_MAX, max = 0;
+    for (int i = 0; i < rows; i++) {
+        int year = dates[i] >> 9;
+        int key = year ? year : INT32_MAX;
+        min = key < min ? key : min;
+        max = year > max ? year : max;
+    }
+    *low = min;
+    *high = max;
+}
+
+/*
+ * Neighbouring rows tend to fall in the same bucket (ids follow the
+ * generations), and back-to-back increments of one counter wait on each
+ * other. The histograms below count into HISTOGRAM_LANES interleaved
+ * copies, row i into copy i % HISTOGRAM_LANES, and sum them at the end.
+ */
+#define HISTOGRAM_LANES 4
+
+static void sum_lanes(const int *lanes, int slots, int *counts) {
+    for (int slot = 0; slot < slots; slot++) {
+        int sum = 0;
+        for (int lane = 0; lane < HISTOGRAM_LANES; lane++) sum += lanes[slot * HISTOGRAM_LANES + lane];
+        counts[slot] += sum;
+    }
+}
+
+// counts[1 + d] += people in decade first_decade + 10 d; counts[0] collects the unknowns
+static int decade_histogram(const int *dates, int rows, int first_decade, int decades, int *counts) {
+    int *lanes = calloc((size_t)(decades + 1) * HISTOGRAM_LANES, sizeof(int));
+    if (!lanes) return 1;
+    for (int i = 0; i < rows; i++) {
+        int year = dates[i] >> 9;
+        lanes[(year ? (year - first_decade) / 10 + 1 : 0) * HISTOGRAM_LANES + i % HISTOGRAM_LANES]++;
+    }
+    sum_lanes(lanes, decades + 1, counts);
+    free(lanes);
+    return 0;
+}
+
+// ages[1 + a] += people who died aged a; ages[0] collects unknown or impossible ages
+static void age_histogram(const int *birth, const int *death, int rows, int *ages) {
+    int lanes[(ANALYTICS_MAX_AGE + 2) * HISTOGRAM_LANES] = { 0 };
+    for (int i = 0; i < rows; i++) {
+        int b = birth[i], d = death[i];
+        int age = (d >> 9) - (b >> 9) - ((d & 511) < (b & 511));
+        int known = (b != 0) & (d != 0) & ((unsigned)age <= ANALYTICS_MAX_AGE);
+        lanes[(known ? age + 1 : 0) * HISTOGRAM_LANES + i % HISTOGRAM_LANES]++;
+    }
+    sum_lanes(lanes, ANALYTICS_MAX_AGE + 2, ages);
+}
+
+static void id_histogram(const uint32_t *ids, int rows, int *counts) {
+    for (int i = 0; i < rows; i++) counts[ids[i]]++;
+}
+
+// Children of each couple: a merge of the two sorted key arrays
+static long children_histogram(const uint64_t *couples, int couple_count, const uint64_t *pairs, int pair_count,
+                               int *histogram) {
+    long children = 0;
+    int j = 0;
+    for (int i = 0; i < couple_count; i++) {
+        while (j < pair_count && pairs[j] < couples[i]) j++;
+        int count = 0;
+        while (j < pair_count && pairs[j] == couples[i]) {
+            count++;
+            j++;
+        }
+        children += count;
+        histogram[count < ANALYTICS_MAX_CHILDREN ? count : ANALYTICS_MAX_CHILDREN]++;
+    }
+    return children;
+}
+
+static int surname_before(const int *counts, uint32_t a, uint32_t b) {
+    if (counts[a] != counts[b]) return counts[a] > counts[b];
+    return strcmp(interned_string(a), interned_string(b)) < 0;
+}
+
+// Distinct surnames, and the ANALYTICS_TOP_SURNAMES commonest by count and then name
+static void top_surnames(const int *counts, uint32_t id_count, AnalyticsReport *report) {
+    uint32_t top[ANALYTICS_TOP_SURNAMES];
+    int kept = 0;
+    for (uint32_t id = 1; id < id_count; id++) {
+        if (!counts[id]) continue;
+        report->surnames++;
+        if (kept == ANALYTICS_TOP_SURNAMES && !surname_before(counts, id, top[kept - 1])) continue;
+        int i = kept < ANALYTICS_TOP_SURNAMES ? kept++ : kept - 1;
+        for (; i > 0 && surname_before(counts, id, top[i - 1]); i--) top[i] = top[i - 1];
+        top[i] = id;
+    }
+    for (int i = 0; i < kept; i++) {
+        report->top_surnames[i].name = interned_string(top[i]);
+        report->top_surnames[i].count = counts[top[i]];
+    }
+    report->top_surname_count = kept;
+}
+
+/*
+ * Every statistic on the page, in one pass per column. The surname names
+ * in the report are interned and live as long as the process.
+ */
+int analytics_report(const AnalyticsSnapshot *snapshot, AnalyticsReport *report) {
+    double start = analytics_now();
+    int rows = snapshot->count;
+    memset(report, 0, sizeof(AnalyticsReport));
+    report->loaded_at = snapshot->loaded_at;
+    report->load_seconds = snapshot->load_seconds;
+
+    report->people = rows;
+    report->male = count_bits(snapshot->male, rows);
+    report->female = count_bits(snapshot->female, rows);
+    report->born = count_known(snapshot->birth, rows);
+    report->died = count_known(snapshot->death, rows);
+
+    int birth_low, birth_high, death_low, death_high;
+    year_range(snapshot->birth, rows, &birth_low, &birth_high);
+    year_range(snapshot->death, rows, &death_low, &death_high);
+    int low = birth_low < death_low ? birth_low : death_low;
+    int high = birth_high > death_high ? birth_high : death_high;
+    if (low <= high) {
+        report->first_decade = low / 10 * 10;
+        report->decade_count = high / 10 - low / 10 + 1;
+        report->births_per_decade = calloc(report->decade_count + 1, sizeof(int));
+        report->deaths_per_decade = calloc(report->decade_count + 1, sizeof(int));
+        if (!report->births_per_decade || !report->deaths_per_decade ||
+            decade_histogram(snapshot->birth, rows, report->first_decade, report->decade_count,
+                             report->births_per_decade) != 0 ||
+            decade_histogram(snapshot->death, rows, report->first_decade, report->decade_count,
+                             report->deaths_per_decade) != 0) {
+            fprintf(stderr, "Memory allocation failed\n");
+            analytics_report_free(report);
+            return 1;
+        }
+        // Drop the unknowns slot so index d is decade d
+        memmove(report->births_per_decade, report->births_per_decade + 1, sizeof(int) * report->decade_count);
+        memmove(report->deaths_per_decade, report->deaths_per_decade + 1, sizeof(int) * report->decade_count);
+    }
+
+    int ages[ANALYTICS_MAX_AGE + 2] = { 0 };
+    age_histogram(snapshot->birth, snapshot->death, rows, ages);
+    memcpy(report->age_at_death, ages + 1, sizeof(report->age_at_death));
+    long age_sum = 0;
+    for (int age = 0; age <= ANALYTICS_MAX_AGE; age++) {
+        report->ages += ages[age + 1];
+        age_sum += (long)age * ages[age + 1];
+    }
+    report->median_age = -1;
+    for (int age = 0, seen = 0; age <= ANALYTICS_MAX_AGE && report->ages; age++) {
+        seen += ages[age + 1];
+        if (seen * 2 >= report->ages) {
+            report->median_age = age;
+            break;
+        }
+    }
+    report->mean_age = report->ages ? (double)age_sum / report->ages : 0;
+
+    // Surnames share the id space with given names, which keep a count of 0
+    uint32_t id_count = intern_count();
+    int *counts = calloc(id_count, sizeof(int));
+    if (!counts) {
+        fprintf(stderr, "Memory allocation failed\n");
+        analytics_report_free(report);
+        return 1;
+    }
+    id_histogram(snapshot->surname, rows, counts);
+    top_surnames(counts, id_count, report);
+    free(counts);
+
+    report->couples = snapshot->couple_count;
+    report->children = children_histogram(snapshot->couples, snapshot->couple_count, snapshot->parent_pairs,
+                                          snapshot->parent_pair_count, report->children_per_couple);
+
+    report->seconds = analytics_now() - start;
+    return 0;
+}
+
+void analytics_report_free(AnalyticsReport *report) {
+    free(report->births_per_decade);
+    free(report->deaths_per_decade);
+    report->births_per_decade = report->deaths_per_decade = NULL;
+    report->decade_count = 0;
+}
+
+// Serve mode keeps one snapshot, reloaded in the parent between connections
+
+static AnalyticsSnapshot *preloaded;
+static sqlite3 *preload_db;
+static int preload_data_version;
+
+static int analytics_data_version(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+int analytics_snapshot_preload(sqlite3 *db) {
+    int version = analytics_data_version(db);
+    AnalyticsSnapshot *snapshot = analytics_snapshot_load(db);
+    if (!snapshot) return 1;
+    analytics_snapshot_free(preloaded);
+    preloaded = snapshot;
+    preload_db = db;
+    preload_data_version = version;
+    return 0;
+}
+
+void analytics_snapshot_maintain(void) {
+    if (!preloaded || time(NULL) - preloaded->loaded_at < ANALYTICS_REFRESH_SECONDS) return;
+    if (analytics_data_version(preload_db) == preload_data_version) return;
+    analytics_snapshot_preload(preload_db);
+}
+
+AnalyticsSnapshot *analytics_snapshot_preloaded(void) {
+    return preloaded;
+}
+
+// Benchmark against the same statistics in SQL
+
+static double analytics_sql_time(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt;
+    double start = analytics_now();
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return analytics_now() - start;
+}
+
+int analytics_benchmark(sqlite3 *db, int samples) {
+    if (samples <= 0) samples = 20;
+
+    AnalyticsSnapshot *snapshot = analytics_snapshot_load(db);
+    if (!snapshot) return 1;
+
+    AnalyticsReport report;
+    double best = 0;
+    for (int i = 0; i < samples; i++) {
+        if (analytics_report(snapshot, &report) != 0) {
+            analytics_snapshot_free(snapshot);
+            return 1;
+        }
+        if (i == 0 || report.seconds < best) best = report.seconds;
+        if (i < samples - 1) analytics_report_free(&report);
+    }
+
+    // The same statistics as GROUP BY queries over the table
+    const char *queries[] = {
+        "SELECT COUNT(*), SUM(gender = 'M'), SUM(gender = 'F'), COUNT(birth_day), COUNT(death_day) FROM people;",
+        "SELECT CAST(strftime('%Y', birth_day * 86400, 'unixepoch') AS INTEGER) / 10, COUNT(*) "
+        "FROM people WHERE birth_day IS NOT NULL GROUP BY 1;",
+        "SELECT CAST(strftime('%Y', death_day * 86400, 'unixepoch') AS INTEGER) / 10, COUNT(*) "
+        "FROM people WHERE death_day IS NOT NULL GROUP BY 1;",
+        "SELECT (death_day - birth_day) / 365, COUNT(*) FROM people "
+        "WHERE birth_day IS NOT NULL AND death_day IS NOT NULL GROUP BY 1;",
+        "SELECT last_name, COUNT(*) FROM people GROUP BY last_name ORDER BY 2 DESC LIMIT 20;",
+        "SELECT COUNT(c.person2_id) FROM relationships s "
+        "LEFT JOIN relationships c ON c.person1_id = s.person1_id AND c.relationship_type = 'parent-child' "
+        "AND EXISTS (SELECT 1 FROM relationships o WHERE o.person2_id = c.person2_id "
+        "AND o.person1_id = s.person2_id AND o.relationship_type = 'parent-child') "
+        "WHERE s.relationship_type = 'spouse' GROUP BY s.id;",
+    };
+    double sql_time = 0;
+    for (int i = 0; i < (int)(sizeof(queries) / sizeof(queries[0])); i++) {
+        double seconds = analytics_sql_time(db, queries[i]);
+        if (seconds < 0) {
+            analytics_report_free(&report);
+            analytics_snapshot_free(snapshot);
+            return 1;
+        }
+        sql_time += seconds;
+    }
+
+    double bytes = (double)snapshot->count * (3 * sizeof(int) + sizeof(uint32_t)) +
+                   2.0 * sizeof(uint64_t) * (snapshot->count / 64 + 1) +
+                   (double)sizeof(uint64_t) * (snapshot->couple_count + snapshot->parent_pair_count);
+    printf("load          %.3f s, %d people, %d surnames, %d couples, %.1f MB\n",
+           snapshot->load_seconds, snapshot->count, report.surnames, report.couples, bytes / 1e6);
+    printf("statistics    snapshot: %9.2f ms   SQL: %9.2f ms\n", best * 1e3, sql_time * 1e3);
+    printf("check         %d male, %d female, %d born, %d died, mean age %.1f, %.2f children per couple\n",
+           report.male, report.female, report.born, report.died, report.mean_age,
+           report.couples ? (double)report.children / report.couples : 0);
+
+    analytics_report_free(&report);
+    analytics_snapshot_free(snapshot);
+    return 0;
+}
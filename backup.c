@@ -0,0 +1,134 @@
+/* backup.c - Online database backup for family tree application */
+
+#include "family_tree.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Copies the live database with the SQLite backup API a few pages at a
+ * time. The source is only read-locked while a step runs, so the CGI can
+ * keep reading and writing between steps. A write from another
+ * connection makes SQLite start the whole copy again from page 1, so
+ * each restart doubles the step size: under steady writes a later pass
+ * copies more per lock and eventually the whole file in one step. The
+ * restarts and elapsed time are still capped, and running past either
+ * fails the backup. The snapshot is written to a temporary file and
+ * renamed into place once complete.
+ */
+
+static double backup_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int backup_database(sqlite3 *db, const char *path, int pages_per_step, int sleep_ms,
+                    BackupProgress *progress) {
+    if (pages_per_step <= 0) pages_per_step = BACKUP_DEFAULT_PAGES;
+    if (sleep_ms < 0) sleep_ms = BACKUP_DEFAULT_SLEEP_MS;
+
+    size_t tmp_len = strlen(path) + 5;
+    char *tmp_path = malloc(tmp_len);
+    if (!tmp_path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+    unlink(tmp_path);
+
+    sqlite3 *dest;
+    int rc = sqlite3_open(tmp_path, &dest);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Cannot open backup file: %s\n", sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        free(tmp_path);
+        return 1;
+    }
+
+    sqlite3_backup *backup = sqlite3_backup_init(dest, "main", db, "main");
+    if (!backup) {
+        fprintf(stderr, "Cannot start backup: %s\n", sqlite3_errmsg(dest));
+        sqlite3_close(dest);
+        unlink(tmp_path);
+        free(tmp_path);
+        return 1;
+    }
+
+    int page_size = 0;
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "PRAGMA page_size;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) page_size = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    double start = backup_now();
+    int steps = 0;
+    int restarts = 0;
+    int last_done = 0;
+
+    do {
+        rc = sqlite3_backup_step(backup, pages_per_step);
+        steps++;
+
+        int total = sqlite3_backup_pagecount(backup);
+        int done = total - sqlite3_backup_remaining(backup);
+        if (progress && progress->callback) {
+            progress->callback(progress->arg, done, total);
+        }
+
+        // Fewer pages done than after the last step means the copy started over
+        if (rc == SQLITE_OK && done < last_done) {
+            restarts++;
+            pages_per_step = pages_per_step > total / 2 ? total : pages_per_step * 2;
+        }
+        last_done = done;
+
+        if (rc != SQLITE_DONE &&
+            (restarts > BACKUP_MAX_RESTARTS || backup_now() - start > BACKUP_MAX_SECONDS)) {
+            sqlite3_backup_finish(backup);
+            fprintf(stderr, "Backup failed: gave up after %d restarts in %.0f s\n",
+                    restarts, backup_now() - start);
+            sqlite3_close(dest);
+            unlink(tmp_path);
+            free(tmp_path);
+            return 1;
+        }
+
+        // Yield between steps so writers are not held off; back off harder when busy
+        if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            sqlite3_sleep(rc == SQLITE_OK ? sleep_ms : sleep_ms * 4 + 1);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    int total_pages = sqlite3_backup_pagecount(backup);
+    sqlite3_backup_finish(backup);
+
+    if (rc == SQLITE_DONE) {
+        rc = sqlite3_errcode(dest);
+    }
+    if (rc != SQLITE_OK && rc != SQLITE_DONE) {
+        fprintf(stderr, "Backup failed: %s\n", sqlite3_errstr(rc));
+        sqlite3_close(dest);
+        unlink(tmp_path);
+        free(tmp_path);
+        return 1;
+    }
+    sqlite3_close(dest);
+
+    if (rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Cannot move backup into place at %s\n", path);
+        unlink(tmp_path);
+        free(tmp_path);
+        return 1;
+    }
+    free(tmp_path);
+
+    if (progress) {
+        progress->pages = total_pages;
+        progress->steps = steps;
+        progress->restarts = restarts;
+        progress->bytes = (double)total_pages * page_size;
+        progress->seconds = backup_now() - start;
+    }
+    return 0;
+}
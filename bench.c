@@ -0,0 +1,436 @@
+/* bench.c - Microbenchmarks for family tree accessors and renderers */
+
+#include "family_tree.h"
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Times the database accessors and HTML renderers one call at a time
+ * against a generated dataset (see gen_tree). Rendered HTML goes to
+ * /dev/null; results are printed one JSON object per line so runs can
+ * be diffed or loaded into a spreadsheet:
+ *
+ *   {"benchmark":"get_person_by_id","iterations":2000,"ns_per_op":...,
+ *    "allocs_per_op":...,"bytes_per_op":...,"p50_ns":...,"p90_ns":...,
+ *    "p99_ns":...,"max_ns":...}
+ *
+ * Usage: family_tree_bench [-d database] [-n iterations] [-s seed] [-f filter]
+ */
+
+#define BENCH_DEFAULT_DB "bench_100k.db"
+#define BENCH_DEFAULT_ITERATIONS 2000
+#define BENCH_WARMUP 20
+
+/*
+ * Allocation counting replaces the allocator entry points and forwards to
+ * glibc's own implementation, so calls made from inside SQLite and libc
+ * (strdup) are counted too.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int counting = 0;
+static uint64_t alloc_count = 0;
+static uint64_t alloc_bytes = 0;
+
+void *malloc(size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (counting) {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+typedef struct {
+    sqlite3 *db;
+    int *ids;
+    int id_count;
+    Person card;
+    int arg;
+} BenchContext;
+
+typedef struct {
+    const char *name;
+    void (*run)(BenchContext *context, int i);
+    int arg;            // Tree depth, or query string kind
+    int divisor;        // Slow benchmarks run iterations / divisor times
+} Benchmark;
+
+static const char *escape_inputs[] = {
+    "Plain name without specials",
+    "O'Brien & Sons <b>\"quoted\"</b>",
+    "Born in the old homestead by the river, farmed maize and beans, married twice & raised seven children",
+    "<<<<>>>>&&&&''''\"\"\"\""
+};
+
+static const char *search_terms[] = { "Smith", "ann", "Otieno", "zzq" };
+
+/*
+ * Query string inputs, generated once from the seed. Fuzz inputs mix
+ * separators, repeated names, invalid and truncated escapes and long
+ * runs, and every one is checked against a linear scan before timing.
+ */
+#define BENCH_QUERY_POOL 64
+#define BENCH_LONG_VALUE 65536
+#define BENCH_MANY_PARAMS 4096
+
+enum { QUERY_TYPICAL, QUERY_LONG, QUERY_MANY, QUERY_FUZZ, QUERY_KINDS };
+
+static char *query_pool[QUERY_KINDS][BENCH_QUERY_POOL];
+
+static const char *typical_queries[] = {
+    "action=view_profile&id=1234",
+    "action=view_tree&root_id=42&levels=3",
+    "action=search&search_term=Mary+Ann",
+    "action=process_add_person&first_name=Jos%C3%A9&last_name=O%27Brien&gender=M&birth_date=1990-01-01"
+    "&death_date=&bio=Farmer+%26+teacher&photo_url=&parent_id=17&relationship_type=parent-child"
+};
+
+static const char *query_lookups[] = { "action", "id", "search_term", "levels", "missing" };
+
+static int bench_id(BenchContext *context, int i) {
+    return context->ids[i % context->id_count];
+}
+
+static void bench_get_person_by_id(BenchContext *context, int i) {
+    Person person;
+    if (get_person_by_id(context->db, bench_id(context, i), &person) == 0) free_person(&person);
+}
+
+static void bench_get_children(BenchContext *context, int i) {
+    Person *children = NULL;
+    int count = 0;
+    if (get_children(context->db, bench_id(context, i), &children, &count) == 0 && count > 0) {
+        for (int c = 0; c < count; c++) free_person(&children[c]);
+        free(children);
+    }
+}
+
+static void bench_get_parents(BenchContext *context, int i) {
+    Person father, mother;
+    if (get_parents(context->db, bench_id(context, i), &father, &mother) == 0) {
+        free_person(&father);
+        free_person(&mother);
+    }
+}
+
+static void bench_get_spouse(BenchContext *context, int i) {
+    Person spouse;
+    if (get_spouse(context->db, bench_id(context, i), &spouse) == 0) free_person(&spouse);
+}
+
+static void bench_html_escape(BenchContext *context, int i) {
+    (void)context;
+    free(html_escape(escape_inputs[i % (int)(sizeof(escape_inputs) / sizeof(escape_inputs[0]))]));
+}
+
+static void bench_render_person_card(BenchContext *context, int i) {
+    (void)i;
+    render_person_card(&context->card);
+}
+
+// arg 0: rendered per request, as in CGI; arg 1: preloaded, as in a serve-mode child
+static void bench_page_shell(BenchContext *context, int i) {
+    static int preloaded = 0;
+    if (context->arg && !preloaded) preloaded = page_shell_preload() == 0;
+    (void)i;
+    print_html_header(PAGE_TITLE);
+    print_html_footer();
+}
+
+static void bench_render_family_tree(BenchContext *context, int i) {
+    render_family_tree(context->db, bench_id(context, i), context->arg);
+}
+
+static void bench_search(BenchContext *context, int i) {
+    PageCursor first_page = { "", "", 0 };
+    show_search_results(context->db, search_terms[i % (int)(sizeof(search_terms) / sizeof(search_terms[0]))],
+                        &first_page);
+}
+
+static void bench_parse_query_string(BenchContext *context, int i) {
+    CGIParams params = parse_query_string(query_pool[context->arg][i % BENCH_QUERY_POOL]);
+    for (size_t l = 0; l < sizeof(query_lookups) / sizeof(query_lookups[0]); l++) {
+        get_cgi_param(params, query_lookups[l]);
+    }
+    free_cgi_params(params);
+}
+
+static char *random_query(unsigned int *seed, int kind) {
+    static const char *fragments[] = {
+        "&", "&&", "=", "==", "%", "%2", "%41", "%zz", "%%", "+", "a", "id", "action", "%61ction",
+        "name", "x", "%00", "%FF", "%e2%82%ac", "search_term", "~", ";", "=&=", "id=", "&id"
+    };
+    int fragment_count = (int)(sizeof(fragments) / sizeof(fragments[0]));
+
+    size_t capacity = kind == QUERY_LONG ? BENCH_LONG_VALUE * 3 + 64 : BENCH_MANY_PARAMS * 16 + 64;
+    char *query = malloc(capacity);
+    if (!query) return NULL;
+    size_t used = 0;
+
+    if (kind == QUERY_TYPICAL) {
+        snprintf(query, capacity, "%s", typical_queries[rand_r(seed) % 4]);
+        return query;
+    }
+    if (kind == QUERY_LONG) {
+        // A large percent-encoded bio, as an edit form would send
+        used = snprintf(query, capacity, "action=process_edit_person&id=7&bio=");
+        while (used + 3 < capacity - 16 && used < BENCH_LONG_VALUE * 3) {
+            used += snprintf(query + used, capacity - used, rand_r(seed) % 4 ? "%%%02X" : "+", rand_r(seed) % 256);
+        }
+        snprintf(query + used, capacity - used, "&search_term=x");
+        return query;
+    }
+    if (kind == QUERY_MANY) {
+        // Many parameters, every other one repeating the same name
+        for (int p = 0; p < BENCH_MANY_PARAMS && used + 32 < capacity; p++) {
+            if (p % 2) {
+                used += snprintf(query + used, capacity - used, "%sid=%d", p ? "&" : "", p);
+            } else {
+                used += snprintf(query + used, capacity - used, "%sk%d=%d", p ? "&" : "", p, p);
+            }
+        }
+        return query;
+    }
+
+    int length = 1 + rand_r(seed) % 400;
+    for (int f = 0; f < length && used + 24 < capacity; f++) {
+        used += snprintf(query + used, capacity - used, "%s", fragments[rand_r(seed) % fragment_count]);
+    }
+    return query;
+}
+
+// Every name must resolve to the value of its first occurrence
+static int check_query(const char *query) {
+    CGIParams params = parse_query_string(query);
+    int rc = 0;
+    for (int p = 0; p < params.count && rc == 0; p++) {
+        const char *expected = NULL;
+        for (int q = 0; q < params.count && !expected; q++) {
+            if (strcmp(params.params[q].name, params.params[p].name) == 0) expected = params.params[q].value;
+        }
+        if (get_cgi_param(params, params.params[p].name) != expected) rc = 1;
+    }
+    if (get_cgi_param(params, "no-such-parameter-name")) rc = 1;
+    free_cgi_params(params);
+    if (rc) fprintf(stderr, "Query string lookup mismatch for: %.80s\n", query);
+    return rc;
+}
+
+static int build_queries(unsigned int seed) {
+    for (int kind = 0; kind < QUERY_KINDS; kind++) {
+        for (int i = 0; i < BENCH_QUERY_POOL; i++) {
+            query_pool[kind][i] = random_query(&seed, kind);
+            if (!query_pool[kind][i] || check_query(query_pool[kind][i])) return 1;
+        }
+    }
+    return 0;
+}
+
+static void free_queries(void) {
+    for (int kind = 0; kind < QUERY_KINDS; kind++) {
+        for (int i = 0; i < BENCH_QUERY_POOL; i++) free(query_pool[kind][i]);
+    }
+}
+
+static const Benchmark benchmarks[] = {
+    { "get_person_by_id", bench_get_person_by_id, 0, 1 },
+    { "get_children", bench_get_children, 0, 1 },
+    { "get_parents", bench_get_parents, 0, 1 },
+    { "get_spouse", bench_get_spouse, 0, 1 },
+    { "html_escape", bench_html_escape, 0, 1 },
+    { "render_person_card", bench_render_person_card, 0, 1 },
+    { "page_shell", bench_page_shell, 0, 1 },
+    { "page_shell/preloaded", bench_page_shell, 1, 1 },
+    { "render_family_tree/1", bench_render_family_tree, 1, 1 },
+    { "render_family_tree/2", bench_render_family_tree, 2, 2 },
+    { "render_family_tree/3", bench_render_family_tree, 3, 4 },
+    { "render_family_tree/5", bench_render_family_tree, 5, 16 },
+    { "search", bench_search, 0, 200 },
+    { "parse_query_string/typical", bench_parse_query_string, QUERY_TYPICAL, 1 },
+    { "parse_query_string/long_value", bench_parse_query_string, QUERY_LONG, 4 },
+    { "parse_query_string/many_params", bench_parse_query_string, QUERY_MANY, 4 },
+    { "parse_query_string/fuzz", bench_parse_query_string, QUERY_FUZZ, 1 },
+};
+
+static int64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_ns(const void *a, const void *b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t *sorted, int count, double p) {
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static int run_benchmark(FILE *results, const Benchmark *benchmark, BenchContext *context,
+                         int iterations, const char *dataset) {
+    int n = iterations / benchmark->divisor;
+    if (n < 5) n = 5;
+
+    int64_t *samples = malloc(sizeof(int64_t) * n);
+    if (!samples) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    context->arg = benchmark->arg;
+    for (int i = 0; i < BENCH_WARMUP && i < n; i++) benchmark->run(context, i);
+
+    alloc_count = 0;
+    alloc_bytes = 0;
+    int64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        counting = 1;
+        int64_t start = bench_now_ns();
+        benchmark->run(context, i);
+        samples[i] = bench_now_ns() - start;
+        counting = 0;
+        total += samples[i];
+    }
+    uint64_t allocs = alloc_count, bytes = alloc_bytes;
+
+    qsort(samples, n, sizeof(int64_t), compare_ns);
+    fprintf(results,
+            "{\"benchmark\":\"%s\",\"dataset\":\"%s\",\"iterations\":%d,\"ns_per_op\":%.1f,"
+            "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f,\"p50_ns\":%lld,\"p90_ns\":%lld,"
+            "\"p99_ns\":%lld,\"max_ns\":%lld}\n",
+            benchmark->name, dataset, n, (double)total / n, (double)allocs / n, (double)bytes / n,
+            (long long)percentile(samples, n, 0.50), (long long)percentile(samples, n, 0.90),
+            (long long)percentile(samples, n, 0.99), (long long)samples[n - 1]);
+    fflush(results);
+
+    free(samples);
+    return 0;
+}
+
+static int load_ids(BenchContext *context, unsigned int seed) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(context->db, "SELECT COUNT(*) FROM people;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(context->db));
+        return 1;
+    }
+    int total = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    if (total == 0) {
+        fprintf(stderr, "Database has no people; generate one with gen_tree first\n");
+        return 1;
+    }
+
+    int *all = malloc(sizeof(int) * total);
+    if (!all) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    int count = 0;
+    if (sqlite3_prepare_v2(context->db, "SELECT id FROM people;", -1, &stmt, NULL) == SQLITE_OK) {
+        while (count < total && sqlite3_step(stmt) == SQLITE_ROW) all[count++] = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+
+    // A fixed, seeded sample keeps runs comparable
+    srand(seed);
+    for (int i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1), swap = all[i];
+        all[i] = all[j];
+        all[j] = swap;
+    }
+    context->ids = all;
+    context->id_count = count < 1024 ? count : 1024;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = BENCH_DEFAULT_DB;
+    const char *filter = NULL;
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:n:s:f:h")) != -1) {
+        switch (opt) {
+            case 'd': path = optarg; break;
+            case 'n': iterations = atoi(optarg); break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'f': filter = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-d database] [-n iterations] [-s seed] [-f filter]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (iterations < 1) iterations = BENCH_DEFAULT_ITERATIONS;
+
+    BenchContext context;
+    memset(&context, 0, sizeof(context));
+
+    if (sqlite3_open_v2(path, &context.db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database %s: %s\n", path, sqlite3_errmsg(context.db));
+        sqlite3_close(context.db);
+        return 1;
+    }
+    if (load_ids(&context, seed) != 0) {
+        sqlite3_close(context.db);
+        return 1;
+    }
+    if (build_queries(seed) != 0) {
+        fprintf(stderr, "Query string parser failed its checks\n");
+        free_queries();
+        sqlite3_close(context.db);
+        return 1;
+    }
+    if (get_person_by_id(context.db, context.ids[0], &context.card) != 0) {
+        fprintf(stderr, "Failed to load a sample person\n");
+        sqlite3_close(context.db);
+        return 1;
+    }
+
+    // Results keep the original stdout; renderer output is discarded
+    FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+    if (!results || !freopen("/dev/null", "w", stdout)) {
+        fprintf(stderr, "Cannot redirect renderer output\n");
+        sqlite3_close(context.db);
+        return 1;
+    }
+
+    const char *dataset = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    int rc = 0;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]) && rc == 0; i++) {
+        if (filter && !strstr(benchmarks[i].name, filter)) continue;
+        rc = run_benchmark(results, &benchmarks[i], &context, iterations, dataset);
+    }
+
+    fclose(results);
+    free_queries();
+    free_person(&context.card);
+    free(context.ids);
+    sqlite3_close(context.db);
+    return rc;
+}
@@ -0,0 +1,411 @@
+/* blob_store.c - Content-addressed photo store for family tree application */
+
+#include "family_tree.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Blobs are named by the SHA-256 of their content and kept under two
+ * levels of fan-out directories (photos/ab/cd/abcd...), so identical
+ * uploads land on the same file and are stored once. Uploads stream into
+ * a temporary file in the store while being hashed, then are renamed into
+ * place; a blob that already exists just drops the temporary copy. Files
+ * never change once written, which is what makes them safe to cache
+ * forever and to serve straight from the page cache with sendfile.
+ */
+
+#define BLOB_CACHE_SECONDS 31536000
+
+/* SHA-256 (FIPS 180-4) */
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} Sha256;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(Sha256 *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void sha256_block(Sha256 *ctx, const unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+static void sha256_update(Sha256 *ctx, const unsigned char *data, size_t len) {
+    ctx->length += len;
+    if (ctx->used) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, data, take);
+        ctx->used += take;
+        data += take;
+        len -= take;
+        if (ctx->used < 64) return;
+        sha256_block(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    for (; len >= 64; data += 64, len -= 64) sha256_block(ctx, data);
+    memcpy(ctx->block, data, len);
+    ctx->used = len;
+}
+
+static void sha256_final(Sha256 *ctx, char hex[BLOB_HASH_HEX + 1]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) sha256_update(ctx, &pad, 1);
+
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) length[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(ctx, length, 8);
+
+    for (int i = 0; i < 8; i++) snprintf(hex + i * 8, 9, "%08x", ctx->state[i]);
+}
+
+/* Store */
+
+struct BlobWriter {
+    Sha256 sha;
+    int fd;
+    char temp_path[256];
+    size_t size;
+};
+
+static const char *blob_root(void) {
+    const char *root = getenv("FAMILY_TREE_BLOBS");
+    return root && *root ? root : BLOB_DIR;
+}
+
+int blob_hash_valid(const char *hash) {
+    if (!hash || strlen(hash) != BLOB_HASH_HEX) return 0;
+    for (const char *p = hash; *p; p++) {
+        if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'))) return 0;
+    }
+    return 1;
+}
+
+int blob_path(const char *hash, char *path, size_t size) {
+    if (!blob_hash_valid(hash)) return 1;
+    int len = snprintf(path, size, "%s/%.2s/%.2s/%s", blob_root(), hash, hash + 2, hash);
+    return len < 0 || (size_t)len >= size;
+}
+
+BlobWriter *blob_writer_open(void) {
+    BlobWriter *writer = malloc(sizeof(BlobWriter));
+    if (!writer) return NULL;
+
+    mkdir(blob_root(), 0755);
+    snprintf(writer->temp_path, sizeof(writer->temp_path), "%s/upload-XXXXXX", blob_root());
+    writer->fd = mkstemp(writer->temp_path);
+    if (writer->fd < 0) {
+        fprintf(stderr, "Cannot create %s: %s\n", writer->temp_path, strerror(errno));
+        free(writer);
+        return NULL;
+    }
+    sha256_init(&writer->sha);
+    writer->size = 0;
+    return writer;
+}
+
+int blob_writer_write(BlobWriter *writer, const void *data, size_t len) {
+    if (writer->size + len > BLOB_MAX_BYTES) return 413;
+
+    sha256_update(&writer->sha, data, len);
+    writer->size += len;
+
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = write(writer->fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Cannot write %s: %s\n", writer->temp_path, strerror(errno));
+            return 500;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+void blob_writer_abort(BlobWriter *writer) {
+    if (!writer) return;
+    close(writer->fd);
+    unlink(writer->temp_path);
+    free(writer);
+}
+
+int blob_writer_commit(BlobWriter *writer, char hash[BLOB_HASH_HEX + 1]) {
+    sha256_final(&writer->sha, hash);
+
+    char path[512];
+    blob_path(hash, path, sizeof(path));
+
+    // Fan-out directories: root/ab and root/ab/cd
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/%.2s", blob_root(), hash);
+    mkdir(dir, 0755);
+    snprintf(dir, sizeof(dir), "%s/%.2s/%.2s", blob_root(), hash, hash + 2);
+    mkdir(dir, 0755);
+
+    int rc = 0;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        // Already stored: same hash means same bytes
+        unlink(writer->temp_path);
+    } else if (fchmod(writer->fd, 0644) != 0 || fsync(writer->fd) != 0 ||
+               rename(writer->temp_path, path) != 0) {
+        fprintf(stderr, "Cannot store blob %s: %s\n", path, strerror(errno));
+        unlink(writer->temp_path);
+        rc = 500;
+    }
+
+    close(writer->fd);
+    free(writer);
+    return rc;
+}
+
+const char *image_content_type(const unsigned char *head, size_t len) {
+    if (len >= 3 && head[0] == 0xFF && head[1] == 0xD8 && head[2] == 0xFF) return "image/jpeg";
+    if (len >= 8 && memcmp(head, "\x89PNG\r\n\x1a\n", 8) == 0) return "image/png";
+    if (len >= 6 && (memcmp(head, "GIF87a", 6) == 0 || memcmp(head, "GIF89a", 6) == 0)) return "image/gif";
+    if (len >= 12 && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WEBP", 4) == 0) return "image/webp";
+    if (len >= 2 && head[0] == 'P' && head[1] >= '1' && head[1] <= '6') return "image/x-portable-anymap";
+    return NULL;
+}
+
+/*
+ * Multipart handler for the "photo" field of the person forms. The first
+ * bytes must look like an image; the stored blob's URL replaces the file
+ * name as the field's value.
+ */
+int photo_file_part(void *arg, const char *field, const char *filename, const char *content_type,
+                    const char *data, size_t len, int final) {
+    PhotoUpload *upload = arg;
+    (void)filename;
+    (void)content_type;
+
+    if (strcmp(field, "photo") != 0) return 0;
+
+    if (!final) {
+        if (!upload->writer) {
+            upload->writer = blob_writer_open();
+            upload->head_len = 0;
+            if (!upload->writer) return 500;
+        }
+        if (upload->head_len < sizeof(upload->head)) {
+            size_t take = sizeof(upload->head) - upload->head_len;
+            if (take > len) take = len;
+            memcpy(upload->head + upload->head_len, data, take);
+            upload->head_len += take;
+        }
+        int rc = blob_writer_write(upload->writer, data, len);
+        if (rc) {
+            blob_writer_abort(upload->writer);
+            upload->writer = NULL;
+        }
+        return rc;
+    }
+
+    if (!upload->writer) return 0;   // Empty file
+    if (!image_content_type(upload->head, upload->head_len)) {
+        blob_writer_abort(upload->writer);
+        upload->writer = NULL;
+        return 415;
+    }
+
+    char hash[BLOB_HASH_HEX + 1];
+    int rc = blob_writer_commit(upload->writer, hash);
+    upload->writer = NULL;
+    if (rc) return rc;
+
+    snprintf(upload->handler.value, sizeof(upload->handler.value), "%s%s", PHOTO_URL_PREFIX, hash);
+    return 0;
+}
+
+/* Delivery */
+
+// Parse a single "bytes=" range; returns 0 to ignore, 1 for a valid range, -1 if unsatisfiable
+static int parse_range(const char *header, off_t size, off_t *start, off_t *end) {
+    if (!header || strncmp(header, "bytes=", 6) != 0 || strchr(header, ',')) return 0;
+
+    const char *spec = header + 6;
+    char *rest;
+    if (*spec == '-') {
+        long long suffix = strtoll(spec + 1, &rest, 10);
+        if (*rest || rest == spec + 1) return 0;
+        if (suffix <= 0 || size == 0) return -1;
+        *start = suffix >= size ? 0 : size - suffix;
+        *end = size - 1;
+        return 1;
+    }
+
+    long long first = strtoll(spec, &rest, 10);
+    if (rest == spec || *rest != '-' || first < 0) return 0;
+    const char *last_spec = rest + 1;
+    long long last = size - 1;
+    if (*last_spec) {
+        last = strtoll(last_spec, &rest, 10);
+        if (*rest || last < first) return 0;
+        if (last >= size) last = size - 1;
+    }
+    if (first >= size) return -1;
+
+    *start = first;
+    *end = last;
+    return 1;
+}
+
+static int copy_to_stdout(int fd, off_t offset, off_t count) {
+    fflush(stdout);
+
+    // Zero-copy from the page cache; falls back to read/write where unsupported
+    while (count > 0) {
+        ssize_t sent = sendfile(STDOUT_FILENO, fd, &offset, count > 1 << 30 ? 1 << 30 : (size_t)count);
+        if (sent > 0) {
+            count -= sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        return 1;
+    }
+
+    char buffer[65536];
+    while (count > 0) {
+        ssize_t n = pread(fd, buffer, count < (off_t)sizeof(buffer) ? (size_t)count : sizeof(buffer), offset);
+        if (n <= 0) return 1;
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(STDOUT_FILENO, buffer + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return 1;
+            done += w;
+        }
+        offset += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static void print_blob_cache_control(int immutable) {
+    if (immutable) {
+        printf("Cache-Control: public, max-age=%d, immutable\n", BLOB_CACHE_SECONDS);
+    } else {
+        printf("Cache-Control: no-cache\n");
+    }
+}
+
+/*
+ * Write a complete CGI response for a stored blob, honouring Range and
+ * If-None-Match. Responses that may be replaced later under the same URL
+ * (a thumbnail URL answered with the original) pass immutable = 0 so
+ * clients revalidate instead of caching them for a year.
+ */
+int serve_blob(const char *hash, int immutable) {
+    char path[512];
+    int fd = -1;
+    struct stat st;
+
+    if (blob_path(hash, path, sizeof(path)) == 0) fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        printf("Status: 404 Not Found\nContent-Type: text/plain\n\nPhoto not found.\n");
+        return 1;
+    }
+
+    unsigned char head[16];
+    ssize_t head_len = pread(fd, head, sizeof(head), 0);
+    const char *type = image_content_type(head, head_len > 0 ? (size_t)head_len : 0);
+
+    // The content never changes, so the hash is a strong validator
+    const char *if_none_match = getenv("HTTP_IF_NONE_MATCH");
+    if (if_none_match && strstr(if_none_match, hash)) {
+        printf("Status: 304 Not Modified\nETag: \"%s\"\n", hash);
+        print_blob_cache_control(immutable);
+        printf("\n");
+        close(fd);
+        return 0;
+    }
+
+    off_t start = 0, end = st.st_size - 1;
+    int range = parse_range(getenv("HTTP_RANGE"), st.st_size, &start, &end);
+    if (range < 0) {
+        printf("Status: 416 Range Not Satisfiable\nContent-Range: bytes */%lld\n\n", (long long)st.st_size);
+        close(fd);
+        return 0;
+    }
+
+    if (range > 0) {
+        printf("Status: 206 Partial Content\n");
+        printf("Content-Range: bytes %lld-%lld/%lld\n", (long long)start, (long long)end, (long long)st.st_size);
+    }
+    printf("Content-Type: %s\n", type ? type : "application/octet-stream");
+    printf("Content-Length: %lld\n", (long long)(st.st_size ? end - start + 1 : 0));
+    printf("Accept-Ranges: bytes\n");
+    printf("ETag: \"%s\"\n", hash);
+    print_blob_cache_control(immutable);
+    printf("X-Content-Type-Options: nosniff\n\n");
+
+    const char *method = getenv("REQUEST_METHOD");
+    int rc = 0;
+    if (!(method && strcmp(method, "HEAD") == 0) && st.st_size > 0) {
+        rc = copy_to_stdout(fd, start, end - start + 1);
+    }
+    close(fd);
+    return rc;
+}
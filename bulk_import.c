@@ -0,0 +1,793 @@
+/* bulk_import.c - Parallel CSV/NDJSON import for family tree application */
+
+#include "family_tree.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Pipeline: the input file is memory-mapped and split at line boundaries
+ * into slices that parser threads claim in turn. Parsers decode and
+ * validate rows into batches and push them onto a bounded queue; the
+ * calling thread is the single writer and inserts each batch in its own
+ * transaction. Records must be one per line (CSV quoted fields may not
+ * contain newlines).
+ */
+
+#define IMPORT_BATCH_ROWS 4096
+#define IMPORT_QUEUE_DEPTH 8
+#define IMPORT_MAX_FIELDS 8
+#define IMPORT_MAX_THREADS 64
+#define IMPORT_SLICES_PER_THREAD 4
+#define IMPORT_MAX_REPORTED 10
+
+typedef enum {
+    IMPORT_PEOPLE,
+    IMPORT_RELATIONSHIPS
+} ImportKind;
+
+// Field slots per kind; the order matches the INSERT statements below
+static const char *people_columns[] = {
+    "id", "first_name", "last_name", "gender", "birth_date", "death_date", "bio", "photo_url", NULL
+};
+static const char *relationship_columns[] = {
+    "id", "person1_id", "person2_id", "relationship_type", "marriage_date", "divorce_date", NULL
+};
+
+typedef struct ImportBatch {
+    int offsets[IMPORT_BATCH_ROWS][IMPORT_MAX_FIELDS];  // Into arena, -1 for NULL
+    int count;
+    char *arena;
+    size_t arena_used;
+    size_t arena_size;
+    struct ImportBatch *next;
+} ImportBatch;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    ImportBatch *head;
+    ImportBatch *tail;
+    int depth;
+    int producers;      // Parser threads still running
+} ImportQueue;
+
+// Input slices, each starting just after a newline; parsers claim them in order
+typedef struct {
+    const char *bounds[IMPORT_MAX_THREADS * IMPORT_SLICES_PER_THREAD + 1];
+    int count;
+    int next;
+} ImportSlices;
+
+typedef struct {
+    ImportQueue *queue;
+    ImportSlices *slices;
+    ImportKind kind;
+    int csv;
+    const int *column_map;  // CSV column -> field slot, -1 to ignore
+    int column_count;
+    long rows;
+    long rejected;
+    double cpu_seconds;
+    double wait_seconds;
+} ImportParser;
+
+static int import_reported = 0;
+
+static double import_now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char **import_columns(ImportKind kind) {
+    return kind == IMPORT_PEOPLE ? people_columns : relationship_columns;
+}
+
+static int import_column_slot(ImportKind kind, const char *name, size_t len) {
+    const char **columns = import_columns(kind);
+    for (int i = 0; columns[i]; i++) {
+        if (strlen(columns[i]) == len && strncmp(columns[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void import_report(const char *reason, const char *line, const char *end) {
+    if (__atomic_fetch_add(&import_reported, 1, __ATOMIC_RELAXED) < IMPORT_MAX_REPORTED) {
+        int len = (int)(end - line);
+        if (len > 80) len = 80;
+        fprintf(stderr, "Rejected row (%s): %.*s\n", reason, len, line);
+    }
+}
+
+// Batches
+
+static ImportBatch *import_batch_new(void) {
+    ImportBatch *batch = malloc(sizeof(ImportBatch));
+    if (!batch) return NULL;
+    batch->count = 0;
+    batch->arena_size = 64 * 1024;
+    batch->arena_used = 0;
+    batch->arena = malloc(batch->arena_size);
+    batch->next = NULL;
+    if (!batch->arena) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+static void import_batch_free(ImportBatch *batch) {
+    if (!batch) return;
+    free(batch->arena);
+    free(batch);
+}
+
+// Reserve room for a decoded field of at most len bytes; returns its offset
+static int import_arena_reserve(ImportBatch *batch, size_t len) {
+    if (batch->arena_used + len + 1 > batch->arena_size) {
+        size_t size = batch->arena_size * 2;
+        while (batch->arena_used + len + 1 > size) size *= 2;
+        char *arena = realloc(batch->arena, size);
+        if (!arena) return -1;
+        batch->arena = arena;
+        batch->arena_size = size;
+    }
+    return (int)batch->arena_used;
+}
+
+static void import_arena_commit(ImportBatch *batch, int offset, size_t len) {
+    batch->arena[offset + len] = '\0';
+    batch->arena_used = offset + len + 1;
+}
+
+// Queue
+
+static void import_queue_push(ImportParser *parser, ImportBatch *batch) {
+    ImportQueue *queue = parser->queue;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->depth >= IMPORT_QUEUE_DEPTH) {
+        double start = import_now(CLOCK_MONOTONIC);
+        while (queue->depth >= IMPORT_QUEUE_DEPTH) {
+            pthread_cond_wait(&queue->not_full, &queue->lock);
+        }
+        parser->wait_seconds += import_now(CLOCK_MONOTONIC) - start;
+    }
+    if (queue->tail) {
+        queue->tail->next = batch;
+    } else {
+        queue->head = batch;
+    }
+    queue->tail = batch;
+    queue->depth++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Returns NULL once every parser has finished and the queue is drained
+static ImportBatch *import_queue_pop(ImportQueue *queue, double *wait_seconds) {
+    pthread_mutex_lock(&queue->lock);
+    if (!queue->head && queue->producers > 0) {
+        double start = import_now(CLOCK_MONOTONIC);
+        while (!queue->head && queue->producers > 0) {
+            pthread_cond_wait(&queue->not_empty, &queue->lock);
+        }
+        *wait_seconds += import_now(CLOCK_MONOTONIC) - start;
+    }
+    ImportBatch *batch = queue->head;
+    if (batch) {
+        queue->head = batch->next;
+        if (!queue->head) queue->tail = NULL;
+        queue->depth--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return batch;
+}
+
+// Validation
+
+// Accepts YYYY, YYYY-MM or YYYY-MM-DD
+static int import_valid_date(const char *date) {
+    size_t len = strlen(date);
+    if (len != 4 && len != 7 && len != 10) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (i == 4 || i == 7) {
+            if (date[i] != '-') return 0;
+        } else if (!isdigit((unsigned char)date[i])) {
+            return 0;
+        }
+    }
+    if (len >= 7) {
+        int month = (date[5] - '0') * 10 + (date[6] - '0');
+        if (month < 1 || month > 12) return 0;
+    }
+    if (len == 10) {
+        int day = (date[8] - '0') * 10 + (date[9] - '0');
+        if (day < 1 || day > 31) return 0;
+    }
+    return 1;
+}
+
+static int import_valid_id(const char *value) {
+    if (!*value) return 0;
+    for (const char *p = value; *p; p++) {
+        if (!isdigit((unsigned char)*p)) return 0;
+    }
+    return 1;
+}
+
+// Normalizes gender in place to "M"/"F"; returns the reason on failure
+static const char *import_validate_row(ImportKind kind, ImportBatch *batch, int row) {
+    int *offsets = batch->offsets[row];
+    char *arena = batch->arena;
+
+    if (offsets[0] >= 0 && !import_valid_id(arena + offsets[0])) return "bad id";
+
+    if (kind == IMPORT_PEOPLE) {
+        if (offsets[1] < 0 || !arena[offsets[1]]) return "missing first_name";
+        if (offsets[2] < 0 || !arena[offsets[2]]) return "missing last_name";
+
+        if (offsets[3] >= 0) {
+            char *gender = arena + offsets[3];
+            if (!*gender) {
+                offsets[3] = -1;
+            } else if (strcasecmp(gender, "M") == 0 || strcasecmp(gender, "male") == 0) {
+                strcpy(gender, "M");
+            } else if (strcasecmp(gender, "F") == 0 || strcasecmp(gender, "female") == 0) {
+                strcpy(gender, "F");
+            } else {
+                return "bad gender";
+            }
+        }
+        for (int slot = 4; slot <= 5; slot++) {
+            if (offsets[slot] >= 0 && arena[offsets[slot]] && !import_valid_date(arena + offsets[slot])) {
+                return "bad date";
+            }
+        }
+    } else {
+        if (offsets[1] < 0 || !import_valid_id(arena + offsets[1])) return "bad person1_id";
+        if (offsets[2] < 0 || !import_valid_id(arena + offsets[2])) return "bad person2_id";
+        if (offsets[3] < 0 ||
+            (strcmp(arena + offsets[3], "parent-child") != 0 && strcmp(arena + offsets[3], "spouse") != 0)) {
+            return "bad relationship_type";
+        }
+        for (int slot = 4; slot <= 5; slot++) {
+            if (offsets[slot] >= 0 && arena[offsets[slot]] && !import_valid_date(arena + offsets[slot])) {
+                return "bad date";
+            }
+        }
+    }
+    return NULL;
+}
+
+// Line parsers; both return 0 on success
+
+static int import_parse_csv(ImportParser *parser, ImportBatch *batch, int row, const char *p, const char *end) {
+    int *offsets = batch->offsets[row];
+    int column = 0;
+
+    for (;;) {
+        int slot = column < parser->column_count ? parser->column_map[column] : -1;
+        int offset = import_arena_reserve(batch, end - p);
+        if (offset < 0) return 1;
+        char *dst = batch->arena + offset;
+        size_t len = 0;
+
+        if (p < end && *p == '"') {
+            p++;
+            for (;;) {
+                if (p >= end) return 1;  // Unterminated quote
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        dst[len++] = '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                dst[len++] = *p++;
+            }
+            if (slot >= 0) {
+                import_arena_commit(batch, offset, len);
+                offsets[slot] = offset;
+            }
+        } else {
+            while (p < end && *p != ',') dst[len++] = *p++;
+            if (slot >= 0 && len > 0) {
+                import_arena_commit(batch, offset, len);
+                offsets[slot] = offset;
+            }
+        }
+
+        if (p >= end) break;
+        if (*p != ',') return 1;
+        p++;
+        column++;
+    }
+    return 0;
+}
+
+static const char *json_skip_space(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+static size_t json_put_utf8(char *dst, unsigned int cp) {
+    if (cp < 0x80) {
+        dst[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        dst[0] = 0xC0 | (cp >> 6);
+        dst[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if (cp < 0x10000) {
+        dst[0] = 0xE0 | (cp >> 12);
+        dst[1] = 0x80 | ((cp >> 6) & 0x3F);
+        dst[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    dst[0] = 0xF0 | (cp >> 18);
+    dst[1] = 0x80 | ((cp >> 12) & 0x3F);
+    dst[2] = 0x80 | ((cp >> 6) & 0x3F);
+    dst[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+static int json_hex4(const char *p, const char *end, unsigned int *value) {
+    if (end - p < 4) return 0;
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        int c = p[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') *value |= c - '0';
+        else if (c >= 'a' && c <= 'f') *value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') *value |= c - 'A' + 10;
+        else return 0;
+    }
+    return 1;
+}
+
+// Decode a JSON string starting after the opening quote; returns the position after the closing quote
+static const char *json_parse_string(const char *p, const char *end, char *dst, size_t *len) {
+    *len = 0;
+    while (p < end && *p != '"') {
+        if (*p != '\\') {
+            dst[(*len)++] = *p++;
+            continue;
+        }
+        if (++p >= end) return NULL;
+        switch (*p++) {
+            case '"': dst[(*len)++] = '"'; break;
+            case '\\': dst[(*len)++] = '\\'; break;
+            case '/': dst[(*len)++] = '/'; break;
+            case 'b': dst[(*len)++] = '\b'; break;
+            case 'f': dst[(*len)++] = '\f'; break;
+            case 'n': dst[(*len)++] = '\n'; break;
+            case 'r': dst[(*len)++] = '\r'; break;
+            case 't': dst[(*len)++] = '\t'; break;
+            case 'u': {
+                unsigned int cp, low;
+                if (!json_hex4(p, end, &cp)) return NULL;
+                p += 4;
+                if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                    json_hex4(p + 2, end, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                // \u escapes never decode longer than their source text
+                *len += json_put_utf8(dst + *len, cp);
+                break;
+            }
+            default:
+                return NULL;
+        }
+    }
+    return p < end ? p + 1 : NULL;
+}
+
+static int import_parse_ndjson(ImportParser *parser, ImportBatch *batch, int row, const char *p, const char *end) {
+    int *offsets = batch->offsets[row];
+    size_t len;
+
+    p = json_skip_space(p, end);
+    if (p >= end || *p++ != '{') return 1;
+    p = json_skip_space(p, end);
+    if (p < end && *p == '}') return 0;
+
+    for (;;) {
+        // Key
+        if (p >= end || *p++ != '"') return 1;
+        int offset = import_arena_reserve(batch, end - p);
+        if (offset < 0) return 1;
+        p = json_parse_string(p, end, batch->arena + offset, &len);
+        if (!p) return 1;
+        int slot = import_column_slot(parser->kind, batch->arena + offset, len);
+
+        p = json_skip_space(p, end);
+        if (p >= end || *p++ != ':') return 1;
+        p = json_skip_space(p, end);
+        if (p >= end) return 1;
+
+        // Value: string, or a bare literal (number, true/false) kept as text; null leaves the slot NULL
+        offset = import_arena_reserve(batch, end - p);
+        if (offset < 0) return 1;
+        if (*p == '"') {
+            p = json_parse_string(p + 1, end, batch->arena + offset, &len);
+            if (!p) return 1;
+            if (slot >= 0) {
+                import_arena_commit(batch, offset, len);
+                offsets[slot] = offset;
+            }
+        } else {
+            const char *start = p;
+            while (p < end && *p != ',' && *p != '}' && !isspace((unsigned char)*p)) p++;
+            len = p - start;
+            if (len == 0 || *start == '{' || *start == '[') return 1;
+            if (slot >= 0 && !(len == 4 && strncmp(start, "null", 4) == 0)) {
+                memcpy(batch->arena + offset, start, len);
+                import_arena_commit(batch, offset, len);
+                offsets[slot] = offset;
+            }
+        }
+
+        p = json_skip_space(p, end);
+        if (p >= end) return 1;
+        if (*p == '}') return 0;
+        if (*p++ != ',') return 1;
+        p = json_skip_space(p, end);
+    }
+}
+
+static ImportBatch *import_parse_slice(ImportParser *parser, ImportBatch *batch,
+                                       const char *line, const char *slice_end) {
+    while (line < slice_end) {
+        const char *eol = memchr(line, '\n', slice_end - line);
+        const char *next = eol ? eol + 1 : slice_end;
+        const char *end = eol ? eol : slice_end;
+        if (end > line && end[-1] == '\r') end--;
+
+        // Skip blank lines
+        const char *p = line;
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p == end) {
+            line = next;
+            continue;
+        }
+
+        if (!batch) {
+            batch = import_batch_new();
+            if (!batch) {
+                fprintf(stderr, "Memory allocation failed\n");
+                break;
+            }
+        }
+
+        int row = batch->count;
+        size_t arena_mark = batch->arena_used;
+        for (int i = 0; i < IMPORT_MAX_FIELDS; i++) batch->offsets[row][i] = -1;
+
+        int rc = parser->csv ? import_parse_csv(parser, batch, row, line, end)
+                             : import_parse_ndjson(parser, batch, row, line, end);
+        const char *reason = rc ? "malformed" : import_validate_row(parser->kind, batch, row);
+
+        if (reason) {
+            import_report(reason, line, end);
+            batch->arena_used = arena_mark;
+            parser->rejected++;
+        } else {
+            batch->count++;
+            parser->rows++;
+            if (batch->count == IMPORT_BATCH_ROWS) {
+                import_queue_push(parser, batch);
+                batch = NULL;
+            }
+        }
+        line = next;
+    }
+    return batch;
+}
+
+static void *import_parser_main(void *arg) {
+    ImportParser *parser = arg;
+    ImportSlices *slices = parser->slices;
+    double cpu_start = import_now(CLOCK_THREAD_CPUTIME_ID);
+    ImportBatch *batch = NULL;
+
+    int slice;
+    while ((slice = __atomic_fetch_add(&slices->next, 1, __ATOMIC_RELAXED)) < slices->count) {
+        batch = import_parse_slice(parser, batch, slices->bounds[slice], slices->bounds[slice + 1]);
+    }
+
+    if (batch && batch->count > 0) {
+        import_queue_push(parser, batch);
+    } else {
+        import_batch_free(batch);
+    }
+
+    parser->cpu_seconds = import_now(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    pthread_mutex_lock(&parser->queue->lock);
+    parser->queue->producers--;
+    pthread_cond_broadcast(&parser->queue->not_empty);
+    pthread_mutex_unlock(&parser->queue->lock);
+    return NULL;
+}
+
+// Writer
+
+static void import_bind_text(sqlite3_stmt *stmt, int index, ImportBatch *batch, int offset) {
+    if (offset >= 0) {
+        sqlite3_bind_text(stmt, index, batch->arena + offset, -1, SQLITE_STATIC);
+    } else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+static void import_bind_id(sqlite3_stmt *stmt, int index, ImportBatch *batch, int offset) {
+    if (offset >= 0) {
+        sqlite3_bind_int64(stmt, index, strtoll(batch->arena + offset, NULL, 10));
+    } else {
+        sqlite3_bind_null(stmt, index);
+    }
+}
+
+// One transaction per batch; returns 1, with the whole batch counted as failed, if it did not commit
+static int import_write_batch(sqlite3 *db, sqlite3_stmt *stmt, ImportKind kind, ImportBatch *batch,
+                              long *inserted, long *failed) {
+    sqlite3_int64 now = time(NULL);
+    int field_count = kind == IMPORT_PEOPLE ? 8 : 6;
+    long batch_inserted = 0, batch_failed = 0;
+
+    if (sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to begin import transaction: %s\n", sqlite3_errmsg(db));
+        *failed += batch->count;
+        return 1;
+    }
+
+    for (int row = 0; row < batch->count; row++) {
+        int *offsets = batch->offsets[row];
+
+        import_bind_id(stmt, 1, batch, offsets[0]);
+        for (int slot = 1; slot < field_count; slot++) {
+            if (kind == IMPORT_RELATIONSHIPS && slot <= 2) {
+                import_bind_id(stmt, slot + 1, batch, offsets[slot]);
+            } else {
+                import_bind_text(stmt, slot + 1, batch, offsets[slot]);
+            }
+        }
+        sqlite3_bind_int64(stmt, field_count + 1, now);
+        sqlite3_bind_int64(stmt, field_count + 2, now);
+        // Both kinds keep their two dates in slots 4 and 5
+        bind_date_day(stmt, field_count + 3, offsets[4] >= 0 ? batch->arena + offsets[4] : NULL);
+        bind_date_day(stmt, field_count + 5, offsets[5] >= 0 ? batch->arena + offsets[5] : NULL);
+
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            batch_inserted++;
+        } else {
+            if (*failed + batch_failed < IMPORT_MAX_REPORTED) {
+                fprintf(stderr, "Failed to insert row: %s\n", sqlite3_errmsg(db));
+            }
+            batch_failed++;
+        }
+        sqlite3_reset(stmt);
+    }
+
+    if (sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to commit import batch of %d rows: %s\n", batch->count, sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        *failed += batch->count;
+        return 1;
+    }
+    *inserted += batch_inserted;
+    *failed += batch_failed;
+    return 0;
+}
+
+// Read the CSV header line into a column map; returns the position after it
+static const char *import_read_csv_header(ImportKind kind, const char *data, const char *end,
+                                          int *column_map, int *column_count) {
+    const char *eol = memchr(data, '\n', end - data);
+    const char *line_end = eol ? eol : end;
+    if (line_end > data && line_end[-1] == '\r') line_end--;
+
+    *column_count = 0;
+    const char *p = data;
+    while (p <= line_end && *column_count < 64) {
+        const char *field_end = memchr(p, ',', line_end - p);
+        if (!field_end) field_end = line_end;
+
+        const char *name = p, *name_end = field_end;
+        while (name < name_end && (isspace((unsigned char)*name) || *name == '"')) name++;
+        while (name_end > name && (isspace((unsigned char)name_end[-1]) || name_end[-1] == '"')) name_end--;
+
+        column_map[(*column_count)++] = import_column_slot(kind, name, name_end - name);
+        p = field_end + 1;
+    }
+    return eol ? eol + 1 : end;
+}
+
+int bulk_import(sqlite3 *db, const char *table, const char *path, int threads) {
+    ImportKind kind;
+    if (strcmp(table, "people") == 0) {
+        kind = IMPORT_PEOPLE;
+    } else if (strcmp(table, "relationships") == 0) {
+        kind = IMPORT_RELATIONSHIPS;
+    } else {
+        fprintf(stderr, "Unknown import table: %s\n", table);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Cannot import empty file %s\n", path);
+        close(fd);
+        return 1;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        return 1;
+    }
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+    const char *end = data + st.st_size;
+
+    // NDJSON if the first non-blank byte opens an object, CSV with a header line otherwise
+    const char *first = json_skip_space(data, end);
+    int csv = (first >= end || *first != '{');
+    int column_map[64];
+    int column_count = 0;
+    const char *body = data;
+    if (csv) {
+        body = import_read_csv_header(kind, data, end, column_map, &column_count);
+    }
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+
+    const char *sql = kind == IMPORT_PEOPLE
+        ? "INSERT INTO people (id, first_name, last_name, gender, birth_date, death_date, bio, photo_url, created_at, updated_at, "
+          "birth_day, birth_precision, death_day, death_precision) "
+          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);"
+        : "INSERT INTO relationships (id, person1_id, person2_id, relationship_type, marriage_date, divorce_date, created_at, updated_at, "
+          "marriage_day, marriage_precision, divorce_day, divorce_precision) "
+          "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        munmap((void*)data, st.st_size);
+        return 1;
+    }
+
+    ImportQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+
+    // Several slices per thread so a slow slice does not leave the other parsers idle
+    ImportSlices slices;
+    size_t body_size = end - body;
+    int wanted = threads * IMPORT_SLICES_PER_THREAD;
+    slices.count = 0;
+    slices.next = 0;
+    slices.bounds[0] = body;
+    for (int i = 1; i <= wanted && slices.bounds[slices.count] < end; i++) {
+        const char *bound = (i == wanted) ? end : body + body_size * i / wanted;
+        if (bound < slices.bounds[slices.count]) bound = slices.bounds[slices.count];
+        if (bound < end) {
+            const char *eol = memchr(bound, '\n', end - bound);
+            bound = eol ? eol + 1 : end;
+        }
+        if (bound > slices.bounds[slices.count]) {
+            slices.bounds[++slices.count] = bound;
+        }
+    }
+
+    ImportParser parsers[IMPORT_MAX_THREADS];
+    pthread_t thread_ids[IMPORT_MAX_THREADS];
+    memset(parsers, 0, sizeof(parsers));
+    int started = 0;
+    double wall_start = import_now(CLOCK_MONOTONIC);
+
+    for (int i = 0; i < threads; i++) {
+        ImportParser *parser = &parsers[started];
+        parser->queue = &queue;
+        parser->slices = &slices;
+        parser->kind = kind;
+        parser->csv = csv;
+        parser->column_map = column_map;
+        parser->column_count = column_count;
+
+        pthread_mutex_lock(&queue.lock);
+        queue.producers++;
+        pthread_mutex_unlock(&queue.lock);
+        if (pthread_create(&thread_ids[started], NULL, import_parser_main, parser) != 0) {
+            // Whatever did start claims the remaining slices
+            pthread_mutex_lock(&queue.lock);
+            queue.producers--;
+            pthread_mutex_unlock(&queue.lock);
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Cannot start parser threads\n");
+        sqlite3_finalize(stmt);
+        munmap((void*)data, st.st_size);
+        return 1;
+    }
+
+    // Single writer: drain batches until all parsers are done. After a batch fails to commit the
+    // rest are still drained, so no parser stays blocked, but counted as failed instead of written.
+    long inserted = 0, failed = 0;
+    int write_error = 0;
+    double insert_seconds = 0, writer_wait = 0;
+    ImportBatch *batch;
+    while ((batch = import_queue_pop(&queue, &writer_wait)) != NULL) {
+        double start = import_now(CLOCK_MONOTONIC);
+        if (write_error) {
+            failed += batch->count;
+        } else {
+            write_error = import_write_batch(db, stmt, kind, batch, &inserted, &failed);
+        }
+        insert_seconds += import_now(CLOCK_MONOTONIC) - start;
+        import_batch_free(batch);
+    }
+
+    long rows = 0, rejected = 0;
+    double parse_cpu = 0, parser_wait = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(thread_ids[i], NULL);
+    }
+    for (int i = 0; i < started; i++) {
+        rows += parsers[i].rows;
+        rejected += parsers[i].rejected;
+        parse_cpu += parsers[i].cpu_seconds;
+        parser_wait += parsers[i].wait_seconds;
+    }
+    double wall = import_now(CLOCK_MONOTONIC) - wall_start;
+
+    sqlite3_finalize(stmt);
+    munmap((void*)data, st.st_size);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_cond_destroy(&queue.not_full);
+
+    double mb = body_size / (1024.0 * 1024.0);
+    fprintf(stderr, "Imported %s from %s (%s, %d parser threads) in %.2f s\n",
+            table, path, csv ? "CSV" : "NDJSON", started, wall);
+    fprintf(stderr, "  parse:  %ld rows, %ld rejected, %.1f MB, %.2f CPU s -> %.0f rows/s, %.1f MB/s per thread\n",
+            rows, rejected, mb, parse_cpu,
+            parse_cpu > 0 ? rows / parse_cpu : 0, parse_cpu > 0 ? mb / parse_cpu : 0);
+    fprintf(stderr, "  insert: %ld rows, %ld failed, %.2f s -> %.0f rows/s\n",
+            inserted, failed, insert_seconds, insert_seconds > 0 ? inserted / insert_seconds : 0);
+    fprintf(stderr, "  stalls: parsers blocked on full queue %.2f s, writer idle on empty queue %.2f s (%s-bound)\n",
+            parser_wait, writer_wait, writer_wait > parser_wait ? "parse" : "insert");
+
+    // Rows went in with plain INSERTs, so a built ancestry closure is rebuilt once rather than per edge
+    int closure_error = 0;
+    if (kind == IMPORT_RELATIONSHIPS && inserted > 0 && closure_enabled(db)) {
+        double start = import_now(CLOCK_MONOTONIC);
+        closure_error = rebuild_closure(db);
+        fprintf(stderr, "%s ancestry closure in %.2f s\n", closure_error ? "Failed to rebuild" : "Rebuilt",
+                import_now(CLOCK_MONOTONIC) - start);
+    }
+
+    return (rejected > 0 || failed > 0 || closure_error) ? 1 : 0;
+}
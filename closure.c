@@ -0,0 +1,360 @@
+/* closure.c - Ancestor/descendant closure table for family tree application */
+
+#include "family_tree.h"
+
+/*
+ * The optional ancestry table holds one row per (ancestor, descendant)
+ * pair with the shortest generation distance between them. It exists only
+ * after rebuild_closure() has run; from then on add_relationship() keeps
+ * it current. Lookups fall back to a recursive walk of relationships when
+ * the table is absent.
+ */
+
+// Guards the recursive walks against cycles in bad data
+#define CLOSURE_MAX_DEPTH 256
+
+static const char *closure_recursive_sql =
+    "WITH RECURSIVE walk(ancestor_id, descendant_id, depth) AS ("
+    "  SELECT person1_id, person2_id, 1 FROM relationships "
+    "  WHERE relationship_type = 'parent-child' AND %s "
+    "  UNION "
+    "  SELECT w.ancestor_id, r.person2_id, w.depth + 1 FROM walk w "
+    "  JOIN relationships r ON r.person1_id = w.descendant_id AND r.relationship_type = 'parent-child' "
+    "  WHERE w.depth < %d"
+    ") ";
+
+int closure_enabled(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'ancestry';";
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    int enabled = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return enabled;
+}
+
+/*
+ * Rebuilt one generation at a time. The frontier holds the pairs first
+ * reached at the current depth; extending it by one parent-child edge and
+ * dropping pairs already present (reached by a shorter path) gives the
+ * next frontier. The descendant index is built once at the end.
+ */
+int rebuild_closure(sqlite3 *db) {
+    char sql[512];
+    char *error_msg = NULL;
+
+    const char *schema_sql =
+        "CREATE TABLE IF NOT EXISTS ancestry ("
+        "ancestor_id INTEGER NOT NULL,"
+        "descendant_id INTEGER NOT NULL,"
+        "depth INTEGER NOT NULL,"
+        "PRIMARY KEY (ancestor_id, descendant_id)"
+        ") WITHOUT ROWID;"
+        "DROP INDEX IF EXISTS idx_ancestry_descendant;"
+        "DELETE FROM ancestry;"
+        "DROP TABLE IF EXISTS temp.closure_frontier;"
+        "CREATE TEMP TABLE closure_frontier AS "
+        "SELECT person1_id AS a, person2_id AS d FROM relationships "
+        "WHERE relationship_type = 'parent-child' AND person1_id <> person2_id "
+        "GROUP BY person1_id, person2_id;"
+        "INSERT INTO ancestry (ancestor_id, descendant_id, depth) SELECT a, d, 1 FROM temp.closure_frontier;";
+
+    const char *extend_sql =
+        "CREATE TEMP TABLE closure_next AS "
+        "SELECT f.a AS a, r.person2_id AS d FROM temp.closure_frontier f "
+        "JOIN relationships r ON r.person1_id = f.d AND r.relationship_type = 'parent-child' "
+        "WHERE r.person2_id <> f.a AND NOT EXISTS "
+        "  (SELECT 1 FROM ancestry WHERE ancestor_id = f.a AND descendant_id = r.person2_id) "
+        "GROUP BY f.a, r.person2_id;"
+        "DROP TABLE temp.closure_frontier;"
+        "ALTER TABLE temp.closure_next RENAME TO closure_frontier;";
+
+    // A savepoint rather than BEGIN so a rebuild can run inside a caller's transaction
+    int rc = sqlite3_exec(db, "SAVEPOINT rebuild_closure;", NULL, NULL, &error_msg);
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db, schema_sql, NULL, NULL, &error_msg);
+    }
+
+    for (int depth = 2; rc == SQLITE_OK && depth <= CLOSURE_MAX_DEPTH; depth++) {
+        rc = sqlite3_exec(db, extend_sql, NULL, NULL, &error_msg);
+        if (rc != SQLITE_OK) break;
+
+        snprintf(sql, sizeof(sql),
+                 "INSERT INTO ancestry (ancestor_id, descendant_id, depth) "
+                 "SELECT a, d, %d FROM temp.closure_frontier;", depth);
+        rc = sqlite3_exec(db, sql, NULL, NULL, &error_msg);
+        if (rc == SQLITE_OK && sqlite3_changes(db) == 0) break;
+    }
+
+    if (rc == SQLITE_OK) {
+        rc = sqlite3_exec(db,
+                          "DROP TABLE temp.closure_frontier;"
+                          "CREATE INDEX idx_ancestry_descendant ON ancestry (descendant_id, ancestor_id);",
+                          NULL, NULL, &error_msg);
+    }
+
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        sqlite3_exec(db, "ROLLBACK TO rebuild_closure; RELEASE rebuild_closure;", NULL, NULL, NULL);
+        return 1;
+    }
+    sqlite3_exec(db, "RELEASE rebuild_closure;", NULL, NULL, NULL);
+    return 0;
+}
+
+int closure_add_edge(sqlite3 *db, int parent_id, int child_id) {
+    sqlite3_stmt *stmt;
+
+    // Every ancestor of the parent (and the parent itself) gains every
+    // descendant of the child (and the child itself)
+    const char *sql =
+        "INSERT INTO ancestry (ancestor_id, descendant_id, depth) "
+        "SELECT a.ancestor_id, d.descendant_id, a.depth + d.depth + 1 "
+        "FROM (SELECT ancestor_id, depth FROM ancestry WHERE descendant_id = ?1 "
+        "      UNION ALL SELECT ?1, 0) a, "
+        "     (SELECT descendant_id, depth FROM ancestry WHERE ancestor_id = ?2 "
+        "      UNION ALL SELECT ?2, 0) d "
+        "WHERE a.ancestor_id <> d.descendant_id "
+        "ON CONFLICT (ancestor_id, descendant_id) DO UPDATE SET depth = MIN(depth, excluded.depth);";
+
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int(stmt, 1, parent_id);
+    sqlite3_bind_int(stmt, 2, child_id);
+
+    rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to update ancestry: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    return 0;
+}
+
+// Returns the generation distance from ancestor to descendant, or 0 if unrelated
+int closure_is_ancestor(sqlite3 *db, int ancestor_id, int descendant_id) {
+    sqlite3_stmt *stmt;
+    char sql[1024];
+
+    if (closure_enabled(db)) {
+        snprintf(sql, sizeof(sql),
+                 "SELECT depth FROM ancestry WHERE ancestor_id = ?1 AND descendant_id = ?2;");
+    } else {
+        int n = snprintf(sql, sizeof(sql), closure_recursive_sql, "person1_id = ?1", CLOSURE_MAX_DEPTH);
+        snprintf(sql + n, sizeof(sql) - n, "SELECT MIN(depth) FROM walk WHERE descendant_id = ?2;");
+    }
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, ancestor_id);
+    sqlite3_bind_int(stmt, 2, descendant_id);
+
+    int depth = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        depth = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return depth;
+}
+
+/*
+ * Collects descendant (or ancestor) ids of person_id up to max_depth
+ * generations (0 for all), nearest generation first. The caller frees *ids.
+ */
+static int closure_collect(sqlite3 *db, int person_id, int max_depth, int descendants,
+                           int **ids, int **depths, int *count) {
+    sqlite3_stmt *stmt;
+    char sql[1024];
+
+    *ids = NULL;
+    if (depths) *depths = NULL;
+    *count = 0;
+
+    if (closure_enabled(db)) {
+        snprintf(sql, sizeof(sql),
+                 descendants
+                     ? "SELECT descendant_id, depth FROM ancestry WHERE ancestor_id = ?1 AND depth <= ?2 ORDER BY depth, descendant_id;"
+                     : "SELECT ancestor_id, depth FROM ancestry WHERE descendant_id = ?1 AND depth <= ?2 ORDER BY depth, ancestor_id;");
+    } else if (descendants) {
+        int n = snprintf(sql, sizeof(sql), closure_recursive_sql, "person1_id = ?1", CLOSURE_MAX_DEPTH);
+        snprintf(sql + n, sizeof(sql) - n,
+                 "SELECT descendant_id, MIN(depth) AS d FROM walk WHERE depth <= ?2 "
+                 "GROUP BY descendant_id ORDER BY d, descendant_id;");
+    } else {
+        snprintf(sql, sizeof(sql),
+                 "WITH RECURSIVE walk(ancestor_id, depth) AS ("
+                 "  SELECT person1_id, 1 FROM relationships "
+                 "  WHERE relationship_type = 'parent-child' AND person2_id = ?1 "
+                 "  UNION "
+                 "  SELECT r.person1_id, w.depth + 1 FROM walk w "
+                 "  JOIN relationships r ON r.person2_id = w.ancestor_id AND r.relationship_type = 'parent-child' "
+                 "  WHERE w.depth < %d"
+                 ") "
+                 "SELECT ancestor_id, MIN(depth) AS d FROM walk WHERE depth <= ?2 "
+                 "GROUP BY ancestor_id ORDER BY d, ancestor_id;", CLOSURE_MAX_DEPTH);
+    }
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_bind_int(stmt, 1, person_id);
+    sqlite3_bind_int(stmt, 2, max_depth > 0 ? max_depth : CLOSURE_MAX_DEPTH);
+
+    int capacity = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            int *grown = realloc(*ids, sizeof(int) * capacity);
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed\n");
+                sqlite3_finalize(stmt);
+                return 1;
+            }
+            *ids = grown;
+            if (depths) {
+                grown = realloc(*depths, sizeof(int) * capacity);
+                if (!grown) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    sqlite3_finalize(stmt);
+                    return 1;
+                }
+                *depths = grown;
+            }
+        }
+        (*ids)[*count] = sqlite3_column_int(stmt, 0);
+        if (depths) (*depths)[*count] = sqlite3_column_int(stmt, 1);
+        (*count)++;
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+int closure_get_descendants(sqlite3 *db, int person_id, int max_depth, int **ids, int **depths, int *count) {
+    return closure_collect(db, person_id, max_depth, 1, ids, depths, count);
+}
+
+int closure_get_ancestors(sqlite3 *db, int person_id, int max_depth, int **ids, int **depths, int *count) {
+    return closure_collect(db, person_id, max_depth, 0, ids, depths, count);
+}
+
+// Benchmark: query time with and without the table, and the insert cost of maintaining it
+
+static double closure_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int closure_random_people(sqlite3 *db, int *ids, int samples) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT person1_id, person2_id FROM relationships "
+        "WHERE relationship_type = 'parent-child' ORDER BY random() LIMIT ?;";
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_bind_int(stmt, 1, samples);
+    int n = 0;
+    while (n < samples && sqlite3_step(stmt) == SQLITE_ROW) {
+        ids[2 * n] = sqlite3_column_int(stmt, 0);
+        ids[2 * n + 1] = sqlite3_column_int(stmt, 1);
+        n++;
+    }
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+static void closure_time_queries(sqlite3 *db, const int *pairs, int n, const char *label) {
+    double start = closure_now();
+    int related = 0;
+    for (int i = 0; i < n; i++) {
+        // Pair each sampled parent with another sample's child: mostly unrelated lookups
+        related += closure_is_ancestor(db, pairs[2 * i], pairs[2 * ((i + 1) % n) + 1]) > 0;
+    }
+    double ancestor_time = closure_now() - start;
+
+    start = closure_now();
+    long total = 0;
+    for (int i = 0; i < n; i++) {
+        int *ids, count;
+        if (closure_get_descendants(db, pairs[2 * i], 0, &ids, NULL, &count) == 0) {
+            total += count;
+            free(ids);
+        }
+    }
+    double descendant_time = closure_now() - start;
+
+    printf("%-10s is_ancestor: %9.1f us/query (%d related)   descendants: %9.1f us/query (%.1f avg rows)\n",
+           label, ancestor_time * 1e6 / n, related, descendant_time * 1e6 / n, (double)total / n);
+}
+
+static double closure_time_inserts(sqlite3 *db, const int *pairs, int n) {
+    Relationship rel;
+    memset(&rel, 0, sizeof(rel));
+    rel.relationship_type = "parent-child";
+
+    // Re-insert sampled edges inside a transaction that is rolled back afterwards
+    sqlite3_exec(db, "SAVEPOINT closure_inserts;", NULL, NULL, NULL);
+    double start = closure_now();
+    for (int i = 0; i < n; i++) {
+        rel.person1_id = pairs[2 * i];
+        rel.person2_id = pairs[2 * i + 1];
+        add_relationship(db, &rel);
+    }
+    double elapsed = closure_now() - start;
+    sqlite3_exec(db, "ROLLBACK TO closure_inserts; RELEASE closure_inserts;", NULL, NULL, NULL);
+    return elapsed;
+}
+
+int closure_benchmark(sqlite3 *db, int samples) {
+    if (samples <= 0) samples = 200;
+    int *pairs = malloc(sizeof(int) * 2 * samples);
+    if (!pairs) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    int n = closure_random_people(db, pairs, samples);
+    if (n == 0) {
+        fprintf(stderr, "No parent-child relationships to benchmark\n");
+        free(pairs);
+        return 1;
+    }
+
+    int had_closure = closure_enabled(db);
+
+    // Everything below happens in a savepoint so the database is left as it was
+    sqlite3_exec(db, "SAVEPOINT closure_bench;", NULL, NULL, NULL);
+    sqlite3_exec(db, "DROP TABLE IF EXISTS ancestry;", NULL, NULL, NULL);
+
+    closure_time_queries(db, pairs, n, "recursive");
+    double plain_insert = closure_time_inserts(db, pairs, n);
+
+    double start = closure_now();
+    rebuild_closure(db);
+    double rebuild_time = closure_now() - start;
+
+    closure_time_queries(db, pairs, n, "closure");
+    double closure_insert = closure_time_inserts(db, pairs, n);
+
+    sqlite3_exec(db, "ROLLBACK TO closure_bench; RELEASE closure_bench;", NULL, NULL, NULL);
+
+    printf("insert     plain: %9.1f us/edge   with closure: %9.1f us/edge\n",
+           plain_insert * 1e6 / n, closure_insert * 1e6 / n);
+    printf("rebuild    %.3f s%s\n", rebuild_time, had_closure ? "" : " (table discarded; run rebuild-closure to keep it)");
+
+    free(pairs);
+    return 0;
+}
@@ -0,0 +1,817 @@
+/* compress.c - Streaming deflate and compressed CGI output for family tree application */
+
+#define _GNU_SOURCE
+#include "family_tree.h"
+#include <assert.h>
+#include <unistd.h>
+
+/*
+ * A small deflate (RFC 1951) encoder with zlib (RFC 1950) and gzip
+ * (RFC 1952) framing. Matching is LZ77 over a 32 KiB window with hash
+ * chains and one step of lazy evaluation, tuned like zlib's default
+ * level; symbols are collected into blocks and each block is written with
+ * whichever of the fixed or a per-block dynamic Huffman code is smaller.
+ * Input can arrive in any number of writes and output leaves through a
+ * sink callback, so pages are compressed while they are rendered.
+ */
+
+#define WSIZE 32768
+#define WMASK (WSIZE - 1)
+#define WINDOW_SIZE (2 * WSIZE)
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define MIN_LOOKAHEAD (MAX_MATCH + MIN_MATCH + 1)
+#define MAX_DIST (WSIZE - MIN_LOOKAHEAD)
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+#define NIL (-1)
+
+#define MAX_CHAIN 128
+#define GOOD_LENGTH 8       // Search less when the previous match is already this long
+#define MAX_LAZY 16         // Do not look for a better match after one this long
+#define NICE_LENGTH 128     // Stop searching once a match is this long
+#define TOO_FAR 4096        // Length-3 matches further back cost more than literals
+
+#define SYM_BUFFER 16384
+#define OUT_BUFFER 65536
+
+#define LITLEN_CODES 286
+#define DIST_CODES 30
+#define CODELEN_CODES 19
+
+struct DeflateStream {
+    int format;
+    DeflateSink sink;
+    void *arg;
+    int failed;
+
+    unsigned char window[WINDOW_SIZE];
+    int window_end;
+    int strstart;
+    int lookahead;
+    int head[HASH_SIZE];
+    int prev[WSIZE];
+
+    int match_length;
+    int match_start;
+    int prev_length;
+    int prev_match;
+    int match_available;
+
+    unsigned short sym_dist[SYM_BUFFER];   // 0 for a literal
+    unsigned short sym_value[SYM_BUFFER];  // Literal byte or match length
+    int sym_count;
+
+    unsigned long long bit_buffer;
+    int bit_count;
+    unsigned char out[OUT_BUFFER];
+    size_t out_len;
+
+    uint32_t check;         // CRC-32 for gzip, Adler-32 for zlib
+    uint32_t total_in;
+};
+
+/* Checksums */
+
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32_update(uint32_t adler, const unsigned char *data, size_t len) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (len > 0) {
+        // 5552 bytes is the most that can be summed before b overflows
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+/* Bit output */
+
+static void flush_output(DeflateStream *s) {
+    if (s->out_len > 0 && !s->failed && s->sink(s->arg, s->out, s->out_len) != 0) s->failed = 1;
+    s->out_len = 0;
+}
+
+static void put_byte(DeflateStream *s, unsigned char byte) {
+    if (s->out_len == OUT_BUFFER) flush_output(s);
+    s->out[s->out_len++] = byte;
+}
+
+static void put_bits(DeflateStream *s, unsigned value, int count) {
+    s->bit_buffer |= (unsigned long long)value << s->bit_count;
+    s->bit_count += count;
+    while (s->bit_count >= 8) {
+        put_byte(s, s->bit_buffer & 0xff);
+        s->bit_buffer >>= 8;
+        s->bit_count -= 8;
+    }
+}
+
+static void align_bits(DeflateStream *s) {
+    if (s->bit_count > 0) put_byte(s, s->bit_buffer & 0xff);
+    s->bit_buffer = 0;
+    s->bit_count = 0;
+}
+
+/* Huffman codes */
+
+typedef struct {
+    int symbol;
+    unsigned freq;
+} HuffLeaf;
+
+static int compare_leaves(const void *a, const void *b) {
+    const HuffLeaf *x = a, *y = b;
+    if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+    return x->symbol - y->symbol;
+}
+
+// Code lengths for the given frequencies, no longer than max_bits
+static void build_lengths(const unsigned *freq, int n, int max_bits, unsigned char *lengths) {
+    HuffLeaf leaves[LITLEN_CODES];
+    int count = 0;
+    memset(lengths, 0, n);
+    for (int i = 0; i < n; i++) {
+        if (freq[i]) {
+            leaves[count].symbol = i;
+            leaves[count].freq = freq[i];
+            count++;
+        }
+    }
+    if (count == 0) return;
+    if (count == 1) {
+        lengths[leaves[0].symbol] = 1;
+        return;
+    }
+    qsort(leaves, count, sizeof(HuffLeaf), compare_leaves);
+
+    // Two-queue construction over the sorted leaves; internal nodes follow them
+    unsigned weight[2 * LITLEN_CODES];
+    int parent[2 * LITLEN_CODES];
+    for (int i = 0; i < count; i++) weight[i] = leaves[i].freq;
+    int next_leaf = 0, next_node = count, nodes = count;
+    while (nodes < 2 * count - 1) {
+        int pick[2];
+        for (int k = 0; k < 2; k++) {
+            if (next_leaf < count && (next_node >= nodes || weight[next_leaf] <= weight[next_node])) {
+                pick[k] = next_leaf++;
+            } else {
+                pick[k] = next_node++;
+            }
+        }
+        weight[nodes] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = nodes;
+        nodes++;
+    }
+
+    /*
+     * Depths from the root down, clipped at max_bits as zlib's gen_bitlen
+     * does. Every clipped node counts as overflow, internal ones as well as
+     * leaves: a subtree squashed onto the max_bits level over-fills it by
+     * its internal nodes too, and counting only leaves under-repairs it.
+     */
+    int depth[2 * LITLEN_CODES];
+    int bl_count[16] = { 0 };
+    int overflow = 0;
+    depth[nodes - 1] = 0;
+    for (int i = nodes - 2; i >= 0; i--) {
+        int bits = depth[parent[i]] + 1;
+        if (bits > max_bits) {
+            bits = max_bits;
+            overflow++;
+        }
+        depth[i] = bits;
+        if (i < count) bl_count[bits]++;
+    }
+
+    // Rebalance: split the deepest leaf above max_bits, moving an overflowed leaf under it
+    while (overflow > 0) {
+        int bits = max_bits - 1;
+        while (bl_count[bits] == 0) bits--;
+        bl_count[bits]--;
+        bl_count[bits + 1] += 2;
+        bl_count[max_bits]--;
+        overflow -= 2;
+    }
+
+    // The code must not be over-subscribed, or decoders reject the block
+    unsigned long kraft = 0;
+    for (int bits = 1; bits <= max_bits; bits++) kraft += (unsigned long)bl_count[bits] << (max_bits - bits);
+    assert(kraft <= 1ul << max_bits);
+
+    // Longest codes go to the least frequent symbols
+    int leaf = 0;
+    for (int bits = max_bits; bits > 0; bits--) {
+        for (int k = 0; k < bl_count[bits]; k++) lengths[leaves[leaf++].symbol] = (unsigned char)bits;
+    }
+}
+
+// Canonical codes, bit-reversed for the LSB-first bit writer
+static void build_codes(const unsigned char *lengths, int n, unsigned short *codes) {
+    int bl_count[16] = { 0 }, next_code[16];
+    for (int i = 0; i < n; i++) bl_count[lengths[i]]++;
+    bl_count[0] = 0;
+    int code = 0;
+    for (int bits = 1; bits < 16; bits++) {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lengths[i];
+        if (!len) continue;
+        unsigned value = next_code[len]++, reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed = (reversed << 1) | (value & 1);
+            value >>= 1;
+        }
+        codes[i] = (unsigned short)reversed;
+    }
+}
+
+/* Length and distance symbols */
+
+static int length_code(int length, int *extra_bits, int *extra) {
+    if (length == 258) {
+        *extra_bits = 0;
+        *extra = 0;
+        return 285;
+    }
+    if (length <= 10) {
+        *extra_bits = 0;
+        *extra = 0;
+        return 254 + length;
+    }
+    int l = length - 3;
+    int n = 31 - __builtin_clz(l);
+    int low = (l >> (n - 2)) & 3;
+    *extra_bits = n - 2;
+    *extra = l - ((4 + low) << (n - 2));
+    return 257 + 4 * (n - 1) + low;
+}
+
+static int dist_code(int dist, int *extra_bits, int *extra) {
+    if (dist <= 4) {
+        *extra_bits = 0;
+        *extra = 0;
+        return dist - 1;
+    }
+    int d = dist - 1;
+    int n = 31 - __builtin_clz(d);
+    int code = 2 * n + ((d >> (n - 1)) & 1);
+    *extra_bits = n - 1;
+    *extra = d - ((2 | (code & 1)) << (n - 1));
+    return code;
+}
+
+/* Blocks */
+
+static const unsigned char codelen_order[CODELEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+typedef struct {
+    unsigned char lengths[LITLEN_CODES + DIST_CODES];
+    int hlit, hdist, hclen;
+    unsigned char rle_symbol[LITLEN_CODES + DIST_CODES];
+    unsigned char rle_extra[LITLEN_CODES + DIST_CODES];
+    int rle_count;
+    unsigned char codelen_lengths[CODELEN_CODES];
+    unsigned short codelen_codes[CODELEN_CODES];
+} DynamicHeader;
+
+// Run-length code the literal/length and distance code lengths (symbols 16-18)
+static void encode_code_lengths(DynamicHeader *h) {
+    int total = h->hlit + h->hdist;
+    h->rle_count = 0;
+    for (int i = 0; i < total; ) {
+        int len = h->lengths[i], run = 1;
+        while (i + run < total && h->lengths[i + run] == len) run++;
+
+        if (len == 0 && run >= 3) {
+            int n = run > 138 ? 138 : run;
+            h->rle_symbol[h->rle_count] = n >= 11 ? 18 : 17;
+            h->rle_extra[h->rle_count++] = (unsigned char)(n >= 11 ? n - 11 : n - 3);
+            i += n;
+        } else if (len != 0 && run >= 4) {
+            h->rle_symbol[h->rle_count] = (unsigned char)len;
+            h->rle_extra[h->rle_count++] = 0;
+            int n = run - 1 > 6 ? 6 : run - 1;
+            h->rle_symbol[h->rle_count] = 16;
+            h->rle_extra[h->rle_count++] = (unsigned char)(n - 3);
+            i += 1 + n;
+        } else {
+            h->rle_symbol[h->rle_count] = (unsigned char)len;
+            h->rle_extra[h->rle_count++] = 0;
+            i++;
+        }
+    }
+}
+
+static void write_block(DeflateStream *s, int final) {
+    unsigned lit_freq[LITLEN_CODES] = { 0 }, dist_freq[DIST_CODES] = { 0 };
+    int extra_bits, extra;
+
+    for (int i = 0; i < s->sym_count; i++) {
+        if (s->sym_dist[i] == 0) {
+            lit_freq[s->sym_value[i]]++;
+        } else {
+            lit_freq[length_code(s->sym_value[i], &extra_bits, &extra)]++;
+            dist_freq[dist_code(s->sym_dist[i], &extra_bits, &extra)]++;
+        }
+    }
+    lit_freq[256] = 1;
+
+    // Give each code at least two symbols so both codes are complete
+    unsigned adjusted_lit[LITLEN_CODES], adjusted_dist[DIST_CODES];
+    memcpy(adjusted_lit, lit_freq, sizeof(lit_freq));
+    memcpy(adjusted_dist, dist_freq, sizeof(dist_freq));
+    if (!adjusted_lit[0] || !adjusted_lit[1]) adjusted_lit[adjusted_lit[0] ? 1 : 0] = 1;
+    int used_dist = 0;
+    for (int i = 0; i < DIST_CODES; i++) used_dist += adjusted_dist[i] != 0;
+    for (int i = 0; used_dist < 2; i++) {
+        if (!adjusted_dist[i]) {
+            adjusted_dist[i] = 1;
+            used_dist++;
+        }
+    }
+
+    DynamicHeader h;
+    build_lengths(adjusted_lit, LITLEN_CODES, 15, h.lengths);
+    unsigned char dist_lengths[DIST_CODES];
+    build_lengths(adjusted_dist, DIST_CODES, 15, dist_lengths);
+    for (h.hlit = LITLEN_CODES; h.hlit > 257 && h.lengths[h.hlit - 1] == 0; h.hlit--) {}
+    for (h.hdist = DIST_CODES; h.hdist > 1 && dist_lengths[h.hdist - 1] == 0; h.hdist--) {}
+
+    unsigned char lit_lengths[LITLEN_CODES];
+    memcpy(lit_lengths, h.lengths, LITLEN_CODES);
+    memcpy(h.lengths + h.hlit, dist_lengths, h.hdist);
+    encode_code_lengths(&h);
+
+    // Decoders reject an incomplete code-length code, so it needs two symbols as well
+    unsigned codelen_freq[CODELEN_CODES] = { 0 };
+    int used_codelen = 0;
+    for (int i = 0; i < h.rle_count; i++) codelen_freq[h.rle_symbol[i]]++;
+    for (int i = 0; i < CODELEN_CODES; i++) used_codelen += codelen_freq[i] != 0;
+    for (int i = 0; used_codelen < 2; i++) {
+        if (!codelen_freq[i]) {
+            codelen_freq[i] = 1;
+            used_codelen++;
+        }
+    }
+    build_lengths(codelen_freq, CODELEN_CODES, 7, h.codelen_lengths);
+    build_codes(h.codelen_lengths, CODELEN_CODES, h.codelen_codes);
+    for (h.hclen = CODELEN_CODES; h.hclen > 4 && h.codelen_lengths[codelen_order[h.hclen - 1]] == 0; h.hclen--) {}
+
+    // Compare the dynamic code, header included, with the fixed code; extra bits cost the same in both
+    unsigned long dynamic_bits = 5 + 5 + 4 + 3 * h.hclen, fixed_bits = 0;
+    for (int i = 0; i < h.rle_count; i++) {
+        int symbol = h.rle_symbol[i];
+        dynamic_bits += h.codelen_lengths[symbol] + (symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0);
+    }
+    for (int i = 0; i < LITLEN_CODES; i++) {
+        dynamic_bits += (unsigned long)lit_freq[i] * lit_lengths[i];
+        fixed_bits += (unsigned long)lit_freq[i] * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    for (int i = 0; i < DIST_CODES; i++) {
+        dynamic_bits += (unsigned long)dist_freq[i] * dist_lengths[i];
+        fixed_bits += (unsigned long)dist_freq[i] * 5;
+    }
+
+    unsigned char fixed_lit[LITLEN_CODES + 2], fixed_dist[DIST_CODES];
+    unsigned short lit_codes[LITLEN_CODES + 2], dist_codes[DIST_CODES];
+    const unsigned char *use_lit, *use_dist;
+
+    if (fixed_bits <= dynamic_bits) {
+        for (int i = 0; i < LITLEN_CODES + 2; i++) fixed_lit[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        memset(fixed_dist, 5, sizeof(fixed_dist));
+        build_codes(fixed_lit, LITLEN_CODES + 2, lit_codes);
+        build_codes(fixed_dist, DIST_CODES, dist_codes);
+        use_lit = fixed_lit;
+        use_dist = fixed_dist;
+        put_bits(s, final | (1 << 1), 3);
+    } else {
+        build_codes(lit_lengths, LITLEN_CODES, lit_codes);
+        build_codes(dist_lengths, DIST_CODES, dist_codes);
+        use_lit = lit_lengths;
+        use_dist = dist_lengths;
+        put_bits(s, final | (2 << 1), 3);
+        put_bits(s, h.hlit - 257, 5);
+        put_bits(s, h.hdist - 1, 5);
+        put_bits(s, h.hclen - 4, 4);
+        for (int i = 0; i < h.hclen; i++) put_bits(s, h.codelen_lengths[codelen_order[i]], 3);
+        for (int i = 0; i < h.rle_count; i++) {
+            int symbol = h.rle_symbol[i];
+            put_bits(s, h.codelen_codes[symbol], h.codelen_lengths[symbol]);
+            if (symbol == 16) put_bits(s, h.rle_extra[i], 2);
+            if (symbol == 17) put_bits(s, h.rle_extra[i], 3);
+            if (symbol == 18) put_bits(s, h.rle_extra[i], 7);
+        }
+    }
+
+    for (int i = 0; i < s->sym_count; i++) {
+        if (s->sym_dist[i] == 0) {
+            int lit = s->sym_value[i];
+            put_bits(s, lit_codes[lit], use_lit[lit]);
+        } else {
+            int code = length_code(s->sym_value[i], &extra_bits, &extra);
+            put_bits(s, lit_codes[code], use_lit[code]);
+            if (extra_bits) put_bits(s, extra, extra_bits);
+            code = dist_code(s->sym_dist[i], &extra_bits, &extra);
+            put_bits(s, dist_codes[code], use_dist[code]);
+            if (extra_bits) put_bits(s, extra, extra_bits);
+        }
+    }
+    put_bits(s, lit_codes[256], use_lit[256]);
+    s->sym_count = 0;
+}
+
+static void emit_symbol(DeflateStream *s, int dist, int value) {
+    s->sym_dist[s->sym_count] = (unsigned short)dist;
+    s->sym_value[s->sym_count] = (unsigned short)value;
+    if (++s->sym_count == SYM_BUFFER) write_block(s, 0);
+}
+
+/* Matching */
+
+static int insert_string(DeflateStream *s, int pos) {
+    const unsigned char *p = s->window + pos;
+    uint32_t h = ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u >> (32 - HASH_BITS);
+    int previous = s->head[h];
+    s->prev[pos & WMASK] = previous;
+    s->head[h] = pos;
+    return previous;
+}
+
+static int longest_match(DeflateStream *s, int cur_match) {
+    int chain = s->prev_length >= GOOD_LENGTH ? MAX_CHAIN / 4 : MAX_CHAIN;
+    int best = s->prev_length;
+    int limit = s->strstart > MAX_DIST ? s->strstart - MAX_DIST : 0;
+    int max_len = s->lookahead < MAX_MATCH ? s->lookahead : MAX_MATCH;
+    const unsigned char *scan = s->window + s->strstart;
+
+    if (best >= max_len) return best;
+    do {
+        const unsigned char *match = s->window + cur_match;
+        if (match[best] != scan[best] || match[0] != scan[0] || match[1] != scan[1]) continue;
+        int len = 2;
+        while (len < max_len && match[len] == scan[len]) len++;
+        if (len > best) {
+            s->match_start = cur_match;
+            best = len;
+            if (len >= NICE_LENGTH || len >= max_len) break;
+        }
+    } while ((cur_match = s->prev[cur_match & WMASK]) >= limit && --chain != 0);
+    return best;
+}
+
+static void slide_window(DeflateStream *s) {
+    memmove(s->window, s->window + WSIZE, WSIZE);
+    s->window_end -= WSIZE;
+    s->strstart -= WSIZE;
+    s->match_start -= WSIZE;
+    s->prev_match -= WSIZE;
+    for (int i = 0; i < HASH_SIZE; i++) s->head[i] = s->head[i] >= WSIZE ? s->head[i] - WSIZE : NIL;
+    for (int i = 0; i < WSIZE; i++) s->prev[i] = s->prev[i] >= WSIZE ? s->prev[i] - WSIZE : NIL;
+}
+
+// zlib's deflate_slow: a match is only taken if the next position has no longer one
+static void deflate_step(DeflateStream *s, int flushing) {
+    while (s->lookahead >= MIN_LOOKAHEAD || (flushing && s->lookahead > 0)) {
+        int hash_head = s->lookahead >= MIN_MATCH ? insert_string(s, s->strstart) : NIL;
+
+        s->prev_length = s->match_length;
+        s->prev_match = s->match_start;
+        s->match_length = MIN_MATCH - 1;
+
+        if (hash_head != NIL && s->prev_length < MAX_LAZY && s->strstart - hash_head <= MAX_DIST) {
+            s->match_length = longest_match(s, hash_head);
+            if (s->match_length == MIN_MATCH && s->strstart - s->match_start > TOO_FAR) {
+                s->match_length = MIN_MATCH - 1;
+            }
+            if (s->match_length < MIN_MATCH) s->match_length = MIN_MATCH - 1;
+        }
+
+        if (s->prev_length >= MIN_MATCH && s->match_length <= s->prev_length) {
+            int max_insert = s->strstart + s->lookahead - MIN_MATCH;
+            emit_symbol(s, s->strstart - 1 - s->prev_match, s->prev_length);
+
+            // The match's remaining strings go into the hash chains
+            s->lookahead -= s->prev_length - 1;
+            s->prev_length -= 2;
+            do {
+                if (++s->strstart <= max_insert) insert_string(s, s->strstart);
+            } while (--s->prev_length != 0);
+            s->match_available = 0;
+            s->match_length = MIN_MATCH - 1;
+            s->strstart++;
+        } else if (s->match_available) {
+            emit_symbol(s, 0, s->window[s->strstart - 1]);
+            s->strstart++;
+            s->lookahead--;
+        } else {
+            s->match_available = 1;
+            s->strstart++;
+            s->lookahead--;
+        }
+    }
+
+    if (flushing && s->match_available) {
+        emit_symbol(s, 0, s->window[s->strstart - 1]);
+        s->match_available = 0;
+    }
+    if (flushing) s->match_length = MIN_MATCH - 1;
+}
+
+/* Streams */
+
+DeflateStream *deflate_open(int format, DeflateSink sink, void *arg) {
+    DeflateStream *s = malloc(sizeof(DeflateStream));
+    if (!s) return NULL;
+
+    s->format = format;
+    s->sink = sink;
+    s->arg = arg;
+    s->failed = 0;
+    s->window_end = s->strstart = s->lookahead = 0;
+    for (int i = 0; i < HASH_SIZE; i++) s->head[i] = NIL;
+    for (int i = 0; i < WSIZE; i++) s->prev[i] = NIL;
+    s->match_length = s->prev_length = MIN_MATCH - 1;
+    s->match_start = s->prev_match = 0;
+    s->match_available = 0;
+    s->sym_count = 0;
+    s->bit_buffer = 0;
+    s->bit_count = 0;
+    s->out_len = 0;
+    s->total_in = 0;
+    s->check = format == DEFLATE_ZLIB ? 1 : 0;
+
+    if (format == DEFLATE_GZIP) {
+        // No file name or modification time, OS "Unix"
+        static const unsigned char gzip_header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+        for (int i = 0; i < 10; i++) put_byte(s, gzip_header[i]);
+    } else if (format == DEFLATE_ZLIB) {
+        put_byte(s, 0x78);
+        put_byte(s, 0x9c);
+    }
+    return s;
+}
+
+int deflate_write(DeflateStream *s, const void *data, size_t len) {
+    const unsigned char *in = data;
+    if (s->format == DEFLATE_GZIP) s->check = crc32_update(s->check, in, len);
+    if (s->format == DEFLATE_ZLIB) s->check = adler32_update(s->check, in, len);
+    s->total_in += (uint32_t)len;
+
+    while (len > 0) {
+        if (s->window_end == WINDOW_SIZE) slide_window(s);
+        size_t n = WINDOW_SIZE - s->window_end;
+        if (n > len) n = len;
+        memcpy(s->window + s->window_end, in, n);
+        s->window_end += (int)n;
+        s->lookahead += (int)n;
+        in += n;
+        len -= n;
+        deflate_step(s, 0);
+    }
+    return s->failed;
+}
+
+// Emit everything written so far, ending on a byte boundary (a zlib sync flush)
+int deflate_flush(DeflateStream *s) {
+    deflate_step(s, 1);
+    if (s->sym_count > 0) write_block(s, 0);
+    put_bits(s, 0, 3);
+    align_bits(s);
+    put_byte(s, 0);
+    put_byte(s, 0);
+    put_byte(s, 0xff);
+    put_byte(s, 0xff);
+    flush_output(s);
+    return s->failed;
+}
+
+int deflate_close(DeflateStream *s) {
+    deflate_step(s, 1);
+    write_block(s, 1);
+    align_bits(s);
+
+    if (s->format == DEFLATE_GZIP) {
+        for (int i = 0; i < 4; i++) put_byte(s, (s->check >> (8 * i)) & 0xff);
+        for (int i = 0; i < 4; i++) put_byte(s, (s->total_in >> (8 * i)) & 0xff);
+    } else if (s->format == DEFLATE_ZLIB) {
+        for (int i = 3; i >= 0; i--) put_byte(s, (s->check >> (8 * i)) & 0xff);
+    }
+    flush_output(s);
+
+    int failed = s->failed;
+    free(s);
+    return failed;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t capacity;
+} GrowBuffer;
+
+static int append_to_buffer(void *arg, const unsigned char *data, size_t len) {
+    GrowBuffer *buffer = arg;
+    if (buffer->len + len > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        while (capacity < buffer->len + len) capacity *= 2;
+        unsigned char *grown = realloc(buffer->data, capacity);
+        if (!grown) return 1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+// Compress a whole buffer in memory; the caller frees the result
+unsigned char *deflate_buffer(const void *data, size_t len, int format, size_t *out_len) {
+    GrowBuffer buffer = { NULL, 0, 0 };
+    DeflateStream *s = deflate_open(format, append_to_buffer, &buffer);
+    if (!s) return NULL;
+
+    int failed = deflate_write(s, data, len);
+    failed |= deflate_close(s);
+    if (failed) {
+        free(buffer.data);
+        return NULL;
+    }
+    *out_len = buffer.len;
+    return buffer.data;
+}
+
+/* Compressed CGI output */
+
+/*
+ * Pages are rendered with printf, so compression sits behind stdout:
+ * stdout is swapped for a stdio stream whose writes pass the CGI headers
+ * through, add Content-Encoding before the blank line that ends them, and
+ * deflate everything after it on its way to the real standard output.
+ */
+
+typedef struct {
+    FILE *real;
+    DeflateStream *deflate;
+    const char *encoding;
+    int headers_done;
+    int line_length;
+} CompressedOutput;
+
+static CompressedOutput compressed_output;
+static FILE *compressed_stdout;
+
+// Pick gzip or deflate from an Accept-Encoding header, honouring q=0
+int choose_content_encoding(const char *accept_encoding) {
+    double gzip_q = 0, deflate_q = 0, any_q = 0;
+    int gzip_listed = 0, deflate_listed = 0;
+    if (!accept_encoding) return -1;
+
+    const char *p = accept_encoding;
+    while (*p) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        const char *name = p;
+        while (*p && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t name_len = p - name;
+        if (name_len == 0) break;
+
+        double q = 1;
+        const char *end = strchr(p, ',');
+        if (!end) end = p + strlen(p);
+        const char *param = p;
+        while ((param = strchr(param, ';')) && param < end) {
+            param++;
+            while (*param == ' ') param++;
+            if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') q = strtod(param + 2, NULL);
+        }
+
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            gzip_q = q;
+            gzip_listed = 1;
+        } else if (name_len == 7 && strncasecmp(name, "deflate", 7) == 0) {
+            deflate_q = q;
+            deflate_listed = 1;
+        } else if (name_len == 1 && name[0] == '*') {
+            any_q = q;
+        }
+        p = end;
+    }
+
+    if (!gzip_listed) gzip_q = any_q;
+    if (!deflate_listed) deflate_q = any_q;
+    if (gzip_q > 0 && gzip_q >= deflate_q) return DEFLATE_GZIP;
+    if (deflate_q > 0) return DEFLATE_ZLIB;
+    return -1;
+}
+
+static int write_to_real(void *arg, const unsigned char *data, size_t len) {
+    CompressedOutput *out = arg;
+    return fwrite(data, 1, len, out->real) != len;
+}
+
+static ssize_t compressed_write(void *cookie, const char *data, size_t size) {
+    CompressedOutput *out = cookie;
+    size_t done = 0;
+
+    // Headers pass through until the blank line, which gets Content-Encoding in front of it
+    while (!out->headers_done && done < size) {
+        char c = data[done];
+        if (c == '\n' && out->line_length == 0) {
+            fprintf(out->real, "Content-Encoding: %s\n\n", out->encoding);
+            out->headers_done = 1;
+        } else {
+            fputc(c, out->real);
+            out->line_length = c == '\n' ? 0 : c == '\r' ? out->line_length : out->line_length + 1;
+        }
+        done++;
+    }
+
+    if (done < size && deflate_write(out->deflate, data + done, size - done) != 0) return -1;
+    return (ssize_t)size;
+}
+
+static int compressed_close(void *cookie) {
+    CompressedOutput *out = cookie;
+    int rc = deflate_close(out->deflate);
+    out->deflate = NULL;
+    if (fflush(out->real) != 0) rc = 1;
+    return rc ? EOF : 0;
+}
+
+static void finish_at_exit(void) {
+    output_compression_finish();
+}
+
+// Route stdout through a deflate stream if the client accepts gzip or deflate
+int output_compression_begin(const char *accept_encoding) {
+    int format = choose_content_encoding(accept_encoding);
+    if (format < 0 || compressed_stdout) return 0;
+
+    memset(&compressed_output, 0, sizeof(compressed_output));
+    compressed_output.real = stdout;
+    compressed_output.encoding = format == DEFLATE_GZIP ? "gzip" : "deflate";
+    compressed_output.deflate = deflate_open(format, write_to_real, &compressed_output);
+    if (!compressed_output.deflate) return 1;
+
+    cookie_io_functions_t functions = { NULL, compressed_write, NULL, compressed_close };
+    FILE *stream = fopencookie(&compressed_output, "w", functions);
+    if (!stream) {
+        deflate_close(compressed_output.deflate);
+        return 1;
+    }
+    setvbuf(stream, NULL, _IOFBF, 16384);
+
+    fflush(stdout);
+    compressed_stdout = stream;
+    stdout = stream;
+
+    static int registered = 0;
+    if (!registered) {
+        atexit(finish_at_exit);
+        registered = 1;
+    }
+    return 0;
+}
+
+// End the compressed stream and put the real stdout back; a plain flush otherwise
+int output_compression_finish(void) {
+    if (!compressed_stdout) return fflush(stdout) != 0;
+
+    stdout = compressed_output.real;
+    int rc = fclose(compressed_stdout) != 0;
+    compressed_stdout = NULL;
+    return rc;
+}
+
+// Push everything rendered so far to the client: a sync flush when compressing
+int output_compression_flush(void) {
+    if (!compressed_stdout) return fflush(stdout) != 0;
+
+    int rc = fflush(compressed_stdout) != 0;
+    if (deflate_flush(compressed_output.deflate) != 0) rc = 1;
+    if (fflush(compressed_output.real) != 0) rc = 1;
+    return rc;
+}
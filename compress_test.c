@@ -0,0 +1,155 @@
+/* compress_test.c - Checks the deflate encoder's Huffman codes and output against zlib */
+
+#include "compress.c"
+#include <zlib.h>
+
+/*
+ * Built into its own binary with compress.c included, so the static
+ * build_lengths() can be called directly. Two checks:
+ *
+ *   - code lengths for skewed frequency sets over the literal/length
+ *     (286 symbols, 15 bits) and code-length (19 symbols, 7 bits)
+ *     alphabets: every used symbol gets a length no longer than the
+ *     limit, and the code is never over-subscribed (Kraft sum <= 1);
+ *   - blocks of literals only with geometric byte frequencies, and whole
+ *     buffers of such bytes in all three formats, inflate back to the
+ *     input with zlib.
+ *
+ * Run with make test; exits non-zero if any check fails.
+ */
+
+static unsigned long long rng_state = 0x9e3779b97f4a7c15ull;
+
+static unsigned rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (unsigned)(rng_state >> 32);
+}
+
+static double rng_unit(void) {
+    return rng() / 4294967296.0;
+}
+
+// Frequencies falling off geometrically, Fibonacci-like (deepest trees) or Zipf-like, in random order
+static void skewed_frequencies(unsigned *freq, int n, int shape) {
+    double ratio = 0.3 + 0.65 * rng_unit(), weight = 1 + rng() % 60000;
+    unsigned a = 1, b = 1;
+    memset(freq, 0, sizeof(unsigned) * n);
+    for (int i = 0; i < n; i++) {
+        int symbol = rng() % n;
+        while (freq[symbol]) symbol = (symbol + 1) % n;
+        if (shape == 0) {
+            freq[symbol] = (unsigned)weight + 1;
+            weight *= ratio;
+        } else if (shape == 1) {
+            freq[symbol] = a;
+            unsigned next = a + b;
+            a = b;
+            b = next > 100000000 ? 1 : next;
+        } else {
+            freq[symbol] = 1 + 65536 / (i + 1) / (i + 1);
+        }
+        if (rng() % 8 == 0) freq[symbol] = 0;     // Unused symbols, as in real blocks
+    }
+}
+
+static int check_lengths(const unsigned *freq, int n, int max_bits) {
+    unsigned char lengths[LITLEN_CODES];
+    build_lengths(freq, n, max_bits, lengths);
+    unsigned long kraft = 0;
+    int used = 0;
+    for (int i = 0; i < n; i++) {
+        if ((freq[i] != 0) != (lengths[i] != 0) || lengths[i] > max_bits) return 1;
+        if (lengths[i]) kraft += 1ul << (max_bits - lengths[i]);
+        used += freq[i] != 0;
+    }
+    return used > 1 && kraft > 1ul << max_bits;
+}
+
+// Inflate with zlib and compare; frees compressed
+static int check_inflate(unsigned char *compressed, size_t compressed_len, const unsigned char *data, size_t len,
+                         int format) {
+    unsigned char *inflated = malloc(len + 1);
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    int window = format == DEFLATE_RAW ? -15 : format == DEFLATE_ZLIB ? 15 : 15 + 16;
+    int rc = inflated ? inflateInit2(&z, window) : Z_MEM_ERROR;
+    if (rc == Z_OK) {
+        z.next_in = compressed;
+        z.avail_in = (uInt)compressed_len;
+        z.next_out = inflated;
+        z.avail_out = (uInt)len + 1;
+        rc = inflate(&z, Z_FINISH);
+        inflateEnd(&z);
+    }
+    int failed = rc != Z_STREAM_END || z.total_out != len || memcmp(inflated, data, len) != 0;
+    if (failed) fprintf(stderr, "round trip failed: format %d, %zu bytes, zlib %d\n", format, len, rc);
+    free(compressed);
+    free(inflated);
+    return failed;
+}
+
+static int check_round_trip(const unsigned char *data, size_t len, int format) {
+    size_t compressed_len;
+    unsigned char *compressed = deflate_buffer(data, len, format, &compressed_len);
+    return compressed ? check_inflate(compressed, compressed_len, data, len, format) : 1;
+}
+
+// A block of literals only, fed past the matcher so no match evens out the frequencies
+static int check_literal_block(const unsigned char *data, size_t len) {
+    GrowBuffer buffer = { NULL, 0, 0 };
+    DeflateStream *s = deflate_open(DEFLATE_RAW, append_to_buffer, &buffer);
+    if (!s) return 1;
+    for (size_t i = 0; i < len; i++) emit_symbol(s, 0, data[i]);
+    if (deflate_close(s) != 0) {
+        free(buffer.data);
+        return 1;
+    }
+    return check_inflate(buffer.data, buffer.len, data, len, DEFLATE_RAW);
+}
+
+// Bytes with geometric frequencies: a few common ones and a long tail of rare ones
+static void geometric_bytes(unsigned char *data, size_t len) {
+    double ratio = 0.5 + 0.49 * rng_unit();
+    int offset = rng() & 0xff;
+    for (size_t i = 0; i < len; i++) {
+        int byte = 0;
+        while (byte < 255 && rng_unit() < ratio) byte++;
+        data[i] = (unsigned char)(byte ^ offset);
+    }
+}
+
+int main(void) {
+    unsigned freq[LITLEN_CODES];
+    int failures = 0;
+
+    for (int round = 0; round < 100000; round++) {
+        skewed_frequencies(freq, LITLEN_CODES, round % 3);
+        failures += check_lengths(freq, LITLEN_CODES, 15);
+        skewed_frequencies(freq, CODELEN_CODES, round % 3);
+        failures += check_lengths(freq, CODELEN_CODES, 7);
+    }
+    printf("code lengths   %d over-subscribed or invalid codes in 200000\n", failures);
+
+    int literal_failures = 0, round_trip_failures = 0;
+    size_t size = 3 * SYM_BUFFER;
+    unsigned char *data = malloc(size);
+    if (!data) return 1;
+    for (int round = 0; round < 10000; round++) {
+        size_t len = 1 + rng() % (SYM_BUFFER - 1);
+        geometric_bytes(data, len);
+        literal_failures += check_literal_block(data, len);
+    }
+    printf("literal blocks %d failed to inflate in 10000\n", literal_failures);
+
+    for (int round = 0; round < 300; round++) {
+        size_t len = 1 + rng() % size;
+        geometric_bytes(data, len);
+        round_trip_failures += check_round_trip(data, len, round % 3);
+    }
+    printf("round trips    %d failed in 300\n", round_trip_failures);
+    free(data);
+
+    return failures || literal_failures || round_trip_failures;
+}
@@ -9,9 +9,73 @@ int init_database(sqlite3 **db) {
         sqlite3_close(*db);
         return 1;
     }
+    
+    // Statement counters and the slow-query log
+    sql_profile_attach(*db);
     return 0;
 }
 
+/*
+ * Databases created before the parsed date columns existed get them added
+ * and filled in from the text once. The probe prepares on any current
+ * schema, so afterwards this costs one prepare per request. The check is
+ * repeated under the write lock in case another process got there first.
+ */
+static int date_columns_exist(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT birth_day, death_precision FROM people LIMIT 0;", -1, &stmt, NULL) != SQLITE_OK) {
+        return 0;
+    }
+    sqlite3_finalize(stmt);
+    return 1;
+}
+
+static int migrate_date_columns(sqlite3 *db) {
+    const char *sql =
+        "ALTER TABLE people ADD COLUMN birth_day INTEGER;"
+        "ALTER TABLE people ADD COLUMN birth_precision INTEGER;"
+        "ALTER TABLE people ADD COLUMN death_day INTEGER;"
+        "ALTER TABLE people ADD COLUMN death_precision INTEGER;"
+        "ALTER TABLE relationships ADD COLUMN marriage_day INTEGER;"
+        "ALTER TABLE relationships ADD COLUMN marriage_precision INTEGER;"
+        "ALTER TABLE relationships ADD COLUMN divorce_day INTEGER;"
+        "ALTER TABLE relationships ADD COLUMN divorce_precision INTEGER;"
+        // Listings by birth date used the text column
+        "DROP INDEX IF EXISTS idx_people_birth;";
+    char *error_msg = NULL;
+    
+    if (date_columns_exist(db)) return 0;
+    
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, &error_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        return 1;
+    }
+    if (date_columns_exist(db)) {
+        sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+        return 0;
+    }
+    if (sqlite3_exec(db, sql, NULL, NULL, &error_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return 1;
+    }
+    if (backfill_dates(db) != 0) {
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return 1;
+    }
+    return sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL) != SQLITE_OK;
+}
+
+/*
+ * Only a serve-mode parent holding a lifespan index reads lifespan_changes,
+ * so the triggers log to it only while that parent's lease in
+ * lifespan_watch is current; plain CGI deployments leave it empty.
+ */
+#define LIFESPAN_WATCHED \
+    "EXISTS (SELECT 1 FROM lifespan_watch WHERE expires_at > CAST(strftime('%s', 'now') AS INTEGER))"
+
 int create_tables(sqlite3 *db) {
     const char *people_sql = 
         "CREATE TABLE IF NOT EXISTS people ("
@@ -24,7 +88,11 @@ int create_tables(sqlite3 *db) {
         "bio TEXT,"
         "photo_url TEXT,"
         "created_at INTEGER NOT NULL,"
-        "updated_at INTEGER NOT NULL"
+        "updated_at INTEGER NOT NULL,"
+        "birth_day INTEGER,"          // Parsed dates (dates.c), NULL if unparseable
+        "birth_precision INTEGER,"
+        "death_day INTEGER,"
+        "death_precision INTEGER"
         ");";
     
     const char *relationships_sql = 
@@ -37,6 +105,10 @@ int create_tables(sqlite3 *db) {
         "divorce_date TEXT,"
         "created_at INTEGER NOT NULL,"
         "updated_at INTEGER NOT NULL,"
+        "marriage_day INTEGER,"
+        "marriage_precision INTEGER,"
+        "divorce_day INTEGER,"
+        "divorce_precision INTEGER,"
         "FOREIGN KEY (person1_id) REFERENCES people (id),"
         "FOREIGN KEY (person2_id) REFERENCES people (id)"
         ");";
@@ -53,6 +125,67 @@ int create_tables(sqlite3 *db) {
         "FOREIGN KEY (person_id) REFERENCES people (id)"
         ");";
     
+    // One thumbnail job per stored photo; workers claim pending rows
+    const char *thumbnails_sql =
+        "CREATE TABLE IF NOT EXISTS thumbnail_jobs ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "hash TEXT NOT NULL UNIQUE,"
+        "state TEXT NOT NULL DEFAULT 'pending' CHECK(state IN ('pending', 'running', 'done', 'failed')),"
+        "attempts INTEGER NOT NULL DEFAULT 0,"
+        "thumb_hash TEXT,"
+        "error TEXT,"
+        "created_at INTEGER NOT NULL,"
+        "updated_at INTEGER NOT NULL"
+        ");"
+        "CREATE INDEX IF NOT EXISTS idx_thumbnail_jobs_state ON thumbnail_jobs (state, id);";
+    
+    // Lookups from either side of a relationship (parents, children, spouses)
+    const char *indexes_sql =
+        "CREATE INDEX IF NOT EXISTS idx_relationships_person1 ON relationships (person1_id, relationship_type);"
+        "CREATE INDEX IF NOT EXISTS idx_relationships_person2 ON relationships (person2_id, relationship_type);"
+        // Keyset-paginated listings and the recently added list on the home page
+        "CREATE INDEX IF NOT EXISTS idx_people_name ON people (last_name, first_name, id);"
+        "CREATE INDEX IF NOT EXISTS idx_people_created ON people (created_at);"
+        // Date range searches and listings by date; covering for lifespan_alive_sql
+        "CREATE INDEX IF NOT EXISTS idx_people_birth_span ON people "
+        "(birth_day, id, birth_precision, death_day, death_precision) WHERE birth_day IS NOT NULL;"
+        "CREATE INDEX IF NOT EXISTS idx_people_death_span ON people "
+        "(death_day, id, death_precision, birth_day, birth_precision) WHERE death_day IS NOT NULL;"
+        "DROP INDEX IF EXISTS idx_people_birth_day;"
+        "DROP INDEX IF EXISTS idx_people_death_day;"
+        // Covering, so a timeline walks them filtering on the partners without touching the table
+        "CREATE INDEX IF NOT EXISTS idx_relationships_marriage ON relationships (marriage_day, person1_id, person2_id) WHERE marriage_day IS NOT NULL;"
+        "CREATE INDEX IF NOT EXISTS idx_relationships_divorce ON relationships (divorce_day, person1_id, person2_id) WHERE divorce_day IS NOT NULL;"
+        "DROP INDEX IF EXISTS idx_relationships_marriage_day;"
+        "DROP INDEX IF EXISTS idx_relationships_divorce_day;";
+    
+    // Lifespans added, edited or removed since an in-memory lifespan index was built (lifespan_index.c)
+    const char *lifespan_sql =
+        "CREATE TABLE IF NOT EXISTS lifespan_changes ("
+        "seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "person_id INTEGER NOT NULL"
+        ");"
+        "CREATE TABLE IF NOT EXISTS lifespan_watch ("
+        "id INTEGER PRIMARY KEY CHECK (id = 1),"
+        "expires_at INTEGER NOT NULL"
+        ");"
+        "DROP TRIGGER IF EXISTS people_lifespan_changed;"
+        "DROP TRIGGER IF EXISTS people_lifespan_inserted;"
+        "DROP TRIGGER IF EXISTS people_lifespan_deleted;"
+        "CREATE TRIGGER IF NOT EXISTS lifespan_log_update "
+        "AFTER UPDATE OF birth_day, birth_precision, death_day, death_precision ON people "
+        "WHEN (OLD.birth_day IS NOT NEW.birth_day OR OLD.birth_precision IS NOT NEW.birth_precision "
+        "OR OLD.death_day IS NOT NEW.death_day OR OLD.death_precision IS NOT NEW.death_precision) "
+        "AND " LIFESPAN_WATCHED " "
+        "BEGIN INSERT INTO lifespan_changes (person_id) VALUES (NEW.id); END;"
+        // Bulk import binds ids from its input, so new people can land below a snapshot's max id
+        "CREATE TRIGGER IF NOT EXISTS lifespan_log_insert AFTER INSERT ON people "
+        "WHEN (NEW.birth_day IS NOT NULL OR NEW.death_day IS NOT NULL) AND " LIFESPAN_WATCHED " "
+        "BEGIN INSERT INTO lifespan_changes (person_id) VALUES (NEW.id); END;"
+        "CREATE TRIGGER IF NOT EXISTS lifespan_log_delete AFTER DELETE ON people "
+        "WHEN (OLD.birth_day IS NOT NULL OR OLD.death_day IS NOT NULL) AND " LIFESPAN_WATCHED " "
+        "BEGIN INSERT INTO lifespan_changes (person_id) VALUES (OLD.id); END;";
+    
     char *error_msg = NULL;
     int rc;
     
@@ -77,13 +210,39 @@ int create_tables(sqlite3 *db) {
         return 1;
     }
     
+    rc = sqlite3_exec(db, thumbnails_sql, NULL, NULL, &error_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        return 1;
+    }
+    
+    if (migrate_date_columns(db) != 0) {
+        return 1;
+    }
+    
+    rc = sqlite3_exec(db, indexes_sql, NULL, NULL, &error_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        return 1;
+    }
+    
+    rc = sqlite3_exec(db, lifespan_sql, NULL, NULL, &error_msg);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        return 1;
+    }
+    
     return 0;
 }
 
 int add_person(sqlite3 *db, Person *person) {
     sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO people (first_name, last_name, gender, birth_date, death_date, bio, photo_url, created_at, updated_at) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    const char *sql = "INSERT INTO people (first_name, last_name, gender, birth_date, death_date, bio, photo_url, created_at, updated_at, "
+                      "birth_day, birth_precision, death_day, death_precision) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
     
     int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
@@ -95,8 +254,8 @@ int add_person(sqlite3 *db, Person *person) {
     person->created_at = now;
     person->updated_at = now;
     
-    sqlite3_bind_text(stmt, 1, person->first_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, person->last_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 1, person->first_name_id ? interned_string(person->first_name_id) : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, person->last_name_id ? interned_string(person->last_name_id) : "", -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, &person->gender, 1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 4, person->birth_date ? person->birth_date : NULL, -1, SQLITE_STATIC);
     
@@ -106,6 +265,8 @@ int add_person(sqlite3 *db, Person *person) {
     
     sqlite3_bind_int64(stmt, 8, person->created_at);
     sqlite3_bind_int64(stmt, 9, person->updated_at);
+    bind_date_day(stmt, 10, person->birth_date);
+    bind_date_day(stmt, 12, person->death_date);
     
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
@@ -121,8 +282,9 @@ int add_person(sqlite3 *db, Person *person) {
 
 int add_relationship(sqlite3 *db, Relationship *rel) {
     sqlite3_stmt *stmt;
-    const char *sql = "INSERT INTO relationships (person1_id, person2_id, relationship_type, marriage_date, divorce_date, created_at, updated_at) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?);";
+    const char *sql = "INSERT INTO relationships (person1_id, person2_id, relationship_type, marriage_date, divorce_date, created_at, updated_at, "
+                      "marriage_day, marriage_precision, divorce_day, divorce_precision) "
+                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
     
     int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
@@ -143,6 +305,8 @@ int add_relationship(sqlite3 *db, Relationship *rel) {
     
     sqlite3_bind_int64(stmt, 6, rel->created_at);
     sqlite3_bind_int64(stmt, 7, rel->updated_at);
+    bind_date_day(stmt, 8, rel->marriage_date);
+    bind_date_day(stmt, 10, rel->divorce_date);
     
     rc = sqlite3_step(stmt);
     if (rc != SQLITE_DONE) {
@@ -153,6 +317,11 @@ int add_relationship(sqlite3 *db, Relationship *rel) {
     
     rel->id = sqlite3_last_insert_rowid(db);
     sqlite3_finalize(stmt);
+    
+    // Keep the ancestry closure current when it has been built
+    if (strcmp(rel->relationship_type, "parent-child") == 0 && closure_enabled(db)) {
+        return closure_add_edge(db, rel->person1_id, rel->person2_id);
+    }
     return 0;
 }
 
@@ -190,8 +359,8 @@ int get_children(sqlite3 *db, int parent_id, Person **children, int *count) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             Person *child = &(*children)[i++];
             child->id = sqlite3_column_int(stmt, 0);
-            child->first_name = strdup((const char*)sqlite3_column_text(stmt, 1));
-            child->last_name = strdup((const char*)sqlite3_column_text(stmt, 2));
+            child->first_name_id = intern_column(stmt, 1);
+            child->last_name_id = intern_column(stmt, 2);
             child->gender = *((const char*)sqlite3_column_text(stmt, 3));
             
             child->birth_date = sqlite3_column_type(stmt, 4) != SQLITE_NULL ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
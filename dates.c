@@ -0,0 +1,272 @@
+/* dates.c - Parsed, sortable day numbers for the free-text date columns */
+
+#include "family_tree.h"
+
+/*
+ * Dates are stored as typed (ISO 8601, GEDCOM, "about 1850", ...) and also
+ * as a day number: days since 1970-01-01 in the proleptic Gregorian
+ * calendar, negative before 1970. Year-only and month-only dates map to the
+ * first day of the period and carry a precision so a range search can
+ * still tell "1850" from "1850-01-01".
+ */
+
+static const char *month_names[] = {
+    "JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"
+};
+
+// Qualifiers that make a date approximate; BET also takes an "AND <date>" tail
+static const char *approximate_words[] = {
+    "ABT", "ABOUT", "CA", "CIRCA", "C", "CAL", "EST", "BEF", "BEFORE", "AFT", "AFTER", "BET", "BETWEEN", NULL
+};
+
+static int days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+static void civil_from_days(int days, int *year, int *month, int *day) {
+    days += 719468;
+    int era = (days >= 0 ? days : days - 146096) / 146097;
+    int day_of_era = days - era * 146097;
+    int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int mp = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = year_of_era + era * 400 + (*month <= 2);
+}
+
+static int days_in_month(int year, int month) {
+    static const int lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if (month == 2 && (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))) return 29;
+    return lengths[month - 1];
+}
+
+// Read up to max_digits digits; returns the count read, 0 if none
+static int read_number(const char **p, int max_digits, int *value) {
+    int count = 0;
+    *value = 0;
+    while (isdigit((unsigned char)**p) && count < max_digits) {
+        *value = *value * 10 + (**p - '0');
+        (*p)++;
+        count++;
+    }
+    return isdigit((unsigned char)**p) ? 0 : count;
+}
+
+// Read a word of letters into buffer, upper-cased; returns its length
+static int read_word(const char **p, char *buffer, int size) {
+    int length = 0;
+    while (isalpha((unsigned char)**p)) {
+        if (length < size - 1) buffer[length] = toupper((unsigned char)**p);
+        length++;
+        (*p)++;
+    }
+    buffer[length < size ? length : size - 1] = '\0';
+    return length;
+}
+
+// Month from a name or its three-letter abbreviation; 0 if not a month
+static int month_from_name(const char *word) {
+    if (strlen(word) < 3) return 0;
+    for (int i = 0; i < 12; i++) {
+        if (strncmp(word, month_names[i], 3) == 0) return i + 1;
+    }
+    return 0;
+}
+
+static void skip_space(const char **p) {
+    while (isspace((unsigned char)**p)) (*p)++;
+}
+
+/*
+ * Parse a date in one of the forms found in the tree: YYYY-MM-DD, YYYY-MM,
+ * YYYY (also with '/'), GEDCOM "12 MAR 1850" and "MAR 1850", optionally
+ * qualified by ABT/about/c./circa/EST/BEF/AFT/BET...AND, a leading '~' or
+ * a trailing '?', which mark it approximate. Returns 0 and the day number
+ * and precision on success, 1 if the text is not a date.
+ */
+int parse_date(const char *text, int *day, int *precision) {
+    const char *p = text;
+    int approximate = 0, range = 0;
+    char word[16];
+
+    if (!text) return 1;
+    skip_space(&p);
+
+    // Qualifiers, any number of them ("ABT.", "c.", "~")
+    for (;;) {
+        if (*p == '~') {
+            approximate = 1;
+            p++;
+            skip_space(&p);
+            continue;
+        }
+        const char *start = p;
+        if (!read_word(&p, word, sizeof(word))) break;
+        int found = 0;
+        for (int i = 0; approximate_words[i]; i++) {
+            if (strcmp(word, approximate_words[i]) == 0) {
+                found = 1;
+                if (strncmp(word, "BET", 3) == 0) range = 1;
+                break;
+            }
+        }
+        if (!found) {
+            p = start;
+            break;
+        }
+        approximate = 1;
+        if (*p == '.') p++;
+        skip_space(&p);
+    }
+
+    int year = 0, month = 0, dom = 0, value;
+    int digits = read_number(&p, 4, &value);
+    if (digits == 4 && (*p == '-' || *p == '/')) {
+        // ISO: YYYY-MM or YYYY-MM-DD
+        char separator = *p++;
+        year = value;
+        if (read_number(&p, 2, &month) == 0) return 1;
+        if (*p == separator) {
+            p++;
+            if (read_number(&p, 2, &dom) == 0) return 1;
+        }
+    } else if (digits > 0 && digits <= 2 && isspace((unsigned char)*p)) {
+        // GEDCOM: D MON YYYY
+        dom = value;
+        skip_space(&p);
+        read_word(&p, word, sizeof(word));
+        if (!(month = month_from_name(word))) return 1;
+        skip_space(&p);
+        if (read_number(&p, 4, &year) == 0) return 1;
+    } else if (digits > 0) {
+        year = value;
+    } else {
+        // GEDCOM: MON YYYY
+        read_word(&p, word, sizeof(word));
+        if (!(month = month_from_name(word))) return 1;
+        if (*p == '.') p++;
+        skip_space(&p);
+        if (read_number(&p, 4, &year) == 0) return 1;
+    }
+
+    if (year < 1 || month < 0 || month > 12) return 1;
+    if (dom && (!month || dom > days_in_month(year, month))) return 1;
+
+    skip_space(&p);
+    if (*p == '?') {
+        approximate = 1;
+        p++;
+        skip_space(&p);
+    }
+    // The second bound of BET ... AND ... is not kept; the day is the earlier one
+    if (range && strncasecmp(p, "AND", 3) == 0) p += strlen(p);
+    if (*p) return 1;
+
+    *day = days_from_civil(year, month ? month : 1, dom ? dom : 1);
+    *precision = (dom ? DATE_EXACT : month ? DATE_MONTH : DATE_YEAR) | (approximate ? DATE_APPROXIMATE : 0);
+    return 0;
+}
+
+// The last day of the period a parsed date stands for
+int date_period_end(int day, int precision) {
+    int year, month, dom;
+    civil_from_days(day, &year, &month, &dom);
+    switch (precision & ~DATE_APPROXIMATE) {
+        case DATE_YEAR:  return days_from_civil(year, 12, 31);
+        case DATE_MONTH: return days_from_civil(year, month, days_in_month(year, month));
+        default:         return day;
+    }
+}
+
+// YYYY-MM-DD into a buffer of at least 11 bytes
+void format_date_day(int day, char *buffer) {
+    int year, month, dom;
+    civil_from_days(day, &year, &month, &dom);
+    sprintf(buffer, "%04d-%02d-%02d", year, month, dom);
+}
+
+/*
+ * A date packed as year << 9 | month << 5 | day, month and day 0 when the
+ * date does not give them: orders like the date, the year is one shift
+ * away and an anniversary is a compare of the low 9 bits. Never 0, which
+ * the analytics columns keep for "no date".
+ */
+int pack_date_day(int day, int precision) {
+    int year, month, dom;
+    civil_from_days(day, &year, &month, &dom);
+    switch (precision & ~DATE_APPROXIMATE) {
+        case DATE_YEAR:  return year << 9;
+        case DATE_MONTH: return year << 9 | month << 5;
+        default:         return year << 9 | month << 5 | dom;
+    }
+}
+
+// Bind the day number and precision of a date to index and index + 1, NULL if unparseable
+void bind_date_day(sqlite3_stmt *stmt, int index, const char *text) {
+    int day, precision;
+    if (parse_date(text, &day, &precision) == 0) {
+        sqlite3_bind_int(stmt, index, day);
+        sqlite3_bind_int(stmt, index + 1, precision);
+    } else {
+        sqlite3_bind_null(stmt, index);
+        sqlite3_bind_null(stmt, index + 1);
+    }
+}
+
+// SQL functions date_day(text) and date_precision(text), NULL if unparseable
+static void sql_date_part(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;
+    int day, precision;
+    if (parse_date((const char*)sqlite3_value_text(argv[0]), &day, &precision) != 0) {
+        sqlite3_result_null(context);
+    } else {
+        sqlite3_result_int(context, sqlite3_user_data(context) ? precision : day);
+    }
+}
+
+int register_date_functions(sqlite3 *db) {
+    static int precision_flag = 1;
+    int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+    if (sqlite3_create_function(db, "date_day", 1, flags, NULL, sql_date_part, NULL, NULL) != SQLITE_OK ||
+        sqlite3_create_function(db, "date_precision", 1, flags, &precision_flag, sql_date_part, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to register date functions: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Recompute every day number from its text, all or nothing; a savepoint so
+ * it also nests in the caller's transaction. Run by the schema migration
+ * that adds the columns, and by hand (backfill-dates) after the parser
+ * learns a new form.
+ */
+int backfill_dates(sqlite3 *db) {
+    const char *sql =
+        "SAVEPOINT backfill_dates;"
+        "UPDATE people SET "
+        "birth_day = date_day(birth_date), birth_precision = date_precision(birth_date), "
+        "death_day = date_day(death_date), death_precision = date_precision(death_date) "
+        "WHERE birth_date IS NOT NULL OR death_date IS NOT NULL OR birth_day IS NOT NULL OR death_day IS NOT NULL;"
+        "UPDATE relationships SET "
+        "marriage_day = date_day(marriage_date), marriage_precision = date_precision(marriage_date), "
+        "divorce_day = date_day(divorce_date), divorce_precision = date_precision(divorce_date) "
+        "WHERE marriage_date IS NOT NULL OR divorce_date IS NOT NULL OR marriage_day IS NOT NULL OR divorce_day IS NOT NULL;"
+        "RELEASE backfill_dates;";
+    char *error_msg = NULL;
+
+    if (register_date_functions(db) != 0) return 1;
+    if (sqlite3_exec(db, sql, NULL, NULL, &error_msg) != SQLITE_OK) {
+        fprintf(stderr, "Failed to backfill dates: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        sqlite3_exec(db, "ROLLBACK TO backfill_dates; RELEASE backfill_dates;", NULL, NULL, NULL);
+        return 1;
+    }
+    return 0;
+}
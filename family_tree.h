@@ -3,17 +3,21 @@
 #ifndef FAMILY_TREE_H
 #define FAMILY_TREE_H
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sqlite3.h>
+#include <sys/uio.h>
 #include <time.h>
 
 /* Data structures */
 typedef struct {
     int id;
-    char* first_name;
-    char* last_name;
+    uint32_t first_name_id;   // Interned (intern.c); 0 for none
+    uint32_t last_name_id;
     char gender;          // 'M' or 'F'
     char* birth_date;     // YYYY-MM-DD format
     char* death_date;     // YYYY-MM-DD format or NULL
@@ -43,8 +47,196 @@ typedef struct {
 typedef struct {
     CGIParam *params;
     int count;
+    char *buffer;               // One allocation holding params, index and decoded text
+    int *index;                 // Open-addressing slots: param position + 1, 0 when empty
+    unsigned int index_mask;
 } CGIParams;
 
+/* Receives file parts of multipart POST bodies a chunk at a time (form.c);
+   final is set once per part, with no data. Returns 0 or an HTTP status. */
+typedef struct {
+    int (*file_part)(void *arg, const char *field, const char *filename, const char *content_type,
+                     const char *data, size_t len, int final);
+    void *arg;
+    char value[128];    // Set by the handler's final call to replace the file name as the field value
+} FormFileHandler;
+
+/* Content-addressed blob store for uploaded photos (blob_store.c) */
+#define BLOB_DIR "photos"
+#define BLOB_HASH_HEX 64
+#define BLOB_MAX_BYTES (20 << 20)
+#define PHOTO_URL_PREFIX "?action=photo&hash="
+
+typedef struct BlobWriter BlobWriter;
+
+typedef struct {
+    FormFileHandler handler;    // handler.arg points back at this upload
+    BlobWriter *writer;
+    unsigned char head[16];     // First bytes, to check the upload is an image
+    size_t head_len;
+} PhotoUpload;
+
+/* Thumbnails of stored photos, built by the thumbnail worker (thumbnail.c) */
+#define THUMB_SIZE 160
+#define THUMB_URL_PREFIX "?action=thumb&hash="
+#define THUMB_MAX_ATTEMPTS 3
+#define THUMB_JOB_TIMEOUT 300     // Seconds before a running job counts as abandoned
+#define THUMB_POLL_SECONDS 2
+
+/* Streaming deflate output framing (compress.c) */
+#define DEFLATE_RAW 0
+#define DEFLATE_ZLIB 1
+#define DEFLATE_GZIP 2
+
+typedef struct DeflateStream DeflateStream;
+typedef int (*DeflateSink)(void *arg, const unsigned char *data, size_t len);
+
+/* Compiled template output (template.c, templates_gen.c from templates/ via tplc) */
+#define TPL_IOV_MAX 64
+#define TPL_ARENA_SIZE 256
+#define TPL_WRITEV_MIN 4096   // Smaller batches are copied into the stdio buffer
+
+typedef struct {
+    struct iovec iov[TPL_IOV_MAX];
+    int count;
+    size_t bytes;
+    char arena[TPL_ARENA_SIZE];   // Formatted integers; spans point into it until flushed
+    size_t arena_used;
+} TemplateOutput;
+
+#define PAGE_TITLE "Family Tree"   // Every page's title; serve mode renders its shell once
+
+/* Keyset pagination: a list page resumes after the sort key and id of the last row shown */
+#define LIST_PAGE_SIZE 50
+
+typedef struct {
+    const char *key;      // last_name, or the day number when listing by birth or death date
+    const char *key2;     // first_name when listing by name
+    int id;
+} PageCursor;
+
+/* Parsed dates (dates.c): day numbers count from 1970-01-01, negative before it */
+#define DATE_EXACT 0
+#define DATE_MONTH 1           // Month and year only; the day is the 1st
+#define DATE_YEAR 2            // Year only; the day is 1 January
+#define DATE_APPROXIMATE 4     // Or'ed in for ABT, c., BEF, AFT, BET, '~' and '?'
+#define DATE_DAY_MIN -719162   // 0001-01-01
+#define DATE_DAY_MAX 2932896   // 9999-12-31
+
+/* Built-in HTTP server (http_server.c) */
+#define HTTP_DEFAULT_PORT 8080
+#define HTTP_MAX_CHILDREN 32
+#define HTTP_MAX_HEAD 16384         // Request line and headers, and the CGI header block of a response
+#define HTTP_STREAM_BUFFER 16384    // Largest response chunk held before it is sent
+#define HTTP_FLUSH_INTERVAL 0.05    // Seconds between flushes of a streamed page
+#define HTTP_IO_TIMEOUT 30
+
+typedef int (*HttpRequestHandler)(int argc, char *argv[]);
+
+/* Decoded image, 8-bit RGB rows with no padding (image_decode.c) */
+typedef struct {
+    int width;
+    int height;
+    unsigned char *pixels;
+} Image;
+
+/* Online backup progress; callback runs after every backup step */
+#define BACKUP_DEFAULT_PAGES 64
+#define BACKUP_DEFAULT_SLEEP_MS 5
+#define BACKUP_MAX_RESTARTS 32          // Copies started over by other writers before giving up
+#define BACKUP_MAX_SECONDS 3600
+
+typedef struct {
+    void (*callback)(void *arg, int done_pages, int total_pages);
+    void *arg;
+    int pages;
+    int steps;
+    int restarts;
+    double bytes;
+    double seconds;
+} BackupProgress;
+
+/* In-memory ancestry reachability index (reach_index.c) */
+#define REACH_REBUILD_SECONDS 60        // Serve mode rebuilds an index that lost rows at most this often
+
+typedef struct ReachIndex ReachIndex;
+
+/* In-memory lifespan interval index (lifespan_index.c) */
+#define LIFESPAN_MAX_YEARS 110          // Assumed when a birth or death date is missing
+#define LIFESPAN_REBUILD_CHANGES 4096   // Serve mode rebuilds once this many changes are pending
+#define LIFESPAN_WATCH_SECONDS 3600     // Lease on change logging, renewed by serve mode before each fork
+
+typedef struct LifespanIndex LifespanIndex;
+
+/* Columnar analytics snapshot (analytics.c) */
+#define ANALYTICS_TOP_SURNAMES 20
+#define ANALYTICS_MAX_AGE 120           // Older ages at death are taken as data errors
+#define ANALYTICS_MAX_CHILDREN 12       // The last children-per-couple bucket means "or more"
+#define ANALYTICS_REFRESH_SECONDS 60    // Serve mode reloads a changed tree at most this often
+
+typedef struct AnalyticsSnapshot AnalyticsSnapshot;
+
+typedef struct {
+    const char *name;
+    int count;
+} SurnameCount;
+
+typedef struct {
+    int people;
+    int male;
+    int female;
+    int born;                       // With a birth date
+    int died;                       // With a death date
+    int first_decade;
+    int decade_count;
+    int *births_per_decade;         // [d] counts the decade first_decade + 10 d
+    int *deaths_per_decade;
+    int ages;                       // With both dates
+    int age_at_death[ANALYTICS_MAX_AGE + 1];
+    double mean_age;
+    int median_age;
+    int surnames;                   // Distinct
+    SurnameCount top_surnames[ANALYTICS_TOP_SURNAMES];
+    int top_surname_count;
+    int couples;
+    long children;                  // Of those couples, with both as parents
+    int children_per_couple[ANALYTICS_MAX_CHILDREN + 1];
+    time_t loaded_at;
+    double load_seconds;
+    double seconds;                 // Spent in the kernels
+} AnalyticsReport;
+
+/* Compact resident person records (person_table.c) */
+#define PERSON_TABLE_REFRESH_SECONDS 60 // Serve mode rebuilds a changed tree at most this often
+
+typedef struct {
+    int id;
+    uint32_t first_name_id;         // Interned (intern.c)
+    uint32_t last_name_id;
+    uint32_t birth : 24;            // pack_date_day(), 0 when unknown
+    uint32_t gender : 8;            // 'M', 'F' or 0
+    uint32_t death : 24;
+    uint32_t parent_count : 8;
+    int links;                      // Parents, then children, in the table's link array from here
+} HotPerson;
+
+typedef struct PersonTable PersonTable;
+
+/* Request phases timed into the shared metrics segment (metrics.c) */
+#define METRICS_DEFAULT_PATH "family_tree.stats"
+#define METRIC_BUCKET_COUNT 15
+
+typedef enum {
+    METRIC_DB_OPEN,
+    METRIC_CREATE_TABLES,
+    METRIC_PARAM_PARSE,
+    METRIC_HANDLER,
+    METRIC_RENDER,
+    METRIC_FLUSH,
+    METRIC_TOTAL,
+    METRIC_PHASE_COUNT
+} MetricPhase;
+
 /* Function declarations */
 int init_database(sqlite3 **db);
 int create_tables(sqlite3 *db);
@@ -56,14 +248,139 @@ int get_parents(sqlite3 *db, int child_id, Person *father, Person *mother);
 int get_spouse(sqlite3 *db, int person_id, Person *spouse);
 int add_relationship(sqlite3 *db, Relationship *rel);
 
+uint32_t intern_string(const char *text);
+const char *interned_string(uint32_t id);
+uint32_t intern_column(sqlite3_stmt *stmt, int column);
+uint32_t intern_count(void);
+size_t intern_memory(void);
+int intern_benchmark(sqlite3 *db);
+
+int parse_date(const char *text, int *day, int *precision);
+int date_period_end(int day, int precision);
+void format_date_day(int day, char *buffer);
+int pack_date_day(int day, int precision);
+void bind_date_day(sqlite3_stmt *stmt, int index, const char *text);
+int register_date_functions(sqlite3 *db);
+int backfill_dates(sqlite3 *db);
+
+int export_gedcom(sqlite3 *db, const char *path);
+int bulk_import(sqlite3 *db, const char *table, const char *path, int threads);
+int closure_enabled(sqlite3 *db);
+int rebuild_closure(sqlite3 *db);
+int closure_add_edge(sqlite3 *db, int parent_id, int child_id);
+int closure_is_ancestor(sqlite3 *db, int ancestor_id, int descendant_id);
+int closure_get_descendants(sqlite3 *db, int person_id, int max_depth, int **ids, int **depths, int *count);
+int closure_get_ancestors(sqlite3 *db, int person_id, int max_depth, int **ids, int **depths, int *count);
+int closure_benchmark(sqlite3 *db, int samples);
+ReachIndex *reach_index_build(sqlite3 *db);
+int reach_index_refresh(ReachIndex *index, sqlite3 *db);
+int reach_index_add_edge(ReachIndex *index, int parent_id, int child_id);
+int reach_is_ancestor(ReachIndex *index, int ancestor_id, int descendant_id);
+int reach_common_ancestors(ReachIndex *index, const int *person_ids, int count,
+                           int **ancestor_ids, int *result_count);
+void reach_index_free(ReachIndex *index);
+int reach_index_preload(sqlite3 *db);
+void reach_index_maintain(void);
+ReachIndex *reach_index_current(sqlite3 *db);
+int reach_benchmark(sqlite3 *db, int samples);
+LifespanIndex *lifespan_index_build(sqlite3 *db);
+void lifespan_index_free(LifespanIndex *index);
+int lifespan_alive(LifespanIndex *index, sqlite3 *db, int from_day, int to_day, const int *within, int within_count,
+                   int after_id, int limit, int *ids, int *count, int *total);
+int lifespan_alive_sql(sqlite3 *db, int from_day, int to_day, const int *within, int within_count,
+                       int after_id, int limit, int *ids, int *count, int *total);
+int lifespan_index_preload(sqlite3 *db);
+void lifespan_index_maintain(void);
+LifespanIndex *lifespan_index_preloaded(void);
+int lifespan_benchmark(sqlite3 *db, int samples);
+AnalyticsSnapshot *analytics_snapshot_load(sqlite3 *db);
+void analytics_snapshot_free(AnalyticsSnapshot *snapshot);
+int analytics_report(const AnalyticsSnapshot *snapshot, AnalyticsReport *report);
+void analytics_report_free(AnalyticsReport *report);
+int analytics_snapshot_preload(sqlite3 *db);
+void analytics_snapshot_maintain(void);
+AnalyticsSnapshot *analytics_snapshot_preloaded(void);
+int analytics_benchmark(sqlite3 *db, int samples);
+PersonTable *person_table_build(sqlite3 *db);
+void person_table_free(PersonTable *table);
+int person_table_descendants(const PersonTable *table, int person_id, int **ids, int *count);
+int person_table_preload(sqlite3 *db);
+void person_table_maintain(void);
+PersonTable *person_table_current(sqlite3 *db);
+int person_table_benchmark(sqlite3 *db, int samples);
+void sql_profile_attach(sqlite3 *db);
+void sql_profile_flush(void);
+int metrics_init(void);
+double metrics_now(void);
+void metrics_count_statement(void);
+void metrics_count_row(void);
+void metrics_record_phase(MetricPhase phase, double seconds);
+void metrics_record_action(const char *action, double seconds);
+void metrics_finish_request(void);
+void metrics_write_prometheus(FILE *out);
+int backup_database(sqlite3 *db, const char *path, int pages_per_step, int sleep_ms,
+                    BackupProgress *progress);
+
+int page_shell_preload(void);
+void page_shell_maintain(void);
 void print_html_header(const char *title);
 void print_html_footer();
 void render_person_profile(sqlite3 *db, int person_id);
 void render_family_tree(sqlite3 *db, int root_person_id, int levels);
+void render_timeline(sqlite3 *db, int person_id, int descendants);
+void render_person_card(Person *person);
 void handle_form_submission(sqlite3 *db);
+void show_search_results(sqlite3 *db, const char *search_term, const PageCursor *after);
+void show_browse_page(sqlite3 *db, const char *order_name, const PageCursor *after);
+void show_date_search(sqlite3 *db, const char *event, const char *from, const char *to, const PageCursor *after);
+void show_alive_page(sqlite3 *db, const char *date, const char *to, int root_id, int after_id);
+void show_statistics_page(sqlite3 *db);
 
 char* html_escape(const char *str);
+CGIParams parse_query_string(const char *query_string);
 char* get_cgi_param(CGIParams params, const char *name);
+void free_cgi_params(CGIParams params);
+CGIParams cgi_params_from_pairs(const char *pairs, size_t len, int count);
+int read_request_body(const char *query_string, FILE *in, CGIParams *params, FormFileHandler *files);
+const char *http_status_text(int status);
+int blob_hash_valid(const char *hash);
+int blob_path(const char *hash, char *path, size_t size);
+BlobWriter *blob_writer_open(void);
+int blob_writer_write(BlobWriter *writer, const void *data, size_t len);
+int blob_writer_commit(BlobWriter *writer, char hash[BLOB_HASH_HEX + 1]);
+void blob_writer_abort(BlobWriter *writer);
+const char *image_content_type(const unsigned char *head, size_t len);
+int photo_file_part(void *arg, const char *field, const char *filename, const char *content_type,
+                    const char *data, size_t len, int final);
+int serve_blob(const char *hash, int immutable);
+int decode_image(const unsigned char *data, size_t len, Image *image, char *error, size_t error_size);
+void free_image(Image *image);
+long inflate_buffer(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len);
+DeflateStream *deflate_open(int format, DeflateSink sink, void *arg);
+int deflate_write(DeflateStream *stream, const void *data, size_t len);
+int deflate_flush(DeflateStream *stream);
+int deflate_close(DeflateStream *stream);
+unsigned char *deflate_buffer(const void *data, size_t len, int format, size_t *out_len);
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len);
+uint32_t adler32_update(uint32_t adler, const unsigned char *data, size_t len);
+int choose_content_encoding(const char *accept_encoding);
+int output_compression_begin(const char *accept_encoding);
+int output_compression_finish(void);
+int output_compression_flush(void);
+int run_http_server(int port, int max_children, HttpRequestHandler handler, void (*before_fork)(void), char *program);
+int output_stream_flush(void);
+int enqueue_thumbnail(sqlite3 *db, const char *photo_url);
+int run_thumbnail_worker(sqlite3 *db, int processes, int once);
+int serve_thumbnail(sqlite3 *db, const char *hash);
+void tpl_begin(TemplateOutput *out);
+void tpl_span(TemplateOutput *out, const char *data, size_t len);
+void tpl_text(TemplateOutput *out, const char *str);
+void tpl_raw(TemplateOutput *out, const char *str);
+void tpl_int(TemplateOutput *out, int value);
+int tpl_flush(TemplateOutput *out);
+int writev_all(int fd, struct iovec *iov, int count);
+void tpl_capture_begin(void);
+char *tpl_capture_end(size_t *len);
 void free_person(Person *person);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,420 @@
+/* form.c - POST request body parsing for family tree application */
+
+#define _GNU_SOURCE     // memmem, strcasestr
+#include "family_tree.h"
+#include <strings.h>
+
+/*
+ * Bodies are read from stdin in fixed-size chunks and never held whole.
+ * Form fields are decoded straight into an arena of NUL-separated names
+ * and values, which becomes the request's CGIParams once the body ends;
+ * fields from QUERY_STRING come first, so the action in a form's URL
+ * still wins. File parts of a multipart body are passed to a handler a
+ * chunk at a time and otherwise discarded.
+ */
+
+#define FORM_CHUNK 16384
+#define FORM_MAX_FIELD (1 << 20)           // Largest single text field (bios)
+#define FORM_MAX_FIELDS (8 << 20)          // All text fields together
+#define FORM_MAX_HEADER 8192               // Headers of one multipart part
+#define FORM_MAX_BOUNDARY 70               // RFC 2046
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int count;          // Completed name/value pairs
+    size_t field_start; // Where the field being decoded began
+} FormArena;
+
+typedef struct {
+    FILE *in;
+    size_t remaining;   // Body bytes not yet read from the stream
+    char *buf;
+    size_t start;
+    size_t end;
+    size_t cap;
+} BodyReader;
+
+static int arena_reserve(FormArena *arena, size_t extra) {
+    if (arena->len + extra <= arena->cap) return 0;
+    if (arena->len + extra > FORM_MAX_FIELDS) return 413;
+
+    size_t cap = arena->cap ? arena->cap : 4096;
+    while (cap < arena->len + extra) cap *= 2;
+    char *grown = realloc(arena->data, cap);
+    if (!grown) return 500;
+    arena->data = grown;
+    arena->cap = cap;
+    return 0;
+}
+
+static int arena_append(FormArena *arena, const char *data, size_t len) {
+    if (arena->len + len - arena->field_start > FORM_MAX_FIELD) return 413;
+    int rc = arena_reserve(arena, len);
+    if (rc) return rc;
+    memcpy(arena->data + arena->len, data, len);
+    arena->len += len;
+    return 0;
+}
+
+// Close the current name or value; a pair is complete after its value
+static int arena_terminate(FormArena *arena, int is_value) {
+    int rc = arena_reserve(arena, 1);
+    if (rc) return rc;
+    arena->data[arena->len++] = '\0';
+    arena->field_start = arena->len;
+    if (is_value) arena->count++;
+    return 0;
+}
+
+static int arena_add_pair(FormArena *arena, const char *name, const char *value) {
+    int rc = arena_append(arena, name, strlen(name));
+    if (!rc) rc = arena_terminate(arena, 0);
+    if (!rc) rc = arena_append(arena, value, strlen(value));
+    if (!rc) rc = arena_terminate(arena, 1);
+    return rc;
+}
+
+// Refill the window, keeping unread bytes; returns bytes added
+static size_t reader_fill(BodyReader *reader) {
+    if (reader->start > 0) {
+        memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    size_t want = reader->cap - reader->end;
+    if (want > reader->remaining) want = reader->remaining;
+    if (want == 0) return 0;
+
+    size_t got = fread(reader->buf + reader->end, 1, want, reader->in);
+    reader->end += got;
+    reader->remaining -= got;
+    if (got < want) reader->remaining = 0;   // Short body: treat as end of input
+    return got;
+}
+
+static int hex_digit(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * application/x-www-form-urlencoded, decoded a chunk at a time. A percent
+ * escape split across two reads is carried over in the escape state.
+ */
+static int parse_urlencoded(BodyReader *reader, FormArena *arena) {
+    int in_value = 0;
+    int escape = 0;     // Bytes of a pending %XX seen so far (0-2)
+    char pending[3];
+    int field_empty = 1;
+    int rc = 0;
+
+    while (rc == 0 && (reader->start < reader->end || reader_fill(reader) > 0)) {
+        char decoded[FORM_CHUNK];
+        size_t out = 0;
+
+        for (; reader->start < reader->end && rc == 0; reader->start++) {
+            char c = reader->buf[reader->start];
+
+            if (escape && hex_digit((unsigned char)c) >= 0) {
+                pending[escape++] = c;
+                if (escape == 3) {
+                    decoded[out++] = (char)(hex_digit((unsigned char)pending[1]) * 16 +
+                                            hex_digit((unsigned char)pending[2]));
+                    escape = 0;
+                }
+                field_empty = 0;
+            } else {
+                if (escape) {
+                    // Not an escape after all: keep the bytes literally
+                    memcpy(decoded + out, pending, escape);
+                    out += escape;
+                    escape = 0;
+                    field_empty = 0;
+                }
+
+                if (c == '&' || (c == '=' && !in_value)) {
+                    rc = arena_append(arena, decoded, out);
+                    out = 0;
+                    if (rc) break;
+
+                    if (c == '=') {
+                        rc = arena_terminate(arena, 0);
+                        in_value = 1;
+                    } else if (in_value) {
+                        rc = arena_terminate(arena, 1);
+                        in_value = 0;
+                    } else if (!field_empty) {
+                        // A bare name: give it an empty value
+                        rc = arena_terminate(arena, 0);
+                        if (!rc) rc = arena_terminate(arena, 1);
+                    }
+                    field_empty = 1;
+                } else if (c == '%') {
+                    pending[0] = c;
+                    escape = 1;
+                } else {
+                    decoded[out++] = c == '+' ? ' ' : c;
+                    field_empty = 0;
+                }
+            }
+
+            if (out + 3 >= sizeof(decoded)) {
+                rc = arena_append(arena, decoded, out);
+                out = 0;
+            }
+        }
+        if (rc == 0) rc = arena_append(arena, decoded, out);
+    }
+    if (rc) return rc;
+
+    if (escape) rc = arena_append(arena, pending, escape);
+    if (rc) return rc;
+
+    if (in_value) return arena_terminate(arena, 1);
+    if (!field_empty) {
+        rc = arena_terminate(arena, 0);
+        if (!rc) rc = arena_terminate(arena, 1);
+    }
+    return rc;
+}
+
+// Copy a parameter such as name="photo" out of a header line
+static int header_param(const char *header, const char *name, char *out, size_t size) {
+    size_t name_len = strlen(name);
+    for (const char *p = header; (p = strcasestr(p, name)) != NULL; p += name_len) {
+        if (p > header && p[-1] != ' ' && p[-1] != ';' && p[-1] != '\t') continue;
+        if (p[name_len] != '=') continue;
+
+        const char *value = p + name_len + 1;
+        size_t len;
+        if (*value == '"') {
+            value++;
+            const char *close = strchr(value, '"');
+            len = close ? (size_t)(close - value) : strlen(value);
+        } else {
+            len = strcspn(value, "; \t\r\n");
+        }
+        if (len >= size) len = size - 1;
+        memcpy(out, value, len);
+        out[len] = '\0';
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    char name[256];
+    char filename[256];
+    char content_type[128];
+    int is_file;
+} FormPart;
+
+static void parse_part_headers(char *headers, FormPart *part) {
+    memset(part, 0, sizeof(*part));
+    strcpy(part->content_type, "text/plain");
+
+    for (char *line = strtok(headers, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+        if (strncasecmp(line, "Content-Disposition:", 20) == 0) {
+            header_param(line + 20, "name", part->name, sizeof(part->name));
+            part->is_file = header_param(line + 20, "filename", part->filename, sizeof(part->filename));
+        } else if (strncasecmp(line, "Content-Type:", 13) == 0) {
+            const char *value = line + 13;
+            while (*value == ' ' || *value == '\t') value++;
+            snprintf(part->content_type, sizeof(part->content_type), "%s", value);
+        }
+    }
+}
+
+static int emit_part_data(FormPart *part, FormArena *arena, FormFileHandler *files,
+                          const char *data, size_t len) {
+    if (len == 0) return 0;
+    if (!part->is_file) return arena_append(arena, data, len);
+    if (files && files->file_part && part->filename[0]) {
+        return files->file_part(files->arg, part->name, part->filename, part->content_type, data, len, 0);
+    }
+    return 0;
+}
+
+static int finish_part(FormPart *part, FormArena *arena, FormFileHandler *files) {
+    int rc = 0;
+    if (part->is_file) {
+        // File fields carry the client's file name unless the handler supplies a value
+        if (files && files->file_part && part->filename[0]) {
+            files->value[0] = '\0';
+            rc = files->file_part(files->arg, part->name, part->filename, part->content_type, NULL, 0, 1);
+        }
+        if (!rc) {
+            const char *value = files && files->value[0] ? files->value : part->filename;
+            rc = arena_add_pair(arena, part->name, value);
+        }
+        if (files) files->value[0] = '\0';
+        return rc;
+    }
+    return arena_terminate(arena, 1);
+}
+
+/*
+ * multipart/form-data. The body is scanned for "\r\n--boundary" in a
+ * sliding window; bytes that cannot be part of a delimiter are handed on
+ * immediately, so memory use is bounded by the window, not the upload.
+ */
+static int parse_multipart(BodyReader *reader, FormArena *arena, const char *boundary, FormFileHandler *files) {
+    enum { PREAMBLE, AFTER_DELIMITER, HEADERS, BODY, DONE } state = PREAMBLE;
+    char delimiter[FORM_MAX_BOUNDARY + 5];
+    size_t delimiter_len = snprintf(delimiter, sizeof(delimiter), "\r\n--%s", boundary);
+    FormPart part;
+    int rc = 0;
+
+    // The first delimiter may start the body without a leading CRLF
+    memcpy(reader->buf, "\r\n", 2);
+    reader->end = 2;
+
+    while (rc == 0 && state != DONE) {
+        size_t available = reader->end - reader->start;
+        char *window = reader->buf + reader->start;
+
+        if (state == PREAMBLE || state == BODY) {
+            char *found = memmem(window, available, delimiter, delimiter_len);
+            if (found) {
+                if (state == BODY) {
+                    rc = emit_part_data(&part, arena, files, window, found - window);
+                    if (!rc) rc = finish_part(&part, arena, files);
+                }
+                reader->start += (found - window) + delimiter_len;
+                state = AFTER_DELIMITER;
+                continue;
+            }
+            // Everything except a possible partial delimiter at the end is data
+            if (available >= delimiter_len) {
+                size_t safe = available - (delimiter_len - 1);
+                if (state == BODY) rc = emit_part_data(&part, arena, files, window, safe);
+                reader->start += safe;
+            }
+        } else if (state == AFTER_DELIMITER) {
+            if (available >= 2) {
+                if (memcmp(window, "--", 2) == 0) {
+                    state = DONE;
+                } else if (memcmp(window, "\r\n", 2) == 0) {
+                    reader->start += 2;
+                    state = HEADERS;
+                } else {
+                    rc = 400;
+                }
+                continue;
+            }
+        } else if (state == HEADERS) {
+            char *found = memmem(window, available, "\r\n\r\n", 4);
+            if (found) {
+                size_t len = found - window;
+                if (len >= FORM_MAX_HEADER) {
+                    rc = 400;
+                    continue;
+                }
+                char headers[FORM_MAX_HEADER];
+                memcpy(headers, window, len);
+                headers[len] = '\0';
+                reader->start += len + 4;
+
+                parse_part_headers(headers, &part);
+                if (!part.name[0]) {
+                    rc = 400;
+                } else if (!part.is_file) {
+                    rc = arena_append(arena, part.name, strlen(part.name));
+                    if (!rc) rc = arena_terminate(arena, 0);
+                }
+                state = BODY;
+                continue;
+            }
+            if (available >= FORM_MAX_HEADER) rc = 400;
+        }
+
+        if (rc == 0 && reader_fill(reader) == 0 && reader->end - reader->start == available) {
+            rc = 400;   // Body ended before the closing delimiter
+        }
+    }
+
+    // Skip any epilogue so the stream is fully consumed
+    reader->start = reader->end;
+    while (reader_fill(reader) > 0) reader->start = reader->end;
+    return rc;
+}
+
+int read_request_body(const char *query_string, FILE *in, CGIParams *params, FormFileHandler *files) {
+    memset(params, 0, sizeof(*params));
+
+    const char *length_str = getenv("CONTENT_LENGTH");
+    const char *content_type = getenv("CONTENT_TYPE");
+    if (!length_str || !*length_str) return 411;
+
+    char *end;
+    long long content_length = strtoll(length_str, &end, 10);
+    if (*end || content_length < 0) return 400;
+
+    FormArena arena;
+    memset(&arena, 0, sizeof(arena));
+
+    // Query string fields first so they win lookups over the body
+    CGIParams query = parse_query_string(query_string);
+    int rc = 0;
+    for (int i = 0; i < query.count && rc == 0; i++) {
+        rc = arena_add_pair(&arena, query.params[i].name, query.params[i].value);
+    }
+    free_cgi_params(query);
+
+    BodyReader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.in = in;
+    reader.remaining = (size_t)content_length;
+    reader.cap = FORM_CHUNK * 2;
+    reader.buf = malloc(reader.cap);
+    if (!reader.buf) rc = 500;
+
+    if (rc == 0) {
+        char boundary[FORM_MAX_BOUNDARY + 1];
+        if (!content_type || strncasecmp(content_type, "application/x-www-form-urlencoded", 33) == 0) {
+            if (content_length > FORM_MAX_FIELDS) {
+                rc = 413;
+            } else {
+                rc = parse_urlencoded(&reader, &arena);
+            }
+        } else if (strncasecmp(content_type, "multipart/form-data", 19) == 0) {
+            if (!header_param(content_type, "boundary", boundary, sizeof(boundary)) || !boundary[0]) {
+                rc = 400;
+            } else {
+                rc = parse_multipart(&reader, &arena, boundary, files);
+            }
+        } else {
+            rc = 415;
+        }
+    }
+
+    if (rc == 0) {
+        *params = cgi_params_from_pairs(arena.data, arena.len, arena.count);
+        if (arena.count > 0 && !params->buffer) rc = 500;
+    } else {
+        fprintf(stderr, "Rejected request body (status %d)\n", rc);
+    }
+
+    free(reader.buf);
+    free(arena.data);
+    return rc;
+}
+
+const char *http_status_text(int status) {
+    switch (status) {
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 408: return "Request Timeout";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 415: return "Unsupported Media Type";
+        case 431: return "Request Header Fields Too Large";
+        case 501: return "Not Implemented";
+        default: return "Internal Server Error";
+    }
+}
@@ -0,0 +1,316 @@
+/* gedcom.c - GEDCOM export for family tree application */
+
+#include "family_tree.h"
+
+// Output buffer for exports; large writes keep syscalls rare on big databases
+#define GEDCOM_BUFFER_SIZE (1 << 20)
+
+// Longest payload per GEDCOM line before continuing with CONC
+#define GEDCOM_LINE_MAX 200
+
+static const char *gedcom_months[] = {
+    "JAN", "FEB", "MAR", "APR", "MAY", "JUN",
+    "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"
+};
+
+/*
+ * Write a one-line value such as a name. CR and LF would end the GEDCOM
+ * line and let the rest of the value read as records of its own, so they
+ * become spaces; long values continue with CONC, split between UTF-8
+ * sequences.
+ */
+static void write_gedcom_value(FILE *out, int level, const char *tag, const char *value) {
+    size_t len = strlen(value);
+    size_t offset = 0;
+
+    fprintf(out, "%d %s ", level, tag);
+    do {
+        size_t chunk = len - offset;
+        if (chunk > GEDCOM_LINE_MAX) {
+            chunk = GEDCOM_LINE_MAX;
+            while (chunk > 1 && ((unsigned char)value[offset + chunk] & 0xC0) == 0x80) chunk--;
+        }
+        if (offset > 0) fprintf(out, "%d CONC ", level + 1);
+
+        for (size_t i = 0; i < chunk; i++) {
+            char c = value[offset + i];
+            fputc(c == '\r' || c == '\n' ? ' ' : c, out);
+        }
+        fputc('\n', out);
+        offset += chunk;
+    } while (offset < len);
+}
+
+// Write "YYYY-MM-DD" as a GEDCOM date ("12 MAR 1900"); anything else is passed through
+static void write_gedcom_date(FILE *out, int level, const char *date) {
+    int year, month, day;
+    if (sscanf(date, "%4d-%2d-%2d", &year, &month, &day) == 3 &&
+        month >= 1 && month <= 12 && day >= 1 && day <= 31) {
+        fprintf(out, "%d DATE %d %s %04d\n", level, day, gedcom_months[month - 1], year);
+    } else if (sscanf(date, "%4d", &year) == 1 && strlen(date) == 4) {
+        fprintf(out, "%d DATE %04d\n", level, year);
+    } else {
+        write_gedcom_value(out, level, "DATE", date);
+    }
+}
+
+// Write free text as a tagged value, using CONT for newlines and CONC for long lines
+static void write_gedcom_text(FILE *out, int level, const char *tag, const char *text) {
+    const char *p = text;
+    int first = 1;
+
+    do {
+        size_t line_len = strcspn(p, "\r\n");
+        size_t offset = 0;
+
+        do {
+            size_t chunk = line_len - offset;
+            if (chunk > GEDCOM_LINE_MAX) chunk = GEDCOM_LINE_MAX;
+
+            if (first) {
+                fprintf(out, "%d %s ", level, tag);
+                first = 0;
+            } else if (offset == 0) {
+                fprintf(out, "%d CONT ", level + 1);
+            } else {
+                fprintf(out, "%d CONC ", level + 1);
+            }
+            fwrite(p + offset, 1, chunk, out);
+            fputc('\n', out);
+            offset += chunk;
+        } while (offset < line_len);
+
+        p += line_len;
+        if (*p == '\r') p++;
+        if (*p == '\n') p++;
+    } while (*p);
+}
+
+/*
+ * Family rows: each spouse row becomes (partner_a, partner_b) and each
+ * child becomes (parent_a, parent_b, child), parent_b 0 for a single
+ * parent. They are built once per export into temp.gedcom_families,
+ * which both the INDI links and the FAM records read. A family is
+ * identified by its couple, so its xref @F<a>_<b>@ can be written in
+ * INDI records before the FAM record itself.
+ */
+#define GEDCOM_FAMILY_ROWS \
+    "SELECT CASE WHEN relationship_type = 'spouse' THEN MIN(person1_id, person2_id) " \
+    "            ELSE MIN(person1_id) END AS fam_a, " \
+    "       CASE WHEN relationship_type = 'spouse' THEN MAX(person1_id, person2_id) " \
+    "            WHEN COUNT(*) > 1 THEN MAX(person1_id) ELSE 0 END AS fam_b, " \
+    "       CASE WHEN relationship_type = 'parent-child' THEN person2_id ELSE 0 END AS child, " \
+    "       marriage_date, divorce_date " \
+    "FROM relationships " \
+    "GROUP BY relationship_type, " \
+    "         CASE WHEN relationship_type = 'spouse' THEN id ELSE person2_id END"
+
+static void write_gedcom_header(FILE *out) {
+    fputs("0 HEAD\n"
+          "1 SOUR FAMILY_TREE\n"
+          "2 NAME Family Tree Project\n"
+          "1 GEDC\n"
+          "2 VERS 5.5.1\n"
+          "2 FORM LINEAGE-LINKED\n"
+          "1 CHAR UTF-8\n", out);
+}
+
+/*
+ * One sequential scan of people, one INDI record per row. The FAMS and
+ * FAMC links come from the family rows turned into (person, family)
+ * pairs sorted by person, read alongside the people scan as a merge.
+ */
+static int export_gedcom_people(sqlite3 *db, FILE *out, int *count) {
+    sqlite3_stmt *stmt, *links;
+    const char *sql =
+        "SELECT id, first_name, last_name, gender, birth_date, death_date, bio, photo_url "
+        "FROM people ORDER BY id;";
+    const char *links_sql =
+        "WITH couples AS (SELECT DISTINCT fam_a, fam_b FROM temp.gedcom_families) "
+        "SELECT fam_a, 0, fam_a, fam_b FROM couples "
+        "UNION ALL SELECT fam_b, 0, fam_a, fam_b FROM couples WHERE fam_b > 0 "
+        "UNION ALL SELECT child, 1, fam_a, fam_b FROM temp.gedcom_families WHERE child > 0 "
+        "ORDER BY 1, 2, 3, 4;";
+
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    rc = sqlite3_prepare_v2(db, links_sql, -1, &links, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(stmt);
+        return 1;
+    }
+    int links_rc = sqlite3_step(links);
+
+    *count = 0;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *first_name = (const char*)sqlite3_column_text(stmt, 1);
+        const char *last_name = (const char*)sqlite3_column_text(stmt, 2);
+        const char *gender = (const char*)sqlite3_column_text(stmt, 3);
+        const char *birth_date = (const char*)sqlite3_column_text(stmt, 4);
+        const char *death_date = (const char*)sqlite3_column_text(stmt, 5);
+        const char *bio = (const char*)sqlite3_column_text(stmt, 6);
+        const char *photo_url = (const char*)sqlite3_column_text(stmt, 7);
+
+        fprintf(out, "0 @I%d@ INDI\n", sqlite3_column_int(stmt, 0));
+        char *name = sqlite3_mprintf("%s /%s/", first_name ? first_name : "", last_name ? last_name : "");
+        write_gedcom_value(out, 1, "NAME", name ? name : "//");
+        sqlite3_free(name);
+        if (first_name && *first_name) write_gedcom_value(out, 2, "GIVN", first_name);
+        if (last_name && *last_name) write_gedcom_value(out, 2, "SURN", last_name);
+        if (gender && (*gender == 'M' || *gender == 'F')) fprintf(out, "1 SEX %c\n", *gender);
+
+        if (birth_date && *birth_date) {
+            fputs("1 BIRT\n", out);
+            write_gedcom_date(out, 2, birth_date);
+        }
+        if (death_date && *death_date) {
+            fputs("1 DEAT\n", out);
+            write_gedcom_date(out, 2, death_date);
+        }
+        if (bio && *bio) write_gedcom_text(out, 1, "NOTE", bio);
+        if (photo_url && *photo_url) {
+            fputs("1 OBJE\n", out);
+            write_gedcom_value(out, 2, "FILE", photo_url);
+        }
+
+        // Families this person heads (FAMS) come before the ones they are a child in (FAMC)
+        int id = sqlite3_column_int(stmt, 0);
+        while (links_rc == SQLITE_ROW && sqlite3_column_int(links, 0) < id) links_rc = sqlite3_step(links);
+        while (links_rc == SQLITE_ROW && sqlite3_column_int(links, 0) == id) {
+            fprintf(out, "1 %s @F%d_%d@\n", sqlite3_column_int(links, 1) ? "FAMC" : "FAMS",
+                    sqlite3_column_int(links, 2), sqlite3_column_int(links, 3));
+            links_rc = sqlite3_step(links);
+        }
+        (*count)++;
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(links);
+    if (rc != SQLITE_DONE || (links_rc != SQLITE_ROW && links_rc != SQLITE_DONE)) {
+        fprintf(stderr, "Failed to read people: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * The family rows sorted on the couple key, which makes every family a
+ * contiguous run, so only the current family is held in memory. The temp
+ * table and SQLite's sorter spill to temp files, keeping the export
+ * bounded.
+ */
+static int export_gedcom_families(sqlite3 *db, FILE *out, int *count) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT f.fam_a, f.fam_b, f.child, f.marriage_date, f.divorce_date, "
+        "       pa.gender, pb.gender "
+        "FROM temp.gedcom_families f "
+        "LEFT JOIN people pa ON pa.id = f.fam_a "
+        "LEFT JOIN people pb ON pb.id = f.fam_b "
+        "ORDER BY f.fam_a, f.fam_b, f.child;";
+
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+    if (rc != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int current_a = -1, current_b = -1;
+    *count = 0;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int fam_a = sqlite3_column_int(stmt, 0);
+        int fam_b = sqlite3_column_int(stmt, 1);
+        int child = sqlite3_column_int(stmt, 2);
+
+        if (fam_a != current_a || fam_b != current_b) {
+            current_a = fam_a;
+            current_b = fam_b;
+            (*count)++;
+
+            fprintf(out, "0 @F%d_%d@ FAM\n", fam_a, fam_b);
+
+            const char *gender_a = (const char*)sqlite3_column_text(stmt, 5);
+            const char *gender_b = (const char*)sqlite3_column_text(stmt, 6);
+
+            // Put the male partner in HUSB when genders allow, otherwise keep key order
+            int a_is_wife = (gender_a && *gender_a == 'F') || (gender_b && *gender_b == 'M');
+            if (fam_a > 0) fprintf(out, "1 %s @I%d@\n", a_is_wife ? "WIFE" : "HUSB", fam_a);
+            if (fam_b > 0) fprintf(out, "1 %s @I%d@\n", a_is_wife ? "HUSB" : "WIFE", fam_b);
+        }
+
+        if (child > 0) {
+            fprintf(out, "1 CHIL @I%d@\n", child);
+        } else {
+            const char *marriage_date = (const char*)sqlite3_column_text(stmt, 3);
+            const char *divorce_date = (const char*)sqlite3_column_text(stmt, 4);
+
+            if (marriage_date && *marriage_date) {
+                fputs("1 MARR\n", out);
+                write_gedcom_date(out, 2, marriage_date);
+            }
+            if (divorce_date && *divorce_date) {
+                fputs("1 DIV\n", out);
+                write_gedcom_date(out, 2, divorce_date);
+            }
+        }
+    }
+
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to read relationships: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    return 0;
+}
+
+int export_gedcom(sqlite3 *db, const char *path) {
+    static char buffer[GEDCOM_BUFFER_SIZE];
+    int to_stdout = (!path || strcmp(path, "-") == 0);
+
+    FILE *out = to_stdout ? stdout : fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "Cannot open %s for writing\n", path);
+        return 1;
+    }
+    setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+    clock_t start = clock();
+    int people_count = 0, family_count = 0;
+
+    // One read transaction so both scans see the same snapshot
+    sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+
+    char *error_msg = NULL;
+    int rc = sqlite3_exec(db, "CREATE TEMP TABLE gedcom_families AS " GEDCOM_FAMILY_ROWS ";",
+                          NULL, NULL, &error_msg) != SQLITE_OK;
+    if (rc) {
+        fprintf(stderr, "Failed to group families: %s\n", error_msg);
+        sqlite3_free(error_msg);
+    }
+
+    write_gedcom_header(out);
+    if (rc == 0) {
+        rc = export_gedcom_people(db, out, &people_count);
+    }
+    if (rc == 0) {
+        rc = export_gedcom_families(db, out, &family_count);
+    }
+    fputs("0 TRLR\n", out);
+
+    sqlite3_exec(db, "DROP TABLE IF EXISTS temp.gedcom_families;", NULL, NULL, NULL);
+    sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+
+    if (fflush(out) != 0 || (!to_stdout && fclose(out) != 0)) {
+        fprintf(stderr, "Failed to write GEDCOM output\n");
+        rc = 1;
+    }
+
+    fprintf(stderr, "Exported %d people and %d families in %.2f s\n",
+            people_count, family_count, (double)(clock() - start) / CLOCKS_PER_SEC);
+    return rc;
+}
@@ -0,0 +1,628 @@
+/* gen_tree.c - Synthetic genealogy generator for family tree benchmarks */
+
+#include "family_tree.h"
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Writes a seeded, reproducible population straight into the project
+ * schema. Founders marry, have children and die; later generations pair
+ * up mostly with each other plus married-in spouses from outside the
+ * tree. Some marriages end in divorce and some people remarry once the
+ * first marriage has ended, and a small share of couples are first
+ * cousins, which collapses the pedigree. Surnames and given names follow
+ * a Zipf-like distribution and pass down the father's line.
+ *
+ * Nobody marries, divorces or has a child after their death or after
+ * GEN_CURRENT_YEAR. The summary re-checks the written tree for records
+ * that break this and fails if it finds any.
+ *
+ * Usage: gen_tree -n people [-g generations] [-s seed] [-o database]
+ */
+
+#define GEN_DEFAULT_PEOPLE 1000
+#define GEN_DEFAULT_GENERATIONS 8
+#define GEN_DEFAULT_SEED 1
+#define GEN_COMMIT_EVERY 100000
+#define GEN_CURRENT_YEAR 2025
+#define GEN_ADULT_AGE 18
+#define GEN_GENERATION_YEARS 36 // Founders are born this far back per generation, so the last can still marry
+
+// Rates per couple or person
+#define GEN_MARRIAGE_RATE 0.85
+#define GEN_MARRIED_IN_RATE 0.35
+#define GEN_COUSIN_RATE 0.03
+#define GEN_DIVORCE_RATE 0.12
+#define GEN_REMARRIAGE_RATE 0.5
+#define GEN_GROWTH 1.25
+
+static const char *surnames[] = {
+    "Smith", "Johnson", "Williams", "Brown", "Jones", "Miller", "Davis", "Wilson", "Anderson", "Taylor",
+    "Thomas", "Moore", "Martin", "Jackson", "Thompson", "White", "Harris", "Clark", "Lewis", "Robinson",
+    "Walker", "Young", "Allen", "King", "Wright", "Scott", "Hill", "Green", "Adams", "Baker",
+    "Nelson", "Carter", "Mitchell", "Roberts", "Turner", "Phillips", "Campbell", "Parker", "Evans", "Edwards",
+    "Collins", "Stewart", "Morris", "Murphy", "Cook", "Rogers", "Morgan", "Cooper", "Peterson", "Reed",
+    "Bailey", "Bell", "Kelly", "Howard", "Ward", "Cox", "Richardson", "Wood", "Watson", "Brooks",
+    "Bennett", "Gray", "Hughes", "Price", "Sanders", "Myers", "Long", "Ross", "Foster", "Powell",
+    "Jenkins", "Perry", "Russell", "Sullivan", "Fisher", "Hayes", "Graham", "Wallace", "Ellis", "Hamilton",
+    "Mwangi", "Otieno", "Kamau", "Wanjiru", "Ochieng", "Njoroge", "Kiprop", "Achieng", "Mutua", "Odhiambo"
+};
+
+static const char *male_names[] = {
+    "John", "William", "James", "George", "Charles", "Thomas", "Joseph", "Henry", "Robert", "Edward",
+    "Samuel", "David", "Peter", "Daniel", "Michael", "Richard", "Francis", "Walter", "Arthur", "Albert",
+    "Frederick", "Harry", "Paul", "Stephen", "Mark", "Brian", "Kevin", "Terence", "Anthony", "Hugh",
+    "Andrew", "Patrick", "Kennedy", "Collins", "Dennis", "Victor", "Moses", "Isaac", "Simon", "Eric"
+};
+
+static const char *female_names[] = {
+    "Mary", "Elizabeth", "Margaret", "Sarah", "Anna", "Emma", "Alice", "Jane", "Catherine", "Ellen",
+    "Grace", "Ruth", "Rose", "Florence", "Ida", "Clara", "Edith", "Helen", "Lucy", "Martha",
+    "Susan", "Agnes", "Esther", "Joyce", "Faith", "Mercy", "Nancy", "Ann", "Lilian", "Dorothy",
+    "Wanjiku", "Akinyi", "Njeri", "Atieno", "Wambui", "Nyambura", "Chebet", "Jepkosgei", "Naliaka", "Auma"
+};
+
+#define COUNT(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+typedef struct {
+    int id;
+    int father;
+    int grandfather;    // Father's father, to find first cousins
+    short birth_year;
+    short death_year;   // 0 while alive
+    short surname;
+    char gender;
+} GenPerson;
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *person_stmt;
+    sqlite3_stmt *relationship_stmt;
+    uint64_t rng;
+    int next_id;
+    int target;
+    long relationships;
+    long marriages;
+    long divorces;
+    long cousin_marriages;
+    long pending;
+    time_t now;
+} Generator;
+
+// splitmix64: small, fast and reproducible across platforms
+static uint64_t gen_next(Generator *gen) {
+    uint64_t z = (gen->rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double gen_uniform(Generator *gen) {
+    return (gen_next(gen) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int gen_range(Generator *gen, int lo, int hi) {
+    return lo + (int)(gen_uniform(gen) * (hi - lo + 1));
+}
+
+static double gen_normal(Generator *gen, double mean, double sd) {
+    // Irwin-Hall approximation; plenty for ages and gaps
+    double sum = 0;
+    for (int i = 0; i < 12; i++) sum += gen_uniform(gen);
+    return mean + (sum - 6.0) * sd;
+}
+
+static int gen_poisson(Generator *gen, double mean) {
+    double limit = exp(-mean), product = gen_uniform(gen);
+    int k = 0;
+    while (product > limit && k < 20) {
+        product *= gen_uniform(gen);
+        k++;
+    }
+    return k;
+}
+
+// Zipf-like pick: index i has weight 1/(i+1)
+static int gen_zipf(Generator *gen, int n) {
+    double harmonic = 0;
+    for (int i = 0; i < n; i++) harmonic += 1.0 / (i + 1);
+    double target = gen_uniform(gen) * harmonic;
+    for (int i = 0; i < n; i++) {
+        target -= 1.0 / (i + 1);
+        if (target <= 0) return i;
+    }
+    return n - 1;
+}
+
+static void gen_date(Generator *gen, char *buffer, size_t size, int year) {
+    snprintf(buffer, size, "%04d-%02d-%02d", year, gen_range(gen, 1, 12), gen_range(gen, 1, 28));
+}
+
+static int gen_checkpoint(Generator *gen) {
+    if (++gen->pending < GEN_COMMIT_EVERY) return 0;
+    gen->pending = 0;
+    return sqlite3_exec(gen->db, "COMMIT; BEGIN;", NULL, NULL, NULL) != SQLITE_OK;
+}
+
+static int gen_insert_person(Generator *gen, GenPerson *person, int min_age) {
+    char birth[16], death[16];
+    const char *first = person->gender == 'M'
+        ? male_names[gen_zipf(gen, COUNT(male_names))]
+        : female_names[gen_zipf(gen, COUNT(female_names))];
+
+    gen_date(gen, birth, sizeof(birth), person->birth_year);
+
+    // Lifespan: some infant mortality, otherwise roughly normal around 70; redrawn below min_age
+    int lifespan;
+    do {
+        lifespan = gen_uniform(gen) < 0.05 ? gen_range(gen, 0, 4) : (int)gen_normal(gen, 70, 14);
+    } while (lifespan < min_age);
+    if (lifespan < 0) lifespan = 0;
+    person->death_year = person->birth_year + lifespan <= GEN_CURRENT_YEAR ? person->birth_year + lifespan : 0;
+    if (person->death_year) gen_date(gen, death, sizeof(death), person->death_year);
+
+    sqlite3_stmt *stmt = gen->person_stmt;
+    sqlite3_bind_int(stmt, 1, person->id);
+    sqlite3_bind_text(stmt, 2, first, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, surnames[person->surname], -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, &person->gender, 1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, birth, -1, SQLITE_TRANSIENT);
+    if (person->death_year) {
+        sqlite3_bind_text(stmt, 6, death, -1, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(stmt, 6);
+    }
+    sqlite3_bind_int64(stmt, 7, gen->now);
+    sqlite3_bind_int64(stmt, 8, gen->now);
+    bind_date_day(stmt, 9, birth);
+    bind_date_day(stmt, 11, person->death_year ? death : NULL);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to insert person: %s\n", sqlite3_errmsg(gen->db));
+        return 1;
+    }
+    return gen_checkpoint(gen);
+}
+
+static int gen_insert_relationship(Generator *gen, int person1_id, int person2_id, const char *type,
+                                   const char *marriage_date, const char *divorce_date) {
+    sqlite3_stmt *stmt = gen->relationship_stmt;
+    sqlite3_bind_int(stmt, 1, person1_id);
+    sqlite3_bind_int(stmt, 2, person2_id);
+    sqlite3_bind_text(stmt, 3, type, -1, SQLITE_STATIC);
+    if (marriage_date) {
+        sqlite3_bind_text(stmt, 4, marriage_date, -1, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(stmt, 4);
+    }
+    if (divorce_date) {
+        sqlite3_bind_text(stmt, 5, divorce_date, -1, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(stmt, 5);
+    }
+    sqlite3_bind_int64(stmt, 6, gen->now);
+    sqlite3_bind_int64(stmt, 7, gen->now);
+    bind_date_day(stmt, 8, marriage_date);
+    bind_date_day(stmt, 10, divorce_date);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to insert relationship: %s\n", sqlite3_errmsg(gen->db));
+        return 1;
+    }
+    gen->relationships++;
+    return gen_checkpoint(gen);
+}
+
+// A person from outside the tree: no parents, random surname, and old enough to marry by now
+static int gen_new_person(Generator *gen, GenPerson *person, char gender, int birth_year) {
+    if (birth_year > GEN_CURRENT_YEAR - GEN_ADULT_AGE) birth_year = GEN_CURRENT_YEAR - GEN_ADULT_AGE;
+    person->id = gen->next_id++;
+    person->father = 0;
+    person->grandfather = 0;
+    person->gender = gender;
+    person->birth_year = birth_year;
+    person->surname = gen_zipf(gen, COUNT(surnames));
+    return gen_insert_person(gen, person, GEN_ADULT_AGE);
+}
+
+// The last year a couple can marry or divorce in: before either dies, and not after GEN_CURRENT_YEAR
+static int gen_last_married_year(const GenPerson *husband, const GenPerson *wife) {
+    int last = GEN_CURRENT_YEAR;
+    if (husband->death_year && husband->death_year - 1 < last) last = husband->death_year - 1;
+    if (wife->death_year && wife->death_year - 1 < last) last = wife->death_year - 1;
+    return last;
+}
+
+// Whether someone in the tree lives to marry before GEN_CURRENT_YEAR
+static int gen_can_marry(const GenPerson *person) {
+    int adult = person->birth_year + GEN_ADULT_AGE;
+    return adult <= GEN_CURRENT_YEAR && (!person->death_year || adult < person->death_year);
+}
+
+/*
+ * Marry a couple, no earlier than earliest, and give them children in
+ * the next generation. children_mean is tuned by the caller to hit the
+ * size target. *ended gets the year the marriage ended (divorce or the
+ * first death), 0 if it lasts, and -1 if the couple cannot marry at all
+ * (one of them dies first, or they would only be of age after
+ * GEN_CURRENT_YEAR), in which case nothing is written.
+ */
+static int gen_family(Generator *gen, GenPerson *husband, GenPerson *wife, int earliest, double children_mean,
+                      GenPerson *next, int *next_count, int next_capacity, int *ended) {
+    char marriage[16], divorce[16];
+    int younger = husband->birth_year > wife->birth_year ? husband->birth_year : wife->birth_year;
+    int first_year = younger + GEN_ADULT_AGE > earliest ? younger + GEN_ADULT_AGE : earliest;
+    int last_year = gen_last_married_year(husband, wife);
+    *ended = -1;
+    if (first_year > last_year) return 0;
+
+    int marriage_year = younger + gen_range(gen, GEN_ADULT_AGE, 32);
+    if (marriage_year < first_year) marriage_year = first_year;
+    if (marriage_year > last_year) marriage_year = last_year;
+    gen_date(gen, marriage, sizeof(marriage), marriage_year);
+
+    // A divorce that would fall after a death or after GEN_CURRENT_YEAR does not happen
+    int divorce_year = marriage_year + gen_range(gen, 2, 20);
+    int divorced = gen_uniform(gen) < GEN_DIVORCE_RATE && divorce_year <= last_year;
+    if (divorced) {
+        gen_date(gen, divorce, sizeof(divorce), divorce_year);
+        gen->divorces++;
+    }
+
+    if (gen_insert_relationship(gen, husband->id, wife->id, "spouse", marriage, divorced ? divorce : NULL)) {
+        return 1;
+    }
+    gen->marriages++;
+    *ended = divorced ? divorce_year : 0;
+    if (!divorced && husband->death_year) *ended = husband->death_year;
+    if (!divorced && wife->death_year && (!*ended || wife->death_year < *ended)) *ended = wife->death_year;
+
+    // Children come while the marriage lasts; the father's death year is allowed, the mother's is not
+    int born_by = divorced ? divorce_year : marriage_year + 20;
+    if (born_by > GEN_CURRENT_YEAR) born_by = GEN_CURRENT_YEAR;
+    if (husband->death_year && born_by > husband->death_year) born_by = husband->death_year;
+    if (wife->death_year && born_by > wife->death_year - 1) born_by = wife->death_year - 1;
+    if (born_by < marriage_year + 1) return 0;
+
+    int children = gen_poisson(gen, children_mean);
+    for (int i = 0; i < children && *next_count < next_capacity && gen->next_id <= gen->target; i++) {
+        GenPerson *child = &next[(*next_count)++];
+        child->id = gen->next_id++;
+        child->father = husband->id;
+        child->grandfather = husband->father;
+        child->gender = gen_uniform(gen) < 0.5 ? 'M' : 'F';
+        child->surname = husband->surname;
+        child->birth_year = gen_range(gen, marriage_year + 1, born_by);
+
+        if (gen_insert_person(gen, child, 0) ||
+            gen_insert_relationship(gen, husband->id, child->id, "parent-child", NULL, NULL) ||
+            gen_insert_relationship(gen, wife->id, child->id, "parent-child", NULL, NULL)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int gen_compare_grandfather(const void *a, const void *b) {
+    const GenPerson *x = a, *y = b;
+    if (x->grandfather != y->grandfather) return x->grandfather < y->grandfather ? -1 : 1;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int gen_generation(Generator *gen, GenPerson *current, int count, GenPerson *next, int *next_count,
+                          int next_capacity, int next_target) {
+    *next_count = 0;
+
+    // First cousins share a paternal grandfather; sorting groups them together
+    qsort(current, count, sizeof(GenPerson), gen_compare_grandfather);
+
+    char *married = calloc(count, 1);
+    int *men = malloc(sizeof(int) * (count + 1));
+    int *women = malloc(sizeof(int) * (count + 1));
+    if (!married || !men || !women) {
+        free(married);
+        free(men);
+        free(women);
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    // Expected couples decide how many children each needs on average
+    double expected_couples = count * GEN_MARRIAGE_RATE * (1.0 + GEN_MARRIED_IN_RATE) / 2.0;
+    double children_mean = expected_couples > 0 ? next_target / expected_couples : 0;
+    if (children_mean > 8) children_mean = 8;
+
+    int rc = 0;
+
+    // Cousin marriages among neighbours in grandfather order
+    for (int i = 0; i + 1 < count && rc == 0 && gen->next_id <= gen->target; i++) {
+        GenPerson *a = &current[i], *b = &current[i + 1];
+        if (a->grandfather == 0 || a->grandfather != b->grandfather || a->father == b->father) continue;
+        if (a->gender == b->gender || married[i] || married[i + 1] || !gen_can_marry(a) || !gen_can_marry(b)) continue;
+        if (gen_uniform(gen) >= GEN_COUSIN_RATE * 4) continue;
+
+        GenPerson *husband = a->gender == 'M' ? a : b;
+        GenPerson *wife = a->gender == 'M' ? b : a;
+        int ended;
+        rc = gen_family(gen, husband, wife, 0, children_mean, next, next_count, next_capacity, &ended);
+        if (ended < 0) continue;
+        married[i] = married[i + 1] = 1;
+        gen->cousin_marriages++;
+    }
+
+    // Everyone else: shuffle singles by sex, pair within the tree or with a married-in spouse
+    int man_count = 0, woman_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (married[i] || !gen_can_marry(&current[i]) || gen_uniform(gen) >= GEN_MARRIAGE_RATE) continue;
+        if (current[i].gender == 'M') {
+            men[man_count++] = i;
+        } else {
+            women[woman_count++] = i;
+        }
+    }
+    for (int i = man_count - 1; i > 0; i--) {
+        int j = gen_range(gen, 0, i), swap = men[i];
+        men[i] = men[j];
+        men[j] = swap;
+    }
+
+    int w = 0;
+    for (int m = 0; m < man_count && rc == 0 && gen->next_id <= gen->target; m++) {
+        GenPerson *husband = &current[men[m]];
+        GenPerson outsider, *wife;
+
+        if (w < woman_count && gen_uniform(gen) >= GEN_MARRIED_IN_RATE) {
+            wife = &current[women[w++]];
+        } else {
+            rc = gen_new_person(gen, &outsider, 'F', husband->birth_year + gen_range(gen, -6, 4));
+            wife = &outsider;
+        }
+        int ended = -1;
+        if (rc == 0) rc = gen_family(gen, husband, wife, 0, children_mean, next, next_count, next_capacity, &ended);
+
+        // Remarriage once divorced or widowed, if he outlives the first marriage
+        int widowed_or_divorced = ended > 0 && (!husband->death_year || ended < husband->death_year);
+        if (rc == 0 && widowed_or_divorced && ended < GEN_CURRENT_YEAR && gen->next_id <= gen->target &&
+            gen_uniform(gen) < GEN_DIVORCE_RATE * GEN_REMARRIAGE_RATE) {
+            GenPerson second;
+            rc = gen_new_person(gen, &second, 'F', husband->birth_year + gen_range(gen, -2, 12));
+            if (rc == 0) {
+                rc = gen_family(gen, husband, &second, ended + 1, children_mean / 2, next, next_count, next_capacity,
+                                &ended);
+            }
+        }
+    }
+
+    // Women left over marry in from outside
+    for (; w < woman_count && rc == 0 && gen->next_id <= gen->target; w++) {
+        GenPerson outsider;
+        GenPerson *wife = &current[women[w]];
+        int ended;
+        rc = gen_new_person(gen, &outsider, 'M', wife->birth_year + gen_range(gen, -4, 6));
+        if (rc == 0) rc = gen_family(gen, &outsider, wife, 0, children_mean, next, next_count, next_capacity, &ended);
+    }
+
+    free(married);
+    free(men);
+    free(women);
+    return rc;
+}
+
+static int gen_prepare(Generator *gen) {
+    const char *person_sql =
+        "INSERT INTO people (id, first_name, last_name, gender, birth_date, death_date, created_at, updated_at, "
+        "birth_day, birth_precision, death_day, death_precision) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    const char *relationship_sql =
+        "INSERT INTO relationships (person1_id, person2_id, relationship_type, marriage_date, divorce_date, created_at, updated_at, "
+        "marriage_day, marriage_precision, divorce_day, divorce_precision) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+
+    if (sqlite3_prepare_v2(gen->db, person_sql, -1, &gen->person_stmt, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(gen->db, relationship_sql, -1, &gen->relationship_stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(gen->db));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Records the generator must never write, counted from the database
+ * rather than trusted: ?1 is the last day of GEN_CURRENT_YEAR. A marriage
+ * ends at its divorce or at the first partner's death.
+ */
+static const struct {
+    const char *name;
+    const char *sql;
+} gen_checks[] = {
+    { "births after the current year",
+      "SELECT COUNT(*) FROM people WHERE birth_day > ?1;" },
+    { "marriages after the current year",
+      "SELECT COUNT(*) FROM relationships WHERE relationship_type = 'spouse' AND marriage_day > ?1;" },
+    { "marriages after a partner's death",
+      "SELECT COUNT(*) FROM relationships r JOIN people a ON a.id = r.person1_id JOIN people b ON b.id = r.person2_id "
+      "WHERE r.relationship_type = 'spouse' AND (r.marriage_day > a.death_day OR r.marriage_day > b.death_day);" },
+    { "children born over a year after a parent died",
+      "SELECT COUNT(*) FROM relationships r JOIN people p ON p.id = r.person1_id JOIN people c ON c.id = r.person2_id "
+      "WHERE r.relationship_type = 'parent-child' AND c.birth_day > p.death_day + 365;" },
+    { "people married twice at once",
+      "WITH marriages AS ("
+      "  SELECT r.id, r.person1_id AS husband, r.person2_id AS wife, r.marriage_day AS start, "
+      "         COALESCE(r.divorce_day, MIN(COALESCE(a.death_day, 1e9), COALESCE(b.death_day, 1e9))) AS finish "
+      "  FROM relationships r JOIN people a ON a.id = r.person1_id JOIN people b ON b.id = r.person2_id "
+      "  WHERE r.relationship_type = 'spouse'"
+      "), spans AS MATERIALIZED ("
+      "  SELECT id, husband AS person, start, finish FROM marriages "
+      "  UNION ALL SELECT id, wife, start, finish FROM marriages"
+      ") SELECT COUNT(DISTINCT x.person) FROM spans x JOIN spans y "
+      "ON y.person = x.person AND y.id > x.id AND y.start < x.finish AND x.start < y.finish;" },
+};
+
+static long gen_check(sqlite3 *db) {
+    int last_day, precision;
+    char last_date[16];
+    snprintf(last_date, sizeof(last_date), "%d-12-31", GEN_CURRENT_YEAR);
+    parse_date(last_date, &last_day, &precision);
+
+    long total = 0;
+    for (int i = 0; i < COUNT(gen_checks); i++) {
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, gen_checks[i].sql, -1, &stmt, NULL) != SQLITE_OK) {
+            fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+            return -1;
+        }
+        sqlite3_bind_int(stmt, 1, last_day);
+        long count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : -1;
+        sqlite3_finalize(stmt);
+        if (count < 0) return -1;
+        if (count > 0) fprintf(stderr, "  %ld %s\n", count, gen_checks[i].name);
+        total += count;
+    }
+    return total;
+}
+
+static void gen_usage(const char *program) {
+    fprintf(stderr, "Usage: %s -n people [-g generations] [-s seed] [-o database]\n", program);
+    fprintf(stderr, "Typical benchmark sizes: -n 1000, -n 100000, -n 10000000\n");
+}
+
+int main(int argc, char *argv[]) {
+    int people = GEN_DEFAULT_PEOPLE;
+    int generations = GEN_DEFAULT_GENERATIONS;
+    unsigned long long seed = GEN_DEFAULT_SEED;
+    const char *path = "family_tree.db";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:s:o:h")) != -1) {
+        switch (opt) {
+            case 'n': people = atoi(optarg); break;
+            case 'g': generations = atoi(optarg); break;
+            case 's': seed = strtoull(optarg, NULL, 10); break;
+            case 'o': path = optarg; break;
+            default:
+                gen_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (people < 2 || generations < 1) {
+        gen_usage(argv[0]);
+        return 1;
+    }
+
+    Generator gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.rng = seed;
+    gen.target = people;
+    gen.now = time(NULL);
+
+    if (sqlite3_open(path, &gen.db) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(gen.db));
+        sqlite3_close(gen.db);
+        return 1;
+    }
+    if (create_tables(gen.db) != 0) {
+        sqlite3_close(gen.db);
+        return 1;
+    }
+
+    sqlite3_stmt *stmt;
+    int existing = 0;
+    if (sqlite3_prepare_v2(gen.db, "SELECT COUNT(*) FROM people;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) existing = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (existing > 0) {
+        fprintf(stderr, "%s already has %d people; generate into an empty database\n", path, existing);
+        sqlite3_close(gen.db);
+        return 1;
+    }
+
+    // Bulk-load settings: the file is disposable until generation finishes
+    sqlite3_exec(gen.db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF; PRAGMA cache_size = -262144;",
+                 NULL, NULL, NULL);
+    if (gen_prepare(&gen)) {
+        sqlite3_close(gen.db);
+        return 1;
+    }
+
+    // Generation sizes grow geometrically; founders are sized so the total reaches the target
+    double weight = 0;
+    for (int g = 0; g < generations; g++) weight += pow(GEN_GROWTH, g);
+    int founders = (int)(people / weight);
+    if (founders < 2) founders = 2;
+
+    int capacity = people + 1;
+    GenPerson *current = malloc(sizeof(GenPerson) * capacity);
+    GenPerson *next = malloc(sizeof(GenPerson) * capacity);
+    if (!current || !next) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(current);
+        free(next);
+        sqlite3_close(gen.db);
+        return 1;
+    }
+
+    clock_t start = clock();
+    gen.next_id = 1;
+    sqlite3_exec(gen.db, "BEGIN;", NULL, NULL, NULL);
+
+    int rc = 0;
+    int count = 0;
+    int base_year = GEN_CURRENT_YEAR - GEN_GENERATION_YEARS * generations - 20;
+    for (int i = 0; i < founders && rc == 0; i++) {
+        rc = gen_new_person(&gen, &current[count], (i % 2) ? 'F' : 'M', base_year + gen_range(&gen, -10, 10));
+        count++;
+    }
+
+    for (int g = 1; g < generations && rc == 0 && gen.next_id <= people && count > 0; g++) {
+        int next_count = 0;
+        int next_target = (int)(founders * pow(GEN_GROWTH, g));
+        rc = gen_generation(&gen, current, count, next, &next_count, capacity, next_target);
+
+        fprintf(stderr, "generation %d: %d born, %d people so far\n", g, next_count, gen.next_id - 1);
+        GenPerson *swap = current;
+        current = next;
+        next = swap;
+        count = next_count;
+    }
+
+    // Top up with married-in spouses of the last generation if the tree fell short
+    while (rc == 0 && gen.next_id <= people && count > 0) {
+        int next_count = 0;
+        rc = gen_generation(&gen, current, count, next, &next_count, capacity, people - gen.next_id + 1);
+        GenPerson *swap = current;
+        current = next;
+        next = swap;
+        if (next_count == 0) break;
+        count = next_count;
+    }
+
+    sqlite3_exec(gen.db, rc == 0 ? "COMMIT;" : "ROLLBACK;", NULL, NULL, NULL);
+    sqlite3_finalize(gen.person_stmt);
+    sqlite3_finalize(gen.relationship_stmt);
+
+    long violations = rc == 0 ? gen_check(gen.db) : 0;
+    if (violations < 0) {
+        fprintf(stderr, "Could not check the generated tree\n");
+        rc = 1;
+    } else if (violations > 0) {
+        fprintf(stderr, "Generated tree has %ld impossible records\n", violations);
+        rc = 1;
+    }
+    sqlite3_close(gen.db);
+    free(current);
+    free(next);
+
+    if (rc == 0) {
+        fprintf(stderr, "Generated %d people, %ld relationships (%ld marriages, %ld divorces, %ld cousin marriages) "
+                        "into %s in %.1f s (seed %llu)\n",
+                gen.next_id - 1, gen.relationships, gen.marriages, gen.divorces, gen.cousin_marriages,
+                path, (double)(clock() - start) / CLOCKS_PER_SEC, seed);
+    }
+    return rc;
+}
@@ -0,0 +1,463 @@
+/* http_server.c - Built-in HTTP/1.1 server with streamed responses */
+
+#define _GNU_SOURCE
+#include "family_tree.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * family_tree.cgi serve [port] [max_children] answers HTTP itself instead
+ * of running behind a web server. Each connection is handled by a forked
+ * child that runs the ordinary CGI code path: the request line and headers
+ * become CGI environment variables, stdin reads the request body from the
+ * socket, and stdout is swapped for a stream that turns the CGI header
+ * block into an HTTP/1.1 response head and sends the body with chunked
+ * transfer encoding. Responses that carry a Content-Length (stored photos)
+ * go out unchunked, and the socket is also the process's standard output
+ * so their sendfile path still applies.
+ *
+ * Long pages call output_stream_flush() once a useful prefix is rendered,
+ * so the shell and controls reach the client before the slow part of the
+ * page. Writes to the socket block, which is the backpressure: a slow
+ * client stalls the renderer rather than letting output pile up, and a
+ * response never holds more than HTTP_STREAM_BUFFER bytes of body (plus
+ * the deflate window when compressing).
+ */
+
+typedef struct {
+    int fd;
+    int http11;             // Client understands chunked responses
+    int head_only;          // HEAD request: send the response head, drop the body
+    int head_done;
+    int chunked;
+    int discard_body;
+    int line_length;
+    char head[HTTP_MAX_HEAD];
+    size_t head_len;
+} HttpResponse;
+
+typedef struct {
+    int fd;
+    const char *pending;    // Body bytes that arrived with the request head
+    size_t pending_len;
+} HttpRequestBody;
+
+static volatile sig_atomic_t server_stop;
+static int streaming = 0;
+static double last_stream_flush = 0;
+
+static void stop_server(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+// Only interrupts accept, so finished children are reaped promptly
+static void child_exited(int sig) {
+    (void)sig;
+}
+
+/* Response */
+
+static int send_all(int fd, const char *data, size_t len) {
+    struct iovec iov = { (void *)data, len };
+    return writev_all(fd, &iov, 1);
+}
+
+// Turn the CGI header block into a status line and CRLF-terminated fields
+static int send_response_head(HttpResponse *out) {
+    char fields[HTTP_MAX_HEAD + 128];
+    size_t len = 0;
+    int status = 200, has_length = 0, has_location = 0;
+    char reason[64] = "OK";
+
+    out->head[out->head_len] = '\0';
+    for (char *line = out->head; *line; ) {
+        char *end = strchr(line, '\n');
+        char *next = end ? end + 1 : line + strlen(line);
+        if (!end) end = next;
+        if (end > line && end[-1] == '\r') end--;
+        *end = '\0';
+
+        if (strncasecmp(line, "Status:", 7) == 0) {
+            char *p = line + 7;
+            status = (int)strtol(p, &p, 10);
+            while (*p == ' ') p++;
+            snprintf(reason, sizeof(reason), "%s", *p ? p : http_status_text(status));
+            if (status < 100 || status > 999) status = 500;
+        } else if (*line) {
+            if (strncasecmp(line, "Content-Length:", 15) == 0) has_length = 1;
+            if (strncasecmp(line, "Location:", 9) == 0) has_location = 1;
+            len += snprintf(fields + len, sizeof(fields) - len, "%s\r\n", line);
+            if (len >= sizeof(fields)) return 1;
+        }
+        line = next;
+    }
+    if (has_location && status == 200) {
+        status = 302;
+        snprintf(reason, sizeof(reason), "Found");
+    }
+
+    out->discard_body = out->head_only || status < 200 || status == 204 || status == 304;
+    out->chunked = out->http11 && !has_length && !out->discard_body;
+
+    char status_line[128];
+    int status_len = snprintf(status_line, sizeof(status_line), "HTTP/1.1 %d %s\r\n", status, reason);
+    const char *trailer = out->chunked ? "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+                                       : "Connection: close\r\n\r\n";
+    struct iovec iov[3] = {
+        { status_line, (size_t)status_len },
+        { fields, len },
+        { (void *)trailer, strlen(trailer) },
+    };
+    out->head_done = 1;
+    return writev_all(out->fd, iov, 3);
+}
+
+static int send_body(HttpResponse *out, const char *data, size_t len) {
+    if (out->discard_body || len == 0) return 0;
+    if (!out->chunked) return send_all(out->fd, data, len);
+
+    char size_line[24];
+    int size_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    struct iovec iov[3] = {
+        { size_line, (size_t)size_len },
+        { (void *)data, len },
+        { "\r\n", 2 },
+    };
+    return writev_all(out->fd, iov, 3);
+}
+
+static ssize_t response_write(void *cookie, const char *data, size_t size) {
+    HttpResponse *out = cookie;
+    size_t done = 0;
+
+    // Collect the CGI headers up to the blank line that ends them
+    while (!out->head_done && done < size) {
+        char c = data[done++];
+        if (out->head_len + 1 >= sizeof(out->head)) return -1;
+        out->head[out->head_len++] = c;
+        if (c == '\n' && out->line_length == 0) {
+            if (send_response_head(out) != 0) return -1;
+        } else {
+            out->line_length = c == '\n' ? 0 : c == '\r' ? out->line_length : out->line_length + 1;
+        }
+    }
+
+    if (done < size && send_body(out, data + done, size - done) != 0) return -1;
+    return (ssize_t)size;
+}
+
+static int response_close(void *cookie) {
+    HttpResponse *out = cookie;
+    int rc = 0;
+
+    // A handler that never ended its headers still gets a well-formed response
+    if (!out->head_done) rc |= send_response_head(out);
+    if (out->chunked) rc |= send_all(out->fd, "0\r\n\r\n", 5);
+    return rc ? EOF : 0;
+}
+
+/* Request body */
+
+static ssize_t body_read(void *cookie, char *buffer, size_t size) {
+    HttpRequestBody *in = cookie;
+    if (in->pending_len > 0) {
+        size_t n = in->pending_len < size ? in->pending_len : size;
+        memcpy(buffer, in->pending, n);
+        in->pending += n;
+        in->pending_len -= n;
+        return (ssize_t)n;
+    }
+    for (;;) {
+        ssize_t n = read(in->fd, buffer, size);
+        if (n < 0 && errno == EINTR) continue;
+        return n;
+    }
+}
+
+/* Request head */
+
+static void send_error(int fd, int status) {
+    char response[256];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n%s\n",
+                       status, http_status_text(status), http_status_text(status));
+    send_all(fd, response, (size_t)len);
+}
+
+// Read until the blank line that ends the request head; returns 0 or an HTTP status
+static int read_request_head(int fd, char *buffer, size_t size, size_t *head_len, size_t *received) {
+    size_t len = 0;
+    for (;;) {
+        buffer[len] = '\0';
+        char *end = strstr(buffer, "\r\n\r\n");
+        if (end || (end = strstr(buffer, "\n\n"))) {
+            *head_len = end + (*end == '\r' ? 4 : 2) - buffer;
+            *received = len;
+            return 0;
+        }
+        if (len + 1 >= size) return 431;
+
+        ssize_t n = read(fd, buffer + len, size - 1 - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 408;
+        if (n <= 0 || memchr(buffer + len, '\0', n)) return 400;
+        len += n;
+    }
+}
+
+// Export one request header as its CGI variable
+static void set_header_variable(const char *name, size_t name_len, const char *value) {
+    char variable[128];
+    size_t j = 0;
+
+    if (name_len == 14 && strncasecmp(name, "Content-Length", 14) == 0) {
+        setenv("CONTENT_LENGTH", value, 1);
+        return;
+    }
+    if (name_len == 12 && strncasecmp(name, "Content-Type", 12) == 0) {
+        setenv("CONTENT_TYPE", value, 1);
+        return;
+    }
+    // Proxy is never passed on (httpoxy)
+    if (name_len == 5 && strncasecmp(name, "Proxy", 5) == 0) return;
+    if (name_len + 6 > sizeof(variable)) return;
+
+    j += snprintf(variable, sizeof(variable), "HTTP_");
+    for (size_t i = 0; i < name_len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        if (!isalnum(c) && c != '-') return;
+        variable[j++] = c == '-' ? '_' : (char)toupper(c);
+    }
+    variable[j] = '\0';
+    setenv(variable, value, 1);
+}
+
+// Parse the request head into the CGI environment; returns 0 or an HTTP status
+static int parse_request_head(char *head, HttpResponse *response, int *expect_continue) {
+    char *line_end = strchr(head, '\n');
+    *line_end = '\0';
+    if (line_end > head && line_end[-1] == '\r') line_end[-1] = '\0';
+
+    char *method = head;
+    char *target = strchr(method, ' ');
+    if (!target) return 400;
+    *target++ = '\0';
+    char *version = strchr(target, ' ');
+    if (!version) return 400;
+    *version++ = '\0';
+    if (strncmp(version, "HTTP/1.", 7) != 0) return 400;
+
+    if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0 && strcmp(method, "POST") != 0) return 501;
+    response->http11 = strcmp(version, "HTTP/1.0") != 0;
+    response->head_only = strcmp(method, "HEAD") == 0;
+
+    char *query = strchr(target, '?');
+    if (query) *query++ = '\0';
+    setenv("GATEWAY_INTERFACE", "CGI/1.1", 1);
+    setenv("SERVER_SOFTWARE", "family_tree", 1);
+    setenv("SERVER_PROTOCOL", version, 1);
+    setenv("REQUEST_METHOD", method, 1);
+    setenv("SCRIPT_NAME", "", 1);
+    setenv("PATH_INFO", target, 1);
+    setenv("QUERY_STRING", query ? query : "", 1);
+
+    int has_length = 0;
+    for (char *line = line_end + 1; *line && *line != '\r' && *line != '\n'; ) {
+        char *end = strchr(line, '\n');
+        char *next = end ? end + 1 : line + strlen(line);
+        if (end) *end = '\0';
+        if (end && end > line && end[-1] == '\r') end[-1] = '\0';
+
+        char *colon = strchr(line, ':');
+        if (!colon || colon == line) return 400;
+        char *value = colon + 1;
+        while (*value == ' ' || *value == '\t') value++;
+        size_t name_len = colon - line;
+
+        if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) return 411;
+        if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) has_length = 1;
+        if (name_len == 6 && strncasecmp(line, "Expect", 6) == 0) {
+            if (strcasecmp(value, "100-continue") != 0) return 400;
+            *expect_continue = response->http11;
+        }
+        set_header_variable(line, name_len, value);
+        line = next;
+    }
+
+    if (strcmp(method, "POST") == 0 && !has_length) return 411;
+    return 0;
+}
+
+/* Connection */
+
+static int serve_connection(int fd, const struct sockaddr_in *peer, HttpRequestHandler handler, char *program) {
+    struct timeval timeout = { HTTP_IO_TIMEOUT, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    static char head[HTTP_MAX_HEAD];
+    size_t head_len = 0, received = 0;
+    int status = read_request_head(fd, head, sizeof(head), &head_len, &received);
+    if (status != 0) {
+        send_error(fd, status);
+        return 1;
+    }
+
+    // The head is parsed in place, so keep the body bytes that followed it
+    static char body_start[HTTP_MAX_HEAD];
+    HttpRequestBody body = { fd, body_start, received - head_len };
+    memcpy(body_start, head + head_len, received - head_len);
+    head[head_len] = '\0';
+
+    static HttpResponse response;
+    memset(&response, 0, sizeof(response));
+    response.fd = fd;
+    int expect_continue = 0;
+    status = parse_request_head(head, &response, &expect_continue);
+    if (status != 0) {
+        send_error(fd, status);
+        return 1;
+    }
+
+    char address[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &peer->sin_addr, address, sizeof(address))) setenv("REMOTE_ADDR", address, 1);
+    if (expect_continue) send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+
+    // The socket stands in for the CGI's standard streams
+    dup2(fd, STDIN_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    FILE *plain_stdout = stdout;
+    FILE *request_body = fopencookie(&body, "r", (cookie_io_functions_t){ body_read, NULL, NULL, NULL });
+    FILE *response_stream = fopencookie(&response, "w", (cookie_io_functions_t){ NULL, response_write, NULL, response_close });
+    if (!request_body || !response_stream) {
+        send_error(fd, 500);
+        return 1;
+    }
+    setvbuf(response_stream, NULL, _IOFBF, HTTP_STREAM_BUFFER);
+    stdin = request_body;
+    stdout = response_stream;
+    streaming = 1;
+
+    char *argv[] = { program, NULL };
+    handler(1, argv);
+
+    // Compression may still hold the tail of the page; closing sends the last chunk
+    output_compression_finish();
+    int rc = fclose(response_stream) != 0;
+    stdout = plain_stdout;
+    streaming = 0;
+    return rc;
+}
+
+// Send what a streamed page has rendered so far, at most every HTTP_FLUSH_INTERVAL
+int output_stream_flush(void) {
+    if (!streaming) return 0;
+
+    double now = metrics_now();
+    if (last_stream_flush > 0 && now - last_stream_flush < HTTP_FLUSH_INTERVAL) return 0;
+    last_stream_flush = now;
+    return output_compression_flush();
+}
+
+/*
+ * Accept connections until SIGTERM or SIGINT, forking a child for each one
+ * and running at most max_children at a time. Each child serves a single
+ * request and closes the connection; the database handle of the caller is
+ * not used after fork, since every request opens its own as a CGI would.
+ * before_fork, if given, runs in this process ahead of every fork.
+ */
+int run_http_server(int port, int max_children, HttpRequestHandler handler, void (*before_fork)(void), char *program) {
+    if (port <= 0 || port > 65535) port = HTTP_DEFAULT_PORT;
+    if (max_children < 1) max_children = HTTP_MAX_CHILDREN;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Cannot create socket: %s\n", strerror(errno));
+        return 1;
+    }
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 128) != 0) {
+        fprintf(stderr, "Cannot listen on port %d: %s\n", port, strerror(errno));
+        close(listener);
+        return 1;
+    }
+
+    // No SA_RESTART, so a signal interrupts accept and ends the loop
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_server;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = child_exited;
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Listening on port %d\n", port);
+    fflush(NULL);
+
+    int children = 0;
+    while (!server_stop) {
+        while (children > 0 && waitpid(-1, NULL, children >= max_children ? 0 : WNOHANG) > 0) children--;
+        if (children >= max_children) continue;
+
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept(listener, (struct sockaddr *)&peer, &peer_len);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr, "Accept failed: %s\n", strerror(errno));
+                sleep(1);
+            }
+            continue;
+        }
+
+        // State the children inherit, such as preloaded indexes, is refreshed here
+        if (before_fork) before_fork();
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);
+            int rc = serve_connection(fd, &peer, handler, program);
+            shutdown(fd, SHUT_WR);
+            close(fd);
+            exit(rc);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+            send_error(fd, 500);
+        } else {
+            children++;
+        }
+        close(fd);
+    }
+
+    // Let requests in progress finish
+    close(listener);
+    while (children > 0) {
+        if (waitpid(-1, NULL, 0) > 0) {
+            children--;
+        } else if (errno != EINTR) {
+            break;
+        }
+    }
+    fprintf(stderr, "Server stopped\n");
+    return 0;
+}
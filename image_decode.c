@@ -0,0 +1,936 @@
+/* image_decode.c - PPM, PNG and baseline JPEG decoding for family tree thumbnails */
+
+#include "family_tree.h"
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * Small self-contained decoders for the formats photos arrive in. Every
+ * format decodes to 8-bit RGB; alpha is composited onto white. They are
+ * written for untrusted input: all reads are bounds-checked and images
+ * larger than IMAGE_MAX_PIXELS are refused before any pixel memory is
+ * allocated. Unsupported variants (progressive or CMYK JPEG, for example)
+ * fail with a message instead of guessing.
+ */
+
+#define IMAGE_MAX_PIXELS (40 * 1000 * 1000)
+
+static int image_fail(char *error, size_t error_size, const char *message) {
+    snprintf(error, error_size, "%s", message);
+    return 1;
+}
+
+static int image_alloc(Image *image, int width, int height, char *error, size_t error_size) {
+    if (width <= 0 || height <= 0) return image_fail(error, error_size, "invalid image dimensions");
+    if ((double)width * height > IMAGE_MAX_PIXELS) return image_fail(error, error_size, "image too large");
+    image->width = width;
+    image->height = height;
+    image->pixels = malloc((size_t)width * height * 3);
+    if (!image->pixels) return image_fail(error, error_size, "out of memory");
+    return 0;
+}
+
+void free_image(Image *image) {
+    free(image->pixels);
+    image->pixels = NULL;
+}
+
+/* PPM/PGM (P2, P3, P5, P6) */
+
+static int pnm_token(const unsigned char *data, size_t len, size_t *pos, long *value) {
+    while (*pos < len) {
+        if (data[*pos] == '#') {
+            while (*pos < len && data[*pos] != '\n') (*pos)++;
+        } else if (data[*pos] == ' ' || data[*pos] == '\t' || data[*pos] == '\r' || data[*pos] == '\n') {
+            (*pos)++;
+        } else {
+            break;
+        }
+    }
+    if (*pos >= len || data[*pos] < '0' || data[*pos] > '9') return 1;
+    *value = 0;
+    while (*pos < len && data[*pos] >= '0' && data[*pos] <= '9') {
+        *value = *value * 10 + (data[*pos] - '0');
+        if (*value > 1000000) return 1;
+        (*pos)++;
+    }
+    return 0;
+}
+
+static int decode_pnm(const unsigned char *data, size_t len, Image *image, char *error, size_t error_size) {
+    char kind = data[1];
+    int channels = (kind == '3' || kind == '6') ? 3 : 1;
+    int binary = kind == '5' || kind == '6';
+    if (kind != '2' && kind != '3' && kind != '5' && kind != '6') {
+        return image_fail(error, error_size, "unsupported PNM variant");
+    }
+
+    size_t pos = 2;
+    long width, height, maxval;
+    if (pnm_token(data, len, &pos, &width) || pnm_token(data, len, &pos, &height) ||
+        pnm_token(data, len, &pos, &maxval) || maxval < 1 || maxval > 65535) {
+        return image_fail(error, error_size, "malformed PNM header");
+    }
+    pos++;  // Single whitespace before binary samples
+
+    if (image_alloc(image, (int)width, (int)height, error, error_size)) return 1;
+
+    int sample_bytes = maxval > 255 ? 2 : 1;
+    size_t samples = (size_t)width * height * channels;
+    if (binary && (pos > len || len - pos < samples * sample_bytes)) {
+        free_image(image);
+        return image_fail(error, error_size, "truncated PNM data");
+    }
+
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        unsigned char rgb[3];
+        for (int c = 0; c < channels; c++) {
+            long sample;
+            if (binary) {
+                sample = data[pos++];
+                if (sample_bytes == 2) sample = (sample << 8) | data[pos++];
+            } else if (pnm_token(data, len, &pos, &sample)) {
+                free_image(image);
+                return image_fail(error, error_size, "truncated PNM data");
+            }
+            if (sample > maxval) sample = maxval;
+            rgb[c] = (unsigned char)(sample * 255 / maxval);
+        }
+        unsigned char *out = image->pixels + i * 3;
+        out[0] = rgb[0];
+        out[1] = channels == 3 ? rgb[1] : rgb[0];
+        out[2] = channels == 3 ? rgb[2] : rgb[0];
+    }
+    return 0;
+}
+
+/* Inflate (RFC 1951), in the canonical-Huffman style of zlib's puff */
+
+#define INFLATE_MAX_BITS 15
+
+typedef struct {
+    const unsigned char *in;
+    size_t in_len;
+    size_t in_pos;
+    uint32_t bit_buffer;
+    int bit_count;
+    unsigned char *out;
+    size_t out_len;
+    size_t out_pos;
+} Inflate;
+
+typedef struct {
+    short count[INFLATE_MAX_BITS + 1];
+    short symbol[288];
+} Huffman;
+
+static int inflate_bits(Inflate *s, int need) {
+    uint32_t value = s->bit_buffer;
+    while (s->bit_count < need) {
+        if (s->in_pos >= s->in_len) return -1;
+        value |= (uint32_t)s->in[s->in_pos++] << s->bit_count;
+        s->bit_count += 8;
+    }
+    s->bit_buffer = value >> need;
+    s->bit_count -= need;
+    return (int)(value & ((1u << need) - 1));
+}
+
+static int inflate_decode(Inflate *s, const Huffman *h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= INFLATE_MAX_BITS; len++) {
+        int bit = inflate_bits(s, 1);
+        if (bit < 0) return -1;
+        code |= bit;
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int inflate_build(Huffman *h, const short *lengths, int n) {
+    short offsets[INFLATE_MAX_BITS + 1];
+    memset(h->count, 0, sizeof(h->count));
+    for (int i = 0; i < n; i++) h->count[lengths[i]]++;
+    if (h->count[0] == n) return 0;
+
+    int left = 1;
+    for (int len = 1; len <= INFLATE_MAX_BITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return -1;   // Over-subscribed
+    }
+
+    offsets[1] = 0;
+    for (int len = 1; len < INFLATE_MAX_BITS; len++) offsets[len + 1] = offsets[len] + h->count[len];
+    for (int i = 0; i < n; i++) {
+        if (lengths[i]) h->symbol[offsets[lengths[i]]++] = (short)i;
+    }
+    return left;
+}
+
+static int inflate_codes(Inflate *s, const Huffman *lencode, const Huffman *distcode) {
+    static const short base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const short extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const short dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const short dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for (;;) {
+        int symbol = inflate_decode(s, lencode);
+        if (symbol < 0) return 1;
+        if (symbol < 256) {
+            if (s->out_pos >= s->out_len) return 1;
+            s->out[s->out_pos++] = (unsigned char)symbol;
+        } else if (symbol == 256) {
+            return 0;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) return 1;
+            int bits = inflate_bits(s, extra[symbol]);
+            if (bits < 0) return 1;
+            size_t len = base[symbol] + bits;
+
+            int dist_symbol = inflate_decode(s, distcode);
+            if (dist_symbol < 0 || dist_symbol >= 30) return 1;
+            bits = inflate_bits(s, dist_extra[dist_symbol]);
+            if (bits < 0) return 1;
+            size_t dist = dist_base[dist_symbol] + bits;
+
+            if (dist > s->out_pos || len > s->out_len - s->out_pos) return 1;
+            for (size_t i = 0; i < len; i++, s->out_pos++) s->out[s->out_pos] = s->out[s->out_pos - dist];
+        }
+    }
+}
+
+static int inflate_stored(Inflate *s) {
+    s->bit_buffer = 0;
+    s->bit_count = 0;
+    if (s->in_len - s->in_pos < 4) return 1;
+    unsigned len = s->in[s->in_pos] | (s->in[s->in_pos + 1] << 8);
+    unsigned nlen = s->in[s->in_pos + 2] | (s->in[s->in_pos + 3] << 8);
+    s->in_pos += 4;
+    if (len != (~nlen & 0xffff) || s->in_len - s->in_pos < len || s->out_len - s->out_pos < len) return 1;
+    memcpy(s->out + s->out_pos, s->in + s->in_pos, len);
+    s->in_pos += len;
+    s->out_pos += len;
+    return 0;
+}
+
+static int inflate_fixed(Inflate *s) {
+    static Huffman lencode, distcode;
+    static int built = 0;
+    if (!built) {
+        short lengths[288];
+        int i = 0;
+        for (; i < 144; i++) lengths[i] = 8;
+        for (; i < 256; i++) lengths[i] = 9;
+        for (; i < 280; i++) lengths[i] = 7;
+        for (; i < 288; i++) lengths[i] = 8;
+        inflate_build(&lencode, lengths, 288);
+        for (i = 0; i < 30; i++) lengths[i] = 5;
+        inflate_build(&distcode, lengths, 30);
+        built = 1;
+    }
+    return inflate_codes(s, &lencode, &distcode);
+}
+
+static int inflate_dynamic(Inflate *s) {
+    static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    short lengths[320];
+    Huffman lencode, distcode;
+
+    int nlen = inflate_bits(s, 5), ndist = inflate_bits(s, 5), ncode = inflate_bits(s, 4);
+    if (nlen < 0 || ndist < 0 || ncode < 0) return 1;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) return 1;
+
+    int index;
+    for (index = 0; index < ncode; index++) {
+        int len = inflate_bits(s, 3);
+        if (len < 0) return 1;
+        lengths[order[index]] = (short)len;
+    }
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (inflate_build(&lencode, lengths, 19) != 0) return 1;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol = inflate_decode(s, &lencode);
+        if (symbol < 0) return 1;
+        if (symbol < 16) {
+            lengths[index++] = (short)symbol;
+            continue;
+        }
+
+        short len = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (index == 0) return 1;
+            len = lengths[index - 1];
+            repeat = 3 + inflate_bits(s, 2);
+        } else if (symbol == 17) {
+            repeat = 3 + inflate_bits(s, 3);
+        } else {
+            repeat = 11 + inflate_bits(s, 7);
+        }
+        if (repeat < 3 || index + repeat > nlen + ndist) return 1;
+        while (repeat--) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) return 1;
+
+    // Incomplete codes are only allowed for a single length or distance code
+    int err = inflate_build(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) return 1;
+    err = inflate_build(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) return 1;
+
+    return inflate_codes(s, &lencode, &distcode);
+}
+
+// Raw deflate into a caller-sized buffer; returns bytes written or -1
+long inflate_buffer(const unsigned char *in, size_t in_len, unsigned char *out, size_t out_len) {
+    Inflate s;
+    memset(&s, 0, sizeof(s));
+    s.in = in;
+    s.in_len = in_len;
+    s.out = out;
+    s.out_len = out_len;
+
+    int last;
+    do {
+        last = inflate_bits(&s, 1);
+        int type = inflate_bits(&s, 2);
+        if (last < 0 || type < 0) return -1;
+
+        int rc;
+        if (type == 0) {
+            rc = inflate_stored(&s);
+        } else if (type == 1) {
+            rc = inflate_fixed(&s);
+        } else if (type == 2) {
+            rc = inflate_dynamic(&s);
+        } else {
+            rc = 1;
+        }
+        if (rc) return -1;
+    } while (!last);
+
+    return (long)s.out_pos;
+}
+
+/* PNG */
+
+static uint32_t read_be32(const unsigned char *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    return pb <= pc ? b : c;
+}
+
+static int png_unfilter(unsigned char *rows, int height, size_t row_bytes, int bpp) {
+    unsigned char *prior = NULL;
+    for (int y = 0; y < height; y++) {
+        unsigned char *row = rows + y * (row_bytes + 1);
+        int filter = row[0];
+        unsigned char *line = row + 1;
+        for (size_t i = 0; i < row_bytes; i++) {
+            int a = i >= (size_t)bpp ? line[i - bpp] : 0;
+            int b = prior ? prior[i] : 0;
+            int c = prior && i >= (size_t)bpp ? prior[i - bpp] : 0;
+            switch (filter) {
+                case 0: break;
+                case 1: line[i] += a; break;
+                case 2: line[i] += b; break;
+                case 3: line[i] += (a + b) / 2; break;
+                case 4: line[i] += paeth(a, b, c); break;
+                default: return 1;
+            }
+        }
+        prior = line;
+    }
+    return 0;
+}
+
+typedef struct {
+    int color_type;
+    int depth;
+    int channels;
+    unsigned char palette[256][4];
+    int palette_size;
+} PngFormat;
+
+static int png_sample(const unsigned char *line, int x, int channel, const PngFormat *format) {
+    if (format->depth == 16) return line[(x * format->channels + channel) * 2];
+    if (format->depth == 8) return line[x * format->channels + channel];
+
+    // Packed 1/2/4-bit samples, most significant bits first
+    int bit = x * format->depth;
+    int value = (line[bit / 8] >> (8 - format->depth - bit % 8)) & ((1 << format->depth) - 1);
+    return value;
+}
+
+static void png_pixel(const unsigned char *line, int x, const PngFormat *format, unsigned char *out) {
+    int r, g, b, a = 255;
+    int scale = format->depth < 8 ? 255 / ((1 << format->depth) - 1) : 1;
+
+    switch (format->color_type) {
+        case 0:
+            r = g = b = png_sample(line, x, 0, format) * (format->depth < 8 ? scale : 1);
+            break;
+        case 2:
+            r = png_sample(line, x, 0, format);
+            g = png_sample(line, x, 1, format);
+            b = png_sample(line, x, 2, format);
+            break;
+        case 3: {
+            int index = png_sample(line, x, 0, format);
+            if (index >= format->palette_size) index = 0;
+            r = format->palette[index][0];
+            g = format->palette[index][1];
+            b = format->palette[index][2];
+            a = format->palette[index][3];
+            break;
+        }
+        case 4:
+            r = g = b = png_sample(line, x, 0, format);
+            a = png_sample(line, x, 1, format);
+            break;
+        default:
+            r = png_sample(line, x, 0, format);
+            g = png_sample(line, x, 1, format);
+            b = png_sample(line, x, 2, format);
+            a = png_sample(line, x, 3, format);
+            break;
+    }
+
+    // Composite onto white
+    out[0] = (unsigned char)((r * a + 255 * (255 - a)) / 255);
+    out[1] = (unsigned char)((g * a + 255 * (255 - a)) / 255);
+    out[2] = (unsigned char)((b * a + 255 * (255 - a)) / 255);
+}
+
+static int decode_png(const unsigned char *data, size_t len, Image *image, char *error, size_t error_size) {
+    PngFormat format;
+    memset(&format, 0, sizeof(format));
+    int width = 0, height = 0, interlace = 0;
+
+    // Gather IHDR, PLTE, tRNS and the concatenated IDAT stream
+    unsigned char *compressed = NULL;
+    size_t compressed_len = 0;
+    size_t pos = 8;
+    int have_header = 0;
+
+    while (pos + 12 <= len) {
+        uint32_t chunk_len = read_be32(data + pos);
+        const unsigned char *type = data + pos + 4;
+        const unsigned char *body = data + pos + 8;
+        if (chunk_len > len - pos - 12) break;
+
+        if (memcmp(type, "IHDR", 4) == 0 && chunk_len >= 13) {
+            width = (int)read_be32(body);
+            height = (int)read_be32(body + 4);
+            format.depth = body[8];
+            format.color_type = body[9];
+            interlace = body[12];
+            have_header = 1;
+        } else if (memcmp(type, "PLTE", 4) == 0) {
+            format.palette_size = chunk_len / 3 > 256 ? 256 : (int)(chunk_len / 3);
+            for (int i = 0; i < format.palette_size; i++) {
+                memcpy(format.palette[i], body + i * 3, 3);
+                format.palette[i][3] = 255;
+            }
+        } else if (memcmp(type, "tRNS", 4) == 0 && format.color_type == 3) {
+            for (uint32_t i = 0; i < chunk_len && i < 256; i++) format.palette[i][3] = body[i];
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            unsigned char *grown = realloc(compressed, compressed_len + chunk_len);
+            if (!grown) {
+                free(compressed);
+                return image_fail(error, error_size, "out of memory");
+            }
+            compressed = grown;
+            memcpy(compressed + compressed_len, body, chunk_len);
+            compressed_len += chunk_len;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + chunk_len;
+    }
+
+    static const int channels_for_type[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    if (!have_header || format.color_type > 6 || channels_for_type[format.color_type] == 0 ||
+        !(format.depth == 1 || format.depth == 2 || format.depth == 4 || format.depth == 8 || format.depth == 16) ||
+        ((format.color_type == 2 || format.color_type >= 4) && format.depth < 8) ||
+        (format.color_type == 3 && format.depth == 16) || interlace > 1) {
+        free(compressed);
+        return image_fail(error, error_size, "unsupported PNG format");
+    }
+    if (compressed_len < 2 || (compressed[0] & 0x0f) != 8) {
+        free(compressed);
+        return image_fail(error, error_size, "missing or invalid PNG image data");
+    }
+    format.channels = channels_for_type[format.color_type];
+
+    if (image_alloc(image, width, height, error, error_size)) {
+        free(compressed);
+        return 1;
+    }
+
+    // Adam7 passes; a non-interlaced image is a single pass covering every pixel
+    static const int pass_x0[7] = { 0, 4, 0, 2, 0, 1, 0 }, pass_dx[7] = { 8, 8, 4, 4, 2, 2, 1 };
+    static const int pass_y0[7] = { 0, 0, 4, 0, 2, 0, 1 }, pass_dy[7] = { 8, 8, 8, 4, 4, 2, 2 };
+    int passes = interlace ? 7 : 1;
+    int bits_per_pixel = format.channels * format.depth;
+    int bpp = (bits_per_pixel + 7) / 8;
+
+    size_t raw_len = 0;
+    for (int p = 0; p < passes; p++) {
+        int pw = interlace ? (width - pass_x0[p] + pass_dx[p] - 1) / pass_dx[p] : width;
+        int ph = interlace ? (height - pass_y0[p] + pass_dy[p] - 1) / pass_dy[p] : height;
+        if (pw > 0 && ph > 0) raw_len += (size_t)ph * (((size_t)pw * bits_per_pixel + 7) / 8 + 1);
+    }
+
+    unsigned char *raw = malloc(raw_len ? raw_len : 1);
+    long inflated = raw ? inflate_buffer(compressed + 2, compressed_len - 2, raw, raw_len) : -1;
+    free(compressed);
+    if (inflated != (long)raw_len) {
+        free(raw);
+        free_image(image);
+        return image_fail(error, error_size, "corrupt PNG image data");
+    }
+
+    unsigned char *rows = raw;
+    for (int p = 0; p < passes; p++) {
+        int x0 = interlace ? pass_x0[p] : 0, dx = interlace ? pass_dx[p] : 1;
+        int y0 = interlace ? pass_y0[p] : 0, dy = interlace ? pass_dy[p] : 1;
+        int pw = (width - x0 + dx - 1) / dx;
+        int ph = (height - y0 + dy - 1) / dy;
+        if (pw <= 0 || ph <= 0) continue;
+
+        size_t row_bytes = ((size_t)pw * bits_per_pixel + 7) / 8;
+        if (png_unfilter(rows, ph, row_bytes, bpp)) {
+            free(raw);
+            free_image(image);
+            return image_fail(error, error_size, "invalid PNG filter");
+        }
+        for (int y = 0; y < ph; y++) {
+            const unsigned char *line = rows + y * (row_bytes + 1) + 1;
+            for (int x = 0; x < pw; x++) {
+                size_t target = ((size_t)(y0 + y * dy) * width + (x0 + x * dx)) * 3;
+                png_pixel(line, x, &format, image->pixels + target);
+            }
+        }
+        rows += ph * (row_bytes + 1);
+    }
+
+    free(raw);
+    return 0;
+}
+
+/* Baseline JPEG (sequential Huffman, 8-bit, one or three components) */
+
+typedef struct {
+    unsigned char bits[17];
+    unsigned char values[256];
+    int max_code[18];
+    int val_offset[17];
+    int present;
+} JpegHuffman;
+
+typedef struct {
+    int id;
+    int h, v;
+    int quant;
+    int dc_table, ac_table;
+    int dc_pred;
+    int blocks_w, blocks_h;     // Blocks per line and column, padded to whole MCUs
+    unsigned char *plane;
+} JpegComponent;
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    uint32_t bit_buffer;
+    int bit_count;
+    int marker_hit;
+    unsigned short quant[4][64];
+    JpegHuffman dc[4], ac[4];
+    JpegComponent comp[3];
+    int components;
+    int width, height;
+    int h_max, v_max;
+    int restart_interval;
+} Jpeg;
+
+static const unsigned char zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static void jpeg_build_huffman(JpegHuffman *h) {
+    int code = 0, k = 0;
+    for (int len = 1; len <= 16; len++) {
+        h->val_offset[len] = k - code;
+        code += h->bits[len];
+        k += h->bits[len];
+        h->max_code[len] = h->bits[len] ? code - 1 : -1;
+        code <<= 1;
+    }
+    h->max_code[17] = 0x7fffffff;
+    h->present = 1;
+}
+
+static int jpeg_bit(Jpeg *j) {
+    if (j->bit_count == 0) {
+        if (j->marker_hit || j->pos >= j->len) {
+            j->bit_buffer = 0;   // Pad with zeros past a marker
+        } else {
+            unsigned char byte = j->data[j->pos++];
+            if (byte == 0xFF) {
+                unsigned char next = j->pos < j->len ? j->data[j->pos] : 0;
+                if (next == 0x00) {
+                    j->pos++;
+                } else {
+                    j->marker_hit = 1;
+                    j->pos--;
+                    byte = 0;
+                }
+            }
+            j->bit_buffer = byte;
+        }
+        j->bit_count = 8;
+    }
+    j->bit_count--;
+    return (j->bit_buffer >> j->bit_count) & 1;
+}
+
+static int jpeg_receive(Jpeg *j, int count) {
+    int value = 0;
+    for (int i = 0; i < count; i++) value = (value << 1) | jpeg_bit(j);
+    return value;
+}
+
+static int jpeg_extend(int value, int count) {
+    return value < (1 << (count - 1)) ? value - (1 << count) + 1 : value;
+}
+
+static int jpeg_decode_symbol(Jpeg *j, const JpegHuffman *h) {
+    int code = 0;
+    for (int len = 1; len <= 16; len++) {
+        code = (code << 1) | jpeg_bit(j);
+        if (code <= h->max_code[len]) {
+            int index = h->val_offset[len] + code;
+            return index >= 0 && index < 256 ? h->values[index] : -1;
+        }
+    }
+    return -1;
+}
+
+static void jpeg_idct(const int *in, unsigned char *out, int stride) {
+    static float table[8][8];
+    static int built = 0;
+    if (!built) {
+        for (int x = 0; x < 8; x++) {
+            for (int u = 0; u < 8; u++) {
+                table[x][u] = (float)((u == 0 ? sqrt(0.5) : 1.0) * cos((2 * x + 1) * u * M_PI / 16) / 2);
+            }
+        }
+        built = 1;
+    }
+
+    float temp[64];
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0;
+            for (int v = 0; v < 8; v++) sum += table[y][v] * in[v * 8 + u];
+            temp[y * 8 + u] = sum;
+        }
+    }
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0;
+            for (int u = 0; u < 8; u++) sum += table[x][u] * temp[y * 8 + u];
+            int value = (int)lrintf(sum) + 128;
+            out[y * stride + x] = (unsigned char)(value < 0 ? 0 : value > 255 ? 255 : value);
+        }
+    }
+}
+
+static int jpeg_decode_block(Jpeg *j, JpegComponent *c, unsigned char *out, int stride) {
+    int coefficients[64];
+    memset(coefficients, 0, sizeof(coefficients));
+    const unsigned short *q = j->quant[c->quant];
+
+    int t = jpeg_decode_symbol(j, &j->dc[c->dc_table]);
+    if (t < 0 || t > 11) return 1;
+    int diff = t ? jpeg_extend(jpeg_receive(j, t), t) : 0;
+    c->dc_pred += diff;
+    coefficients[0] = c->dc_pred * q[0];
+
+    for (int k = 1; k < 64; ) {
+        int rs = jpeg_decode_symbol(j, &j->ac[c->ac_table]);
+        if (rs < 0) return 1;
+        int run = rs >> 4, size = rs & 15;
+        if (size == 0) {
+            if (run != 15) break;   // End of block
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) return 1;
+        coefficients[zigzag[k]] = jpeg_extend(jpeg_receive(j, size), size) * q[k];
+        k++;
+    }
+
+    jpeg_idct(coefficients, out, stride);
+    return 0;
+}
+
+static int jpeg_scan(Jpeg *j, char *error, size_t error_size) {
+    int mcus_x = (j->width + 8 * j->h_max - 1) / (8 * j->h_max);
+    int mcus_y = (j->height + 8 * j->v_max - 1) / (8 * j->v_max);
+
+    for (int i = 0; i < j->components; i++) {
+        JpegComponent *c = &j->comp[i];
+        c->blocks_w = mcus_x * c->h;
+        c->blocks_h = mcus_y * c->v;
+        c->plane = malloc((size_t)c->blocks_w * 8 * c->blocks_h * 8);
+        if (!c->plane) return image_fail(error, error_size, "out of memory");
+        c->dc_pred = 0;
+        if (!j->dc[c->dc_table].present || !j->ac[c->ac_table].present) {
+            return image_fail(error, error_size, "missing JPEG Huffman table");
+        }
+    }
+
+    int restarts_left = j->restart_interval;
+    for (int my = 0; my < mcus_y; my++) {
+        for (int mx = 0; mx < mcus_x; mx++) {
+            if (j->restart_interval && restarts_left == 0) {
+                // Byte-align, skip the RSTn marker and reset predictions
+                j->bit_count = 0;
+                j->marker_hit = 0;
+                while (j->pos + 1 < j->len && !(j->data[j->pos] == 0xFF && j->data[j->pos + 1] >= 0xD0 &&
+                                                 j->data[j->pos + 1] <= 0xD7)) {
+                    j->pos++;
+                }
+                j->pos += 2;
+                for (int i = 0; i < j->components; i++) j->comp[i].dc_pred = 0;
+                restarts_left = j->restart_interval;
+            }
+
+            for (int i = 0; i < j->components; i++) {
+                JpegComponent *c = &j->comp[i];
+                int stride = c->blocks_w * 8;
+                for (int by = 0; by < c->v; by++) {
+                    for (int bx = 0; bx < c->h; bx++) {
+                        int block_x = mx * c->h + bx, block_y = my * c->v + by;
+                        unsigned char *out = c->plane + (size_t)block_y * 8 * stride + block_x * 8;
+                        if (jpeg_decode_block(j, c, out, stride)) {
+                            return image_fail(error, error_size, "corrupt JPEG scan data");
+                        }
+                    }
+                }
+            }
+            if (j->restart_interval) restarts_left--;
+        }
+    }
+    return 0;
+}
+
+static int jpeg_upsample(const Jpeg *j, const JpegComponent *c, int x, int y) {
+    int stride = c->blocks_w * 8;
+    if (c->h == j->h_max && c->v == j->v_max) return c->plane[(size_t)y * stride + x];
+
+    int plane_w = (j->width * c->h + j->h_max - 1) / j->h_max;
+    int plane_h = (j->height * c->v + j->v_max - 1) / j->v_max;
+    float fx = (x + 0.5f) * c->h / j->h_max - 0.5f;
+    float fy = (y + 0.5f) * c->v / j->v_max - 0.5f;
+    if (fx < 0) fx = 0;
+    if (fy < 0) fy = 0;
+
+    int x0 = (int)fx, y0 = (int)fy;
+    int x1 = x0 + 1 < plane_w ? x0 + 1 : x0;
+    int y1 = y0 + 1 < plane_h ? y0 + 1 : y0;
+    float ax = fx - x0, ay = fy - y0;
+    const unsigned char *row0 = c->plane + (size_t)y0 * stride;
+    const unsigned char *row1 = c->plane + (size_t)y1 * stride;
+    float top = row0[x0] + (row0[x1] - row0[x0]) * ax;
+    float bottom = row1[x0] + (row1[x1] - row1[x0]) * ax;
+    return (int)lrintf(top + (bottom - top) * ay);
+}
+
+static int decode_jpeg(const unsigned char *data, size_t len, Image *image, char *error, size_t error_size) {
+    Jpeg *j = calloc(1, sizeof(Jpeg));
+    if (!j) return image_fail(error, error_size, "out of memory");
+    j->data = data;
+    j->len = len;
+    j->pos = 2;
+
+    int rc = 1, have_frame = 0, done = 0;
+    while (!done && j->pos + 4 <= len) {
+        if (data[j->pos] != 0xFF) {
+            j->pos++;
+            continue;
+        }
+        int marker = data[j->pos + 1];
+        if (marker == 0xFF) {
+            j->pos++;
+            continue;
+        }
+        j->pos += 2;
+        if (marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) continue;
+        if (marker == 0xD9) break;
+
+        size_t segment_len = (data[j->pos] << 8) | data[j->pos + 1];
+        if (segment_len < 2 || segment_len > len - j->pos) {
+            image_fail(error, error_size, "truncated JPEG segment");
+            break;
+        }
+        const unsigned char *s = data + j->pos + 2;
+        size_t n = segment_len - 2;
+        j->pos += segment_len;
+
+        if (marker == 0xDB) {
+            // Quantisation tables, 8- or 16-bit, stored in zigzag order
+            for (size_t i = 0; i < n; ) {
+                int precision = s[i] >> 4, id = s[i] & 3;
+                size_t size = precision ? 128 : 64;
+                if (i + 1 + size > n) break;
+                for (int k = 0; k < 64; k++) {
+                    j->quant[id][k] = precision ? (s[i + 1 + k * 2] << 8 | s[i + 2 + k * 2]) : s[i + 1 + k];
+                }
+                i += 1 + size;
+            }
+        } else if (marker == 0xC4) {
+            for (size_t i = 0; i + 17 <= n; ) {
+                int table_class = s[i] >> 4, id = s[i] & 3;
+                JpegHuffman *h = table_class ? &j->ac[id] : &j->dc[id];
+                int total = 0;
+                for (int b = 1; b <= 16; b++) {
+                    h->bits[b] = s[i + b];
+                    total += s[i + b];
+                }
+                if (total > 256 || i + 17 + total > n) break;
+                memcpy(h->values, s + i + 17, total);
+                jpeg_build_huffman(h);
+                i += 17 + total;
+            }
+        } else if (marker == 0xDD && n >= 2) {
+            j->restart_interval = s[0] << 8 | s[1];
+        } else if (marker == 0xC0 || marker == 0xC1) {
+            if (n < 6 || s[0] != 8) {
+                image_fail(error, error_size, "unsupported JPEG sample precision");
+                break;
+            }
+            j->height = s[1] << 8 | s[2];
+            j->width = s[3] << 8 | s[4];
+            j->components = s[5];
+            if ((j->components != 1 && j->components != 3) || n < 6 + (size_t)j->components * 3) {
+                image_fail(error, error_size, "unsupported JPEG colour components");
+                break;
+            }
+            if ((double)j->width * j->height > IMAGE_MAX_PIXELS || j->width == 0 || j->height == 0) {
+                image_fail(error, error_size, "invalid or oversized JPEG dimensions");
+                break;
+            }
+            j->h_max = j->v_max = 1;
+            int valid = 1;
+            for (int i = 0; i < j->components; i++) {
+                JpegComponent *c = &j->comp[i];
+                c->id = s[6 + i * 3];
+                c->h = s[7 + i * 3] >> 4;
+                c->v = s[7 + i * 3] & 15;
+                c->quant = s[8 + i * 3] & 3;
+                if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4) valid = 0;
+                if (c->h > j->h_max) j->h_max = c->h;
+                if (c->v > j->v_max) j->v_max = c->v;
+            }
+            if (!valid) {
+                image_fail(error, error_size, "invalid JPEG sampling factors");
+                break;
+            }
+            have_frame = 1;
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            image_fail(error, error_size, "progressive, lossless and arithmetic-coded JPEGs are not supported");
+            break;
+        } else if (marker == 0xDA) {
+            if (!have_frame || n < 1 || s[0] != j->components || n < 1 + (size_t)s[0] * 2) {
+                image_fail(error, error_size, "unsupported JPEG scan");
+                break;
+            }
+            for (int i = 0; i < s[0]; i++) {
+                for (int k = 0; k < j->components; k++) {
+                    if (j->comp[k].id == s[1 + i * 2]) {
+                        j->comp[k].dc_table = s[2 + i * 2] >> 4 & 3;
+                        j->comp[k].ac_table = s[2 + i * 2] & 3;
+                    }
+                }
+            }
+            if (jpeg_scan(j, error, error_size) == 0) rc = 0;
+            done = 1;
+        }
+    }
+
+    if (rc == 0 && image_alloc(image, j->width, j->height, error, error_size)) rc = 1;
+    if (rc == 0) {
+        // Upsample subsampled planes bilinearly at sample centres and convert YCbCr to RGB
+        for (int y = 0; y < j->height; y++) {
+            for (int x = 0; x < j->width; x++) {
+                int sample[3];
+                for (int i = 0; i < j->components; i++) {
+                    sample[i] = jpeg_upsample(j, &j->comp[i], x, y);
+                }
+                unsigned char *out = image->pixels + ((size_t)y * j->width + x) * 3;
+                if (j->components == 1) {
+                    out[0] = out[1] = out[2] = (unsigned char)sample[0];
+                } else {
+                    float yy = sample[0], cb = sample[1] - 128.0f, cr = sample[2] - 128.0f;
+                    int rgb[3] = {
+                        (int)lrintf(yy + 1.402f * cr),
+                        (int)lrintf(yy - 0.344136f * cb - 0.714136f * cr),
+                        (int)lrintf(yy + 1.772f * cb)
+                    };
+                    for (int k = 0; k < 3; k++) out[k] = (unsigned char)(rgb[k] < 0 ? 0 : rgb[k] > 255 ? 255 : rgb[k]);
+                }
+            }
+        }
+    } else if (!error[0]) {
+        image_fail(error, error_size, "no JPEG image data");
+    }
+
+    for (int i = 0; i < 3; i++) free(j->comp[i].plane);
+    free(j);
+    return rc;
+}
+
+int decode_image(const unsigned char *data, size_t len, Image *image, char *error, size_t error_size) {
+    memset(image, 0, sizeof(*image));
+    error[0] = '\0';
+
+    if (len >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) return decode_png(data, len, image, error, error_size);
+    if (len >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+        return decode_jpeg(data, len, image, error, error_size);
+    }
+    if (len >= 3 && data[0] == 'P' && data[1] >= '1' && data[1] <= '6') {
+        return decode_pnm(data, len, image, error, error_size);
+    }
+    return image_fail(error, error_size, "unsupported image format");
+}
@@ -0,0 +1,217 @@
+/* intern.c - Process-wide interned strings for names */
+
+#include "family_tree.h"
+#include <malloc.h>
+
+/*
+ * Names repeat: a tree of thousands of people has a few hundred surnames
+ * and not many more given names. Each distinct name is stored once and
+ * known by a 32-bit id, so a Person, an analytics column or a cache holds
+ * 4 bytes per name instead of its own heap copy, and comparing two names
+ * is comparing two ids. The text is looked up only when a page is
+ * rendered.
+ *
+ * The table only grows: texts are packed into INTERN_BLOCK_SIZE blocks
+ * that are never moved or freed, so a pointer from interned_string()
+ * stays valid for the life of the process. Serve mode's parent interns
+ * what it preloads and each connection's child adds its own names to its
+ * copy, which goes away with it.
+ */
+
+#define INTERN_BLOCK_SIZE 65536
+
+typedef struct InternBlock {
+    struct InternBlock *next;
+    size_t used;
+    size_t size;
+    char text[];
+} InternBlock;
+
+static const char **strings;        // Id -> text; [0] is NULL
+static uint32_t *hashes;            // Id -> hash, so growing the slots rehashes nothing
+static uint32_t string_count = 1;
+static uint32_t string_capacity;
+static uint32_t *slots;             // Open addressing on the text, 0 for empty
+static uint32_t slot_capacity;      // Power of two
+static InternBlock *blocks;
+static size_t block_bytes;
+
+static uint32_t intern_hash(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    return hash;
+}
+
+static int intern_grow_slots(void) {
+    uint32_t capacity = slot_capacity ? slot_capacity * 2 : 1024;
+    uint32_t *grown = calloc(capacity, sizeof(uint32_t));
+    if (!grown) return 1;
+    for (uint32_t id = 1; id < string_count; id++) {
+        uint32_t slot = hashes[id] & (capacity - 1);
+        while (grown[slot]) slot = (slot + 1) & (capacity - 1);
+        grown[slot] = id;
+    }
+    free(slots);
+    slots = grown;
+    slot_capacity = capacity;
+    return 0;
+}
+
+// A copy of text in the current block, starting a new one if it does not fit
+static const char *intern_store(const char *text, size_t length) {
+    if (!blocks || blocks->size - blocks->used < length + 1) {
+        size_t size = length + 1 > INTERN_BLOCK_SIZE ? length + 1 : INTERN_BLOCK_SIZE;
+        InternBlock *block = malloc(sizeof(InternBlock) + size);
+        if (!block) return NULL;
+        block->next = blocks;
+        block->used = 0;
+        block->size = size;
+        blocks = block;
+        block_bytes += sizeof(InternBlock) + size;
+    }
+    char *copy = blocks->text + blocks->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    blocks->used += length + 1;
+    return copy;
+}
+
+// The id of text, added if new; 0 for NULL or "", and if out of memory
+uint32_t intern_string(const char *text) {
+    if (!text || !*text) return 0;
+    size_t length = strlen(text);
+    uint32_t hash = intern_hash(text, length);
+
+    if (string_count * 2 >= slot_capacity && intern_grow_slots() != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    uint32_t slot = hash & (slot_capacity - 1);
+    for (; slots[slot]; slot = (slot + 1) & (slot_capacity - 1)) {
+        uint32_t id = slots[slot];
+        if (hashes[id] == hash && strcmp(strings[id], text) == 0) return id;
+    }
+
+    if (string_count >= string_capacity) {
+        uint32_t capacity = string_capacity ? string_capacity * 2 : 1024;
+        const char **grown_strings = realloc(strings, sizeof(char*) * capacity);
+        if (grown_strings) strings = grown_strings;
+        uint32_t *grown_hashes = realloc(hashes, sizeof(uint32_t) * capacity);
+        if (grown_hashes) hashes = grown_hashes;
+        if (!grown_strings || !grown_hashes) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 0;
+        }
+        string_capacity = capacity;
+        strings[0] = NULL;
+    }
+    const char *copy = intern_store(text, length);
+    if (!copy) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 0;
+    }
+    strings[string_count] = copy;
+    hashes[string_count] = hash;
+    slots[slot] = string_count;
+    return string_count++;
+}
+
+// The text of an id; NULL for 0 and unknown ids
+const char *interned_string(uint32_t id) {
+    return id < string_count ? strings[id] : NULL;
+}
+
+// Intern a text column of the current row; 0 for NULL
+uint32_t intern_column(sqlite3_stmt *stmt, int column) {
+    return intern_string((const char*)sqlite3_column_text(stmt, column));
+}
+
+// Ids in use, including 0: a bound for arrays indexed by id
+uint32_t intern_count(void) {
+    return string_count;
+}
+
+// Bytes held by the table: text blocks, the id arrays and the hash slots
+size_t intern_memory(void) {
+    return block_bytes + (size_t)string_capacity * (sizeof(char*) + sizeof(uint32_t)) +
+           (size_t)slot_capacity * sizeof(uint32_t);
+}
+
+// Benchmark: every person's names held as heap copies, then as interned ids
+
+static double intern_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int intern_benchmark(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int count = 0;
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM people;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    if (sqlite3_prepare_v2(db, "SELECT first_name, last_name FROM people;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    // The heap in use before and after each copy of the names, statement excluded
+    size_t before = mallinfo2().uordblks;
+    double start = intern_now();
+    char **copies = malloc(sizeof(char*) * 2 * (count + 1));
+    int rows = 0;
+    while (copies && rows < count && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *first = (const char*)sqlite3_column_text(stmt, 0);
+        const char *last = (const char*)sqlite3_column_text(stmt, 1);
+        copies[2 * rows] = first ? strdup(first) : NULL;
+        copies[2 * rows + 1] = last ? strdup(last) : NULL;
+        rows++;
+    }
+    double copy_time = intern_now() - start;
+    size_t copy_bytes = mallinfo2().uordblks - before;
+    for (int i = 0; copies && i < 2 * rows; i++) free(copies[i]);
+    free(copies);
+    sqlite3_reset(stmt);
+
+    before = mallinfo2().uordblks;
+    start = intern_now();
+    uint32_t *ids = malloc(sizeof(uint32_t) * 2 * (count + 1));
+    int interned_rows = 0;
+    while (ids && interned_rows < count && sqlite3_step(stmt) == SQLITE_ROW) {
+        ids[2 * interned_rows] = intern_column(stmt, 0);
+        ids[2 * interned_rows + 1] = intern_column(stmt, 1);
+        interned_rows++;
+    }
+    double intern_time = intern_now() - start;
+    size_t intern_bytes = mallinfo2().uordblks - before;
+    sqlite3_finalize(stmt);
+    if (!copies || !ids) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(ids);
+        return 1;
+    }
+
+    // Every id must give back the text it was made from
+    int mismatches = 0;
+    if (sqlite3_prepare_v2(db, "SELECT first_name, last_name FROM people;", -1, &stmt, NULL) == SQLITE_OK) {
+        for (int i = 0; i < interned_rows && sqlite3_step(stmt) == SQLITE_ROW; i++) {
+            for (int column = 0; column < 2; column++) {
+                const char *text = (const char*)sqlite3_column_text(stmt, column);
+                const char *interned = interned_string(ids[2 * i + column]);
+                mismatches += (text && *text) ? !interned || strcmp(text, interned) != 0 : interned != NULL;
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    free(ids);
+
+    printf("names         %d people, %u distinct names\n", rows, intern_count() - 1);
+    printf("heap copies   %8.2f MB  %7.1f ms\n", copy_bytes / 1e6, copy_time * 1e3);
+    printf("interned ids  %8.2f MB  %7.1f ms   (table %.2f MB)%s\n", intern_bytes / 1e6, intern_time * 1e3,
+           intern_memory() / 1e6, mismatches ? ", MISMATCH" : "");
+    return mismatches != 0;
+}
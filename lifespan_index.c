@@ -0,0 +1,691 @@
+/* lifespan_index.c - In-memory lifespan interval index for "who was alive" queries */
+
+#include "family_tree.h"
+
+/*
+ * Each person with a birth or death date gets a lifespan: the days on
+ * which they may have been alive, from the earliest day their birth could
+ * fall on to the latest their death could. Year-only and month-only
+ * dates stretch to cover their whole period, approximate ones by a year
+ * either side, and a missing date is assumed LIFESPAN_MAX_YEARS from the
+ * other one.
+ *
+ * The lifespans form a static centered interval tree. Every node holds
+ * the lifespans containing its center day, once sorted by start and once
+ * by end (descending). Lifespans wholly before the center go to the left
+ * subtree, wholly after it to the right. A query for the days [from, to]
+ * visits O(log n) nodes, and at each one scans only the entries that
+ * match plus one.
+ *
+ * The index is a snapshot. People added since (ids above max_person_id)
+ * and people whose dates were added, changed or deleted (logged by
+ * triggers in lifespan_changes, which also catch people inserted with
+ * ids below max_person_id) are read back from SQL at query time and
+ * override the snapshot, so a long-lived copy answers correctly until a
+ * rebuild.
+ */
+
+typedef struct {
+    int id;
+    int start;
+    int end;
+} Lifespan;
+
+typedef struct {
+    int center;
+    int first;      // Entries [first, first + count) of by_start and by_end
+    int count;
+    int left;       // Node indexes, -1 for none
+    int right;
+} LifespanNode;
+
+struct LifespanIndex {
+    Lifespan *by_start;
+    Lifespan *by_end;
+    int count;
+    LifespanNode *nodes;
+    int node_count;
+    int root;
+    int max_person_id;              // Snapshot covers ids up to here
+    sqlite3_int64 change_seq;       // and lifespan_changes up to here
+};
+
+// Collects the total and the first `limit` ids above after_id, ascending
+typedef struct {
+    const unsigned char *within;    // Bitmap of ids to keep, NULL for everyone
+    int within_max;
+    const int *overridden;          // Sorted ids whose snapshot entry is stale
+    int overridden_count;
+    int after_id;
+    int limit;
+    int *ids;                       // Max-heap of the smallest ids seen
+    int count;
+    int total;
+} LifespanResults;
+
+#define LIFESPAN_MAX_DAYS (LIFESPAN_MAX_YEARS * 36525 / 100)
+#define LIFESPAN_APPROX_DAYS 366
+
+// Lifespans
+
+// Fills span from (id, birth_day, birth_precision, death_day, death_precision); 0 if no dates
+static int lifespan_from_row(sqlite3_stmt *stmt, Lifespan *span) {
+    int has_birth = sqlite3_column_type(stmt, 1) != SQLITE_NULL;
+    int has_death = sqlite3_column_type(stmt, 3) != SQLITE_NULL;
+    if (!has_birth && !has_death) return 0;
+
+    span->id = sqlite3_column_int(stmt, 0);
+    if (has_birth) {
+        int precision = sqlite3_column_int(stmt, 2);
+        span->start = sqlite3_column_int(stmt, 1);
+        if (precision & DATE_APPROXIMATE) span->start -= LIFESPAN_APPROX_DAYS;
+    }
+    if (has_death) {
+        int precision = sqlite3_column_int(stmt, 4);
+        span->end = date_period_end(sqlite3_column_int(stmt, 3), precision);
+        if (precision & DATE_APPROXIMATE) span->end += LIFESPAN_APPROX_DAYS;
+    }
+    if (!has_birth) {
+        span->start = sqlite3_column_int(stmt, 3) - LIFESPAN_MAX_DAYS;
+    }
+    if (!has_death) {
+        int precision = sqlite3_column_int(stmt, 2);
+        span->end = date_period_end(sqlite3_column_int(stmt, 1), precision) + LIFESPAN_MAX_DAYS;
+        if (precision & DATE_APPROXIMATE) span->end += LIFESPAN_APPROX_DAYS;
+    }
+    if (span->end < span->start) span->end = span->start;
+    return 1;
+}
+
+static void lifespan_results_add(LifespanResults *results, int id) {
+    if (results->within && (id > results->within_max || !(results->within[id >> 3] & (1 << (id & 7))))) return;
+    results->total++;
+    if (id <= results->after_id || results->limit <= 0) return;
+
+    int *heap = results->ids;
+    if (results->count < results->limit) {
+        // Sift up
+        int i = results->count++;
+        while (i > 0 && heap[(i - 1) / 2] < id) {
+            heap[i] = heap[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        heap[i] = id;
+    } else if (id < heap[0]) {
+        // Replace the largest and sift down
+        int i = 0;
+        for (;;) {
+            int child = 2 * i + 1;
+            if (child >= results->count) break;
+            if (child + 1 < results->count && heap[child + 1] > heap[child]) child++;
+            if (heap[child] <= id) break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = id;
+    }
+}
+
+static int lifespan_overridden(const LifespanResults *results, int id) {
+    int lo = 0, hi = results->overridden_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (results->overridden[mid] < id) {
+            lo = mid + 1;
+        } else if (results->overridden[mid] > id) {
+            hi = mid - 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void lifespan_report(LifespanResults *results, const Lifespan *span) {
+    if (results->overridden_count && lifespan_overridden(results, span->id)) return;
+    lifespan_results_add(results, span->id);
+}
+
+// Build
+
+static int compare_start(const void *a, const void *b) {
+    const Lifespan *x = a, *y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+static int compare_end_descending(const void *a, const void *b) {
+    const Lifespan *x = a, *y = b;
+    if (x->end != y->end) return x->end > y->end ? -1 : 1;
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+/*
+ * Build the subtree for spans[0, n), sorted by start, using scratch as
+ * partition space. The center is the median start: at most half the
+ * spans start after it and at most half end before it, so the depth is
+ * O(log n), and the median span itself always lands in the node.
+ */
+static int lifespan_build_node(LifespanIndex *index, Lifespan *spans, Lifespan *scratch, int n, int *filled) {
+    if (n == 0) return -1;
+
+    int center = spans[n / 2].start;
+    int left = 0, middle = 0, right = 0;
+    for (int i = 0; i < n; i++) {
+        if (spans[i].end < center) left++;
+        else if (spans[i].start > center) right++;
+        else middle++;
+    }
+
+    // Stable partition into left | middle | right, each still sorted by start
+    int l = 0, m = left, r = left + middle;
+    for (int i = 0; i < n; i++) {
+        if (spans[i].end < center) scratch[l++] = spans[i];
+        else if (spans[i].start > center) scratch[r++] = spans[i];
+        else scratch[m++] = spans[i];
+    }
+    memcpy(spans, scratch, sizeof(Lifespan) * n);
+
+    int node = index->node_count++;
+    LifespanNode *entry = &index->nodes[node];
+    entry->center = center;
+    entry->first = *filled;
+    entry->count = middle;
+    memcpy(index->by_start + *filled, spans + left, sizeof(Lifespan) * middle);
+    memcpy(index->by_end + *filled, spans + left, sizeof(Lifespan) * middle);
+    qsort(index->by_end + *filled, middle, sizeof(Lifespan), compare_end_descending);
+    *filled += middle;
+
+    int left_node = lifespan_build_node(index, spans, scratch, left, filled);
+    int right_node = lifespan_build_node(index, spans + left + middle, scratch, right, filled);
+    index->nodes[node].left = left_node;
+    index->nodes[node].right = right_node;
+    return node;
+}
+
+LifespanIndex *lifespan_index_build(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    LifespanIndex *index = calloc(1, sizeof(LifespanIndex));
+    if (!index) return NULL;
+
+    // One read transaction so the snapshot bounds match the rows read
+    sqlite3_exec(db, "SAVEPOINT lifespan_build;", NULL, NULL, NULL);
+    const char *bounds_sql =
+        "SELECT (SELECT COALESCE(MAX(id), 0) FROM people), (SELECT COALESCE(MAX(seq), 0) FROM lifespan_changes);";
+    if (sqlite3_prepare_v2(db, bounds_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "RELEASE lifespan_build;", NULL, NULL, NULL);
+        free(index);
+        return NULL;
+    }
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        index->max_person_id = sqlite3_column_int(stmt, 0);
+        index->change_seq = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    const char *sql =
+        "SELECT id, birth_day, birth_precision, death_day, death_precision FROM people "
+        "WHERE (birth_day IS NOT NULL OR death_day IS NOT NULL) AND id <= ?;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "RELEASE lifespan_build;", NULL, NULL, NULL);
+        free(index);
+        return NULL;
+    }
+    sqlite3_bind_int(stmt, 1, index->max_person_id);
+
+    int capacity = 1024, count = 0;
+    Lifespan *spans = malloc(sizeof(Lifespan) * capacity);
+    int ok = spans != NULL;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity *= 2;
+            Lifespan *grown = realloc(spans, sizeof(Lifespan) * capacity);
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            spans = grown;
+        }
+        count += lifespan_from_row(stmt, &spans[count]);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "RELEASE lifespan_build;", NULL, NULL, NULL);
+
+    Lifespan *scratch = ok ? malloc(sizeof(Lifespan) * (count + 1)) : NULL;
+    index->by_start = ok ? malloc(sizeof(Lifespan) * (count + 1)) : NULL;
+    index->by_end = ok ? malloc(sizeof(Lifespan) * (count + 1)) : NULL;
+    index->nodes = ok ? malloc(sizeof(LifespanNode) * (count + 1)) : NULL;
+    if (!scratch || !index->by_start || !index->by_end || !index->nodes) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(spans);
+        free(scratch);
+        lifespan_index_free(index);
+        return NULL;
+    }
+
+    qsort(spans, count, sizeof(Lifespan), compare_start);
+    int filled = 0;
+    index->count = count;
+    index->root = lifespan_build_node(index, spans, scratch, count, &filled);
+
+    free(spans);
+    free(scratch);
+    return index;
+}
+
+void lifespan_index_free(LifespanIndex *index) {
+    if (!index) return;
+    free(index->by_start);
+    free(index->by_end);
+    free(index->nodes);
+    free(index);
+}
+
+// Queries
+
+static void lifespan_query_node(const LifespanIndex *index, int node, int from_day, int to_day,
+                                LifespanResults *results) {
+    while (node >= 0) {
+        const LifespanNode *entry = &index->nodes[node];
+        const Lifespan *first = index->by_start + entry->first;
+        const Lifespan *last = first + entry->count;
+
+        if (to_day < entry->center) {
+            // Everything here reaches past to_day; only the start decides
+            for (const Lifespan *span = first; span < last && span->start <= to_day; span++) {
+                lifespan_report(results, span);
+            }
+            node = entry->left;
+        } else if (from_day > entry->center) {
+            // Everything here starts before from_day; only the end decides
+            const Lifespan *by_end = index->by_end + entry->first;
+            for (const Lifespan *span = by_end; span < by_end + entry->count && span->end >= from_day; span++) {
+                lifespan_report(results, span);
+            }
+            node = entry->right;
+        } else {
+            // The center is inside [from_day, to_day]: all of them overlap, and both sides may
+            for (const Lifespan *span = first; span < last; span++) {
+                lifespan_report(results, span);
+            }
+            lifespan_query_node(index, entry->left, from_day, to_day, results);
+            node = entry->right;
+        }
+    }
+}
+
+// Apply people added or re-dated since the snapshot; fills results->overridden
+static int lifespan_apply_changes(const LifespanIndex *index, sqlite3 *db, int from_day, int to_day,
+                                  LifespanResults *results, int **overridden) {
+    sqlite3_stmt *stmt;
+    const char *changed_sql =
+        "SELECT DISTINCT person_id FROM lifespan_changes WHERE seq > ?1 AND person_id <= ?2 ORDER BY person_id;";
+    const char *rows_sql =
+        "SELECT id, birth_day, birth_precision, death_day, death_precision FROM people "
+        "WHERE id > ?2 OR id IN (SELECT person_id FROM lifespan_changes WHERE seq > ?1);";
+
+    *overridden = NULL;
+    if (sqlite3_prepare_v2(db, changed_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_bind_int64(stmt, 1, index->change_seq);
+    sqlite3_bind_int(stmt, 2, index->max_person_id);
+    int capacity = 0, count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            int *grown = realloc(*overridden, sizeof(int) * capacity);
+            if (!grown) {
+                sqlite3_finalize(stmt);
+                return 1;
+            }
+            *overridden = grown;
+        }
+        (*overridden)[count++] = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    results->overridden = *overridden;
+    results->overridden_count = count;
+
+    if (sqlite3_prepare_v2(db, rows_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_bind_int64(stmt, 1, index->change_seq);
+    sqlite3_bind_int(stmt, 2, index->max_person_id);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Lifespan span;
+        if (lifespan_from_row(stmt, &span) && span.start <= to_day && span.end >= from_day) {
+            lifespan_results_add(results, span.id);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sets up results for lifespan_alive and lifespan_alive_sql; *bitmap is theirs to free
+static int lifespan_results_init(LifespanResults *results, const int *within, int within_count, int after_id,
+                                 int limit, int *ids, unsigned char **bitmap) {
+    memset(results, 0, sizeof(*results));
+    results->after_id = after_id;
+    results->limit = limit;
+    results->ids = ids;
+    *bitmap = NULL;
+    if (!within) return 0;
+
+    int max_id = 0;
+    for (int i = 0; i < within_count; i++) {
+        if (within[i] > max_id) max_id = within[i];
+    }
+    *bitmap = calloc(max_id / 8 + 1, 1);
+    if (!*bitmap) return 1;
+    for (int i = 0; i < within_count; i++) {
+        if (within[i] >= 0) (*bitmap)[within[i] >> 3] |= 1 << (within[i] & 7);
+    }
+    results->within = *bitmap;
+    results->within_max = max_id;
+    return 0;
+}
+
+/*
+ * People who may have been alive on some day in [from_day, to_day],
+ * optionally only those listed in within. *total gets the number of
+ * matches; ids gets up to limit of them with ids above after_id, in
+ * ascending order, and *count how many. db is read for changes made
+ * since the index was built.
+ */
+int lifespan_alive(LifespanIndex *index, sqlite3 *db, int from_day, int to_day, const int *within, int within_count,
+                   int after_id, int limit, int *ids, int *count, int *total) {
+    LifespanResults results;
+    unsigned char *bitmap;
+    if (lifespan_results_init(&results, within, within_count, after_id, limit, ids, &bitmap) != 0) return 1;
+
+    int *overridden = NULL;
+    int rc = lifespan_apply_changes(index, db, from_day, to_day, &results, &overridden);
+    if (rc == 0) lifespan_query_node(index, index->root, from_day, to_day, &results);
+
+    qsort(ids, results.count, sizeof(int), compare_ids);
+    *count = results.count;
+    *total = results.total;
+    free(overridden);
+    free(bitmap);
+    return rc;
+}
+
+/*
+ * The same answer without an index, for processes that have none
+ * preloaded: building one costs seconds on a large tree, more than a
+ * single request should spend. Candidates come from range scans of the
+ * covering birth_day and death_day indexes, each widened by
+ * LIFESPAN_MAX_DAYS and the slack of imprecise dates, and are then
+ * checked exactly; the death_day scan skips those the first found. A
+ * recorded lifespan longer than LIFESPAN_MAX_YEARS that covers the whole
+ * window with neither end inside the widened ranges is not found.
+ */
+int lifespan_alive_sql(sqlite3 *db, int from_day, int to_day, const int *within, int within_count,
+                       int after_id, int limit, int *ids, int *count, int *total) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT id, birth_day, birth_precision, death_day, death_precision FROM people "
+        "WHERE birth_day BETWEEN ?1 - ?3 AND ?2 + ?4 "
+        "UNION ALL "
+        "SELECT id, birth_day, birth_precision, death_day, death_precision FROM people "
+        "WHERE death_day BETWEEN ?1 - ?4 AND ?2 + ?3 AND (birth_day IS NULL OR birth_day < ?1 - ?3);";
+
+    LifespanResults results;
+    unsigned char *bitmap;
+    if (lifespan_results_init(&results, within, within_count, after_id, limit, ids, &bitmap) != 0) return 1;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        free(bitmap);
+        return 1;
+    }
+    // A year-precision date ends a year after its day, and approximate ones move a year further
+    sqlite3_bind_int(stmt, 1, from_day);
+    sqlite3_bind_int(stmt, 2, to_day);
+    sqlite3_bind_int(stmt, 3, LIFESPAN_MAX_DAYS + 2 * LIFESPAN_APPROX_DAYS);
+    sqlite3_bind_int(stmt, 4, 2 * LIFESPAN_APPROX_DAYS);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        Lifespan span;
+        if (lifespan_from_row(stmt, &span) && span.start <= to_day && span.end >= from_day) {
+            lifespan_results_add(&results, span.id);
+        }
+    }
+    if (rc != SQLITE_DONE) fprintf(stderr, "Failed to search lifespans: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+
+    qsort(ids, results.count, sizeof(int), compare_ids);
+    *count = results.count;
+    *total = results.total;
+    free(bitmap);
+    return rc == SQLITE_DONE ? 0 : 1;
+}
+
+/*
+ * Serve mode builds the index once in the listening process, and every
+ * connection's child inherits it through fork. Before each fork the
+ * parent checks whether the database changed, and rebuilds once enough
+ * changes have piled up to make the per-query catch-up noticeable.
+ *
+ * The triggers only log changes while the lease in lifespan_watch is
+ * current. The parent takes it before building and renews it before
+ * each fork; if it ran out while the server sat idle, changes may have
+ * gone unlogged, so the index is rebuilt.
+ */
+static LifespanIndex *preloaded;
+static sqlite3 *preload_db;
+static int preload_data_version;
+static time_t watch_expires;
+
+static int lifespan_data_version(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+static int lifespan_watch_renew(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "INSERT INTO lifespan_watch (id, expires_at) VALUES (1, ?) "
+        "ON CONFLICT (id) DO UPDATE SET expires_at = MAX(expires_at, excluded.expires_at);";
+
+    time_t expires = time(NULL) + LIFESPAN_WATCH_SECONDS;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_bind_int64(stmt, 1, expires);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to renew lifespan watch: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    watch_expires = expires;
+    return 0;
+}
+
+int lifespan_index_preload(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+
+    // Changes from here on are logged, so none slip in between the build and the lease
+    if (lifespan_watch_renew(db) != 0) return 1;
+    LifespanIndex *index = lifespan_index_build(db);
+    if (!index) return 1;
+
+    /*
+     * A snapshot only reads lifespan_changes past its own change_seq.
+     * Children still running on the previous snapshot need the rows past
+     * that one, so rows up to it are consumed; on the first build, with
+     * no children yet, rows up to the new one are.
+     */
+    sqlite3_int64 consumed = preloaded ? preloaded->change_seq : index->change_seq;
+    lifespan_index_free(preloaded);
+    preloaded = index;
+    preload_db = db;
+    if (sqlite3_prepare_v2(db, "DELETE FROM lifespan_changes WHERE seq <= ?;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, consumed);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            fprintf(stderr, "Failed to prune lifespan changes: %s\n", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+    }
+    preload_data_version = lifespan_data_version(db);
+    return 0;
+}
+
+void lifespan_index_maintain(void) {
+    sqlite3_stmt *stmt;
+    if (!preloaded) return;
+
+    time_t now = time(NULL);
+    if (now >= watch_expires) {
+        // The lease lapsed, so edits since may be missing from the log; without a rebuild, drop the index
+        if (lifespan_index_preload(preload_db) != 0) {
+            lifespan_index_free(preloaded);
+            preloaded = NULL;
+        }
+        return;
+    }
+    if (watch_expires - now < LIFESPAN_WATCH_SECONDS / 2) lifespan_watch_renew(preload_db);
+
+    int version = lifespan_data_version(preload_db);
+    if (version == preload_data_version) return;
+    preload_data_version = version;
+
+    // New dated people are logged too, so the change log alone counts the catch-up work
+    const char *sql = "SELECT COUNT(*) FROM lifespan_changes WHERE seq > ?;";
+    int pending = 0;
+    if (sqlite3_prepare_v2(preload_db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, preloaded->change_seq);
+        if (sqlite3_step(stmt) == SQLITE_ROW) pending = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    if (pending >= LIFESPAN_REBUILD_CHANGES) {
+        lifespan_index_preload(preload_db);
+    }
+}
+
+LifespanIndex *lifespan_index_preloaded(void) {
+    return preloaded;
+}
+
+// Benchmark against a linear scan and the SQL equivalent
+
+static double lifespan_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int lifespan_benchmark(sqlite3 *db, int samples) {
+    if (samples <= 0) samples = 200;
+
+    double start = lifespan_now();
+    LifespanIndex *index = lifespan_index_build(db);
+    double build_time = lifespan_now() - start;
+    if (!index) return 1;
+    if (index->count == 0) {
+        fprintf(stderr, "No dated people to benchmark\n");
+        lifespan_index_free(index);
+        return 1;
+    }
+
+    int depth = 0, max_depth = 0;
+    int *stack = malloc(sizeof(int) * 2 * (index->node_count + 1));
+    int *days = malloc(sizeof(int) * samples);
+    if (!stack || !days) {
+        free(stack);
+        free(days);
+        lifespan_index_free(index);
+        return 1;
+    }
+    stack[0] = index->root;
+    stack[1] = 1;
+    for (int top = 1; top > 0;) {
+        top--;
+        int node = stack[2 * top];
+        depth = stack[2 * top + 1];
+        if (node < 0) continue;
+        if (depth > max_depth) max_depth = depth;
+        stack[2 * top] = index->nodes[node].left;
+        stack[2 * top + 1] = depth + 1;
+        top++;
+        stack[2 * top] = index->nodes[node].right;
+        stack[2 * top + 1] = depth + 1;
+        top++;
+    }
+    free(stack);
+
+    // Sample days between the earliest start and the latest birth-based end
+    int earliest = index->by_start[0].start, latest = earliest;
+    for (int i = 0; i < index->count; i++) {
+        if (index->by_start[i].start < earliest) earliest = index->by_start[i].start;
+        if (index->by_start[i].start > latest) latest = index->by_start[i].start;
+    }
+    srand(42);
+    for (int i = 0; i < samples; i++) days[i] = earliest + (int)((double)rand() / RAND_MAX * (latest - earliest));
+
+    int ids[LIST_PAGE_SIZE];
+    long index_total = 0;
+    start = lifespan_now();
+    for (int i = 0; i < samples; i++) {
+        int count, total;
+        lifespan_alive(index, db, days[i], days[i], NULL, 0, 0, LIST_PAGE_SIZE, ids, &count, &total);
+        index_total += total;
+    }
+    double index_time = lifespan_now() - start;
+
+    // Every lifespan checked in turn: the answer the tree must match
+    long scan_total = 0;
+    start = lifespan_now();
+    for (int i = 0; i < samples; i++) {
+        for (int j = 0; j < index->count; j++) {
+            scan_total += index->by_start[j].start <= days[i] && index->by_start[j].end >= days[i];
+        }
+    }
+    double scan_time = lifespan_now() - start;
+
+    // What a process without the index does: lifespan_alive_sql
+    long sql_total = 0, sql_expected = 0;
+    int sql_samples = samples < 20 ? samples : 20;
+    start = lifespan_now();
+    for (int i = 0; i < sql_samples; i++) {
+        int count, total;
+        if (lifespan_alive_sql(db, days[i], days[i], NULL, 0, 0, LIST_PAGE_SIZE, ids, &count, &total) == 0) {
+            sql_total += total;
+        }
+    }
+    double sql_time = lifespan_now() - start;
+    for (int i = 0; i < sql_samples; i++) {
+        for (int j = 0; j < index->count; j++) {
+            sql_expected += index->by_start[j].start <= days[i] && index->by_start[j].end >= days[i];
+        }
+    }
+
+    printf("build         %.3f s, %d lifespans, %d nodes, depth %d, %.1f MB\n",
+           build_time, index->count, index->node_count, max_depth,
+           (2.0 * sizeof(Lifespan) * index->count + (double)sizeof(LifespanNode) * index->node_count) / 1e6);
+    printf("alive on day  tree: %9.1f us/query   linear scan: %9.1f us/query   SQL: %9.1f us/query   (%.0f avg alive%s)\n",
+           index_time * 1e6 / samples, scan_time * 1e6 / samples, sql_time * 1e6 / sql_samples,
+           (double)index_total / samples,
+           index_total == scan_total && sql_total == sql_expected ? "" : ", MISMATCH");
+
+    free(days);
+    lifespan_index_free(index);
+    return index_total == scan_total && sql_total == sql_expected ? 0 : 1;
+}
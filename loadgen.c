@@ -0,0 +1,581 @@
+/* loadgen.c - CGI load-replay harness for family tree application */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Replays a weighted mix of QUERY_STRINGs against family_tree.cgi, one
+ * process per request exactly as a web server would run it, or against an
+ * HTTP endpoint with -u. Several workers run concurrently for a fixed
+ * time or request count; the report gives throughput, latency percentiles
+ * and error rates overall and per action.
+ *
+ * Mix files have one query per line, optionally prefixed by a weight.
+ * A query marked POST is sent as an urlencoded form body instead, as the
+ * add and edit forms submit it:
+ *
+ *   35 action=view_profile&id={id}
+ *   action=search&search_term={term}
+ *   5 POST action=process_add_person&first_name=Load&last_name=Test{n}
+ *
+ * Placeholders: {id} random person id up to -m, {levels} 1-5, {term} a
+ * search term, {n} a unique number. The CGI opens family_tree.db in the
+ * working directory, so run from (or -C into) the directory holding it.
+ *
+ * Usage: loadgen [-c workers] [-t seconds | -n requests] [-f mixfile]
+ *                [-m max_id] [-b cgi_binary | -u http://host:port/path] [-C dir]
+ */
+
+#define LOADGEN_DEFAULT_WORKERS 4
+#define LOADGEN_DEFAULT_SECONDS 10
+#define LOADGEN_DEFAULT_MAX_ID 1000
+#define LOADGEN_DEFAULT_CGI "./family_tree.cgi"
+#define LOADGEN_MAX_QUERY 1024
+#define LOADGEN_MAX_ACTIONS 32
+
+extern char **environ;
+
+typedef struct {
+    char *query;
+    char action[32];
+    int weight;
+    int post;           // Send the query as a form body
+} MixEntry;
+
+typedef struct {
+    double *latencies;
+    int count;
+    int capacity;
+    int errors;
+} ActionStats;
+
+typedef struct {
+    int id;
+    unsigned int seed;
+    ActionStats actions[LOADGEN_MAX_ACTIONS];
+    long bytes;
+} Worker;
+
+static MixEntry *mix = NULL;
+static int mix_count = 0;
+static int mix_total_weight = 0;
+
+static const char *cgi_path = LOADGEN_DEFAULT_CGI;
+static const char *http_host = NULL;
+static const char *http_port = "80";
+static const char *http_path = "/";
+static int max_id = LOADGEN_DEFAULT_MAX_ID;
+
+static double deadline = 0;
+static long request_limit = 0;
+static long requests_started = 0;
+static long unique_counter = 0;
+
+static const char *default_mix[] = {
+    "35 action=view_profile&id={id}",
+    "25 action=view_tree&root_id={id}&levels={levels}",
+    "20 action=search&search_term={term}",
+    "5 action=add_person&person_id={id}&relationship_type=parent-child",
+    "5 POST action=process_add_person&first_name=Load&last_name=Test{n}&gender=F&birth_date=1990-01-01&parent_id={id}&relationship_type=parent-child",
+    "5 action=edit_person&id={id}",
+    "5 POST action=process_edit_person&id={id}&first_name=Load&last_name=Edit{n}&gender=M&birth_date=1950-01-01",
+};
+
+static const char *search_terms[] = { "Smith", "ann", "Otieno", "Mary", "zzq", "Jo" };
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_mix_line(const char *line) {
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '#' || *line == '\n') return 0;
+
+    int weight = 1;
+    char *end;
+    long parsed = strtol(line, &end, 10);
+    if (end != line && (*end == ' ' || *end == '\t')) {
+        weight = parsed > 0 ? (int)parsed : 1;
+        line = end;
+        while (*line == ' ' || *line == '\t') line++;
+    }
+
+    MixEntry *grown = realloc(mix, sizeof(MixEntry) * (mix_count + 1));
+    if (!grown) return 1;
+    mix = grown;
+
+    MixEntry *entry = &mix[mix_count];
+    entry->post = strncmp(line, "POST", 4) == 0 && (line[4] == ' ' || line[4] == '\t');
+    if (entry->post) {
+        line += 4;
+        while (*line == ' ' || *line == '\t') line++;
+    }
+    entry->query = strdup(line);
+    if (!entry->query) return 1;
+    entry->query[strcspn(entry->query, "\r\n")] = '\0';
+    entry->weight = weight;
+
+    // Label by the action parameter so the report can break latency down
+    const char *action = strstr(entry->query, "action=");
+    if (action && (action == entry->query || action[-1] == '&')) {
+        action += 7;
+        size_t len = strcspn(action, "&");
+        if (len >= sizeof(entry->action)) len = sizeof(entry->action) - 1;
+        memcpy(entry->action, action, len);
+        entry->action[len] = '\0';
+    } else {
+        strcpy(entry->action, "home");
+    }
+
+    mix_count++;
+    mix_total_weight += weight;
+    return 0;
+}
+
+static int load_mix(const char *path) {
+    if (!path) {
+        for (size_t i = 0; i < sizeof(default_mix) / sizeof(default_mix[0]); i++) {
+            if (add_mix_line(default_mix[i])) return 1;
+        }
+        return 0;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Cannot open mix file %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    char line[LOADGEN_MAX_QUERY];
+    while (fgets(line, sizeof(line), file)) {
+        if (add_mix_line(line)) {
+            fclose(file);
+            return 1;
+        }
+    }
+    fclose(file);
+
+    if (mix_count == 0) {
+        fprintf(stderr, "Mix file %s has no queries\n", path);
+        return 1;
+    }
+    if (mix_count > LOADGEN_MAX_ACTIONS) {
+        fprintf(stderr, "Mix file %s has more than %d entries\n", path, LOADGEN_MAX_ACTIONS);
+        return 1;
+    }
+    return 0;
+}
+
+static int pick_entry(Worker *worker) {
+    int target = rand_r(&worker->seed) % mix_total_weight;
+    for (int i = 0; i < mix_count; i++) {
+        target -= mix[i].weight;
+        if (target < 0) return i;
+    }
+    return mix_count - 1;
+}
+
+// Expand placeholders into a concrete query string
+static void expand_query(Worker *worker, const char *pattern, char *out, size_t size) {
+    size_t used = 0;
+    for (const char *p = pattern; *p && used + 1 < size; ) {
+        char value[64] = "";
+        size_t skip = 0;
+
+        if (strncmp(p, "{id}", 4) == 0) {
+            snprintf(value, sizeof(value), "%d", 1 + rand_r(&worker->seed) % max_id);
+            skip = 4;
+        } else if (strncmp(p, "{levels}", 8) == 0) {
+            snprintf(value, sizeof(value), "%d", 1 + rand_r(&worker->seed) % 5);
+            skip = 8;
+        } else if (strncmp(p, "{term}", 6) == 0) {
+            int count = (int)(sizeof(search_terms) / sizeof(search_terms[0]));
+            snprintf(value, sizeof(value), "%s", search_terms[rand_r(&worker->seed) % count]);
+            skip = 6;
+        } else if (strncmp(p, "{n}", 3) == 0) {
+            snprintf(value, sizeof(value), "%ld", __atomic_add_fetch(&unique_counter, 1, __ATOMIC_RELAXED));
+            skip = 3;
+        }
+
+        if (skip) {
+            used += snprintf(out + used, size - used, "%s", value);
+            if (used >= size) used = size - 1;
+            p += skip;
+        } else {
+            out[used++] = *p++;
+        }
+    }
+    out[used] = '\0';
+}
+
+// Drain a descriptor; returns bytes read and copies the first few into head
+static long drain(int fd, char *head, size_t head_size) {
+    char buffer[16384];
+    long total = 0;
+    size_t head_used = 0;
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (head_used + 1 < head_size) {
+            size_t copy = head_size - 1 - head_used;
+            if ((size_t)n < copy) copy = n;
+            memcpy(head + head_used, buffer, copy);
+            head_used += copy;
+        }
+        total += n;
+    }
+    head[head_used] = '\0';
+    return total;
+}
+
+static int run_cgi(const char *query, int post, long *bytes) {
+    int pipefd[2], bodyfd[2] = { -1, -1 };
+    if (pipe(pipefd) != 0) return 1;
+
+    // A form body goes through a pipe on stdin; it is far smaller than the pipe buffer
+    size_t body_len = post ? strlen(query) : 0;
+    if (post && (pipe(bodyfd) != 0 || write(bodyfd[1], query, body_len) != (ssize_t)body_len)) {
+        if (bodyfd[0] >= 0) {
+            close(bodyfd[0]);
+            close(bodyfd[1]);
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 1;
+    }
+    if (post) close(bodyfd[1]);
+
+    // Inherit the caller's environment and add the CGI variables a web server sets
+    int env_count = 0;
+    while (environ[env_count]) env_count++;
+    char **envp = malloc(sizeof(char*) * (env_count + 10));
+    if (!envp) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (post) close(bodyfd[0]);
+        return 1;
+    }
+
+    char query_var[LOADGEN_MAX_QUERY + 16], length_var[48];
+    snprintf(query_var, sizeof(query_var), "QUERY_STRING=%s", post ? "" : query);
+    snprintf(length_var, sizeof(length_var), "CONTENT_LENGTH=%zu", body_len);
+    int e = 0;
+    for (int i = 0; i < env_count; i++) {
+        if (strncmp(environ[i], "QUERY_STRING=", 13) != 0 && strncmp(environ[i], "REQUEST_METHOD=", 15) != 0 &&
+            strncmp(environ[i], "GATEWAY_INTERFACE=", 18) != 0 && strncmp(environ[i], "CONTENT_", 8) != 0) {
+            envp[e++] = environ[i];
+        }
+    }
+    envp[e++] = "GATEWAY_INTERFACE=CGI/1.1";
+    envp[e++] = post ? "REQUEST_METHOD=POST" : "REQUEST_METHOD=GET";
+    if (post) {
+        envp[e++] = "CONTENT_TYPE=application/x-www-form-urlencoded";
+        envp[e++] = length_var;
+    }
+    envp[e++] = "SERVER_PROTOCOL=HTTP/1.1";
+    envp[e++] = "SCRIPT_NAME=/cgi-bin/family_tree.cgi";
+    envp[e++] = "REMOTE_ADDR=127.0.0.1";
+    envp[e++] = query_var;
+    envp[e] = NULL;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, pipefd[0]);
+    posix_spawn_file_actions_addclose(&actions, pipefd[1]);
+    if (post) {
+        posix_spawn_file_actions_adddup2(&actions, bodyfd[0], STDIN_FILENO);
+        posix_spawn_file_actions_addclose(&actions, bodyfd[0]);
+    } else {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char *argv[] = { (char*)cgi_path, NULL };
+    pid_t pid;
+    int rc = posix_spawn(&pid, cgi_path, &actions, NULL, argv, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    free(envp);
+    close(pipefd[1]);
+    if (post) close(bodyfd[0]);
+
+    if (rc != 0) {
+        close(pipefd[0]);
+        return 1;
+    }
+
+    char head[256];
+    *bytes = drain(pipefd[0], head, sizeof(head));
+    close(pipefd[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+    if (strncmp(head, "Content-Type:", 13) != 0 || strstr(head, "Database Error")) return 1;
+    return 0;
+}
+
+static int run_http(const char *query, int post, long *bytes) {
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(http_host, http_port, &hints, &result) != 0) return 1;
+
+    int fd = -1;
+    for (struct addrinfo *ai = result; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) return 1;
+
+    char request[2 * LOADGEN_MAX_QUERY + 256];
+    int len;
+    if (post) {
+        len = snprintf(request, sizeof(request),
+                       "POST %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+                       "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n\r\n%s",
+                       http_path, http_host, strlen(query), query);
+    } else {
+        len = snprintf(request, sizeof(request),
+                       "GET %s?%s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                       http_path, query, http_host);
+    }
+    for (int sent = 0; sent < len; ) {
+        ssize_t n = write(fd, request + sent, len - sent);
+        if (n <= 0) {
+            close(fd);
+            return 1;
+        }
+        sent += n;
+    }
+
+    char head[256];
+    *bytes = drain(fd, head, sizeof(head));
+    close(fd);
+
+    // Any 2xx status line counts as success
+    return !(strncmp(head, "HTTP/1.", 7) == 0 && strlen(head) > 9 && head[9] == '2');
+}
+
+static int record(ActionStats *stats, double latency, int error) {
+    if (stats->count == stats->capacity) {
+        int capacity = stats->capacity ? stats->capacity * 2 : 1024;
+        double *grown = realloc(stats->latencies, sizeof(double) * capacity);
+        if (!grown) return 1;
+        stats->latencies = grown;
+        stats->capacity = capacity;
+    }
+    stats->latencies[stats->count++] = latency;
+    if (error) stats->errors++;
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    Worker *worker = arg;
+    char query[LOADGEN_MAX_QUERY];
+
+    for (;;) {
+        if (request_limit > 0) {
+            if (__atomic_fetch_add(&requests_started, 1, __ATOMIC_RELAXED) >= request_limit) break;
+        } else if (now_seconds() >= deadline) {
+            break;
+        }
+
+        int entry = pick_entry(worker);
+        expand_query(worker, mix[entry].query, query, sizeof(query));
+
+        long bytes = 0;
+        double start = now_seconds();
+        int post = mix[entry].post;
+        int error = http_host ? run_http(query, post, &bytes) : run_cgi(query, post, &bytes);
+        double latency = now_seconds() - start;
+
+        worker->bytes += bytes;
+        if (record(&worker->actions[entry], latency, error)) break;
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    if (count == 0) return 0;
+    int index = (int)(p * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+static void print_row(const char *label, double *latencies, int count, int errors, double elapsed) {
+    qsort(latencies, count, sizeof(double), compare_double);
+    printf("%-22s %8d %9.1f %7.2f%% %9.2f %9.2f %9.2f %9.2f\n", label, count, count / elapsed,
+           count ? 100.0 * errors / count : 0.0,
+           percentile(latencies, count, 0.50) * 1e3, percentile(latencies, count, 0.99) * 1e3,
+           percentile(latencies, count, 0.999) * 1e3, count ? latencies[count - 1] * 1e3 : 0.0);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-c workers] [-t seconds | -n requests] [-f mixfile] [-m max_id]\n"
+                    "       [-b cgi_binary | -u http://host:port/path] [-C dir] [-s seed]\n", program);
+}
+
+static int parse_url(char *url) {
+    if (strncmp(url, "http://", 7) != 0) return 1;
+    char *host = url + 7;
+    char *slash = strchr(host, '/');
+    if (slash) {
+        http_path = strdup(slash);
+        *slash = '\0';
+    }
+    char *colon = strchr(host, ':');
+    if (colon) {
+        *colon = '\0';
+        http_port = colon + 1;
+    }
+    http_host = host;
+    return *host == '\0';
+}
+
+int main(int argc, char *argv[]) {
+    int workers = LOADGEN_DEFAULT_WORKERS;
+    double seconds = LOADGEN_DEFAULT_SECONDS;
+    const char *mix_path = NULL;
+    const char *directory = NULL;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:n:f:m:b:u:C:s:h")) != -1) {
+        switch (opt) {
+            case 'c': workers = atoi(optarg); break;
+            case 't': seconds = atof(optarg); break;
+            case 'n': request_limit = atol(optarg); break;
+            case 'f': mix_path = optarg; break;
+            case 'm': max_id = atoi(optarg); break;
+            case 'b': cgi_path = optarg; break;
+            case 'u':
+                if (parse_url(optarg)) {
+                    fprintf(stderr, "Expected a URL like http://localhost:8080/\n");
+                    return 1;
+                }
+                break;
+            case 'C': directory = optarg; break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (workers < 1 || max_id < 1 || (request_limit <= 0 && seconds <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (load_mix(mix_path)) return 1;
+
+    // Resolve the binary before changing directory so relative paths keep working
+    char resolved[4096];
+    if (!http_host && realpath(cgi_path, resolved)) cgi_path = resolved;
+    if (!http_host && access(cgi_path, X_OK) != 0) {
+        fprintf(stderr, "Cannot execute %s\n", cgi_path);
+        return 1;
+    }
+    if (directory && chdir(directory) != 0) {
+        fprintf(stderr, "Cannot change to %s: %s\n", directory, strerror(errno));
+        return 1;
+    }
+
+    Worker *pool = calloc(workers, sizeof(Worker));
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    if (!pool || !threads) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    double start = now_seconds();
+    deadline = start + seconds;
+
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pool[i].id = i;
+        pool[i].seed = seed * 7919u + i;
+        if (pthread_create(&threads[i], NULL, worker_main, &pool[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    double elapsed = now_seconds() - start;
+
+    // Merge per-worker samples by action, then overall
+    long total = 0, total_errors = 0, total_bytes = 0;
+    for (int w = 0; w < started; w++) {
+        total_bytes += pool[w].bytes;
+        for (int a = 0; a < mix_count; a++) total += pool[w].actions[a].count;
+    }
+    double *all = malloc(sizeof(double) * (total > 0 ? total : 1));
+    if (!all) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    printf("target: %s, workers: %d, elapsed: %.2f s\n", http_host ? http_host : cgi_path, started, elapsed);
+    printf("%-22s %8s %9s %8s %9s %9s %9s %9s\n", "action", "requests", "req/s", "errors",
+           "p50 ms", "p99 ms", "p999 ms", "max ms");
+
+    long offset = 0;
+    for (int a = 0; a < mix_count; a++) {
+        int count = 0, errors = 0;
+        for (int w = 0; w < started; w++) count += pool[w].actions[a].count;
+        double *latencies = malloc(sizeof(double) * (count > 0 ? count : 1));
+        if (!latencies) break;
+
+        count = 0;
+        for (int w = 0; w < started; w++) {
+            ActionStats *stats = &pool[w].actions[a];
+            memcpy(latencies + count, stats->latencies, sizeof(double) * stats->count);
+            count += stats->count;
+            errors += stats->errors;
+            free(stats->latencies);
+        }
+        memcpy(all + offset, latencies, sizeof(double) * count);
+        offset += count;
+        total_errors += errors;
+
+        print_row(mix[a].action, latencies, count, errors, elapsed);
+        free(latencies);
+    }
+    print_row("total", all, (int)offset, (int)total_errors, elapsed);
+    printf("throughput: %.1f req/s, %.1f KiB/s, error rate %.2f%%\n", offset / elapsed,
+           total_bytes / 1024.0 / elapsed, offset ? 100.0 * total_errors / offset : 0.0);
+
+    free(all);
+    free(pool);
+    free(threads);
+    for (int i = 0; i < mix_count; i++) free(mix[i].query);
+    free(mix);
+    return total_errors > 0 ? 2 : 0;
+}
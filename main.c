@@ -1,12 +1,14 @@
 /* main.c - Main entry point for family tree CGI application */
 
 #include "family_tree.h"
+#include "templates_gen.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
 #include <sqlite3.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 // Structure definitions (moved from family_tree.h for completeness)
 
@@ -27,87 +29,184 @@ void render_family_tree(sqlite3 *db, int root_id, int levels);
 void render_person_profile(sqlite3 *db, int person_id);
 
 
+/*
+ * A query string is decoded into a single allocation laid out as
+ * [CGIParam array][index slots][decoded text], so a request costs one
+ * malloc however many parameters it has. Decoding never makes text
+ * longer, which bounds the text area by the input length. Lookups go
+ * through an open-addressing table keyed by a seeded hash of the name;
+ * as before, the first occurrence of a repeated name wins.
+ */
+static unsigned int cgi_hash_seed = 0;
+
+static unsigned int cgi_hash(const char *name) {
+    unsigned int hash = 2166136261u ^ cgi_hash_seed;
+    for (const unsigned char *p = (const unsigned char*)name; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode [src, end) into dst and NUL-terminate; returns the byte after the terminator
+static char *url_decode_into(const char *src, const char *end, char *dst) {
+    while (src < end) {
+        if (*src == '+') {
+            *dst++ = ' ';
+            src++;
+        } else if (*src == '%' && end - src >= 3) {
+            int high = hex_value(src[1]);
+            int low = hex_value(src[2]);
+            if (high >= 0 && low >= 0) {
+                *dst++ = (char)(high * 16 + low);
+                src += 3;
+            } else {
+                *dst++ = *src++;
+            }
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst++ = '\0';
+    return dst;
+}
+
+// Lay out [params][index][text] in one allocation; returns the text area
+static char *alloc_cgi_params(CGIParams *params, int max_params, size_t text_len) {
+    memset(params, 0, sizeof(*params));
+    
+    if (!cgi_hash_seed) {
+        cgi_hash_seed = ((unsigned int)time(NULL) ^ (unsigned int)(size_t)params) | 1;
+    }
+    
+    unsigned int slots = 8;
+    while (slots < (unsigned int)max_params * 2) {
+        slots <<= 1;
+    }
+    
+    char *buffer = malloc(sizeof(CGIParam) * max_params + sizeof(int) * slots + text_len);
+    if (!buffer) {
+        return NULL;
+    }
+    
+    params->buffer = buffer;
+    params->params = (CGIParam*)buffer;
+    params->index = (int*)(params->params + max_params);
+    params->index_mask = slots - 1;
+    memset(params->index, 0, sizeof(int) * slots);
+    return (char*)(params->index + slots);
+}
+
+// Append the next parsed parameter to the index unless its name is already there
+static void index_cgi_param(CGIParams *params) {
+    CGIParam *param = &params->params[params->count];
+    unsigned int slot = cgi_hash(param->name) & params->index_mask;
+    while (params->index[slot] && strcmp(params->params[params->index[slot] - 1].name, param->name) != 0) {
+        slot = (slot + 1) & params->index_mask;
+    }
+    if (!params->index[slot]) {
+        params->index[slot] = params->count + 1;
+    }
+    params->count++;
+}
+
 CGIParams parse_query_string(const char *query_string) {
-    CGIParams params = {NULL, 0};
+    CGIParams params;
+    memset(&params, 0, sizeof(params));
     if (!query_string || !*query_string) {
         return params;
     }
     
-    // Count parameters
-    const char *p = query_string;
-    params.count = 1;
-    while (*p) {
+    // Upper bound on parameters: one per separator plus one
+    size_t len = 0;
+    int max_params = 1;
+    for (const char *p = query_string; *p; p++, len++) {
         if (*p == '&') {
-            params.count++;
+            max_params++;
         }
-        p++;
     }
     
-    // Allocate memory
-    params.params = malloc(sizeof(CGIParam) * params.count);
-    if (!params.params) {
-        params.count = 0;
+    // Each parameter adds at most two terminators to its text
+    char *text = alloc_cgi_params(&params, max_params, len + 2 * (size_t)max_params);
+    if (!text) {
         return params;
     }
     
-    // Parse parameters
-    char *qs = strdup(query_string);
-    char *token = strtok(qs, "&");
-    int i = 0;
-    
-    while (token && i < params.count) {
-        char *value = strchr(token, '=');
-        if (value) {
-            *value = '\0'; // Split name and value
-            value++;
-            
-            // URL decode
-            params.params[i].name = strdup(token);
-            params.params[i].value = strdup(value);
+    const char *p = query_string;
+    while (*p) {
+        const char *end = strchr(p, '&');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        
+        // Empty pairs ("a=1&&b=2") are skipped
+        if (end > p) {
+            const char *equals = memchr(p, '=', end - p);
+            CGIParam *param = &params.params[params.count];
             
-            // Decode URL-encoded characters (simplified)
-            char *src, *dst;
-            for (src = dst = params.params[i].value; *src; src++, dst++) {
-                if (*src == '+') {
-                    *dst = ' ';
-                } else if (*src == '%' && src[1] && src[2]) {
-                    int hex;
-                    sscanf(src + 1, "%2x", &hex);
-                    *dst = hex;
-                    src += 2;
-                } else {
-                    *dst = *src;
-                }
-            }
-            *dst = '\0';
-        } else {
-            params.params[i].name = strdup(token);
-            params.params[i].value = strdup("");
+            param->name = text;
+            text = url_decode_into(p, equals ? equals : end, text);
+            param->value = text;
+            text = url_decode_into(equals ? equals + 1 : end, end, text);
+            index_cgi_param(&params);
         }
         
-        token = strtok(NULL, "&");
-        i++;
+        p = *end ? end + 1 : end;
+    }
+    
+    return params;
+}
+
+// Build params from already decoded name and value strings, each NUL-terminated, in order
+CGIParams cgi_params_from_pairs(const char *pairs, size_t len, int count) {
+    CGIParams params;
+    memset(&params, 0, sizeof(params));
+    if (count == 0) {
+        return params;
+    }
+    
+    char *text = alloc_cgi_params(&params, count, len);
+    if (!text) {
+        return params;
+    }
+    memcpy(text, pairs, len);
+    
+    for (int i = 0; i < count; i++) {
+        CGIParam *param = &params.params[i];
+        param->name = text;
+        text += strlen(text) + 1;
+        param->value = text;
+        text += strlen(text) + 1;
+        index_cgi_param(&params);
     }
     
-    free(qs);
     return params;
 }
 
 char* get_cgi_param(CGIParams params, const char *name) {
-    for (int i = 0; i < params.count; i++) {
-        if (strcmp(params.params[i].name, name) == 0) {
-            return params.params[i].value;
+    if (!params.index) {
+        return NULL;
+    }
+    
+    unsigned int slot = cgi_hash(name) & params.index_mask;
+    while (params.index[slot]) {
+        CGIParam *param = &params.params[params.index[slot] - 1];
+        if (strcmp(param->name, name) == 0) {
+            return param->value;
         }
+        slot = (slot + 1) & params.index_mask;
     }
     return NULL; // Return NULL if the parameter is not found
 }
 
 void free_cgi_params(CGIParams params) {
-    for (int i = 0; i < params.count; i++) {
-        free(params.params[i].name);
-        free(params.params[i].value);
-    }
-    free(params.params);
+    free(params.buffer);
 }
 
 // HTML helper functions
@@ -125,16 +224,12 @@ void free_cgi_params(CGIParams params) {
 void free_person(Person *person) {
     if (!person) return;
     
-    free(person->first_name);
-    free(person->last_name);
     free(person->birth_date);
     free(person->death_date);
     free(person->bio);
     free(person->photo_url);
     
-    // Reset to avoid double-free
-    person->first_name = NULL;
-    person->last_name = NULL;
+    // Reset to avoid double-free; names are interned, not owned
     person->birth_date = NULL;
     person->death_date = NULL;
     person->bio = NULL;
@@ -155,8 +250,8 @@ int get_person_by_id(sqlite3 *db, int id, Person *person) {
     
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         person->id = sqlite3_column_int(stmt, 0);
-        person->first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-        person->last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
+        person->first_name_id = intern_column(stmt, 1);
+        person->last_name_id = intern_column(stmt, 2);
         person->gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
         person->birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
         person->death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
@@ -204,8 +299,8 @@ int get_parents(sqlite3 *db, int child_id, Person *father, Person *mother) {
         
         if (parent) {
             parent->id = sqlite3_column_int(stmt, 0);
-            parent->first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-            parent->last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
+            parent->first_name_id = intern_column(stmt, 1);
+            parent->last_name_id = intern_column(stmt, 2);
             parent->gender = gender;
             parent->birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
             parent->death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
@@ -243,8 +338,8 @@ int get_spouse(sqlite3 *db, int person_id, Person *spouse) {
     
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         spouse->id = sqlite3_column_int(stmt, 0);
-        spouse->first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-        spouse->last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
+        spouse->first_name_id = intern_column(stmt, 1);
+        spouse->last_name_id = intern_column(stmt, 2);
         spouse->gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
         spouse->birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
         spouse->death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
@@ -266,8 +361,9 @@ int update_person(sqlite3 *db, Person *person) {
     const char *sql = 
         "UPDATE people SET "
         "first_name = ?, last_name = ?, gender = ?, birth_date = ?, "
-        "death_date = ?, bio = ?, photo_url = ?, updated_at = ? "
-        "WHERE id = ?;";
+        "death_date = ?, bio = ?, photo_url = ?, updated_at = ?, "
+        "birth_day = ?10, birth_precision = ?11, death_day = ?12, death_precision = ?13 "
+        "WHERE id = ?9;";
     
     int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
     if (rc != SQLITE_OK) {
@@ -278,8 +374,8 @@ int update_person(sqlite3 *db, Person *person) {
     time_t now = time(NULL);
     person->updated_at = now;
     
-    sqlite3_bind_text(stmt, 1, person->first_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, person->last_name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 1, person->first_name_id ? interned_string(person->first_name_id) : "", -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, person->last_name_id ? interned_string(person->last_name_id) : "", -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, &person->gender, 1, SQLITE_STATIC);
     
     if (person->birth_date)
@@ -304,6 +400,8 @@ int update_person(sqlite3 *db, Person *person) {
         
     sqlite3_bind_int64(stmt, 8, person->updated_at);
     sqlite3_bind_int(stmt, 9, person->id);
+    bind_date_day(stmt, 10, person->birth_date);
+    bind_date_day(stmt, 12, person->death_date);
     
     rc = sqlite3_step(stmt);
     sqlite3_finalize(stmt);
@@ -318,40 +416,23 @@ int update_person(sqlite3 *db, Person *person) {
 void render_person_card(Person *person) {
     if (!person || !person->id) return;
     
-    char *escaped_first_name = html_escape(person->first_name);
-    char *escaped_last_name = html_escape(person->last_name);
-    char *gender_class = (person->gender == 'M') ? "male" : "female";
-    
-    printf("<div class=\"person-card %s\">\n", gender_class);
-    if (person->photo_url) {
-        char *escaped_photo_url = html_escape(person->photo_url);
-        printf("  <img src=\"%s\" alt=\"%s %s\" class=\"person-photo\">\n", 
-               escaped_photo_url, escaped_first_name, escaped_last_name);
-        free(escaped_photo_url);
-    } else {
-        printf("  <div class=\"person-photo-placeholder\"></div>\n");
-    }
-    
-    printf("  <h3>%s %s</h3>\n", escaped_first_name, escaped_last_name);
-    
-    if (person->birth_date) {
-        char *escaped_birth = html_escape(person->birth_date);
-        printf("  <p>Born: %s</p>\n", escaped_birth);
-        free(escaped_birth);
+    // Cards show stored photos through their thumbnail
+    char thumb_url[sizeof(THUMB_URL_PREFIX) + BLOB_HASH_HEX];
+    const char *photo_url = person->photo_url;
+    if (photo_url && strncmp(photo_url, PHOTO_URL_PREFIX, strlen(PHOTO_URL_PREFIX)) == 0) {
+        snprintf(thumb_url, sizeof(thumb_url), THUMB_URL_PREFIX "%s", photo_url + strlen(PHOTO_URL_PREFIX));
+        photo_url = thumb_url;
     }
     
-    if (person->death_date) {
-        char *escaped_death = html_escape(person->death_date);
-        printf("  <p>Died: %s</p>\n", escaped_death);
-        free(escaped_death);
-    }
-    
-    printf("  <a href=\"?action=view_profile&id=%d\" class=\"btn-primary\">View Profile</a>\n", person->id);
-    
-    printf("</div>\n");
-    
-    free(escaped_first_name);
-    free(escaped_last_name);
+    tpl_person_card(&(TplPersonCard){
+        .gender_class = (person->gender == 'M') ? "male" : "female",
+        .photo_url = photo_url,
+        .first_name = interned_string(person->first_name_id),
+        .last_name = interned_string(person->last_name_id),
+        .birth_date = person->birth_date,
+        .death_date = person->death_date,
+        .id = person->id,
+    });
 }
 
 
@@ -359,64 +440,18 @@ void render_person_card(Person *person) {
 
 
 void show_add_person_form(sqlite3 *db, int parent_id, const char *relationship_type) {
-    printf("<h2>Add %s</h2>\n", relationship_type ? relationship_type : "Person");
-    
-    printf("<form action=\"?action=process_add_person\" method=\"post\">\n");
-    
-    if (parent_id > 0 && relationship_type) {
-        printf("<input type=\"hidden\" name=\"parent_id\" value=\"%d\">\n", parent_id);
-        printf("<input type=\"hidden\" name=\"relationship_type\" value=\"%s\">\n", relationship_type);
-    }
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"first_name\">First Name:</label>\n");
-    printf("<input type=\"text\" id=\"first_name\" name=\"first_name\" class=\"form-control\" required>\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"last_name\">Last Name:</label>\n");
-    printf("<input type=\"text\" id=\"last_name\" name=\"last_name\" class=\"form-control\" required>\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"gender\">Gender:</label>\n");
-    printf("<select id=\"gender\" name=\"gender\" class=\"form-control\">\n");
-    printf("<option value=\"M\">Male</option>\n");
-    printf("<option value=\"F\">Female</option>\n");
-    printf("</select>\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"birth_date\">Birth Date:</label>\n");
-    printf("<input type=\"date\" id=\"birth_date\" name=\"birth_date\" class=\"form-control\">\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"death_date\">Death Date (if applicable):</label>\n");
-    printf("<input type=\"date\" id=\"death_date\" name=\"death_date\" class=\"form-control\">\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"bio\">Biography:</label>\n");
-    printf("<textarea id=\"bio\" name=\"bio\" class=\"form-control\" rows=\"5\"></textarea>\n");
-    printf("</div>\n");
-    
-    printf("<div class=\"form-group\">\n");
-    printf("<label for=\"photo_url\">Photo URL:</label>\n");
-    printf("<input type=\"url\" id=\"photo_url\" name=\"photo_url\" class=\"form-control\">\n");
-    printf("</div>\n");
-    
-    if (strcmp(relationship_type, "spouse") == 0) {
-        printf("<div class=\"form-group\">\n");
-        printf("<label for=\"marriage_date\">Marriage Date:</label>\n");
-        printf("<input type=\"date\" id=\"marriage_date\" name=\"marriage_date\" class=\"form-control\">\n");
-        printf("</div>\n");
-    }
-    
-    printf("<button type=\"submit\" class=\"btn-primary\">Add Person</button>\n");
-    printf("<a href=\"?action=view_profile&id=%d\" class=\"btn-secondary\">Cancel</a>\n", parent_id);
-    
-    printf("</form>\n");
+    tpl_add_person_form(&(TplAddPersonForm){
+        .relationship_type = relationship_type,
+        .has_parent = parent_id > 0 && relationship_type,
+        .parent_id = parent_id,
+        .is_spouse = relationship_type && strcmp(relationship_type, "spouse") == 0,
+    });
+}
+
+// Intern a submitted name; returns 1 if it is not empty but could not be interned (out of memory)
+static int intern_name_param(const char *text, uint32_t *id) {
+    *id = intern_string(text);
+    return text && *text && *id == 0;
 }
 
 void process_add_person(sqlite3 *db, CGIParams params) {
@@ -429,6 +464,7 @@ void process_add_person(sqlite3 *db, CGIParams params) {
     char *death_date = get_cgi_param(params, "death_date");
     char *bio = get_cgi_param(params, "bio");
     char *photo_url = get_cgi_param(params, "photo_url");
+    char *photo = get_cgi_param(params, "photo");
     char *parent_id_str = get_cgi_param(params, "parent_id");
     char *relationship_type = get_cgi_param(params, "relationship_type");
     char *marriage_date = get_cgi_param(params, "marriage_date");
@@ -440,17 +476,22 @@ void process_add_person(sqlite3 *db, CGIParams params) {
     Person new_person;
     memset(&new_person, 0, sizeof(Person));
     
-    new_person.first_name = first_name ? strdup(first_name) : strdup("");
-    new_person.last_name = last_name ? strdup(last_name) : strdup("");
+    int names_ok = !intern_name_param(first_name, &new_person.first_name_id) &&
+                   !intern_name_param(last_name, &new_person.last_name_id);
     new_person.gender = gender;
     new_person.birth_date = birth_date && *birth_date ? strdup(birth_date) : NULL;
     new_person.death_date = death_date && *death_date ? strdup(death_date) : NULL;
     new_person.bio = bio && *bio ? strdup(bio) : NULL;
+    // An uploaded photo takes precedence over a link
+    if (photo && strncmp(photo, PHOTO_URL_PREFIX, strlen(PHOTO_URL_PREFIX)) == 0) {
+        photo_url = photo;
+    }
     new_person.photo_url = photo_url && *photo_url ? strdup(photo_url) : NULL;
     
-    if (add_person(db, &new_person) == 0) {
+    if (names_ok && add_person(db, &new_person) == 0) {
         // Person added successfully
         int new_person_id = new_person.id;
+        enqueue_thumbnail(db, new_person.photo_url);
         
         // Add relationship if parent_id is provided
         if (parent_id > 0 && relationship_type) {
@@ -522,6 +563,9 @@ void show_home_page(sqlite3 *db) {
     printf("<div class=\"home-actions\">\n");
     printf("<a href=\"?action=add_person\" class=\"btn-primary\">Add New Person</a>\n");
     printf("<a href=\"?action=view_tree\" class=\"btn-primary\">View Family Tree</a>\n");
+    printf("<a href=\"?action=browse\" class=\"btn-primary\">Browse All People</a>\n");
+    printf("<a href=\"?action=date_search\" class=\"btn-primary\">Search by Date</a>\n");
+    printf("<a href=\"?action=alive\" class=\"btn-primary\">Who Was Alive</a>\n");
     printf("</div>\n");
     
     // Show recently added people
@@ -536,8 +580,8 @@ void show_home_page(sqlite3 *db) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             Person person;
             person.id = sqlite3_column_int(stmt, 0);
-            person.first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-            person.last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
+            person.first_name_id = intern_column(stmt, 1);
+            person.last_name_id = intern_column(stmt, 2);
             person.gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
             person.birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
             person.death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
@@ -553,8 +597,629 @@ void show_home_page(sqlite3 *db) {
     }
 }
 
+/*
+ * Keyset pagination: each page continues from the sort key and id of the
+ * last row shown, as a range scan on the matching index, so a deep page
+ * costs the same as the first one instead of skipping OFFSET rows. The
+ * cursor travels in the Next link as after_key, after_key2 and after_id.
+ */
+typedef enum { PEOPLE_BY_NAME, PEOPLE_BY_BIRTH, PEOPLE_BY_DEATH } PeopleOrder;
+
+static const char *people_page_sql[] = {
+    // idx_people_name
+    [PEOPLE_BY_NAME] =
+        "SELECT * FROM people WHERE (last_name, first_name, id) > (?1, ?2, ?3) "
+        "AND (?5 IS NULL OR first_name LIKE ?5 OR last_name LIKE ?5) "
+        "ORDER BY last_name, first_name, id LIMIT ?4;",
+    /*
+     * idx_people_birth_span and idx_people_death_span, between the cursor
+     * and the day ?7. People whose date does not parse are only listed by
+     * name.
+     * The day number is repeated as the last column for the cursor.
+     */
+    [PEOPLE_BY_BIRTH] =
+        "SELECT *, birth_day FROM people WHERE birth_day IS NOT NULL AND (birth_day, id) > (?1, ?3) "
+        "AND birth_day <= ?7 ORDER BY birth_day, id LIMIT ?4;",
+    [PEOPLE_BY_DEATH] =
+        "SELECT *, death_day FROM people WHERE death_day IS NOT NULL AND (death_day, id) > (?1, ?3) "
+        "AND death_day <= ?7 ORDER BY death_day, id LIMIT ?4;",
+};
+
+// Percent-encode a value for a query string parameter; returns a new string or NULL
+static char *url_encode(const char *value) {
+    char *encoded = malloc(strlen(value) * 3 + 1);
+    if (!encoded) return NULL;
+
+    char *out = encoded;
+    for (const unsigned char *p = (const unsigned char *)value; *p; p++) {
+        if (isalnum(*p) || *p == '-' || *p == '_' || *p == '.' || *p == '~') {
+            *out++ = *p;
+        } else {
+            out += sprintf(out, "%%%02X", *p);
+        }
+    }
+    *out = '\0';
+    return encoded;
+}
+
+static void read_page_cursor(CGIParams params, PageCursor *cursor) {
+    char *id_str = get_cgi_param(params, "after_id");
+    cursor->key = get_cgi_param(params, "after_key");
+    cursor->key2 = get_cgi_param(params, "after_key2");
+    cursor->id = id_str ? atoi(id_str) : 0;
+    if (!cursor->key) cursor->key = "";
+    if (!cursor->key2) cursor->key2 = "";
+}
+
+/*
+ * Render up to LIST_PAGE_SIZE person cards in index order after the cursor,
+ * then a Next link to the following page if there is one. The link is
+ * next_url plus the search term, if any, and the cursor. Date orders only
+ * list days from from_day to to_day. Returns the number of cards shown.
+ */
+static int render_people_page(sqlite3 *db, PeopleOrder order, const char *search_term, int from_day, int to_day,
+                              const PageCursor *after, const char *next_url) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, people_page_sql[order], -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 0;
+    }
+    if (order == PEOPLE_BY_NAME) {
+        sqlite3_bind_text(stmt, 1, after->key, -1, SQLITE_STATIC);
+    } else {
+        // The first page starts at (from_day, 0), ahead of every id on that day
+        int key = *after->key ? atoi(after->key) : from_day;
+        sqlite3_bind_int(stmt, 1, key > from_day ? key : from_day);
+        sqlite3_bind_int(stmt, 7, to_day);
+    }
+    sqlite3_bind_text(stmt, 2, after->key2, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, after->id);
+    sqlite3_bind_int(stmt, 4, LIST_PAGE_SIZE + 1);
+    if (search_term) sqlite3_bind_text(stmt, 5, sqlite3_mprintf("%%%s%%", search_term), -1, sqlite3_free);
+    
+    // The last card stays loaded until the next one, since its keys become the cursor
+    Person last;
+    memset(&last, 0, sizeof(last));
+    int last_day = 0;
+    int shown = 0, has_more = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (shown == LIST_PAGE_SIZE) {
+            has_more = 1;
+            break;
+        }
+        free_person(&last);
+        last.id = sqlite3_column_int(stmt, 0);
+        last.first_name_id = intern_column(stmt, 1);
+        last.last_name_id = intern_column(stmt, 2);
+        last.gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
+        last.birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
+        last.death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
+        last.bio = sqlite3_column_text(stmt, 6) ? strdup((const char*)sqlite3_column_text(stmt, 6)) : NULL;
+        last.photo_url = sqlite3_column_text(stmt, 7) ? strdup((const char*)sqlite3_column_text(stmt, 7)) : NULL;
+        if (order != PEOPLE_BY_NAME) last_day = sqlite3_column_int(stmt, sqlite3_column_count(stmt) - 1);
+        
+        render_person_card(&last);
+        shown++;
+        output_stream_flush();
+    }
+    sqlite3_finalize(stmt);
+    
+    if (has_more) {
+        char day_key[16];
+        snprintf(day_key, sizeof(day_key), "%d", last_day);
+        char *term = search_term ? url_encode(search_term) : NULL;
+        const char *last_name = last.last_name_id ? interned_string(last.last_name_id) : "";
+        const char *first_name = last.first_name_id ? interned_string(last.first_name_id) : "";
+        char *key = order == PEOPLE_BY_NAME ? url_encode(last_name) : day_key;
+        char *key2 = order == PEOPLE_BY_NAME ? url_encode(first_name) : NULL;
+        
+        // Without the whole cursor the link would lead to the wrong page, so none is better
+        if ((!search_term || term) && key && (order != PEOPLE_BY_NAME || key2)) {
+            tpl_next_page_link(&(TplNextPageLink){
+                .url = next_url,
+                .search_term = term,
+                .after_key = key,
+                .after_key2 = key2,
+                .after_id = last.id,
+            });
+        }
+        free(term);
+        if (key != day_key) free(key);
+        free(key2);
+    }
+    free_person(&last);
+    return shown;
+}
+
+void show_search_results(sqlite3 *db, const char *search_term, const PageCursor *after) {
+    tpl_search_results_head();
+    
+    if (search_term && *search_term) {
+        // Matches come back in name order, a page at a time
+        tpl_people_list_begin(&(TplPeopleListBegin){ .list_class = "search-results" });
+        output_stream_flush();
+        int shown = render_people_page(db, PEOPLE_BY_NAME, search_term, 0, 0, after, "?action=search");
+        tpl_people_list_end();
+        
+        if (shown == 0) {
+            tpl_search_no_results(&(TplSearchNoResults){ .more = after->id != 0, .search_term = search_term });
+        }
+    } else {
+        tpl_notice(&(TplNotice){ .text = "Please enter a search term." });
+    }
+}
+
+// Everyone, a page at a time, by surname or by birth date
+void show_browse_page(sqlite3 *db, const char *order_name, const PageCursor *after) {
+    PeopleOrder order = order_name && strcmp(order_name, "birth") == 0 ? PEOPLE_BY_BIRTH : PEOPLE_BY_NAME;
+    
+    tpl_browse_head(&(TplBrowseHead){ .by_birth = order == PEOPLE_BY_BIRTH });
+    tpl_people_list_begin(&(TplPeopleListBegin){ .list_class = "browse-results" });
+    output_stream_flush();
+    int shown = render_people_page(db, order, NULL, DATE_DAY_MIN, DATE_DAY_MAX, after,
+                                   order == PEOPLE_BY_BIRTH ? "?action=browse&order=birth" : "?action=browse&order=name");
+    tpl_people_list_end();
+    
+    if (shown == 0) {
+        tpl_browse_empty(&(TplBrowseEmpty){ .more = after->id != 0 });
+    }
+}
+
+/*
+ * People born, or who died, between two dates, in date order: a range scan
+ * on the day-number index. The bounds take any form parse_date accepts and
+ * cover whole periods, so 1850 to 1900 means 1850-01-01 to 1900-12-31.
+ */
+void show_date_search(sqlite3 *db, const char *event, const char *from, const char *to, const PageCursor *after) {
+    PeopleOrder order = event && strcmp(event, "death") == 0 ? PEOPLE_BY_DEATH : PEOPLE_BY_BIRTH;
+    int from_day = DATE_DAY_MIN, to_day = DATE_DAY_MAX, day, precision, valid = 1;
+    
+    if (from && *from) {
+        if (parse_date(from, &day, &precision) == 0) from_day = day;
+        else valid = 0;
+    }
+    if (to && *to) {
+        if (parse_date(to, &day, &precision) == 0) to_day = date_period_end(day, precision);
+        else valid = 0;
+    }
+    
+    tpl_date_search_form(&(TplDateSearchForm){
+        .by_birth = order == PEOPLE_BY_BIRTH,
+        .by_death = order == PEOPLE_BY_DEATH,
+        .from = from,
+        .to = to,
+    });
+    
+    if (!valid) {
+        tpl_date_format_hint();
+        return;
+    }
+    if (!(from && *from) && !(to && *to)) return;
+    
+    // The Next link carries the bounds as resolved days, which need no escaping
+    char from_text[16], to_text[16], next_url[128];
+    format_date_day(from_day, from_text);
+    format_date_day(to_day, to_text);
+    snprintf(next_url, sizeof(next_url), "?action=date_search&event=%s&from=%s&to=%s",
+             order == PEOPLE_BY_DEATH ? "death" : "birth", from_text, to_text);
+    
+    tpl_people_list_begin(&(TplPeopleListBegin){ .list_class = "search-results" });
+    output_stream_flush();
+    int shown = render_people_page(db, order, NULL, from_day, to_day, after, next_url);
+    tpl_people_list_end();
+    
+    if (shown == 0) {
+        tpl_date_search_empty(&(TplDateSearchEmpty){ .more = after->id != 0 });
+    }
+}
+
+/*
+ * Everyone who may have been alive on a date, or at some point between two
+ * dates, from the lifespan interval index; with root_id, only that person
+ * and their descendants. Serve mode answers from the index built at
+ * startup, a CGI request from SQL. Pages go by person id.
+ */
+void show_alive_page(sqlite3 *db, const char *date, const char *to, int root_id, int after_id) {
+    int from_day = 0, to_day = 0, day, precision, valid = 1;
+    
+    if (date && *date) {
+        if (parse_date(date, &day, &precision) == 0) {
+            from_day = day;
+            to_day = date_period_end(day, precision);
+        } else {
+            valid = 0;
+        }
+    }
+    if (valid && to && *to) {
+        if (parse_date(to, &day, &precision) == 0 && date_period_end(day, precision) >= from_day) {
+            to_day = date_period_end(day, precision);
+        } else {
+            valid = 0;
+        }
+    }
+    
+    tpl_alive_form(&(TplAliveForm){
+        .date = date,
+        .to = to,
+        .has_root = root_id > 0,
+        .root_id = root_id,
+    });
+    
+    if (!valid) {
+        tpl_date_format_hint();
+        return;
+    }
+    if (!(date && *date)) return;
+    
+    // The subtree: the root and everyone descended from them
+    int *within = NULL, within_count = 0;
+    if (root_id > 0) {
+        PersonTable *table = person_table_current(db);
+        int rc = table ? person_table_descendants(table, root_id, &within, &within_count)
+                       : closure_get_descendants(db, root_id, 0, &within, NULL, &within_count);
+        if (rc != 0) {
+            free(within);
+            tpl_alive_root_failed(&(TplAliveRootFailed){ .root_id = root_id });
+            return;
+        }
+        int *grown = realloc(within, sizeof(int) * (within_count + 1));
+        if (!grown) {
+            free(within);
+            return;
+        }
+        within = grown;
+        within[within_count++] = root_id;
+    }
+    
+    // Serve mode has the index preloaded; a CGI process asks SQL rather than build one per request
+    LifespanIndex *index = lifespan_index_preloaded();
+    int ids[LIST_PAGE_SIZE + 1], count = 0, total = 0;
+    int rc = index ? lifespan_alive(index, db, from_day, to_day, within, within_count, after_id,
+                                    LIST_PAGE_SIZE + 1, ids, &count, &total)
+                   : lifespan_alive_sql(db, from_day, to_day, within, within_count, after_id,
+                                        LIST_PAGE_SIZE + 1, ids, &count, &total);
+    free(within);
+    if (rc != 0) {
+        tpl_notice(&(TplNotice){ .text = "Could not search lifespans." });
+        return;
+    }
+    
+    char from_text[16], to_text[16];
+    format_date_day(from_day, from_text);
+    format_date_day(to_day, to_text);
+    tpl_alive_summary(&(TplAliveSummary){
+        .total = total,
+        .one = total == 1,
+        .from = from_text,
+        .to = from_day == to_day ? NULL : to_text,
+    });
+    
+    tpl_people_list_begin(&(TplPeopleListBegin){ .list_class = "search-results" });
+    output_stream_flush();
+    int shown = count > LIST_PAGE_SIZE ? LIST_PAGE_SIZE : count;
+    for (int i = 0; i < shown; i++) {
+        Person person;
+        if (get_person_by_id(db, ids[i], &person) == 0) {
+            render_person_card(&person);
+            free_person(&person);
+        }
+        output_stream_flush();
+    }
+    tpl_people_list_end();
+    
+    if (count > LIST_PAGE_SIZE) {
+        // Resolved days and ids, which need no encoding
+        char next_url[128];
+        int len = snprintf(next_url, sizeof(next_url), "?action=alive&date=%s&to=%s", from_text, to_text);
+        if (root_id > 0) snprintf(next_url + len, sizeof(next_url) - len, "&root_id=%d", root_id);
+        tpl_next_page_link(&(TplNextPageLink){ .url = next_url, .after_id = ids[shown - 1] });
+    }
+}
+
+// One row of a statistics table, with a bar scaled to the largest count
+static void print_statistics_row(const char *label, int count, int total, int largest) {
+    char share[16];
+    snprintf(share, sizeof(share), "%.1f", total ? 100.0 * count / total : 0.0);
+    tpl_statistics_row(&(TplStatisticsRow){ .label = label, .count = count, .share = share,
+                                            .width = largest ? 100 * count / largest : 0 });
+}
+
+/*
+ * Tree-wide statistics for the administrator, aggregated from the columnar
+ * snapshot: the one serve mode keeps, or one loaded for this request.
+ */
+void show_statistics_page(sqlite3 *db) {
+    AnalyticsSnapshot *snapshot = analytics_snapshot_preloaded();
+    AnalyticsSnapshot *loaded = NULL;
+    if (!snapshot) snapshot = loaded = analytics_snapshot_load(db);
+    
+    AnalyticsReport report;
+    if (!snapshot || analytics_report(snapshot, &report) != 0) {
+        analytics_snapshot_free(loaded);
+        tpl_notice(&(TplNotice){ .text = "Could not compute statistics." });
+        return;
+    }
+    
+    char loaded_at[32], load_ms[32], compute_ms[32];
+    strftime(loaded_at, sizeof(loaded_at), "%Y-%m-%d %H:%M:%S", localtime(&report.loaded_at));
+    snprintf(load_ms, sizeof(load_ms), "%.1f", report.load_seconds * 1e3);
+    snprintf(compute_ms, sizeof(compute_ms), "%.2f", report.seconds * 1e3);
+    tpl_statistics_head(&(TplStatisticsHead){ .people = report.people, .loaded_at = loaded_at,
+                                              .load_ms = load_ms, .compute_ms = compute_ms });
+    
+    tpl_statistics_section(&(TplStatisticsSection){ .title = "People" });
+    tpl_statistics_table_begin();
+    print_statistics_row("Male", report.male, report.people, report.people);
+    print_statistics_row("Female", report.female, report.people, report.people);
+    print_statistics_row("Gender unknown", report.people - report.male - report.female, report.people, report.people);
+    print_statistics_row("With a birth date", report.born, report.people, report.people);
+    print_statistics_row("With a death date", report.died, report.people, report.people);
+    tpl_statistics_table_end();
+    
+    tpl_statistics_section(&(TplStatisticsSection){ .title = "Births and Deaths per Decade" });
+    if (report.decade_count == 0) {
+        tpl_notice(&(TplNotice){ .text = "No dated people." });
+    } else {
+        int largest = 0;
+        for (int d = 0; d < report.decade_count; d++) {
+            if (report.births_per_decade[d] > largest) largest = report.births_per_decade[d];
+            if (report.deaths_per_decade[d] > largest) largest = report.deaths_per_decade[d];
+        }
+        tpl_statistics_table_begin();
+        tpl_statistics_decade_head();
+        for (int d = 0; d < report.decade_count; d++) {
+            if (!report.births_per_decade[d] && !report.deaths_per_decade[d]) continue;
+            tpl_statistics_decade_row(&(TplStatisticsDecadeRow){
+                .decade = report.first_decade + 10 * d,
+                .births = report.births_per_decade[d],
+                .births_width = 100 * report.births_per_decade[d] / largest,
+                .deaths = report.deaths_per_decade[d],
+                .deaths_width = 100 * report.deaths_per_decade[d] / largest });
+        }
+        tpl_statistics_table_end();
+    }
+    
+    tpl_statistics_section(&(TplStatisticsSection){ .title = "Age at Death" });
+    if (report.ages == 0) {
+        tpl_notice(&(TplNotice){ .text = "Nobody has both a birth and a death date." });
+    } else {
+        char mean_age[32];
+        snprintf(mean_age, sizeof(mean_age), "%.1f", report.mean_age);
+        tpl_statistics_ages(&(TplStatisticsAges){ .ages = report.ages, .mean_age = mean_age,
+                                                  .median_age = report.median_age });
+        int buckets[ANALYTICS_MAX_AGE / 10 + 1] = { 0 }, largest = 0;
+        for (int age = 0; age <= ANALYTICS_MAX_AGE; age++) buckets[age / 10] += report.age_at_death[age];
+        for (int b = 0; b <= ANALYTICS_MAX_AGE / 10; b++) if (buckets[b] > largest) largest = buckets[b];
+        tpl_statistics_table_begin();
+        for (int b = 0; b <= ANALYTICS_MAX_AGE / 10; b++) {
+            if (!buckets[b]) continue;
+            char share[16];
+            snprintf(share, sizeof(share), "%.1f", 100.0 * buckets[b] / report.ages);
+            tpl_statistics_age_row(&(TplStatisticsAgeRow){ .low = b * 10, .high = b * 10 + 9,
+                                                           .count = buckets[b], .share = share,
+                                                           .width = 100 * buckets[b] / largest });
+        }
+        tpl_statistics_table_end();
+    }
+    
+    tpl_statistics_section(&(TplStatisticsSection){ .title = "Commonest Surnames" });
+    tpl_statistics_surnames(&(TplStatisticsSurnames){ .surnames = report.surnames });
+    if (report.top_surname_count > 0) {
+        tpl_statistics_table_begin();
+        for (int i = 0; i < report.top_surname_count; i++) {
+            print_statistics_row(report.top_surnames[i].name, report.top_surnames[i].count, report.people,
+                                 report.top_surnames[0].count);
+        }
+        tpl_statistics_table_end();
+    }
+    
+    tpl_statistics_section(&(TplStatisticsSection){ .title = "Children per Couple" });
+    if (report.couples == 0) {
+        tpl_notice(&(TplNotice){ .text = "No couples recorded." });
+    } else {
+        char children_each[32];
+        snprintf(children_each, sizeof(children_each), "%.2f", (double)report.children / report.couples);
+        tpl_statistics_couples(&(TplStatisticsCouples){ .couples = report.couples,
+                                                        .children_each = children_each });
+        int largest = 0;
+        for (int c = 0; c <= ANALYTICS_MAX_CHILDREN; c++) {
+            if (report.children_per_couple[c] > largest) largest = report.children_per_couple[c];
+        }
+        tpl_statistics_table_begin();
+        for (int c = 0; c <= ANALYTICS_MAX_CHILDREN; c++) {
+            char label[16];
+            snprintf(label, sizeof(label), c < ANALYTICS_MAX_CHILDREN ? "%d" : "%d or more", c);
+            if (report.children_per_couple[c]) {
+                print_statistics_row(label, report.children_per_couple[c], report.couples, largest);
+            }
+        }
+        tpl_statistics_table_end();
+    }
+    
+    analytics_report_free(&report);
+    analytics_snapshot_free(loaded);
+}
+
+void print_backup_progress(void *arg, int done_pages, int total_pages) {
+    (void)arg;
+    fprintf(stderr, "\rBackup: %d/%d pages (%d%%)", done_pages, total_pages,
+            total_pages > 0 ? (int)(100.0 * done_pages / total_pages) : 100);
+}
+
+// Backups are CLI-only: the target is chosen by whoever runs the command, never by a web request
+int run_backup_command(sqlite3 *db, const char *target, int pages_per_step) {
+    char path[4096];
+    struct stat st;
+    if (stat(target, &st) == 0 && S_ISDIR(st.st_mode)) {
+        // A directory gets a timestamped snapshot
+        time_t now = time(NULL);
+        char name[64];
+        strftime(name, sizeof(name), "family_tree-%Y%m%d-%H%M%S.db", localtime(&now));
+        snprintf(path, sizeof(path), "%s/%s", target, name);
+    } else {
+        snprintf(path, sizeof(path), "%s", target);
+    }
+    
+    BackupProgress progress;
+    memset(&progress, 0, sizeof(progress));
+    progress.callback = print_backup_progress;
+    
+    if (backup_database(db, path, pages_per_step, BACKUP_DEFAULT_SLEEP_MS, &progress) != 0) {
+        fprintf(stderr, "\n");
+        return 1;
+    }
+    
+    fprintf(stderr, "\nBacked up %d pages (%.1f MB) to %s in %d steps, %d restarts, %.2f s (%.1f MB/s)\n",
+            progress.pages, progress.bytes / (1024.0 * 1024.0), path, progress.steps, progress.restarts,
+            progress.seconds,
+            progress.seconds > 0 ? progress.bytes / (1024.0 * 1024.0) / progress.seconds : 0);
+    return 0;
+}
+
+int run_common_ancestors_command(sqlite3 *db, int count, char *ids[]) {
+    int *person_ids = malloc(sizeof(int) * count);
+    if (!person_ids) return 1;
+    for (int i = 0; i < count; i++) person_ids[i] = atoi(ids[i]);
+    
+    ReachIndex *index = reach_index_build(db);
+    if (!index) {
+        free(person_ids);
+        return 1;
+    }
+    
+    int *ancestors = NULL;
+    int ancestor_count = 0;
+    int rc = reach_common_ancestors(index, person_ids, count, &ancestors, &ancestor_count);
+    for (int i = 0; i < ancestor_count; i++) {
+        printf("%d\n", ancestors[i]);
+    }
+    
+    free(ancestors);
+    free(person_ids);
+    reach_index_free(index);
+    return rc;
+}
+
+// Command-line mode for maintenance tasks: family_tree.cgi <command> [args]
+int main(int argc, char *argv[]);
+
+// Serve mode's parent brings its in-memory indexes up to date before each connection
+static void serve_before_fork(void) {
+    lifespan_index_maintain();
+    analytics_snapshot_maintain();
+    person_table_maintain();
+    reach_index_maintain();
+    page_shell_maintain();
+    sql_profile_flush();
+}
+
+int run_command(sqlite3 *db, int argc, char *argv[]) {
+    const char *command = argv[1];
+    
+    if (strcmp(command, "export-gedcom") == 0) {
+        return export_gedcom(db, argc > 2 ? argv[2] : "-");
+    }
+    
+    if (strcmp(command, "backup") == 0 && argc > 2) {
+        return run_backup_command(db, argv[2], argc > 3 ? atoi(argv[3]) : BACKUP_DEFAULT_PAGES);
+    }
+    
+    if (strcmp(command, "rebuild-closure") == 0) {
+        return rebuild_closure(db);
+    }
+    
+    if (strcmp(command, "closure-bench") == 0) {
+        return closure_benchmark(db, argc > 2 ? atoi(argv[2]) : 0);
+    }
+    
+    if (strcmp(command, "reach-bench") == 0) {
+        return reach_benchmark(db, argc > 2 ? atoi(argv[2]) : 0);
+    }
+    
+    if (strcmp(command, "common-ancestors") == 0 && argc > 2) {
+        return run_common_ancestors_command(db, argc - 2, argv + 2);
+    }
+    
+    if (strcmp(command, "thumbnail-worker") == 0) {
+        int processes = 1, once = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--once") == 0) {
+                once = 1;
+            } else {
+                processes = atoi(argv[i]);
+            }
+        }
+        return run_thumbnail_worker(db, processes, once);
+    }
+    
+    if (strcmp(command, "lifespan-bench") == 0) {
+        return lifespan_benchmark(db, argc > 2 ? atoi(argv[2]) : 0);
+    }
+    
+    if (strcmp(command, "intern-bench") == 0) {
+        return intern_benchmark(db);
+    }
+    
+    if (strcmp(command, "analytics-bench") == 0) {
+        return analytics_benchmark(db, argc > 2 ? atoi(argv[2]) : 0);
+    }
+    
+    if (strcmp(command, "tree-bench") == 0) {
+        return person_table_benchmark(db, argc > 2 ? atoi(argv[2]) : 0);
+    }
+    
+    if (strcmp(command, "serve") == 0) {
+        // Built once here; every connection's child inherits them
+        if (lifespan_index_preload(db) != 0 || analytics_snapshot_preload(db) != 0 ||
+            person_table_preload(db) != 0 || reach_index_preload(db) != 0 ||
+            page_shell_preload() != 0) return 1;
+        return run_http_server(argc > 2 ? atoi(argv[2]) : HTTP_DEFAULT_PORT,
+                               argc > 3 ? atoi(argv[3]) : HTTP_MAX_CHILDREN, main, serve_before_fork, argv[0]);
+    }
+    
+    if (strcmp(command, "backfill-dates") == 0) {
+        return backfill_dates(db);
+    }
+    
+    if (strcmp(command, "import") == 0 && argc > 3) {
+        return bulk_import(db, argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0);
+    }
+    
+    fprintf(stderr, "Unknown command: %s\n", command);
+    fprintf(stderr, "Usage: %s <command> [args]\n", argv[0]);
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "  export-gedcom [file]    Write all people and families as GEDCOM (default stdout)\n");
+    fprintf(stderr, "  import <people|relationships> <file.csv|file.ndjson> [threads]\n");
+    fprintf(stderr, "                          Bulk-load rows with parallel parsing\n");
+    fprintf(stderr, "  backfill-dates          Re-parse every date into its day-number column\n");
+    fprintf(stderr, "  rebuild-closure         Build or refresh the ancestry closure table\n");
+    fprintf(stderr, "  closure-bench [samples] Compare closure and recursive ancestry queries\n");
+    fprintf(stderr, "  reach-bench [samples]   Time the in-memory reachability index\n");
+    fprintf(stderr, "  lifespan-bench [samples]\n");
+    fprintf(stderr, "                          Time \"alive on date\" queries on the lifespan index\n");
+    fprintf(stderr, "  intern-bench\n");
+    fprintf(stderr, "                          Compare names held as heap copies and as interned ids\n");
+    fprintf(stderr, "  analytics-bench [samples]\n");
+    fprintf(stderr, "                          Time the statistics page kernels against SQL\n");
+    fprintf(stderr, "  tree-bench [samples]    Compare descendant walks on compact and full person records\n");
+    fprintf(stderr, "  common-ancestors <id> <id> ...\n");
+    fprintf(stderr, "                          List ancestors shared by all given people\n");
+    fprintf(stderr, "  thumbnail-worker [processes] [--once]\n");
+    fprintf(stderr, "                          Build thumbnails for queued photos\n");
+    fprintf(stderr, "  serve [port] [max_children]\n");
+    fprintf(stderr, "                          Answer HTTP directly, streaming long pages\n");
+    fprintf(stderr, "  backup <file|directory> [pages_per_step]\n");
+    fprintf(stderr, "                          Snapshot the live database in small steps; a directory\n");
+    fprintf(stderr, "                          gets a timestamped file\n");
+    return 1;
+}
+
 // Main function
-int main() {
+int main(int argc, char *argv[]) {
+    // Per-request timings go to the shared metrics segment
+    metrics_init();
+    double request_start = metrics_now();
+    
     // Initialize database
     sqlite3 *db;
     if (init_database(&db) != 0) {
@@ -563,8 +1228,10 @@ int main() {
         printf("<p>Could not initialize database.</p>");
         return 1;
     }
+    double db_open_time = metrics_now() - request_start;
     
     // Create tables if they don't exist
+    double phase_start = metrics_now();
     if (create_tables(db) != 0) {
         printf("Content-Type: text/html\n\n");
         printf("<h1>Database Error</h1>");
@@ -572,19 +1239,87 @@ int main() {
         sqlite3_close(db);
         return 1;
     }
+    double create_tables_time = metrics_now() - phase_start;
+    
+    // Run as a command when invoked from a shell rather than by the web server
+    if (argc > 1 && !getenv("GATEWAY_INTERFACE")) {
+        int rc = run_command(db, argc, argv);
+        sql_profile_flush();
+        sqlite3_close(db);
+        return rc;
+    }
+    
+    metrics_record_phase(METRIC_DB_OPEN, db_open_time);
+    metrics_record_phase(METRIC_CREATE_TABLES, create_tables_time);
     
     // Parse query string
+    phase_start = metrics_now();
     char *query_string = getenv("QUERY_STRING");
-    CGIParams params = parse_query_string(query_string);
+    const char *request_method = getenv("REQUEST_METHOD");
+    CGIParams params;
+    
+    // Form posts carry their fields in the body; the URL may still name the action
+    if (request_method && strcmp(request_method, "POST") == 0) {
+        PhotoUpload upload;
+        memset(&upload, 0, sizeof(upload));
+        upload.handler.file_part = photo_file_part;
+        upload.handler.arg = &upload;
+        
+        int status = read_request_body(query_string, stdin, &params, &upload.handler);
+        if (upload.writer) {
+            blob_writer_abort(upload.writer);
+        }
+        if (status != 0) {
+            printf("Status: %d %s\n", status, http_status_text(status));
+            printf("Content-Type: text/html\n\n");
+            printf("<h1>%s</h1>", http_status_text(status));
+            printf("<p>The submitted form could not be read.</p>");
+            sqlite3_close(db);
+            return 1;
+        }
+    } else {
+        params = parse_query_string(query_string);
+    }
     
     // Get action parameter
     char *action = get_cgi_param(params, "action");
     if (!action) action = "home";
+    metrics_record_phase(METRIC_PARAM_PARSE, metrics_now() - phase_start);
+    
+    // Metrics are plain text for the Prometheus scraper, not a page
+    if (strcmp(action, "metrics") == 0) {
+        printf("Content-Type: text/plain; version=0.0.4\n\n");
+        metrics_write_prometheus(stdout);
+        fflush(stdout);
+        free_cgi_params(params);
+        sqlite3_close(db);
+        return 0;
+    }
+    
+    // Stored photos are sent as they are, with their own headers
+    if (strcmp(action, "photo") == 0) {
+        int rc = serve_blob(get_cgi_param(params, "hash"), 1);
+        free_cgi_params(params);
+        sqlite3_close(db);
+        return rc;
+    }
+    
+    if (strcmp(action, "thumb") == 0) {
+        int rc = serve_thumbnail(db, get_cgi_param(params, "hash"));
+        free_cgi_params(params);
+        sql_profile_flush();
+        sqlite3_close(db);
+        return rc;
+    }
     
-    // Start HTML output
-    print_html_header("Family Tree");
+    // Start HTML output, compressed when the client accepts it
+    phase_start = metrics_now();
+    output_compression_begin(getenv("HTTP_ACCEPT_ENCODING"));
+    print_html_header(PAGE_TITLE);
+    double render_time = metrics_now() - phase_start;
     
     // Process actions
+    double handler_start = metrics_now();
     if (strcmp(action, "view_profile") == 0) {
         char *id_str = get_cgi_param(params, "id");
         int id = id_str ? atoi(id_str) : 0;
@@ -618,6 +1353,7 @@ int main() {
         printf("</div>\n");
         
         printf("<div class=\"tree-container\">\n");
+        output_stream_flush();
         render_family_tree(db, root_id, levels);
         printf("</div>\n");
     } else if (strcmp(action, "add_person") == 0) {
@@ -636,81 +1372,17 @@ int main() {
         if (id > 0) {
             Person person;
             if (get_person_by_id(db, id, &person) == 0) {
-                printf("<h2>Edit Person</h2>\n");
-                
-                printf("<form action=\"?action=process_edit_person\" method=\"post\">\n");
-                printf("<input type=\"hidden\" name=\"id\" value=\"%d\">\n", person.id);
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"first_name\">First Name:</label>\n");
-                char *escaped_first_name = html_escape(person.first_name);
-                printf("<input type=\"text\" id=\"first_name\" name=\"first_name\" value=\"%s\" class=\"form-control\" required>\n", escaped_first_name);
-                free(escaped_first_name);
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"last_name\">Last Name:</label>\n");
-                char *escaped_last_name = html_escape(person.last_name);
-                printf("<input type=\"text\" id=\"last_name\" name=\"last_name\" value=\"%s\" class=\"form-control\" required>\n", escaped_last_name);
-                free(escaped_last_name);
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"gender\">Gender:</label>\n");
-                printf("<select id=\"gender\" name=\"gender\" class=\"form-control\">\n");
-                printf("<option value=\"M\"%s>Male</option>\n", person.gender == 'M' ? " selected" : "");
-                printf("<option value=\"F\"%s>Female</option>\n", person.gender == 'F' ? " selected" : "");
-                printf("</select>\n");
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"birth_date\">Birth Date:</label>\n");
-                if (person.birth_date) {
-                    char *escaped_birth_date = html_escape(person.birth_date);
-                    printf("<input type=\"date\" id=\"birth_date\" name=\"birth_date\" value=\"%s\" class=\"form-control\">\n", escaped_birth_date);
-                    free(escaped_birth_date);
-                } else {
-                    printf("<input type=\"date\" id=\"birth_date\" name=\"birth_date\" class=\"form-control\">\n");
-                }
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"death_date\">Death Date (if applicable):</label>\n");
-                if (person.death_date) {
-                    char *escaped_death_date = html_escape(person.death_date);
-                    printf("<input type=\"date\" id=\"death_date\" name=\"death_date\" value=\"%s\" class=\"form-control\">\n", escaped_death_date);
-                    free(escaped_death_date);
-                } else {
-                    printf("<input type=\"date\" id=\"death_date\" name=\"death_date\" class=\"form-control\">\n");
-                }
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"bio\">Biography:</label>\n");
-                if (person.bio) {
-                    char *escaped_bio = html_escape(person.bio);
-                    printf("<textarea id=\"bio\" name=\"bio\" class=\"form-control\" rows=\"5\">%s</textarea>\n", escaped_bio);
-                    free(escaped_bio);
-                } else {
-                    printf("<textarea id=\"bio\" name=\"bio\" class=\"form-control\" rows=\"5\"></textarea>\n");
-                }
-                printf("</div>\n");
-                
-                printf("<div class=\"form-group\">\n");
-                printf("<label for=\"photo_url\">Photo URL:</label>\n");
-                if (person.photo_url) {
-                    char *escaped_photo_url = html_escape(person.photo_url);
-                    printf("<input type=\"url\" id=\"photo_url\" name=\"photo_url\" value=\"%s\" class=\"form-control\">\n", escaped_photo_url);
-                    free(escaped_photo_url);
-                } else {
-                    printf("<input type=\"url\" id=\"photo_url\" name=\"photo_url\" class=\"form-control\">\n");
-                }
-                printf("</div>\n");
-                
-                printf("<button type=\"submit\" class=\"btn-primary\">Update Person</button>\n");
-                printf("<a href=\"?action=view_profile&id=%d\" class=\"btn-secondary\">Cancel</a>\n", person.id);
-                
-                printf("</form>\n");
+                tpl_edit_person_form(&(TplEditPersonForm){
+                    .id = person.id,
+                    .first_name = interned_string(person.first_name_id),
+                    .last_name = interned_string(person.last_name_id),
+                    .male = person.gender == 'M',
+                    .female = person.gender == 'F',
+                    .birth_date = person.birth_date,
+                    .death_date = person.death_date,
+                    .bio = person.bio,
+                    .photo_url = person.photo_url,
+                });
                 
                 free_person(&person);
             } else {
@@ -727,8 +1399,6 @@ int main() {
             Person person;
             if (get_person_by_id(db, id, &person) == 0) {
                 // Free existing values before updating
-                free(person.first_name);
-                free(person.last_name);
                 free(person.birth_date);
                 free(person.death_date);
                 free(person.bio);
@@ -742,16 +1412,22 @@ int main() {
                 char *death_date = get_cgi_param(params, "death_date");
                 char *bio = get_cgi_param(params, "bio");
                 char *photo_url = get_cgi_param(params, "photo_url");
+                char *photo = get_cgi_param(params, "photo");
+                
+                if (photo && strncmp(photo, PHOTO_URL_PREFIX, strlen(PHOTO_URL_PREFIX)) == 0) {
+                    photo_url = photo;
+                }
                 
-                person.first_name = first_name ? strdup(first_name) : strdup("");
-                person.last_name = last_name ? strdup(last_name) : strdup("");
+                int names_ok = !intern_name_param(first_name, &person.first_name_id) &&
+                               !intern_name_param(last_name, &person.last_name_id);
                 person.gender = gender_str ? gender_str[0] : 'M';
                 person.birth_date = birth_date && *birth_date ? strdup(birth_date) : NULL;
                 person.death_date = death_date && *death_date ? strdup(death_date) : NULL;
                 person.bio = bio && *bio ? strdup(bio) : NULL;
                 person.photo_url = photo_url && *photo_url ? strdup(photo_url) : NULL;
                 
-                if (update_person(db, &person) == 0) {
+                if (names_ok && update_person(db, &person) == 0) {
+                    enqueue_thumbnail(db, person.photo_url);
                     printf("<p>Person updated successfully.</p>\n");
                     printf("<a href=\"?action=view_profile&id=%d\" class=\"btn-primary\">View Profile</a>\n", person.id);
                 } else {
@@ -772,8 +1448,8 @@ int main() {
         if (person_id > 0) {
             Person person;
             if (get_person_by_id(db, person_id, &person) == 0) {
-                char *first_name = html_escape(person.first_name);
-                char *last_name = html_escape(person.last_name);
+                char *first_name = html_escape(interned_string(person.first_name_id));
+                char *last_name = html_escape(interned_string(person.last_name_id));
                 
                 printf("<h2>Add Family Member for %s %s</h2>\n", first_name, last_name);
                 
@@ -831,51 +1507,10 @@ int main() {
         }
     } else if (strcmp(action, "search") == 0) {
         char *search_term = get_cgi_param(params, "search_term");
+        PageCursor after;
+        read_page_cursor(params, &after);
         
-        printf("<h2>Search Results</h2>\n");
-        
-        if (search_term && *search_term) {
-            sqlite3_stmt *stmt;
-            const char *sql = 
-                "SELECT * FROM people WHERE first_name LIKE ? OR last_name LIKE ?;";
-            
-            if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
-                char search_pattern[256];
-                snprintf(search_pattern, sizeof(search_pattern), "%%%s%%", search_term);
-                
-                sqlite3_bind_text(stmt, 1, search_pattern, -1, SQLITE_STATIC);
-                sqlite3_bind_text(stmt, 2, search_pattern, -1, SQLITE_STATIC);
-                
-                printf("<div class=\"search-results\">\n");
-                
-                int found = 0;
-                while (sqlite3_step(stmt) == SQLITE_ROW) {
-                    found = 1;
-                    Person person;
-                    person.id = sqlite3_column_int(stmt, 0);
-                    person.first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-                    person.last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
-                    person.gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
-                    person.birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
-                    person.death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
-                    person.bio = sqlite3_column_text(stmt, 6) ? strdup((const char*)sqlite3_column_text(stmt, 6)) : NULL;
-                    person.photo_url = sqlite3_column_text(stmt, 7) ? strdup((const char*)sqlite3_column_text(stmt, 7)) : NULL;
-                    
-                    render_person_card(&person);
-                    free_person(&person);
-                }
-                
-                printf("</div>\n");
-                
-                if (!found) {
-                    printf("<p>No results found for \"%s\".</p>\n", search_term);
-                }
-                
-                sqlite3_finalize(stmt);
-            }
-        } else {
-            printf("<p>Please enter a search term.</p>\n");
-        }
+        show_search_results(db, search_term, &after);
         
         printf("<form action=\"?action=search\" method=\"get\">\n");
         printf("<input type=\"hidden\" name=\"action\" value=\"search\">\n");
@@ -885,16 +1520,57 @@ int main() {
         printf("</div>\n");
         printf("<button type=\"submit\" class=\"btn-primary\">Search</button>\n");
         printf("</form>\n");
+    } else if (strcmp(action, "browse") == 0) {
+        PageCursor after;
+        read_page_cursor(params, &after);
+        show_browse_page(db, get_cgi_param(params, "order"), &after);
+    } else if (strcmp(action, "date_search") == 0) {
+        PageCursor after;
+        read_page_cursor(params, &after);
+        show_date_search(db, get_cgi_param(params, "event"), get_cgi_param(params, "from"),
+                         get_cgi_param(params, "to"), &after);
+    } else if (strcmp(action, "timeline") == 0) {
+        char *id_str = get_cgi_param(params, "id");
+        char *scope = get_cgi_param(params, "scope");
+        int id = id_str ? atoi(id_str) : 0;
+        
+        if (id > 0) {
+            render_timeline(db, id, scope && strcmp(scope, "descendants") == 0);
+        } else {
+            printf("<p>Invalid person ID.</p>");
+        }
+    } else if (strcmp(action, "statistics") == 0) {
+        // In a real application, this would check for an admin user
+        show_statistics_page(db);
+    } else if (strcmp(action, "alive") == 0) {
+        char *root_str = get_cgi_param(params, "root_id");
+        char *after_str = get_cgi_param(params, "after_id");
+        show_alive_page(db, get_cgi_param(params, "date"), get_cgi_param(params, "to"),
+                        root_str ? atoi(root_str) : 0, after_str ? atoi(after_str) : 0);
     } else {
-        // Default to home page
+        // Default to home page; unknown actions are counted as home so they cannot flood the action slots
         show_home_page(db);
+        action = "home";
     }
+    double handler_time = metrics_now() - handler_start;
+    metrics_record_phase(METRIC_HANDLER, handler_time);
+    metrics_record_action(action, handler_time);
     
+    phase_start = metrics_now();
     print_html_footer();
+    metrics_record_phase(METRIC_RENDER, render_time + metrics_now() - phase_start);
     
-    // Cleanup
+    phase_start = metrics_now();
+    output_compression_finish();
+    metrics_record_phase(METRIC_FLUSH, metrics_now() - phase_start);
+    
+    // Cleanup; slow statements get their plans now that the page is sent
     free_cgi_params(params);
+    sql_profile_flush();
     sqlite3_close(db);
     
+    metrics_record_phase(METRIC_TOTAL, metrics_now() - request_start);
+    metrics_finish_request();
+    
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+/* metrics.c - Request latency metrics for family tree application */
+
+#include "family_tree.h"
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Each CGI process lives for one request, so metrics are kept in a small
+ * file-backed shared memory segment that every process maps and bumps
+ * with atomic adds. Counters only ever grow (Prometheus counters and
+ * cumulative histograms), so readers never need a lock. Action slots are
+ * claimed on first use and never released.
+ */
+
+#define METRICS_MAGIC 0x46544d31u   // "FTM1"
+#define METRICS_ACTION_SLOTS 32
+#define METRICS_ACTION_NAME 32
+#define METRICS_CLAIM_SPINS 1000  // Yields to wait on a slot being named before skipping it
+
+static const double metric_bucket_bounds[METRIC_BUCKET_COUNT] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0
+};
+
+static const char *metric_phase_names[METRIC_PHASE_COUNT] = {
+    "db_open", "create_tables", "param_parse", "handler", "render", "flush", "total"
+};
+
+typedef struct {
+    uint64_t buckets[METRIC_BUCKET_COUNT + 1];   // Last bucket is +Inf; not cumulative here
+    uint64_t count;
+    uint64_t sum_ns;
+} MetricHistogram;
+
+typedef struct {
+    uint32_t state;     // 0 free, 1 being claimed, 2 named
+    char name[METRICS_ACTION_NAME];
+    MetricHistogram latency;
+} MetricActionSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t requests;
+    uint64_t sql_statements;
+    uint64_t sql_rows;
+    MetricHistogram phases[METRIC_PHASE_COUNT];
+    MetricActionSlot actions[METRICS_ACTION_SLOTS];
+} MetricSegment;
+
+static MetricSegment *segment = NULL;
+
+// Counts for the current request, added to the segment when it finishes
+static uint64_t request_statements = 0;
+static uint64_t request_rows = 0;
+
+double metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int metrics_init(void) {
+    if (segment) return 0;
+
+    const char *path = getenv("FAMILY_TREE_STATS");
+    if (!path || !*path) path = METRICS_DEFAULT_PATH;
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return 1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(MetricSegment) &&
+                                ftruncate(fd, sizeof(MetricSegment)) != 0)) {
+        close(fd);
+        return 1;
+    }
+
+    void *map = mmap(NULL, sizeof(MetricSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    segment = map;
+
+    // A fresh file is all zeros, which is already a valid empty segment
+    uint32_t expected = 0;
+    __atomic_compare_exchange_n(&segment->magic, &expected, METRICS_MAGIC, 0,
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    if (segment->magic != METRICS_MAGIC) {
+        munmap(segment, sizeof(MetricSegment));
+        segment = NULL;
+        return 1;
+    }
+    segment->size = sizeof(MetricSegment);
+    return 0;
+}
+
+static void metrics_observe(MetricHistogram *histogram, double seconds) {
+    int bucket = 0;
+    while (bucket < METRIC_BUCKET_COUNT && seconds > metric_bucket_bounds[bucket]) bucket++;
+
+    __atomic_fetch_add(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_ns, (uint64_t)(seconds * 1e9), __ATOMIC_RELAXED);
+}
+
+void metrics_record_phase(MetricPhase phase, double seconds) {
+    if (!segment || phase < 0 || phase >= METRIC_PHASE_COUNT) return;
+    metrics_observe(&segment->phases[phase], seconds);
+}
+
+static MetricActionSlot *metrics_action_slot(const char *action) {
+    unsigned int hash = 5381;
+    for (const char *p = action; *p; p++) hash = hash * 33 + (unsigned char)*p;
+
+    for (int probe = 0; probe < METRICS_ACTION_SLOTS; probe++) {
+        MetricActionSlot *slot = &segment->actions[(hash + probe) % METRICS_ACTION_SLOTS];
+        uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+
+        if (state == 0) {
+            uint32_t expected = 0;
+            if (__atomic_compare_exchange_n(&slot->state, &expected, 1, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                snprintf(slot->name, sizeof(slot->name), "%s", action);
+                __atomic_store_n(&slot->state, 2, __ATOMIC_RELEASE);
+                return slot;
+            }
+            state = expected;
+        }
+        // Another process is naming this slot; it is usable a moment later.
+        // A process killed mid-claim leaves the slot at 1 for good, so the
+        // wait is bounded and a slot that never settles is probed past.
+        for (int spin = 0; state == 1 && spin < METRICS_CLAIM_SPINS; spin++) {
+            sched_yield();
+            state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+        }
+        if (state != 2) continue;
+        if (strncmp(slot->name, action, sizeof(slot->name) - 1) == 0) return slot;
+    }
+    return NULL;
+}
+
+void metrics_record_action(const char *action, double seconds) {
+    if (!segment) return;
+
+    // Only label with names made of safe characters; everything else is "other"
+    const char *label = action;
+    size_t len = strlen(action);
+    if (len == 0 || len >= METRICS_ACTION_NAME) label = "other";
+    for (const char *p = action; label == action && *p; p++) {
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '_')) label = "other";
+    }
+
+    MetricActionSlot *slot = metrics_action_slot(label);
+    if (!slot) slot = metrics_action_slot("other");
+    if (slot) metrics_observe(&slot->latency, seconds);
+}
+
+// Called from the SQL trace hook installed by init_database
+void metrics_count_statement(void) {
+    request_statements++;
+}
+
+void metrics_count_row(void) {
+    request_rows++;
+}
+
+void metrics_finish_request(void) {
+    if (!segment) return;
+    __atomic_fetch_add(&segment->requests, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&segment->sql_statements, request_statements, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&segment->sql_rows, request_rows, __ATOMIC_RELAXED);
+    request_statements = 0;
+    request_rows = 0;
+}
+
+static void metrics_write_histogram(FILE *out, const char *name, const char *label_name,
+                                    const char *label_value, const MetricHistogram *histogram) {
+    uint64_t cumulative = 0;
+    for (int i = 0; i <= METRIC_BUCKET_COUNT; i++) {
+        cumulative += __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        if (i < METRIC_BUCKET_COUNT) {
+            fprintf(out, "%s_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label_name, label_value,
+                    metric_bucket_bounds[i], (unsigned long long)cumulative);
+        } else {
+            fprintf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label_name, label_value,
+                    (unsigned long long)cumulative);
+        }
+    }
+    fprintf(out, "%s_sum{%s=\"%s\"} %.9f\n", name, label_name, label_value,
+            __atomic_load_n(&histogram->sum_ns, __ATOMIC_RELAXED) / 1e9);
+    fprintf(out, "%s_count{%s=\"%s\"} %llu\n", name, label_name, label_value,
+            (unsigned long long)__atomic_load_n(&histogram->count, __ATOMIC_RELAXED));
+}
+
+// Prometheus text exposition format (version 0.0.4)
+void metrics_write_prometheus(FILE *out) {
+    if (!segment) {
+        fprintf(out, "# metrics segment unavailable\n");
+        return;
+    }
+
+    fprintf(out, "# HELP family_tree_requests_total CGI requests handled.\n");
+    fprintf(out, "# TYPE family_tree_requests_total counter\n");
+    fprintf(out, "family_tree_requests_total %llu\n",
+            (unsigned long long)__atomic_load_n(&segment->requests, __ATOMIC_RELAXED));
+
+    fprintf(out, "# HELP family_tree_sql_statements_total SQL statements started.\n");
+    fprintf(out, "# TYPE family_tree_sql_statements_total counter\n");
+    fprintf(out, "family_tree_sql_statements_total %llu\n",
+            (unsigned long long)__atomic_load_n(&segment->sql_statements, __ATOMIC_RELAXED));
+
+    fprintf(out, "# HELP family_tree_sql_rows_total Result rows stepped.\n");
+    fprintf(out, "# TYPE family_tree_sql_rows_total counter\n");
+    fprintf(out, "family_tree_sql_rows_total %llu\n",
+            (unsigned long long)__atomic_load_n(&segment->sql_rows, __ATOMIC_RELAXED));
+
+    fprintf(out, "# HELP family_tree_phase_seconds Time spent in each request phase.\n");
+    fprintf(out, "# TYPE family_tree_phase_seconds histogram\n");
+    for (int i = 0; i < METRIC_PHASE_COUNT; i++) {
+        metrics_write_histogram(out, "family_tree_phase_seconds", "phase", metric_phase_names[i],
+                                &segment->phases[i]);
+    }
+
+    fprintf(out, "# HELP family_tree_action_seconds Time spent in each action handler.\n");
+    fprintf(out, "# TYPE family_tree_action_seconds histogram\n");
+    for (int i = 0; i < METRICS_ACTION_SLOTS; i++) {
+        MetricActionSlot *slot = &segment->actions[i];
+        if (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != 2) continue;
+
+        // A claim that outwaited a slow namer can leave two slots with one
+        // name; each name is written once, with its slots summed
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = __atomic_load_n(&segment->actions[j].state, __ATOMIC_ACQUIRE) == 2 &&
+                   strcmp(segment->actions[j].name, slot->name) == 0;
+        }
+        if (seen) continue;
+
+        MetricHistogram total = {0};
+        for (int j = i; j < METRICS_ACTION_SLOTS; j++) {
+            MetricActionSlot *same = &segment->actions[j];
+            if (__atomic_load_n(&same->state, __ATOMIC_ACQUIRE) != 2 ||
+                strcmp(same->name, slot->name) != 0) continue;
+            for (int b = 0; b <= METRIC_BUCKET_COUNT; b++) {
+                total.buckets[b] += __atomic_load_n(&same->latency.buckets[b], __ATOMIC_RELAXED);
+            }
+            total.count += __atomic_load_n(&same->latency.count, __ATOMIC_RELAXED);
+            total.sum_ns += __atomic_load_n(&same->latency.sum_ns, __ATOMIC_RELAXED);
+        }
+        metrics_write_histogram(out, "family_tree_action_seconds", "action", slot->name, &total);
+    }
+}
@@ -0,0 +1,441 @@
+/* person_table.c - Compact resident person records for tree traversal */
+
+#include "family_tree.h"
+
+/*
+ * A Person is ten fields of pointers and time_t with every string on the
+ * heap: walking a family through them touches a cache line or two per
+ * person plus one per string. The table keeps only what traversal reads,
+ * in a 24-byte HotPerson per person, contiguous and in id order:
+ *
+ *   id, first and last name (interned), birth and death (packed dates),
+ *   gender, parent count, and the offset of the person's links
+ *
+ * Links are row numbers in one shared array: row r's parents are
+ * links[records[r].links ..] for parent_count entries, then its children
+ * up to records[r + 1].links (a sentinel record closes the last row), in
+ * relationship id order like the SQL they replace. Everything else (the
+ * dates as written, bio, photo_url) is cold and stays in SQLite, read by
+ * id when a page renders a card.
+ *
+ * Serve mode builds a table up front and rebuilds it before a connection
+ * once the data has changed, at most every PERSON_TABLE_REFRESH_SECONDS.
+ * In between the table is stale and person_table_current() returns NULL,
+ * so callers fall back to SQL rather than answer from old data.
+ */
+
+_Static_assert(sizeof(HotPerson) == 24, "HotPerson should stay 24 bytes");
+
+struct PersonTable {
+    HotPerson *records;         // count + 1, the last a sentinel
+    int count;
+    int *links;
+    int link_count;
+    int *row_of;                // Person id -> row, -1 for none
+    int max_person_id;
+    int data_version;           // Of the building connection, to spot later commits
+    time_t built_at;
+};
+
+static int person_table_data_version(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+// A day and precision column pair packed into 24 bits; 0 when unknown or outside years 1-32767
+static uint32_t person_table_pack_date(sqlite3_stmt *stmt, int column) {
+    if (sqlite3_column_type(stmt, column) == SQLITE_NULL) return 0;
+    int packed = pack_date_day(sqlite3_column_int(stmt, column), sqlite3_column_int(stmt, column + 1));
+    return packed > 0 && packed < (1 << 24) ? (uint32_t)packed : 0;
+}
+
+static int person_table_load_people(PersonTable *table, sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *bounds_sql = "SELECT COUNT(*), COALESCE(MAX(id), 0) FROM people;";
+    if (sqlite3_prepare_v2(db, bounds_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    int capacity = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        capacity = sqlite3_column_int(stmt, 0);
+        table->max_person_id = sqlite3_column_int(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    table->records = calloc(capacity + 1, sizeof(HotPerson));
+    table->row_of = malloc(sizeof(int) * (table->max_person_id + 1));
+    if (!table->records || !table->row_of) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    memset(table->row_of, -1, sizeof(int) * (table->max_person_id + 1));
+
+    const char *sql =
+        "SELECT id, first_name, last_name, gender, birth_day, birth_precision, death_day, death_precision "
+        "FROM people ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    int n = 0;
+    while (n < capacity && sqlite3_step(stmt) == SQLITE_ROW) {
+        HotPerson *record = &table->records[n];
+        const char *gender = (const char*)sqlite3_column_text(stmt, 3);
+        record->id = sqlite3_column_int(stmt, 0);
+        record->first_name_id = intern_column(stmt, 1);
+        record->last_name_id = intern_column(stmt, 2);
+        record->gender = gender ? *gender : '\0';
+        record->birth = person_table_pack_date(stmt, 4);
+        record->death = person_table_pack_date(stmt, 6);
+        if (record->id >= 0 && record->id <= table->max_person_id) table->row_of[record->id] = n;
+        n++;
+    }
+    sqlite3_finalize(stmt);
+    table->count = n;
+    return 0;
+}
+
+/*
+ * Two passes over the edges: count each row's parents and children to
+ * place its links, then fill them in relationship id order. Edges to
+ * people that do not exist are dropped, as the SQL joins drop them.
+ */
+static int person_table_load_links(PersonTable *table, sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT person1_id, person2_id FROM relationships WHERE relationship_type = 'parent-child' ORDER BY id;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int capacity = 1024, edge_count = 0;
+    int *edges = malloc(sizeof(int) * 2 * capacity);        // (parent row, child row) pairs
+    int *children = calloc(table->count + 1, sizeof(int));
+    int ok = edges && children;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        int parent = sqlite3_column_int(stmt, 0), child = sqlite3_column_int(stmt, 1);
+        if (parent < 0 || parent > table->max_person_id || child < 0 || child > table->max_person_id) continue;
+        parent = table->row_of[parent];
+        child = table->row_of[child];
+        if (parent < 0 || child < 0) continue;
+        if (table->records[child].parent_count == 255) {
+            fprintf(stderr, "Person %d has too many parents\n", table->records[child].id);
+            ok = 0;
+            break;
+        }
+        if (edge_count == capacity) {
+            capacity *= 2;
+            int *grown = realloc(edges, sizeof(int) * 2 * capacity);
+            if (!(ok = grown != NULL)) break;
+            edges = grown;
+        }
+        edges[2 * edge_count] = parent;
+        edges[2 * edge_count + 1] = child;
+        edge_count++;
+        table->records[child].parent_count++;
+        children[parent]++;
+    }
+    sqlite3_finalize(stmt);
+
+    table->links = ok ? malloc(sizeof(int) * (2 * edge_count + 1)) : NULL;
+    if (!table->links) {
+        if (ok) fprintf(stderr, "Memory allocation failed\n");
+        free(edges);
+        free(children);
+        return 1;
+    }
+
+    // Place each row's links, then fill them: parents from the row's offset, children after its parents
+    int *parent_cursor = malloc(sizeof(int) * (table->count + 1));
+    if (!parent_cursor) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(edges);
+        free(children);
+        return 1;
+    }
+    int offset = 0;
+    for (int row = 0; row < table->count; row++) {
+        int child_count = children[row];
+        table->records[row].links = offset;
+        parent_cursor[row] = offset;
+        children[row] = offset + table->records[row].parent_count;
+        offset += table->records[row].parent_count + child_count;
+    }
+    table->records[table->count].links = offset;
+    table->link_count = offset;
+    for (int e = 0; e < edge_count; e++) {
+        int parent = edges[2 * e], child = edges[2 * e + 1];
+        table->links[parent_cursor[child]++] = parent;
+        table->links[children[parent]++] = child;
+    }
+    free(parent_cursor);
+    free(edges);
+    free(children);
+    return 0;
+}
+
+PersonTable *person_table_build(sqlite3 *db) {
+    PersonTable *table = calloc(1, sizeof(PersonTable));
+    if (!table) return NULL;
+
+    table->data_version = person_table_data_version(db);
+
+    // One read transaction so the links match the people read
+    sqlite3_exec(db, "SAVEPOINT person_table_build;", NULL, NULL, NULL);
+    int rc = person_table_load_people(table, db);
+    if (rc == 0) rc = person_table_load_links(table, db);
+    sqlite3_exec(db, "RELEASE person_table_build;", NULL, NULL, NULL);
+
+    if (rc != 0) {
+        person_table_free(table);
+        return NULL;
+    }
+    table->built_at = time(NULL);
+    return table;
+}
+
+void person_table_free(PersonTable *table) {
+    if (!table) return;
+    free(table->records);
+    free(table->links);
+    free(table->row_of);
+    free(table);
+}
+
+/*
+ * Everyone descended from person_id, breadth first, each once however
+ * many ways they descend; not the person themselves. The caller frees
+ * *ids. Returns 1 if out of memory.
+ */
+int person_table_descendants(const PersonTable *table, int person_id, int **ids, int *count) {
+    *ids = NULL;
+    *count = 0;
+    if (person_id < 0 || person_id > table->max_person_id || table->row_of[person_id] < 0) return 0;
+
+    int *queue = malloc(sizeof(int) * (table->count + 1));
+    unsigned char *seen = calloc(table->count / 8 + 1, 1);
+    if (!queue || !seen) {
+        free(queue);
+        free(seen);
+        return 1;
+    }
+    int head = 0, tail = 0, root = table->row_of[person_id];
+    seen[root / 8] |= 1 << (root % 8);
+    queue[tail++] = root;
+    while (head < tail) {
+        const HotPerson *record = &table->records[queue[head++]];
+        for (int i = record->links + record->parent_count; i < record[1].links; i++) {
+            int child = table->links[i];
+            if (seen[child / 8] & (1 << (child % 8))) continue;
+            seen[child / 8] |= 1 << (child % 8);
+            queue[tail++] = child;
+        }
+    }
+    free(seen);
+
+    // Rows to ids in place, dropping the root at the front
+    for (int i = 1; i < tail; i++) queue[i - 1] = table->records[queue[i]].id;
+    *ids = queue;
+    *count = tail - 1;
+    return 0;
+}
+
+/*
+ * Serve mode keeps one table, built in the parent and inherited by each
+ * connection's child, which has a connection of its own. The parent is
+ * the one that can see commits (data_version on the building connection),
+ * so it checks before every fork: a changed tree is rebuilt if the last
+ * build is old enough, and otherwise marked stale until it is.
+ */
+
+static PersonTable *preloaded;
+static sqlite3 *preload_db;
+static int preload_stale;
+
+int person_table_preload(sqlite3 *db) {
+    PersonTable *table = person_table_build(db);
+    if (!table) return 1;
+    person_table_free(preloaded);
+    preloaded = table;
+    preload_db = db;
+    preload_stale = 0;
+    return 0;
+}
+
+void person_table_maintain(void) {
+    if (!preloaded || person_table_data_version(preload_db) == preloaded->data_version) return;
+    preload_stale = 1;
+    if (time(NULL) - preloaded->built_at < PERSON_TABLE_REFRESH_SECONDS) return;
+    person_table_preload(preload_db);
+}
+
+/*
+ * The preloaded table if it still matches the database as db sees it:
+ * nothing was committed before this connection's fork that the table
+ * lacks, and db itself has written nothing since. NULL otherwise, and
+ * always outside serve mode.
+ */
+PersonTable *person_table_current(sqlite3 *db) {
+    if (!preloaded || preload_stale || sqlite3_total_changes(db) != 0) return NULL;
+    return preloaded;
+}
+
+// Benchmark: the same walk over hot records, over full Person structs, and in SQL
+
+static double person_table_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Daughters among the root and its descendants: one field read per person
+static long walk_hot(const PersonTable *table, int root, int *queue, unsigned char *seen) {
+    long found = 0;
+    int head = 0, tail = 0;
+    seen[root / 8] |= 1 << (root % 8);
+    queue[tail++] = root;
+    while (head < tail) {
+        const HotPerson *record = &table->records[queue[head++]];
+        found += record->gender == 'F';
+        for (int i = record->links + record->parent_count; i < record[1].links; i++) {
+            int child = table->links[i];
+            if (seen[child / 8] & (1 << (child % 8))) continue;
+            seen[child / 8] |= 1 << (child % 8);
+            queue[tail++] = child;
+        }
+    }
+    for (int i = 0; i < tail; i++) seen[queue[i] / 8] = 0;
+    return found;
+}
+
+// The same walk reading the field from full Person structs
+static long walk_people(const PersonTable *table, const Person *people, int root, int *queue, unsigned char *seen) {
+    long found = 0;
+    int head = 0, tail = 0;
+    seen[root / 8] |= 1 << (root % 8);
+    queue[tail++] = root;
+    while (head < tail) {
+        int row = queue[head++];
+        found += people[row].gender == 'F';
+        const HotPerson *record = &table->records[row];
+        for (int i = record->links + record->parent_count; i < record[1].links; i++) {
+            int child = table->links[i];
+            if (seen[child / 8] & (1 << (child % 8))) continue;
+            seen[child / 8] |= 1 << (child % 8);
+            queue[tail++] = child;
+        }
+    }
+    for (int i = 0; i < tail; i++) seen[queue[i] / 8] = 0;
+    return found;
+}
+
+int person_table_benchmark(sqlite3 *db, int samples) {
+    if (samples <= 0) samples = 100;
+
+    double start = person_table_now();
+    PersonTable *table = person_table_build(db);
+    double build_time = person_table_now() - start;
+    if (!table) return 1;
+    if (table->count == 0) {
+        fprintf(stderr, "No people to benchmark\n");
+        person_table_free(table);
+        return 1;
+    }
+
+    // The same people as full records, the way get_person_by_id fills them
+    sqlite3_stmt *stmt;
+    Person *people = calloc(table->count, sizeof(Person));
+    int *queue = malloc(sizeof(int) * (table->count + 1));
+    unsigned char *seen = calloc(table->count / 8 + 1, 1);     // The walks leave it clear
+    int *roots = malloc(sizeof(int) * samples);
+    double people_bytes = (double)sizeof(Person) * table->count;   // Plus each string's heap copy
+    int rc = !people || !queue || !seen || !roots ||
+             sqlite3_prepare_v2(db, "SELECT id, first_name, last_name, gender, birth_date, death_date, bio, photo_url, "
+                                    "created_at, updated_at FROM people ORDER BY id;", -1, &stmt, NULL) != SQLITE_OK;
+    for (int row = 0; rc == 0 && row < table->count && sqlite3_step(stmt) == SQLITE_ROW; row++) {
+        Person *person = &people[row];
+        person->id = sqlite3_column_int(stmt, 0);
+        person->first_name_id = intern_column(stmt, 1);
+        person->last_name_id = intern_column(stmt, 2);
+        person->gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
+        person->birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
+        person->death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
+        person->bio = sqlite3_column_text(stmt, 6) ? strdup((const char*)sqlite3_column_text(stmt, 6)) : NULL;
+        person->photo_url = sqlite3_column_text(stmt, 7) ? strdup((const char*)sqlite3_column_text(stmt, 7)) : NULL;
+        for (int column = 4; column <= 7; column++) {
+            if (sqlite3_column_type(stmt, column) != SQLITE_NULL) people_bytes += sqlite3_column_bytes(stmt, column) + 1;
+        }
+        person->created_at = sqlite3_column_int64(stmt, 8);
+        person->updated_at = sqlite3_column_int64(stmt, 9);
+    }
+    if (people && queue && seen && roots) sqlite3_finalize(stmt);
+
+    // Roots from the older half of the tree, where subtrees are large
+    srand(42);
+    for (int i = 0; rc == 0 && i < samples; i++) roots[i] = (int)((double)rand() / RAND_MAX * (table->count / 2));
+
+    long hot_found = 0, people_found = 0, sql_found = 0, sql_expected = 0;
+    double hot_time = 0, people_time = 0, sql_time = 0;
+    if (rc == 0) {
+        // One untimed pass each, so neither is timed on what the other left in cache
+        for (int i = 0; i < samples; i++) walk_people(table, people, roots[i], queue, seen);
+        for (int i = 0; i < samples; i++) walk_hot(table, roots[i], queue, seen);
+
+        start = person_table_now();
+        for (int i = 0; i < samples; i++) hot_found += walk_hot(table, roots[i], queue, seen);
+        hot_time = person_table_now() - start;
+
+        start = person_table_now();
+        for (int i = 0; i < samples; i++) people_found += walk_people(table, people, roots[i], queue, seen);
+        people_time = person_table_now() - start;
+    }
+
+    // What the pages did before: the recursive query
+    const char *sql =
+        "WITH RECURSIVE subtree(id) AS ("
+        "  SELECT ?1 "
+        "  UNION "
+        "  SELECT r.person2_id FROM relationships r "
+        "  JOIN subtree s ON r.person1_id = s.id AND r.relationship_type = 'parent-child'"
+        ") SELECT COUNT(*) FROM subtree JOIN people p ON p.id = subtree.id WHERE p.gender = 'F';";
+    int sql_samples = samples < 10 ? samples : 10;
+    if (rc == 0 && sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        start = person_table_now();
+        for (int i = 0; i < sql_samples; i++) {
+            sqlite3_bind_int(stmt, 1, table->records[roots[i]].id);
+            if (sqlite3_step(stmt) == SQLITE_ROW) sql_found += sqlite3_column_int(stmt, 0);
+            sqlite3_reset(stmt);
+        }
+        sql_time = person_table_now() - start;
+        sqlite3_finalize(stmt);
+    }
+    for (int i = 0; rc == 0 && i < sql_samples; i++) sql_expected += walk_hot(table, roots[i], queue, seen);
+
+    if (rc == 0) {
+        double hot_bytes = (double)sizeof(HotPerson) * (table->count + 1);
+        double link_bytes = sizeof(int) * ((double)table->link_count + table->max_person_id + 1);
+        printf("build         %.3f s, %d people, %d links\n", build_time, table->count, table->link_count);
+        printf("memory        hot records %.1f MB (%d bytes each), Person structs %.1f MB (%d bytes and strings), "
+               "links shared %.1f MB\n", hot_bytes / 1e6, (int)sizeof(HotPerson), people_bytes / 1e6,
+               (int)sizeof(Person), link_bytes / 1e6);
+        printf("descendants   hot records: %9.1f us/walk   Person structs: %9.1f us/walk   SQL: %9.1f us/walk\n",
+               hot_time * 1e6 / samples, people_time * 1e6 / samples, sql_time * 1e6 / sql_samples);
+        printf("check         %.0f daughters per walk%s\n", (double)hot_found / samples,
+               hot_found == people_found && sql_found == sql_expected ? "" : ", MISMATCH");
+    }
+
+    for (int row = 0; people && row < table->count; row++) free_person(&people[row]);
+    free(people);
+    free(queue);
+    free(seen);
+    free(roots);
+    person_table_free(table);
+    return rc != 0 || hot_found != people_found || sql_found != sql_expected;
+}
@@ -0,0 +1,699 @@
+/* reach_index.c - In-memory ancestry reachability index for family tree application */
+
+#include "family_tree.h"
+
+/*
+ * Interval labeling over the parent-child DAG. Each direction (down to
+ * descendants, up to ancestors) numbers people in DFS post-order, so a
+ * spanning-tree subtree is one contiguous range of numbers. A person's
+ * reachable set is stored as a sorted list of such ranges; pedigree
+ * collapse (a child reachable through both parents, cousin marriages)
+ * only adds extra ranges instead of breaking the scheme.
+ *
+ * is_ancestor is a binary search over one list, and common ancestors are
+ * a merge-intersection of run-length ranges: the same operation as an AND
+ * over run-compressed bitsets.
+ */
+
+typedef struct {
+    int lo;
+    int hi;
+} ReachInterval;
+
+typedef struct {
+    ReachInterval *items;
+    int count;
+    int capacity;
+} ReachSet;
+
+typedef struct {
+    int *number;        // node -> position in this direction's order
+    int *node_at;       // position -> node
+    ReachSet *sets;     // node -> positions reachable (including itself)
+    int next_number;
+} ReachLabels;
+
+struct ReachIndex {
+    int node_count;
+    int node_capacity;
+    int *person_ids;    // node -> person id
+    int *node_of;       // person id -> node, -1 when unknown
+    int max_person_id;
+    ReachLabels down;
+    ReachLabels up;
+    sqlite3_int64 last_relationship_id;
+    sqlite3_int64 relationship_rows;    // Of every type, up to last_relationship_id
+};
+
+// Interval sets
+
+static int reach_set_reserve(ReachSet *set, int capacity) {
+    if (capacity <= set->capacity) return 0;
+    int size = set->capacity ? set->capacity : 2;
+    while (size < capacity) size *= 2;
+    ReachInterval *items = realloc(set->items, sizeof(ReachInterval) * size);
+    if (!items) return 1;
+    set->items = items;
+    set->capacity = size;
+    return 0;
+}
+
+// Append keeping the list sorted and coalesced; callers append in ascending lo order
+static void reach_set_append(ReachSet *out, int lo, int hi) {
+    if (out->count > 0 && lo <= out->items[out->count - 1].hi + 1) {
+        if (hi > out->items[out->count - 1].hi) out->items[out->count - 1].hi = hi;
+        return;
+    }
+    out->items[out->count].lo = lo;
+    out->items[out->count].hi = hi;
+    out->count++;
+}
+
+// dst |= src
+static int reach_set_union(ReachSet *dst, const ReachSet *src) {
+    if (src->count == 0) return 0;
+
+    ReachSet merged = {NULL, 0, 0};
+    if (reach_set_reserve(&merged, dst->count + src->count)) return 1;
+
+    int i = 0, j = 0;
+    while (i < dst->count || j < src->count) {
+        const ReachInterval *next;
+        if (j >= src->count || (i < dst->count && dst->items[i].lo <= src->items[j].lo)) {
+            next = &dst->items[i++];
+        } else {
+            next = &src->items[j++];
+        }
+        reach_set_append(&merged, next->lo, next->hi);
+    }
+
+    free(dst->items);
+    *dst = merged;
+    return 0;
+}
+
+static int reach_set_contains(const ReachSet *set, int value) {
+    int lo = 0, hi = set->count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (value < set->items[mid].lo) {
+            hi = mid - 1;
+        } else if (value > set->items[mid].hi) {
+            lo = mid + 1;
+        } else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// out = a & b
+static int reach_set_intersect(const ReachSet *a, const ReachSet *b, ReachSet *out) {
+    out->count = 0;
+    if (reach_set_reserve(out, a->count + b->count)) return 1;
+
+    int i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        int lo = a->items[i].lo > b->items[j].lo ? a->items[i].lo : b->items[j].lo;
+        int hi = a->items[i].hi < b->items[j].hi ? a->items[i].hi : b->items[j].hi;
+        if (lo <= hi) reach_set_append(out, lo, hi);
+        if (a->items[i].hi < b->items[j].hi) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return 0;
+}
+
+// Build
+
+static void reach_labels_free(ReachLabels *labels, int node_count) {
+    if (labels->sets) {
+        for (int i = 0; i < node_count; i++) free(labels->sets[i].items);
+    }
+    free(labels->sets);
+    free(labels->number);
+    free(labels->node_at);
+    memset(labels, 0, sizeof(*labels));
+}
+
+/*
+ * Number nodes in post-order of a DFS along adj (CSR form) and compute
+ * each node's reachable set from its successors' sets. In a DAG every
+ * successor finishes before its predecessor, so one pass suffices.
+ */
+static int reach_labels_build(ReachLabels *labels, int node_count, int capacity,
+                              const int *adj_start, const int *adj, const int *in_degree) {
+    labels->number = malloc(sizeof(int) * capacity);
+    labels->node_at = malloc(sizeof(int) * capacity);
+    labels->sets = calloc(capacity, sizeof(ReachSet));
+    int *stack = malloc(sizeof(int) * (node_count + 1));
+    int *cursor = malloc(sizeof(int) * (node_count + 1));
+    if (!labels->number || !labels->node_at || !labels->sets || !stack || !cursor) {
+        free(stack);
+        free(cursor);
+        return 1;
+    }
+
+    for (int i = 0; i < node_count; i++) labels->number[i] = -1;
+    labels->next_number = 0;
+
+    // Roots first (no incoming edges), then anything left over from cycles
+    for (int pass = 0; pass < 2; pass++) {
+        for (int root = 0; root < node_count; root++) {
+            if (labels->number[root] != -1) continue;
+            if (pass == 0 && in_degree[root] > 0) continue;
+
+            int depth = 0;
+            stack[0] = root;
+            cursor[0] = adj_start[root];
+            labels->number[root] = -2;  // On the stack
+
+            while (depth >= 0) {
+                int node = stack[depth];
+                if (cursor[depth] < adj_start[node + 1]) {
+                    int next = adj[cursor[depth]++];
+                    if (labels->number[next] == -1) {
+                        labels->number[next] = -2;
+                        stack[++depth] = next;
+                        cursor[depth] = adj_start[next];
+                    }
+                    continue;
+                }
+
+                int number = labels->next_number++;
+                labels->number[node] = number;
+                labels->node_at[number] = node;
+
+                ReachSet *set = &labels->sets[node];
+                if (reach_set_reserve(set, 1)) {
+                    free(stack);
+                    free(cursor);
+                    return 1;
+                }
+                set->items[0].lo = number;
+                set->items[0].hi = number;
+                set->count = 1;
+                for (int e = adj_start[node]; e < adj_start[node + 1]; e++) {
+                    // Successors still on the stack mean a cycle; their sets are incomplete
+                    if (labels->number[adj[e]] >= 0 && reach_set_union(set, &labels->sets[adj[e]])) {
+                        free(stack);
+                        free(cursor);
+                        return 1;
+                    }
+                }
+                depth--;
+            }
+        }
+    }
+
+    free(stack);
+    free(cursor);
+    return 0;
+}
+
+static int reach_node_for(ReachIndex *index, int person_id) {
+    if (person_id < 0 || person_id > index->max_person_id) return -1;
+    return index->node_of[person_id];
+}
+
+ReachIndex *reach_index_build(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    ReachIndex *index = calloc(1, sizeof(ReachIndex));
+    if (!index) return NULL;
+
+    // Nodes: one per person
+    if (sqlite3_prepare_v2(db, "SELECT COUNT(*), COALESCE(MAX(id), 0) FROM people;", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        free(index);
+        return NULL;
+    }
+    sqlite3_step(stmt);
+    int people_count = sqlite3_column_int(stmt, 0);
+    index->max_person_id = sqlite3_column_int(stmt, 1);
+    sqlite3_finalize(stmt);
+
+    index->node_capacity = people_count > 0 ? people_count : 1;
+    index->person_ids = malloc(sizeof(int) * index->node_capacity);
+    index->node_of = malloc(sizeof(int) * (index->max_person_id + 1));
+    if (!index->person_ids || !index->node_of) {
+        reach_index_free(index);
+        return NULL;
+    }
+    for (int i = 0; i <= index->max_person_id; i++) index->node_of[i] = -1;
+
+    if (sqlite3_prepare_v2(db, "SELECT id FROM people ORDER BY id;", -1, &stmt, NULL) != SQLITE_OK) {
+        reach_index_free(index);
+        return NULL;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW && index->node_count < index->node_capacity) {
+        int id = sqlite3_column_int(stmt, 0);
+        if (id < 0 || id > index->max_person_id) continue;
+        index->node_of[id] = index->node_count;
+        index->person_ids[index->node_count++] = id;
+    }
+    sqlite3_finalize(stmt);
+
+    // Edges: parent-child pairs in both directions, as CSR arrays
+    const char *bounds_sql = "SELECT COALESCE(MAX(id), 0), COUNT(*) FROM relationships;";
+    if (sqlite3_prepare_v2(db, bounds_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            index->last_relationship_id = sqlite3_column_int64(stmt, 0);
+            index->relationship_rows = sqlite3_column_int64(stmt, 1);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    const char *edges_sql =
+        "SELECT person1_id, person2_id FROM relationships "
+        "WHERE relationship_type = 'parent-child' AND id <= ?;";
+    if (sqlite3_prepare_v2(db, edges_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        reach_index_free(index);
+        return NULL;
+    }
+    sqlite3_bind_int64(stmt, 1, index->last_relationship_id);
+
+    int n = index->node_count;
+    int edge_capacity = 1024, edge_count = 0;
+    int *edges = malloc(sizeof(int) * 2 * edge_capacity);
+    int *down_start = calloc(n + 1, sizeof(int));
+    int *up_start = calloc(n + 1, sizeof(int));
+    int ok = edges && down_start && up_start;
+
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        int parent = reach_node_for(index, sqlite3_column_int(stmt, 0));
+        int child = reach_node_for(index, sqlite3_column_int(stmt, 1));
+        if (parent < 0 || child < 0 || parent == child) continue;
+        if (edge_count == edge_capacity) {
+            edge_capacity *= 2;
+            int *grown = realloc(edges, sizeof(int) * 2 * edge_capacity);
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            edges = grown;
+        }
+        edges[2 * edge_count] = parent;
+        edges[2 * edge_count + 1] = child;
+        edge_count++;
+        down_start[parent + 1]++;
+        up_start[child + 1]++;
+    }
+    sqlite3_finalize(stmt);
+
+    int *down_adj = ok ? malloc(sizeof(int) * (edge_count + 1)) : NULL;
+    int *up_adj = ok ? malloc(sizeof(int) * (edge_count + 1)) : NULL;
+    int *down_fill = ok ? malloc(sizeof(int) * (n + 1)) : NULL;
+    int *up_fill = ok ? malloc(sizeof(int) * (n + 1)) : NULL;
+    int *child_in = ok ? malloc(sizeof(int) * (n + 1)) : NULL;
+    int *parent_in = ok ? malloc(sizeof(int) * (n + 1)) : NULL;
+    ok = ok && down_adj && up_adj && down_fill && up_fill && child_in && parent_in;
+
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            child_in[i] = up_start[i + 1];     // Parents of i: in-degree going down
+            parent_in[i] = down_start[i + 1];  // Children of i: in-degree going up
+            down_start[i + 1] += down_start[i];
+            up_start[i + 1] += up_start[i];
+        }
+        memcpy(down_fill, down_start, sizeof(int) * (n + 1));
+        memcpy(up_fill, up_start, sizeof(int) * (n + 1));
+        for (int e = 0; e < edge_count; e++) {
+            int parent = edges[2 * e], child = edges[2 * e + 1];
+            down_adj[down_fill[parent]++] = child;
+            up_adj[up_fill[child]++] = parent;
+        }
+
+        ok = reach_labels_build(&index->down, n, index->node_capacity, down_start, down_adj, child_in) == 0 &&
+             reach_labels_build(&index->up, n, index->node_capacity, up_start, up_adj, parent_in) == 0;
+    }
+
+    free(edges);
+    free(down_start);
+    free(up_start);
+    free(down_adj);
+    free(up_adj);
+    free(down_fill);
+    free(up_fill);
+    free(child_in);
+    free(parent_in);
+
+    if (!ok) {
+        fprintf(stderr, "Memory allocation failed\n");
+        reach_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+void reach_index_free(ReachIndex *index) {
+    if (!index) return;
+    reach_labels_free(&index->down, index->node_count);
+    reach_labels_free(&index->up, index->node_count);
+    free(index->person_ids);
+    free(index->node_of);
+    free(index);
+}
+
+// Incremental updates
+
+static int reach_add_person(ReachIndex *index, int person_id) {
+    if (person_id < 0) return -1;
+    if (person_id <= index->max_person_id && index->node_of[person_id] >= 0) {
+        return index->node_of[person_id];
+    }
+
+    if (person_id > index->max_person_id) {
+        int *grown = realloc(index->node_of, sizeof(int) * (person_id + 1));
+        if (!grown) return -1;
+        for (int i = index->max_person_id + 1; i <= person_id; i++) grown[i] = -1;
+        index->node_of = grown;
+        index->max_person_id = person_id;
+    }
+
+    if (index->node_count == index->node_capacity) {
+        int capacity = index->node_capacity * 2;
+        int *person_ids = realloc(index->person_ids, sizeof(int) * capacity);
+        if (person_ids) index->person_ids = person_ids;
+        ReachLabels *both[2] = {&index->down, &index->up};
+        for (int d = 0; d < 2 && person_ids; d++) {
+            int *number = realloc(both[d]->number, sizeof(int) * capacity);
+            if (number) both[d]->number = number;
+            int *node_at = realloc(both[d]->node_at, sizeof(int) * capacity);
+            if (node_at) both[d]->node_at = node_at;
+            ReachSet *sets = realloc(both[d]->sets, sizeof(ReachSet) * capacity);
+            if (sets) {
+                both[d]->sets = sets;
+                memset(sets + index->node_capacity, 0, sizeof(ReachSet) * (capacity - index->node_capacity));
+            }
+            if (!number || !node_at || !sets) person_ids = NULL;
+        }
+        if (!person_ids) return -1;
+        index->node_capacity = capacity;
+    }
+
+    // A new person reaches only itself; it gets the next number in each direction
+    int node = index->node_count++;
+    index->person_ids[node] = person_id;
+    index->node_of[person_id] = node;
+
+    ReachLabels *both[2] = {&index->down, &index->up};
+    for (int d = 0; d < 2; d++) {
+        ReachLabels *labels = both[d];
+        int number = labels->next_number++;
+        labels->number[node] = number;
+        labels->node_at[number] = node;
+        if (reach_set_reserve(&labels->sets[node], 1)) return -1;
+        labels->sets[node].items[0].lo = number;
+        labels->sets[node].items[0].hi = number;
+        labels->sets[node].count = 1;
+    }
+    return node;
+}
+
+int reach_index_add_edge(ReachIndex *index, int parent_id, int child_id) {
+    int parent = reach_add_person(index, parent_id);
+    int child = reach_add_person(index, child_id);
+    if (parent < 0 || child < 0) return 1;
+    if (parent == child || reach_set_contains(&index->down.sets[parent], index->down.number[child])) {
+        return 0;  // Already reachable
+    }
+
+    // Snapshot both sides first: the updates below may touch them
+    ReachSet parent_up = {NULL, 0, 0}, child_down = {NULL, 0, 0};
+    if (reach_set_union(&parent_up, &index->up.sets[parent]) ||
+        reach_set_union(&child_down, &index->down.sets[child])) {
+        free(parent_up.items);
+        free(child_down.items);
+        return 1;
+    }
+
+    int rc = 0;
+
+    // The parent and its ancestors now reach the child's descendants
+    for (int i = 0; i < parent_up.count && rc == 0; i++) {
+        for (int number = parent_up.items[i].lo; number <= parent_up.items[i].hi; number++) {
+            int node = index->up.node_at[number];
+            if (reach_set_union(&index->down.sets[node], &child_down)) {
+                rc = 1;
+                break;
+            }
+        }
+    }
+
+    // The child and its descendants now reach the parent's ancestors
+    for (int i = 0; i < child_down.count && rc == 0; i++) {
+        for (int number = child_down.items[i].lo; number <= child_down.items[i].hi; number++) {
+            int node = index->down.node_at[number];
+            if (reach_set_union(&index->up.sets[node], &parent_up)) {
+                rc = 1;
+                break;
+            }
+        }
+    }
+
+    free(parent_up.items);
+    free(child_down.items);
+    return rc;
+}
+
+// Applies relationships added since the index was built or last refreshed
+int reach_index_refresh(ReachIndex *index, sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT id, person1_id, person2_id, relationship_type FROM relationships "
+        "WHERE id > ? ORDER BY id;";
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    sqlite3_bind_int64(stmt, 1, index->last_relationship_id);
+
+    int rc = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        index->last_relationship_id = sqlite3_column_int64(stmt, 0);
+        index->relationship_rows++;
+        const char *type = (const char*)sqlite3_column_text(stmt, 3);
+        if (type && strcmp(type, "parent-child") == 0) {
+            rc |= reach_index_add_edge(index, sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Queries
+
+int reach_is_ancestor(ReachIndex *index, int ancestor_id, int descendant_id) {
+    int ancestor = reach_node_for(index, ancestor_id);
+    int descendant = reach_node_for(index, descendant_id);
+    if (ancestor < 0 || descendant < 0 || ancestor == descendant) return 0;
+    return reach_set_contains(&index->down.sets[ancestor], index->down.number[descendant]);
+}
+
+/*
+ * Common ancestors of every listed person (the people themselves excluded).
+ * The caller frees *ancestor_ids.
+ */
+int reach_common_ancestors(ReachIndex *index, const int *person_ids, int count,
+                           int **ancestor_ids, int *result_count) {
+    *ancestor_ids = NULL;
+    *result_count = 0;
+    if (count <= 0) return 0;
+
+    ReachSet current = {NULL, 0, 0}, next = {NULL, 0, 0};
+    for (int i = 0; i < count; i++) {
+        int node = reach_node_for(index, person_ids[i]);
+        if (node < 0) {
+            free(current.items);
+            free(next.items);
+            return 0;
+        }
+        if (i == 0) {
+            if (reach_set_union(&current, &index->up.sets[node])) {
+                free(current.items);
+                return 1;
+            }
+            continue;
+        }
+        if (reach_set_intersect(&current, &index->up.sets[node], &next)) {
+            free(current.items);
+            free(next.items);
+            return 1;
+        }
+        ReachSet swap = current;
+        current = next;
+        next = swap;
+    }
+    free(next.items);
+
+    int total = 0;
+    for (int i = 0; i < current.count; i++) total += current.items[i].hi - current.items[i].lo + 1;
+
+    *ancestor_ids = malloc(sizeof(int) * (total > 0 ? total : 1));
+    if (!*ancestor_ids) {
+        free(current.items);
+        return 1;
+    }
+
+    for (int i = 0; i < current.count; i++) {
+        for (int number = current.items[i].lo; number <= current.items[i].hi; number++) {
+            int person_id = index->person_ids[index->up.node_at[number]];
+            int queried = 0;
+            for (int j = 0; j < count; j++) {
+                if (person_ids[j] == person_id) queried = 1;
+            }
+            if (!queried) (*ancestor_ids)[(*result_count)++] = person_id;
+        }
+    }
+
+    free(current.items);
+    return 0;
+}
+
+/*
+ * Serve mode keeps one index, built in the parent and inherited by each
+ * connection's child. Before every fork the parent applies relationships
+ * added since (relationships are only ever appended); if rows have gone
+ * missing instead, the index is marked stale and rebuilt at most every
+ * REACH_REBUILD_SECONDS. Until then reach_index_current() returns NULL
+ * and callers ask SQL.
+ */
+
+static ReachIndex *preloaded;
+static sqlite3 *preload_db;
+static int preload_data_version;
+static int preload_stale;
+static time_t preload_built_at;
+
+static int reach_data_version(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, NULL) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+        sqlite3_finalize(stmt);
+    }
+    return version;
+}
+
+int reach_index_preload(sqlite3 *db) {
+    int version = reach_data_version(db);
+    ReachIndex *index = reach_index_build(db);
+    if (!index) return 1;
+    reach_index_free(preloaded);
+    preloaded = index;
+    preload_db = db;
+    preload_data_version = version;
+    preload_stale = 0;
+    preload_built_at = time(NULL);
+    return 0;
+}
+
+void reach_index_maintain(void) {
+    sqlite3_stmt *stmt;
+    if (!preloaded) return;
+
+    int version = reach_data_version(preload_db);
+    if (version != preload_data_version) {
+        preload_data_version = version;
+        sqlite3_int64 rows = -1;
+        int rc = reach_index_refresh(preloaded, preload_db);
+        if (rc == 0 && sqlite3_prepare_v2(preload_db, "SELECT COUNT(*) FROM relationships WHERE id <= ?;",
+                                          -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, preloaded->last_relationship_id);
+            if (sqlite3_step(stmt) == SQLITE_ROW) rows = sqlite3_column_int64(stmt, 0);
+            sqlite3_finalize(stmt);
+        }
+        if (rc != 0 || rows != preloaded->relationship_rows) preload_stale = 1;
+    }
+    if (preload_stale && time(NULL) - preload_built_at >= REACH_REBUILD_SECONDS) reach_index_preload(preload_db);
+}
+
+/*
+ * The preloaded index if it covers everything committed before this
+ * connection's fork and db itself has written nothing since; NULL
+ * otherwise, and always outside serve mode.
+ */
+ReachIndex *reach_index_current(sqlite3 *db) {
+    if (!preloaded || preload_stale || sqlite3_total_changes(db) != 0) return NULL;
+    return preloaded;
+}
+
+// Benchmark against the SQL ancestry lookups
+
+static double reach_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int reach_benchmark(sqlite3 *db, int samples) {
+    if (samples <= 0) samples = 1000;
+
+    double start = reach_now();
+    ReachIndex *index = reach_index_build(db);
+    double build_time = reach_now() - start;
+    if (!index) return 1;
+
+    long intervals = 0;
+    for (int i = 0; i < index->node_count; i++) {
+        intervals += index->down.sets[i].count + index->up.sets[i].count;
+    }
+
+    int n = index->node_count;
+    if (n < 2) {
+        fprintf(stderr, "Not enough people to benchmark\n");
+        reach_index_free(index);
+        return 1;
+    }
+
+    srand(42);
+    int *pairs = malloc(sizeof(int) * 2 * samples);
+    if (!pairs) {
+        reach_index_free(index);
+        return 1;
+    }
+    for (int i = 0; i < 2 * samples; i++) pairs[i] = index->person_ids[rand() % n];
+
+    int index_hits = 0, sql_hits = 0;
+    int rounds = 100;
+    start = reach_now();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < samples; i++) {
+            index_hits += reach_is_ancestor(index, pairs[2 * i], pairs[2 * i + 1]);
+        }
+    }
+    double index_time = (reach_now() - start) / rounds;
+
+    start = reach_now();
+    for (int i = 0; i < samples; i++) {
+        sql_hits += closure_is_ancestor(db, pairs[2 * i], pairs[2 * i + 1]) > 0;
+    }
+    double sql_time = reach_now() - start;
+
+    start = reach_now();
+    long common_total = 0;
+    for (int i = 0; i < samples; i++) {
+        int *ids, count;
+        if (reach_common_ancestors(index, &pairs[2 * i], 2, &ids, &count) == 0) {
+            common_total += count;
+            free(ids);
+        }
+    }
+    double common_time = reach_now() - start;
+
+    printf("build             %.3f s, %d people, %ld intervals (%.2f per person per direction)\n",
+           build_time, n, intervals, (double)intervals / (2.0 * n));
+    printf("is_ancestor       index: %8.3f us/query   %s: %8.1f us/query   (%d/%d related%s)\n",
+           index_time * 1e6 / samples, closure_enabled(db) ? "closure table" : "recursive SQL",
+           sql_time * 1e6 / samples, index_hits / rounds, samples,
+           index_hits / rounds == sql_hits ? "" : ", MISMATCH");
+    printf("common_ancestors  index: %8.3f us/query   (%.1f avg results)\n",
+           common_time * 1e6 / samples, (double)common_total / samples);
+
+    free(pairs);
+    reach_index_free(index);
+    return index_hits / rounds == sql_hits ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/* sql_profile.c - SQL statement profiling and slow-query log for family tree application */
+
+#include "family_tree.h"
+#include <strings.h>
+#include <unistd.h>
+
+/*
+ * A single trace hook per connection feeds the request counters in
+ * metrics.c and times every statement. Statements slower than the
+ * threshold are appended to the slow-query log with their expanded SQL
+ * and the plan SQLite chose, so table scans show up as "SCAN" lines.
+ * The hook only records the statement: it runs inside sqlite3_step, where
+ * preparing EXPLAIN on the same connection would re-enter it. Plans are
+ * captured by sql_profile_flush once the request is finished.
+ *
+ * FAMILY_TREE_SLOW_MS      threshold in milliseconds (default 50, negative disables)
+ * FAMILY_TREE_SLOW_LOG     log file (default slow_query.log)
+ */
+
+#define SQL_PROFILE_DEFAULT_MS 50.0
+#define SQL_PROFILE_DEFAULT_LOG "slow_query.log"
+#define SQL_PROFILE_MAX_PLAN_ROWS 64
+#define SQL_PROFILE_MAX_PENDING 32
+
+// A slow statement waiting for its plan: the log entry so far, and the SQL to explain if any
+typedef struct {
+    sqlite3 *db;
+    char *entry;
+    char *plan_sql;
+} SlowStatement;
+
+static SlowStatement pending[SQL_PROFILE_MAX_PENDING];
+static int pending_count = 0;
+
+static double slow_threshold_ns = SQL_PROFILE_DEFAULT_MS * 1e6;
+static const char *slow_log_path = SQL_PROFILE_DEFAULT_LOG;
+
+// Set while the plan of a slow statement is being captured, so that query is not traced itself
+static int capturing_plan = 0;
+
+static void write_query_plan(FILE *log, sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt;
+    size_t len = strlen(sql) + 32;
+    char *explain_sql = malloc(len);
+    if (!explain_sql) return;
+    snprintf(explain_sql, len, "EXPLAIN QUERY PLAN %s", sql);
+
+    if (sqlite3_prepare_v2(db, explain_sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(log, "  (plan unavailable: %s)\n", sqlite3_errmsg(db));
+        free(explain_sql);
+        return;
+    }
+
+    // Rows are (id, parent, notused, detail); indent each by its depth in the plan tree
+    int ids[SQL_PROFILE_MAX_PLAN_ROWS];
+    int depths[SQL_PROFILE_MAX_PLAN_ROWS];
+    int rows = 0;
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        int parent = sqlite3_column_int(stmt, 1);
+        const char *detail = (const char*)sqlite3_column_text(stmt, 3);
+
+        int depth = 0;
+        for (int i = 0; i < rows; i++) {
+            if (ids[i] == parent) depth = depths[i] + 1;
+        }
+        if (rows < SQL_PROFILE_MAX_PLAN_ROWS) {
+            ids[rows] = id;
+            depths[rows] = depth;
+            rows++;
+        }
+
+        fprintf(log, "  %*s%s\n", depth * 2, "", detail ? detail : "");
+    }
+
+    sqlite3_finalize(stmt);
+    free(explain_sql);
+}
+
+static void write_slow_entry(const char *entry, const char *plan_sql, sqlite3 *db) {
+    FILE *log = fopen(slow_log_path, "a");
+    if (!log) return;
+    fputs(entry, log);
+    if (plan_sql && db) {
+        capturing_plan = 1;
+        write_query_plan(log, db, plan_sql);
+        capturing_plan = 0;
+    } else if (plan_sql) {
+        fprintf(log, "  (plan not captured)\n");
+    }
+    fprintf(log, "\n");
+    fclose(log);
+}
+
+static void record_slow_statement(sqlite3_stmt *stmt, sqlite3_int64 elapsed_ns) {
+    const char *sql = sqlite3_sql(stmt);
+    if (!sql) return;
+
+    // Plans are only meaningful for single queries, not PRAGMAs or transaction control
+    const char *p = sql;
+    while (*p == ' ' || *p == '\n' || *p == '\t') p++;
+    int explainable = (strncasecmp(p, "SELECT", 6) == 0 || strncasecmp(p, "WITH", 4) == 0 ||
+                       strncasecmp(p, "INSERT", 6) == 0 || strncasecmp(p, "UPDATE", 6) == 0 ||
+                       strncasecmp(p, "DELETE", 6) == 0);
+
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    const char *query_string = getenv("QUERY_STRING");
+    char *expanded = sqlite3_expanded_sql(stmt);
+    char *entry = sqlite3_mprintf("# %s pid=%d time=%.3f ms fullscan_steps=%d sorts=%d query_string=%s\n%s\n",
+                                  timestamp, (int)getpid(), elapsed_ns / 1e6,
+                                  sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0),
+                                  sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0),
+                                  query_string ? query_string : "-", expanded ? expanded : sql);
+    sqlite3_free(expanded);
+    if (!entry) return;
+
+    char *plan_sql = explainable ? sqlite3_mprintf("%s", sql) : NULL;
+    if (pending_count == SQL_PROFILE_MAX_PENDING) {
+        // Too many to hold until the request ends: log this one now, without its plan
+        write_slow_entry(entry, plan_sql, NULL);
+        sqlite3_free(entry);
+        sqlite3_free(plan_sql);
+        return;
+    }
+    pending[pending_count++] = (SlowStatement){ sqlite3_db_handle(stmt), entry, plan_sql };
+}
+
+/*
+ * Write the slow statements recorded so far, explaining each on the
+ * connection that ran it. Call between statements, before those
+ * connections close; serve mode's parent also calls it before each fork
+ * so children do not inherit its entries.
+ */
+void sql_profile_flush(void) {
+    for (int i = 0; i < pending_count; i++) {
+        write_slow_entry(pending[i].entry, pending[i].plan_sql, pending[i].db);
+        sqlite3_free(pending[i].entry);
+        sqlite3_free(pending[i].plan_sql);
+    }
+    pending_count = 0;
+}
+
+static int sql_trace(unsigned int type, void *context, void *p, void *x) {
+    (void)context;
+
+    if (capturing_plan) return 0;
+
+    switch (type) {
+        case SQLITE_TRACE_STMT:
+            metrics_count_statement();
+            break;
+        case SQLITE_TRACE_ROW:
+            metrics_count_row();
+            break;
+        case SQLITE_TRACE_PROFILE: {
+            sqlite3_int64 elapsed_ns = *(sqlite3_int64*)x;
+            if (slow_threshold_ns >= 0 && elapsed_ns >= slow_threshold_ns) {
+                record_slow_statement((sqlite3_stmt*)p, elapsed_ns);
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+void sql_profile_attach(sqlite3 *db) {
+    const char *threshold = getenv("FAMILY_TREE_SLOW_MS");
+    if (threshold && *threshold) {
+        slow_threshold_ns = atof(threshold) * 1e6;
+    }
+
+    const char *path = getenv("FAMILY_TREE_SLOW_LOG");
+    if (path && *path) {
+        slow_log_path = path;
+    }
+
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE, sql_trace, NULL);
+}
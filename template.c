@@ -0,0 +1,175 @@
+/* template.c - Output runtime for compiled templates */
+
+#include "family_tree.h"
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * Generated template functions (tplc.c) append static spans and slot values
+ * to a TemplateOutput as iovecs without copying them. Escaped text is split
+ * into runs that point at the source string and static entity spans, and
+ * integers are formatted into a small arena. Nothing is copied until the
+ * batch is flushed: large batches go out with one writev, small ones are
+ * copied into the stdio buffer so they stay ordered with printf output and
+ * pass through the compression filter when stdout is not a plain file.
+ */
+
+// While capturing, flushed output is collected here instead of going to stdout
+static int capturing = 0;
+static int capture_failed = 0;
+static char *capture_data = NULL;
+static size_t capture_len = 0;
+static size_t capture_capacity = 0;
+
+void tpl_begin(TemplateOutput *out) {
+    out->count = 0;
+    out->bytes = 0;
+    out->arena_used = 0;
+}
+
+// Write every iovec, resuming after partial writes; used for sockets too
+int writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 1;
+        }
+        // Skip what was written, then resume mid-iovec on a partial write
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+int tpl_flush(TemplateOutput *out) {
+    int rc = 0;
+    int fd = fileno(stdout);
+
+    if (capturing) {
+        if (capture_len + out->bytes > capture_capacity) {
+            size_t capacity = capture_capacity ? capture_capacity * 2 : 1024;
+            while (capacity < capture_len + out->bytes) capacity *= 2;
+            char *data = realloc(capture_data, capacity);
+            if (!data) {
+                capture_failed = 1;
+                tpl_begin(out);
+                return 1;
+            }
+            capture_data = data;
+            capture_capacity = capacity;
+        }
+        for (int i = 0; i < out->count; i++) {
+            memcpy(capture_data + capture_len, out->iov[i].iov_base, out->iov[i].iov_len);
+            capture_len += out->iov[i].iov_len;
+        }
+    } else if (out->bytes >= TPL_WRITEV_MIN && fd >= 0) {
+        // Earlier printf output must reach the descriptor first
+        if (fflush(stdout) != 0 || writev_all(fd, out->iov, out->count) != 0) rc = 1;
+    } else {
+        for (int i = 0; i < out->count; i++) {
+            if (fwrite(out->iov[i].iov_base, 1, out->iov[i].iov_len, stdout) != out->iov[i].iov_len) rc = 1;
+        }
+    }
+
+    tpl_begin(out);
+    return rc;
+}
+
+void tpl_span(TemplateOutput *out, const char *data, size_t len) {
+    if (len == 0) return;
+
+    // Pieces contiguous in memory, like consecutive arena integers, share an iovec
+    if (out->count > 0) {
+        struct iovec *last = &out->iov[out->count - 1];
+        if ((const char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            out->bytes += len;
+            return;
+        }
+    }
+
+    if (out->count == TPL_IOV_MAX) tpl_flush(out);
+    out->iov[out->count].iov_base = (void *)data;
+    out->iov[out->count].iov_len = len;
+    out->count++;
+    out->bytes += len;
+}
+
+void tpl_raw(TemplateOutput *out, const char *str) {
+    if (str) tpl_span(out, str, strlen(str));
+}
+
+// Same entities as html_escape()
+void tpl_text(TemplateOutput *out, const char *str) {
+    if (!str) return;
+
+    const char *run = str;
+    for (const char *p = str; ; p++) {
+        const char *entity;
+        size_t entity_len;
+        switch (*p) {
+            case '&': entity = "&amp;"; entity_len = 5; break;
+            case '<': entity = "&lt;"; entity_len = 4; break;
+            case '>': entity = "&gt;"; entity_len = 4; break;
+            case '"': entity = "&quot;"; entity_len = 6; break;
+            case '\'': entity = "&#039;"; entity_len = 6; break;
+            case '\0':
+                tpl_span(out, run, p - run);
+                return;
+            default:
+                continue;
+        }
+        tpl_span(out, run, p - run);
+        tpl_span(out, entity, entity_len);
+        run = p + 1;
+    }
+}
+
+void tpl_int(TemplateOutput *out, int value) {
+    char digits[12];
+    int n = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) digits[n++] = '-';
+
+    // The arena is only reclaimed by a flush, which also retires every span pointing into it
+    if (out->arena_used + n > TPL_ARENA_SIZE || out->count == TPL_IOV_MAX) tpl_flush(out);
+    char *dest = out->arena + out->arena_used;
+    for (int i = 0; i < n; i++) dest[i] = digits[n - 1 - i];
+    out->arena_used += n;
+    tpl_span(out, dest, n);
+}
+
+// Render templates into memory instead of stdout, e.g. to cache invariant markup
+void tpl_capture_begin(void) {
+    capturing = 1;
+    capture_failed = 0;
+    capture_data = NULL;
+    capture_len = 0;
+    capture_capacity = 0;
+}
+
+// Returns the captured bytes (caller frees) or NULL if memory ran out
+char *tpl_capture_end(size_t *len) {
+    capturing = 0;
+    if (capture_failed) {
+        free(capture_data);
+        capture_data = NULL;
+        return NULL;
+    }
+    char *data = capture_data ? capture_data : malloc(1);
+    capture_data = NULL;
+    *len = capture_len;
+    return data;
+}
@@ -0,0 +1,65 @@
+{{! dates.tpl - Searches by date: births and deaths in a range, who was alive }}
+
+{{define date_search_form}}
+<h2>Search by Date</h2>
+<form action="?action=date_search" method="get">
+<input type="hidden" name="action" value="date_search">
+<div class="form-group">
+<label for="event">Event:</label>
+<select id="event" name="event" class="form-control">
+<option value="birth"{{#if by_birth}} selected{{/if}}>Born</option>
+<option value="death"{{#if by_death}} selected{{/if}}>Died</option>
+</select>
+</div>
+<div class="form-group">
+<label for="from">From:</label>
+<input type="text" id="from" name="from" value="{{from}}" placeholder="1850" class="form-control">
+</div>
+<div class="form-group">
+<label for="to">To:</label>
+<input type="text" id="to" name="to" value="{{to}}" placeholder="1900" class="form-control">
+</div>
+<button type="submit" class="btn-primary">Search</button>
+</form>
+{{end}}
+
+{{define date_format_hint}}
+<p>Dates can be written as 1850, 1850-03, 1850-03-12 or 12 MAR 1850.</p>
+{{end}}
+
+{{define date_search_empty}}
+<p>No {{#if more}}more {{/if}}people found.</p>
+{{end}}
+
+{{define alive_form}}
+<h2>Who Was Alive</h2>
+<form action="?action=alive" method="get">
+<input type="hidden" name="action" value="alive">
+<div class="form-group">
+<label for="date">On:</label>
+<input type="text" id="date" name="date" value="{{date}}" placeholder="1920" class="form-control" required>
+</div>
+<div class="form-group">
+<label for="to">Until (optional):</label>
+<input type="text" id="to" name="to" value="{{to}}" class="form-control">
+</div>
+<div class="form-group">
+<label for="root_id">Descendants of person ID (optional):</label>
+{{#if has_root}}
+<input type="number" id="root_id" name="root_id" value="{{root_id:int}}" class="form-control">
+{{#else}}
+<input type="number" id="root_id" name="root_id" class="form-control">
+{{/if}}
+</div>
+<button type="submit" class="btn-primary">Search</button>
+</form>
+{{end}}
+
+{{define alive_root_failed}}
+<p>Could not load the descendants of person {{root_id:int}}.</p>
+{{end}}
+
+{{! to is only set for a range of days }}
+{{define alive_summary}}
+<p>{{total:int}} {{#if one}}person{{#else}}people{{/if}} may have been alive {{#if to}}between {{from}} and {{to}}{{#else}}on {{from}}{{/if}}.</p>
+{{end}}
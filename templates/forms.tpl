@@ -0,0 +1,99 @@
+{{! forms.tpl - Add and edit person forms }}
+
+{{define add_person_form}}
+<h2>Add {{#if relationship_type}}{{relationship_type}}{{#else}}Person{{/if}}</h2>
+<form action="?action=process_add_person" method="post" enctype="multipart/form-data">
+{{#if has_parent}}
+<input type="hidden" name="parent_id" value="{{parent_id:int}}">
+<input type="hidden" name="relationship_type" value="{{relationship_type}}">
+{{/if}}
+<div class="form-group">
+<label for="first_name">First Name:</label>
+<input type="text" id="first_name" name="first_name" class="form-control" required>
+</div>
+<div class="form-group">
+<label for="last_name">Last Name:</label>
+<input type="text" id="last_name" name="last_name" class="form-control" required>
+</div>
+<div class="form-group">
+<label for="gender">Gender:</label>
+<select id="gender" name="gender" class="form-control">
+<option value="M">Male</option>
+<option value="F">Female</option>
+</select>
+</div>
+<div class="form-group">
+<label for="birth_date">Birth Date:</label>
+<input type="date" id="birth_date" name="birth_date" class="form-control">
+</div>
+<div class="form-group">
+<label for="death_date">Death Date (if applicable):</label>
+<input type="date" id="death_date" name="death_date" class="form-control">
+</div>
+<div class="form-group">
+<label for="bio">Biography:</label>
+<textarea id="bio" name="bio" class="form-control" rows="5"></textarea>
+</div>
+<div class="form-group">
+<label for="photo_url">Photo URL:</label>
+<input type="url" id="photo_url" name="photo_url" class="form-control">
+</div>
+<div class="form-group">
+<label for="photo">Or upload a photo:</label>
+<input type="file" id="photo" name="photo" accept="image/*" class="form-control">
+</div>
+{{#if is_spouse}}
+<div class="form-group">
+<label for="marriage_date">Marriage Date:</label>
+<input type="date" id="marriage_date" name="marriage_date" class="form-control">
+</div>
+{{/if}}
+<button type="submit" class="btn-primary">Add Person</button>
+<a href="?action=view_profile&id={{parent_id:int}}" class="btn-secondary">Cancel</a>
+</form>
+{{end}}
+
+{{! Stored photos have a relative URL, so photo_url cannot be type="url" here }}
+{{define edit_person_form}}
+<h2>Edit Person</h2>
+<form action="?action=process_edit_person" method="post" enctype="multipart/form-data">
+<input type="hidden" name="id" value="{{id:int}}">
+<div class="form-group">
+<label for="first_name">First Name:</label>
+<input type="text" id="first_name" name="first_name" value="{{first_name}}" class="form-control" required>
+</div>
+<div class="form-group">
+<label for="last_name">Last Name:</label>
+<input type="text" id="last_name" name="last_name" value="{{last_name}}" class="form-control" required>
+</div>
+<div class="form-group">
+<label for="gender">Gender:</label>
+<select id="gender" name="gender" class="form-control">
+<option value="M"{{#if male}} selected{{/if}}>Male</option>
+<option value="F"{{#if female}} selected{{/if}}>Female</option>
+</select>
+</div>
+<div class="form-group">
+<label for="birth_date">Birth Date:</label>
+<input type="date" id="birth_date" name="birth_date"{{#if birth_date}} value="{{birth_date}}"{{/if}} class="form-control">
+</div>
+<div class="form-group">
+<label for="death_date">Death Date (if applicable):</label>
+<input type="date" id="death_date" name="death_date"{{#if death_date}} value="{{death_date}}"{{/if}} class="form-control">
+</div>
+<div class="form-group">
+<label for="bio">Biography:</label>
+<textarea id="bio" name="bio" class="form-control" rows="5">{{bio}}</textarea>
+</div>
+<div class="form-group">
+<label for="photo_url">Photo URL:</label>
+<input type="text" id="photo_url" name="photo_url"{{#if photo_url}} value="{{photo_url}}"{{/if}} class="form-control">
+</div>
+<div class="form-group">
+<label for="photo">Replace with an uploaded photo:</label>
+<input type="file" id="photo" name="photo" accept="image/*" class="form-control">
+</div>
+<button type="submit" class="btn-primary">Update Person</button>
+<a href="?action=view_profile&id={{id:int}}" class="btn-secondary">Cancel</a>
+</form>
+{{end}}
@@ -0,0 +1,38 @@
+{{! lists.tpl - Paged person listings: search results and browsing }}
+
+{{define notice}}
+<p>{{text}}</p>
+{{end}}
+
+{{define search_results_head}}
+<h2>Search Results</h2>
+{{end}}
+
+{{define browse_head}}
+<h2>All People</h2>
+<div class="browse-order">
+<a href="?action=browse&order=name" class="{{#if by_birth}}btn-secondary{{#else}}btn-primary{{/if}}">By surname</a>
+<a href="?action=browse&order=birth" class="{{#if by_birth}}btn-primary{{#else}}btn-secondary{{/if}}">By birth date</a>
+</div>
+{{end}}
+
+{{define people_list_begin}}
+<div class="{{list_class:raw}}">
+{{end}}
+
+{{define people_list_end}}
+</div>
+{{end}}
+
+{{! url is a fixed query built in C; the search term and cursor keys arrive percent-encoded }}
+{{define next_page_link}}
+<a href="{{url:raw}}{{#if search_term}}&search_term={{search_term}}{{/if}}{{#if after_key}}&after_key={{after_key}}{{/if}}{{#if after_key2}}&after_key2={{after_key2}}{{/if}}&after_id={{after_id:int}}" class="btn-secondary">Next page</a>
+{{end}}
+
+{{define search_no_results}}
+<p>No {{#if more}}more {{/if}}results found for "{{search_term}}".</p>
+{{end}}
+
+{{define browse_empty}}
+<p>No {{#if more}}more {{/if}}people to show.</p>
+{{end}}
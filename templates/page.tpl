@@ -0,0 +1,35 @@
+{{! page.tpl - Document shell shared by every HTML page }}
+
+{{define page_header}}
+<!DOCTYPE html>
+<html lang="en">
+<head>
+  <meta charset="UTF-8">
+  <meta name="viewport" content="width=device-width, initial-scale=1.0">
+  <title>{{title}}</title>
+  <link rel="stylesheet" href="/styles.css">
+  <script src="https://cdnjs.cloudflare.com/ajax/libs/d3/7.8.5/d3.min.js"></script>
+  <script src="/family-tree.js"></script>
+</head>
+<body>
+  <header>
+    <h1>{{title}}</h1>
+    <nav>
+      <ul>
+        <li><a href="/">Home</a></li>
+        <li><a href="/tree">Family Tree</a></li>
+        <li><a href="/login">Login</a></li>
+      </ul>
+    </nav>
+  </header>
+  <main>
+{{end}}
+
+{{define page_footer}}
+  </main>
+  <footer>
+    <p>&copy; {{year:int}} Family Tree Project</p>
+  </footer>
+</body>
+</html>
+{{end}}
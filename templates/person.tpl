@@ -0,0 +1,65 @@
+{{! person.tpl - Person cards and the profile page }}
+
+{{define person_card}}
+<div class="person-card {{gender_class:raw}}">
+{{#if photo_url}}
+  <img src="{{photo_url}}" alt="{{first_name}} {{last_name}}" class="person-photo">
+{{#else}}
+  <div class="person-photo-placeholder"></div>
+{{/if}}
+  <h3>{{first_name}} {{last_name}}</h3>
+{{#if birth_date}}
+  <p>Born: {{birth_date}}</p>
+{{/if}}
+{{#if death_date}}
+  <p>Died: {{death_date}}</p>
+{{/if}}
+  <a href="?action=view_profile&id={{id:int}}" class="btn-primary">View Profile</a>
+</div>
+{{end}}
+
+{{define person_profile_head}}
+<div class="person-profile">
+  <h2>{{first_name}} {{last_name}}</h2>
+{{#if photo_url}}
+  <img src="{{photo_url}}" alt="{{first_name}} {{last_name}}" class="profile-photo">
+{{/if}}
+  <div class="person-details">
+    <p><strong>Birth:</strong> {{#if birth_date}}{{birth_date}}{{#else}}Unknown{{/if}}</p>
+{{#if death_date}}
+    <p><strong>Death:</strong> {{death_date}}</p>
+{{/if}}
+{{#if bio}}
+    <div class="bio">
+      <h3>Biography</h3>
+      <p>{{bio}}</p>
+    </div>
+{{/if}}
+  </div>
+{{end}}
+
+{{define family_section_begin}}
+  <div class="family-section {{section_class:raw}}">
+    <h3>{{heading}}</h3>
+    <ul>
+{{end}}
+
+{{define person_link}}
+      <li><a href="/person?id={{id:int}}">{{first_name}} {{last_name}}</a></li>
+{{end}}
+
+{{define family_section_end}}
+    </ul>
+  </div>
+{{end}}
+
+{{define person_profile_end}}
+  <div class="edit-section">
+    <form action="/edit_person" method="get">
+      <input type="hidden" name="id" value="{{id:int}}">
+      <button type="submit" class="edit-button">Edit Information</button>
+    </form>
+    <a href="?action=timeline&id={{id:int}}&scope=descendants" class="btn-secondary">Family Timeline</a>
+  </div>
+</div>
+{{end}}
@@ -0,0 +1,48 @@
+{{! statistics.tpl - Tree-wide statistics for the administrator }}
+
+{{! The timings are formatted in C, to one and two decimals }}
+{{define statistics_head}}
+<h2>Statistics</h2>
+<p>{{people:int}} people as of {{loaded_at}}; snapshot loaded in {{load_ms}} ms, statistics computed in {{compute_ms}} ms.</p>
+{{end}}
+
+{{define statistics_section}}
+<h3>{{title}}</h3>
+{{end}}
+
+{{define statistics_table_begin}}
+<table class="statistics">
+{{end}}
+
+{{define statistics_table_end}}
+</table>
+{{end}}
+
+{{! share is a percentage formatted in C; width scales the bar to the largest count }}
+{{define statistics_row}}
+<tr><td>{{label}}</td><td>{{count:int}}</td><td>{{share}}%</td><td><div class="stat-bar" style="width: {{width:int}}%"></div></td></tr>
+{{end}}
+
+{{define statistics_age_row}}
+<tr><td>{{low:int}}&ndash;{{high:int}}</td><td>{{count:int}}</td><td>{{share}}%</td><td><div class="stat-bar" style="width: {{width:int}}%"></div></td></tr>
+{{end}}
+
+{{define statistics_decade_head}}
+<tr><th>Decade</th><th>Births</th><th>Deaths</th></tr>
+{{end}}
+
+{{define statistics_decade_row}}
+<tr><td>{{decade:int}}s</td><td>{{births:int}} <div class="stat-bar" style="width: {{births_width:int}}%"></div></td><td>{{deaths:int}} <div class="stat-bar" style="width: {{deaths_width:int}}%"></div></td></tr>
+{{end}}
+
+{{define statistics_ages}}
+<p>{{ages:int}} people with both dates: mean {{mean_age}} years, median {{median_age:int}}.</p>
+{{end}}
+
+{{define statistics_surnames}}
+<p>{{surnames:int}} distinct surnames.</p>
+{{end}}
+
+{{define statistics_couples}}
+<p>{{couples:int}} couples, {{children_each}} children each on average.</p>
+{{end}}
@@ -0,0 +1,496 @@
+/* thumbnail.c - Thumbnail jobs and worker processes for stored photos */
+
+#include "family_tree.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Person cards show photos at a fixed small size, so each uploaded photo
+ * gets a THUMB_SIZE square thumbnail stored back into the blob store. The
+ * CGI only records a job row when a photo is saved; decoding and scaling
+ * happen in separate worker processes (family_tree.cgi thumbnail-worker)
+ * that claim jobs one at a time inside an immediate transaction. Until a
+ * thumbnail exists, the thumbnail URL answers with the original photo,
+ * marked for revalidation so the thumbnail replaces it once it is ready.
+ */
+
+#define THUMB_BUSY_TIMEOUT_MS 5000
+#define THUMB_RETRY_SECONDS 30    // Backoff per failed attempt
+#define THUMB_MAX_WORKERS 64
+
+static pid_t worker_pids[THUMB_MAX_WORKERS];
+static int worker_count;
+static volatile sig_atomic_t worker_stop;
+
+static const char *photo_hash(const char *photo_url) {
+    size_t prefix_len = strlen(PHOTO_URL_PREFIX);
+    if (!photo_url || strncmp(photo_url, PHOTO_URL_PREFIX, prefix_len) != 0) return NULL;
+    return blob_hash_valid(photo_url + prefix_len) ? photo_url + prefix_len : NULL;
+}
+
+// Queue a thumbnail for a stored photo; links to other sites are left alone
+int enqueue_thumbnail(sqlite3 *db, const char *photo_url) {
+    const char *hash = photo_hash(photo_url);
+    if (!hash) return 0;
+
+    const char *sql = "INSERT OR IGNORE INTO thumbnail_jobs (hash, state, attempts, created_at, updated_at) "
+                      "VALUES (?, 'pending', 0, ?, ?);";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    time_t now = time(NULL);
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, now);
+    sqlite3_bind_int64(stmt, 3, now);
+
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to queue thumbnail: %s\n", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc != SQLITE_DONE;
+}
+
+/* Scaling */
+
+// Centre-crop to a square and box-filter it to THUMB_SIZE x THUMB_SIZE
+static void scale_thumbnail(const Image *image, unsigned char *out) {
+    int side = image->width < image->height ? image->width : image->height;
+    int left = (image->width - side) / 2;
+    int top = (image->height - side) / 2;
+
+    for (int oy = 0; oy < THUMB_SIZE; oy++) {
+        int y0 = top + (int)((long)oy * side / THUMB_SIZE);
+        int y1 = top + (int)((long)(oy + 1) * side / THUMB_SIZE);
+        if (y1 <= y0) y1 = y0 + 1;
+
+        for (int ox = 0; ox < THUMB_SIZE; ox++) {
+            int x0 = left + (int)((long)ox * side / THUMB_SIZE);
+            int x1 = left + (int)((long)(ox + 1) * side / THUMB_SIZE);
+            if (x1 <= x0) x1 = x0 + 1;
+
+            unsigned long sum[3] = { 0, 0, 0 };
+            for (int y = y0; y < y1; y++) {
+                const unsigned char *row = image->pixels + ((size_t)y * image->width + x0) * 3;
+                for (int x = x0; x < x1; x++, row += 3) {
+                    sum[0] += row[0];
+                    sum[1] += row[1];
+                    sum[2] += row[2];
+                }
+            }
+
+            unsigned long count = (unsigned long)(y1 - y0) * (x1 - x0);
+            unsigned char *pixel = out + ((size_t)oy * THUMB_SIZE + ox) * 3;
+            for (int c = 0; c < 3; c++) pixel[c] = (unsigned char)((sum[c] + count / 2) / count);
+        }
+    }
+}
+
+/* PNG output */
+
+static unsigned char *put_be32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+    return p + 4;
+}
+
+static int write_png_chunk(BlobWriter *writer, const char *type, const unsigned char *data, size_t len) {
+    unsigned char header[8], trailer[4];
+    put_be32(header, (uint32_t)len);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = crc32_update(crc32_update(0, header + 4, 4), data, len);
+    put_be32(trailer, crc);
+
+    return blob_writer_write(writer, header, sizeof(header)) || blob_writer_write(writer, data, len) ||
+           blob_writer_write(writer, trailer, sizeof(trailer));
+}
+
+// Per-row PNG filter: whichever of the five leaves the smallest sum of residuals
+static void filter_row(const unsigned char *row, const unsigned char *prior, size_t len, unsigned char *out) {
+    unsigned char candidate[THUMB_SIZE * 3];
+    unsigned long best_sum = (unsigned long)-1;
+
+    for (int filter = 0; filter < 5; filter++) {
+        unsigned long sum = 0;
+        for (size_t i = 0; i < len; i++) {
+            int a = i >= 3 ? row[i - 3] : 0;
+            int b = prior ? prior[i] : 0;
+            int c = prior && i >= 3 ? prior[i - 3] : 0;
+            int predicted = 0;
+            if (filter == 1) predicted = a;
+            if (filter == 2) predicted = b;
+            if (filter == 3) predicted = (a + b) / 2;
+            if (filter == 4) {
+                int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+            }
+            candidate[i] = (unsigned char)(row[i] - predicted);
+            sum += candidate[i] < 128 ? candidate[i] : 256 - candidate[i];
+        }
+        if (sum < best_sum) {
+            best_sum = sum;
+            out[0] = (unsigned char)filter;
+            memcpy(out + 1, candidate, len);
+        }
+    }
+}
+
+static int write_thumbnail_png(BlobWriter *writer, const unsigned char *pixels) {
+    size_t line = THUMB_SIZE * 3;
+    size_t raw_len = (line + 1) * THUMB_SIZE;
+    unsigned char *raw = malloc(raw_len);
+    if (!raw) return 1;
+
+    for (int y = 0; y < THUMB_SIZE; y++) {
+        filter_row(pixels + y * line, y ? pixels + (y - 1) * line : NULL, line, raw + y * (line + 1));
+    }
+
+    size_t zlib_len;
+    unsigned char *zlib = deflate_buffer(raw, raw_len, DEFLATE_ZLIB, &zlib_len);
+    free(raw);
+    if (!zlib) return 1;
+
+    unsigned char ihdr[13];
+    put_be32(ihdr, THUMB_SIZE);
+    put_be32(ihdr + 4, THUMB_SIZE);
+    ihdr[8] = 8;     // Bit depth
+    ihdr[9] = 2;     // Truecolour
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    int rc = blob_writer_write(writer, "\x89PNG\r\n\x1a\n", 8) ||
+             write_png_chunk(writer, "IHDR", ihdr, sizeof(ihdr)) ||
+             write_png_chunk(writer, "IDAT", zlib, zlib_len) ||
+             write_png_chunk(writer, "IEND", NULL, 0);
+
+    free(zlib);
+    return rc;
+}
+
+/* Jobs */
+
+static unsigned char *read_blob(const char *hash, size_t *len, char *error, size_t error_size) {
+    char path[512];
+    if (blob_path(hash, path, sizeof(path)) != 0) {
+        snprintf(error, error_size, "invalid photo hash");
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        snprintf(error, error_size, "cannot open photo: %s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    if (st.st_size > BLOB_MAX_BYTES) {
+        snprintf(error, error_size, "photo too large");
+        close(fd);
+        return NULL;
+    }
+
+    unsigned char *data = malloc(st.st_size ? st.st_size : 1);
+    size_t done = 0;
+    while (data && done < (size_t)st.st_size) {
+        ssize_t n = read(fd, data + done, st.st_size - done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            snprintf(error, error_size, "cannot read photo");
+            free(data);
+            data = NULL;
+            break;
+        }
+        done += n;
+    }
+    close(fd);
+    if (!data && !error[0]) snprintf(error, error_size, "out of memory");
+
+    *len = done;
+    return data;
+}
+
+// Returns 0, 1 for a failure worth retrying, or 2 when the photo cannot be decoded
+static int build_thumbnail(const char *hash, char thumb_hash[BLOB_HASH_HEX + 1], char *error, size_t error_size) {
+    error[0] = '\0';
+    size_t len;
+    unsigned char *data = read_blob(hash, &len, error, error_size);
+    if (!data) return 1;
+
+    Image image;
+    int rc = decode_image(data, len, &image, error, error_size);
+    free(data);
+    if (rc) return 2;
+
+    unsigned char *pixels = malloc(THUMB_SIZE * THUMB_SIZE * 3);
+    if (!pixels) {
+        free_image(&image);
+        snprintf(error, error_size, "out of memory");
+        return 1;
+    }
+    scale_thumbnail(&image, pixels);
+    free_image(&image);
+
+    BlobWriter *writer = blob_writer_open();
+    if (!writer) {
+        free(pixels);
+        snprintf(error, error_size, "cannot create thumbnail file");
+        return 1;
+    }
+    if (write_thumbnail_png(writer, pixels) != 0) {
+        blob_writer_abort(writer);
+        free(pixels);
+        snprintf(error, error_size, "cannot write thumbnail");
+        return 1;
+    }
+    free(pixels);
+
+    if (blob_writer_commit(writer, thumb_hash) != 0) {
+        snprintf(error, error_size, "cannot store thumbnail");
+        return 1;
+    }
+    return 0;
+}
+
+// Returns 1 with a job claimed, 0 when the queue is empty, -1 on error
+static int claim_thumbnail_job(sqlite3 *db, sqlite3_int64 *job_id, char hash[BLOB_HASH_HEX + 1]) {
+    char *error_msg = NULL;
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", NULL, NULL, &error_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        return -1;
+    }
+
+    // Jobs left running by a worker that died are retried, or given up on
+    const char *expire_sql =
+        "UPDATE thumbnail_jobs SET state = 'failed', error = 'worker stopped while processing', updated_at = ?1 "
+        "WHERE state = 'running' AND updated_at < ?2 AND attempts >= ?3;";
+    const char *claim_sql =
+        "UPDATE thumbnail_jobs SET state = 'running', attempts = attempts + 1, updated_at = ?1 "
+        "WHERE id = (SELECT id FROM thumbnail_jobs "
+        "WHERE (state = 'pending' AND updated_at <= ?1 - attempts * ?3) "
+        "OR (state = 'running' AND updated_at < ?2) ORDER BY id LIMIT 1) "
+        "RETURNING id, hash;";
+
+    time_t now = time(NULL);
+    int claimed = -1;
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_prepare_v2(db, expire_sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_int64(stmt, 1, now);
+        sqlite3_bind_int64(stmt, 2, now - THUMB_JOB_TIMEOUT);
+        sqlite3_bind_int(stmt, 3, THUMB_MAX_ATTEMPTS);
+        int rc = sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+
+        if (rc == SQLITE_DONE && sqlite3_prepare_v2(db, claim_sql, -1, &stmt, NULL) == SQLITE_OK) {
+            sqlite3_bind_int64(stmt, 1, now);
+            sqlite3_bind_int64(stmt, 2, now - THUMB_JOB_TIMEOUT);
+            sqlite3_bind_int(stmt, 3, THUMB_RETRY_SECONDS);
+            rc = sqlite3_step(stmt);
+            if (rc == SQLITE_ROW) {
+                *job_id = sqlite3_column_int64(stmt, 0);
+                snprintf(hash, BLOB_HASH_HEX + 1, "%s", (const char *)sqlite3_column_text(stmt, 1));
+                claimed = 1;
+            } else if (rc == SQLITE_DONE) {
+                claimed = 0;
+            }
+            sqlite3_finalize(stmt);
+        }
+    }
+
+    if (claimed < 0) {
+        fprintf(stderr, "Failed to claim thumbnail job: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    if (sqlite3_exec(db, "COMMIT;", NULL, NULL, &error_msg) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", error_msg);
+        sqlite3_free(error_msg);
+        sqlite3_exec(db, "ROLLBACK;", NULL, NULL, NULL);
+        return -1;
+    }
+    return claimed;
+}
+
+// Record a result; failures go back to pending until attempts run out, unless permanent
+static int finish_thumbnail_job(sqlite3 *db, sqlite3_int64 job_id, const char *thumb_hash, const char *error,
+                                int permanent) {
+    const char *sql = thumb_hash
+        ? "UPDATE thumbnail_jobs SET state = 'done', thumb_hash = ?2, error = NULL, updated_at = ?3 WHERE id = ?1;"
+        : "UPDATE thumbnail_jobs SET state = CASE WHEN attempts >= ?4 THEN 'failed' ELSE 'pending' END, "
+          "error = ?2, updated_at = ?3 WHERE id = ?1;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int64(stmt, 1, job_id);
+    sqlite3_bind_text(stmt, 2, thumb_hash ? thumb_hash : error, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, time(NULL));
+    if (!thumb_hash) sqlite3_bind_int(stmt, 4, permanent ? 0 : THUMB_MAX_ATTEMPTS);
+
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to update thumbnail job: %s\n", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc != SQLITE_DONE;
+}
+
+/* Workers */
+
+static void worker_signal(int sig) {
+    (void)sig;
+    worker_stop = 1;
+}
+
+static void forward_signal(int sig) {
+    for (int i = 0; i < worker_count; i++) {
+        if (worker_pids[i] > 0) kill(worker_pids[i], sig);
+    }
+}
+
+// One worker process: its own connection, one job at a time until stopped
+static int thumbnail_worker(int once) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = worker_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    sqlite3 *db;
+    if (init_database(&db) != 0) return 1;
+    sqlite3_busy_timeout(db, THUMB_BUSY_TIMEOUT_MS);
+
+    int rc = 0, built = 0, failed = 0;
+    while (!worker_stop) {
+        sqlite3_int64 job_id;
+        char hash[BLOB_HASH_HEX + 1];
+        int claimed = claim_thumbnail_job(db, &job_id, hash);
+        if (claimed < 0) {
+            rc = 1;
+            break;
+        }
+        if (claimed == 0) {
+            if (once) break;
+            sleep(THUMB_POLL_SECONDS);
+            continue;
+        }
+
+        char thumb_hash[BLOB_HASH_HEX + 1];
+        char error[256];
+        int result = build_thumbnail(hash, thumb_hash, error, sizeof(error));
+        if (result == 0) {
+            finish_thumbnail_job(db, job_id, thumb_hash, NULL, 0);
+            built++;
+        } else {
+            fprintf(stderr, "Thumbnail for %s failed: %s\n", hash, error);
+            finish_thumbnail_job(db, job_id, NULL, error, result == 2);
+            failed++;
+        }
+    }
+
+    fprintf(stderr, "Worker %d: %d thumbnails built, %d failed\n", (int)getpid(), built, failed);
+    sqlite3_close(db);
+    return rc;
+}
+
+// Queue photos saved before the thumbnail stage existed
+static int enqueue_missing_thumbnails(sqlite3 *db) {
+    const char *sql =
+        "INSERT OR IGNORE INTO thumbnail_jobs (hash, state, attempts, created_at, updated_at) "
+        "SELECT DISTINCT substr(photo_url, length(?1) + 1), 'pending', 0, ?2, ?2 FROM people "
+        "WHERE substr(photo_url, 1, length(?1)) = ?1 AND length(photo_url) = length(?1) + ?3;";
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_text(stmt, 1, PHOTO_URL_PREFIX, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, time(NULL));
+    sqlite3_bind_int(stmt, 3, BLOB_HASH_HEX);
+    int rc = sqlite3_step(stmt);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to queue thumbnails: %s\n", sqlite3_errmsg(db));
+    } else if (sqlite3_changes(db) > 0) {
+        fprintf(stderr, "Queued %d existing photos\n", sqlite3_changes(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc != SQLITE_DONE;
+}
+
+/*
+ * family_tree.cgi thumbnail-worker [processes] [--once]: fork the worker
+ * processes and wait for them. With --once the workers exit when the
+ * queue is empty; otherwise they poll until sent SIGTERM or SIGINT.
+ */
+int run_thumbnail_worker(sqlite3 *db, int processes, int once) {
+    if (processes < 1) processes = 1;
+    if (processes > THUMB_MAX_WORKERS) processes = THUMB_MAX_WORKERS;
+
+    if (enqueue_missing_thumbnails(db) != 0) return 1;
+
+    // Workers open their own connections; this one is not used after fork
+    fflush(NULL);
+    for (worker_count = 0; worker_count < processes; worker_count++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Cannot start worker: %s\n", strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            _exit(thumbnail_worker(once));
+        }
+        worker_pids[worker_count] = pid;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = forward_signal;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    int rc = worker_count == processes ? 0 : 1;
+    for (int i = 0; i < worker_count; i++) {
+        int status;
+        while (waitpid(worker_pids[i], &status, 0) < 0) {
+            if (errno != EINTR) {
+                status = 1;
+                break;
+            }
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) rc = 1;
+    }
+    return rc;
+}
+
+/* Serving */
+
+// Send the thumbnail of a stored photo, or the photo itself until one is built
+int serve_thumbnail(sqlite3 *db, const char *hash) {
+    char thumb_hash[BLOB_HASH_HEX + 1] = "";
+    const char *sql = "SELECT thumb_hash FROM thumbnail_jobs WHERE hash = ? AND state = 'done';";
+    sqlite3_stmt *stmt;
+
+    if (hash && sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_text(stmt, 0)) {
+            snprintf(thumb_hash, sizeof(thumb_hash), "%s", (const char *)sqlite3_column_text(stmt, 0));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (thumb_hash[0]) return serve_blob(thumb_hash, 1);
+    return serve_blob(hash, 0);
+}
@@ -0,0 +1,438 @@
+/* tplc.c - Template compiler for family tree application markup */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Turns the markup in the templates directory into C. Each {{define name}} ...
+ * {{end}} block becomes a function tpl_name() taking a struct of typed
+ * slots, and its body becomes a sequence of calls that append pre-split
+ * static byte spans and slot values to a TemplateOutput (template.c), so
+ * rendering does no format-string parsing at run time.
+ *
+ * Template syntax:
+ *   {{define name}} ... {{end}}   one template; text outside is ignored
+ *   {{field}}                     const char *, HTML-escaped, NULL renders nothing
+ *   {{field:raw}}                 const char *, trusted markup written as is
+ *   {{field:int}}                 int
+ *   {{#if field}} ... {{#else}} ... {{/if}}
+ *                                 a text field tests non-NULL and non-empty;
+ *                                 a field only used in conditions is an int flag
+ *   {{! comment}}
+ * A line holding nothing but a define, end, if, else or comment tag is
+ * dropped entirely, newline included, so block tags can sit on their own
+ * lines without adding blank lines to the output.
+ *
+ * Usage: tplc -o output_base template.tpl ...
+ * writes output_base.h (slot structs and prototypes) and output_base.c.
+ */
+
+#define TPLC_MAX_FIELDS 64
+#define TPLC_MAX_NESTING 16
+
+typedef enum { FIELD_FLAG, FIELD_TEXT, FIELD_RAW, FIELD_INT } FieldType;
+
+typedef enum { NODE_TEXT, NODE_SLOT, NODE_IF, NODE_ELSE, NODE_ENDIF } NodeKind;
+
+typedef struct {
+    NodeKind kind;
+    const char *text;       // NODE_TEXT: span in the source buffer
+    size_t len;
+    int field;              // NODE_SLOT, NODE_IF: index into the template's fields
+    FieldType type;         // NODE_SLOT: how this use renders the field
+} Node;
+
+typedef struct {
+    char name[64];
+    FieldType type;
+} Field;
+
+typedef struct {
+    char name[64];
+    const char *file;
+    Field fields[TPLC_MAX_FIELDS];
+    int field_count;
+    Node *nodes;
+    int node_count;
+    int node_capacity;
+} Template;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} Buffer;
+
+static const char *current_file;
+static int current_line;
+
+static void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", current_file, current_line);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static void buffer_append(Buffer *buffer, const char *data, size_t len) {
+    if (buffer->len + len + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+        while (capacity < buffer->len + len + 1) capacity *= 2;
+        buffer->data = realloc(buffer->data, capacity);
+        if (!buffer->data) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    buffer->data[buffer->len] = '\0';
+}
+
+static void buffer_printf(Buffer *buffer, const char *format, ...) {
+    char line[1024];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    buffer_append(buffer, line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1);
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        exit(1);
+    }
+    Buffer buffer = { NULL, 0, 0 };
+    char chunk[8192];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) buffer_append(&buffer, chunk, n);
+    fclose(file);
+    if (!buffer.data) buffer_append(&buffer, "", 0);
+    return buffer.data;
+}
+
+static void add_node(Template *tpl, Node node) {
+    if (tpl->node_count == tpl->node_capacity) {
+        tpl->node_capacity = tpl->node_capacity ? tpl->node_capacity * 2 : 64;
+        tpl->nodes = realloc(tpl->nodes, tpl->node_capacity * sizeof(Node));
+        if (!tpl->nodes) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    tpl->nodes[tpl->node_count++] = node;
+}
+
+static int valid_name(const char *name) {
+    if (!*name || !(islower((unsigned char)*name) || *name == '_')) return 0;
+    for (const char *p = name; *p; p++) {
+        if (!(islower((unsigned char)*p) || isdigit((unsigned char)*p) || *p == '_')) return 0;
+    }
+    return 1;
+}
+
+// Field index for a use of name with the given type; conditions adopt the slot type
+static int use_field(Template *tpl, const char *name, FieldType type) {
+    if (!valid_name(name) || strlen(name) >= sizeof(tpl->fields[0].name)) fail("invalid field name '%s'", name);
+
+    for (int i = 0; i < tpl->field_count; i++) {
+        Field *field = &tpl->fields[i];
+        if (strcmp(field->name, name) != 0) continue;
+        if (type == FIELD_FLAG) return i;
+        if (field->type == FIELD_FLAG) {
+            field->type = type;
+        } else if ((field->type == FIELD_INT) != (type == FIELD_INT)) {
+            fail("field '%s' used as both int and text", name);
+        }
+        // Escaped and raw uses of one string share a const char * slot
+        return i;
+    }
+
+    if (tpl->field_count == TPLC_MAX_FIELDS) fail("too many fields in template '%s'", tpl->name);
+    Field *field = &tpl->fields[tpl->field_count];
+    snprintf(field->name, sizeof(field->name), "%s", name);
+    field->type = type;
+    return tpl->field_count++;
+}
+
+static int is_block_tag(const char *tag) {
+    return strncmp(tag, "define ", 7) == 0 || strcmp(tag, "end") == 0 || strncmp(tag, "#if ", 4) == 0 ||
+           strcmp(tag, "#else") == 0 || strcmp(tag, "/if") == 0 || tag[0] == '!';
+}
+
+static void parse_file(const char *path, char *source, Template **templates, int *template_count) {
+    current_file = path;
+    current_line = 1;
+
+    Template *tpl = NULL;
+    int nesting = 0;
+    const char *text_start = source;
+    const char *p = source;
+
+    for (;;) {
+        const char *open = strstr(p, "{{");
+        const char *text_end = open ? open : p + strlen(p);
+        for (const char *c = p; c < text_end; c++) current_line += *c == '\n';
+        if (!open) {
+            if (tpl) fail("template '%s' has no {{end}}", tpl->name);
+            for (const char *c = text_start; *c; c++) {
+                if (!isspace((unsigned char)*c)) fail("text outside {{define}}");
+            }
+            return;
+        }
+
+        const char *close = strstr(open + 2, "}}");
+        if (!close) fail("unterminated tag");
+        char tag[256];
+        const char *t = open + 2, *te = close;
+        while (t < te && isspace((unsigned char)*t)) t++;
+        while (te > t && isspace((unsigned char)te[-1])) te--;
+        if ((size_t)(te - t) >= sizeof(tag)) fail("tag too long");
+        memcpy(tag, t, te - t);
+        tag[te - t] = '\0';
+        const char *after = close + 2;
+
+        // A block tag alone on its line takes the whole line with it
+        if (is_block_tag(tag)) {
+            const char *line_start = open;
+            while (line_start > text_start && (line_start[-1] == ' ' || line_start[-1] == '\t')) line_start--;
+            const char *line_end = after;
+            while (*line_end == ' ' || *line_end == '\t' || *line_end == '\r') line_end++;
+            int at_line_start = line_start == source || line_start[-1] == '\n';
+            if (at_line_start && (*line_end == '\n' || *line_end == '\0')) {
+                text_end = line_start;
+                after = *line_end == '\n' ? line_end + 1 : line_end;
+                current_line += *line_end == '\n';
+            } else {
+                text_end = open;
+            }
+        }
+
+        if (text_end > text_start) {
+            if (tpl) {
+                add_node(tpl, (Node){ NODE_TEXT, text_start, (size_t)(text_end - text_start), -1, FIELD_TEXT });
+            } else {
+                for (const char *c = text_start; c < text_end; c++) {
+                    if (!isspace((unsigned char)*c)) fail("text outside {{define}}");
+                }
+            }
+        }
+
+        if (tag[0] == '!') {
+            // Comment
+        } else if (strncmp(tag, "define ", 7) == 0) {
+            if (tpl) fail("{{define}} inside template '%s'", tpl->name);
+            const char *name = tag + 7;
+            while (*name == ' ') name++;
+            if (!valid_name(name) || strlen(name) >= sizeof(tpl->name)) fail("invalid template name '%s'", name);
+            for (int i = 0; i < *template_count; i++) {
+                if (strcmp((*templates)[i].name, name) == 0) fail("template '%s' defined twice", name);
+            }
+            *templates = realloc(*templates, (*template_count + 1) * sizeof(Template));
+            if (!*templates) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            tpl = &(*templates)[(*template_count)++];
+            memset(tpl, 0, sizeof(Template));
+            snprintf(tpl->name, sizeof(tpl->name), "%s", name);
+            tpl->file = path;
+            nesting = 0;
+        } else if (!tpl) {
+            fail("{{%s}} outside {{define}}", tag);
+        } else if (strcmp(tag, "end") == 0) {
+            if (nesting) fail("{{#if}} not closed in template '%s'", tpl->name);
+            tpl = NULL;
+        } else if (strncmp(tag, "#if ", 4) == 0) {
+            if (++nesting > TPLC_MAX_NESTING) fail("conditions nested too deeply");
+            const char *name = tag + 4;
+            while (*name == ' ') name++;
+            add_node(tpl, (Node){ NODE_IF, NULL, 0, use_field(tpl, name, FIELD_FLAG), FIELD_FLAG });
+        } else if (strcmp(tag, "#else") == 0) {
+            if (!nesting) fail("{{#else}} without {{#if}}");
+            add_node(tpl, (Node){ NODE_ELSE, NULL, 0, -1, FIELD_FLAG });
+        } else if (strcmp(tag, "/if") == 0) {
+            if (!nesting--) fail("{{/if}} without {{#if}}");
+            add_node(tpl, (Node){ NODE_ENDIF, NULL, 0, -1, FIELD_FLAG });
+        } else {
+            FieldType type = FIELD_TEXT;
+            char *colon = strchr(tag, ':');
+            if (colon) {
+                *colon = '\0';
+                if (strcmp(colon + 1, "int") == 0) {
+                    type = FIELD_INT;
+                } else if (strcmp(colon + 1, "raw") == 0) {
+                    type = FIELD_RAW;
+                } else if (strcmp(colon + 1, "text") != 0) {
+                    fail("unknown slot type '%s'", colon + 1);
+                }
+            }
+            add_node(tpl, (Node){ NODE_SLOT, NULL, 0, use_field(tpl, tag, type), type });
+        }
+
+        p = text_start = after;
+    }
+}
+
+/* Output */
+
+static void struct_name(const char *name, char *out, size_t size) {
+    size_t j = 0;
+    j += snprintf(out, size, "Tpl");
+    int upper = 1;
+    for (const char *p = name; *p && j + 1 < size; p++) {
+        if (*p == '_') {
+            upper = 1;
+            continue;
+        }
+        out[j++] = upper ? (char)toupper((unsigned char)*p) : *p;
+        upper = 0;
+    }
+    out[j] = '\0';
+}
+
+// Emit a span as C string literals, one source line per literal
+static void write_span(Buffer *out, const char *text, size_t len, int indent) {
+    buffer_printf(out, "%*stpl_span(out, ", indent, "");
+    for (size_t i = 0; i < len; ) {
+        if (i > 0) buffer_printf(out, "\n%*s", indent + 14, "");
+        buffer_append(out, "\"", 1);
+        while (i < len) {
+            unsigned char c = (unsigned char)text[i++];
+            if (c == '\n') {
+                buffer_append(out, "\\n", 2);
+                break;
+            } else if (c == '"' || c == '\\') {
+                char escaped[2] = { '\\', (char)c };
+                buffer_append(out, escaped, 2);
+            } else if (c == '\t') {
+                buffer_append(out, "\\t", 2);
+            } else if (c < 0x20 || c == 0x7f || (c == '?' && i < len && text[i] == '?')) {
+                // Octal escapes also keep "??" trigraph sequences out of the literal
+                buffer_printf(out, "\\%03o", c);
+            } else {
+                buffer_append(out, (const char *)&c, 1);
+            }
+        }
+        buffer_append(out, "\"", 1);
+    }
+    buffer_printf(out, ", %zu);\n", len);
+}
+
+static void write_template(Buffer *header, Buffer *source, const Template *tpl) {
+    char type_name[96];
+    struct_name(tpl->name, type_name, sizeof(type_name));
+
+    if (tpl->field_count > 0) {
+        buffer_printf(header, "\n/* %s: %s */\ntypedef struct {\n", tpl->file, tpl->name);
+        for (int i = 0; i < tpl->field_count; i++) {
+            const Field *field = &tpl->fields[i];
+            buffer_printf(header, "    %s%s;\n", field->type == FIELD_INT || field->type == FIELD_FLAG ? "int " : "const char *",
+                          field->name);
+        }
+        buffer_printf(header, "} %s;\n", type_name);
+        buffer_printf(header, "void tpl_%s(const %s *v);\n", tpl->name, type_name);
+        buffer_printf(source, "\nvoid tpl_%s(const %s *v) {\n", tpl->name, type_name);
+    } else {
+        buffer_printf(header, "\n/* %s: %s */\nvoid tpl_%s(void);\n", tpl->file, tpl->name, tpl->name);
+        buffer_printf(source, "\nvoid tpl_%s(void) {\n", tpl->name);
+    }
+
+    buffer_printf(source, "    TemplateOutput output;\n    TemplateOutput *out = &output;\n    tpl_begin(out);\n");
+    int indent = 4;
+    for (int i = 0; i < tpl->node_count; i++) {
+        const Node *node = &tpl->nodes[i];
+        const Field *field = node->field >= 0 ? &tpl->fields[node->field] : NULL;
+        switch (node->kind) {
+            case NODE_TEXT:
+                write_span(source, node->text, node->len, indent);
+                break;
+            case NODE_SLOT:
+                buffer_printf(source, "%*stpl_%s(out, v->%s);\n", indent, "",
+                              node->type == FIELD_INT ? "int" : node->type == FIELD_RAW ? "raw" : "text", field->name);
+                break;
+            case NODE_IF:
+                if (field->type == FIELD_INT || field->type == FIELD_FLAG) {
+                    buffer_printf(source, "%*sif (v->%s) {\n", indent, "", field->name);
+                } else {
+                    buffer_printf(source, "%*sif (v->%s && v->%s[0]) {\n", indent, "", field->name, field->name);
+                }
+                indent += 4;
+                break;
+            case NODE_ELSE:
+                buffer_printf(source, "%*s} else {\n", indent - 4, "");
+                break;
+            case NODE_ENDIF:
+                indent -= 4;
+                buffer_printf(source, "%*s}\n", indent, "");
+                break;
+        }
+    }
+    buffer_printf(source, "    tpl_flush(out);\n}\n");
+}
+
+static void write_file(const char *path, const Buffer *buffer) {
+    char temp[1024];
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+    FILE *file = fopen(temp, "wb");
+    if (!file || fwrite(buffer->data, 1, buffer->len, file) != buffer->len || fclose(file) != 0 ||
+        rename(temp, path) != 0) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        remove(temp);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *base = NULL;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+        base = argv[2];
+        first = 3;
+    }
+    if (!base || first >= argc) {
+        fprintf(stderr, "Usage: %s -o output_base template.tpl ...\n", argv[0]);
+        return 1;
+    }
+
+    Template *templates = NULL;
+    int template_count = 0;
+    for (int i = first; i < argc; i++) {
+        parse_file(argv[i], read_file(argv[i]), &templates, &template_count);
+    }
+
+    const char *base_name = strrchr(base, '/') ? strrchr(base, '/') + 1 : base;
+    char guard[256];
+    size_t g = 0;
+    for (const char *p = base_name; *p && g + 3 < sizeof(guard); p++) {
+        guard[g++] = isalnum((unsigned char)*p) ? (char)toupper((unsigned char)*p) : '_';
+    }
+    guard[g++] = '_';
+    guard[g++] = 'H';
+    guard[g] = '\0';
+
+    Buffer header = { NULL, 0, 0 }, source = { NULL, 0, 0 };
+    buffer_printf(&header, "/* %s.h - Generated by tplc from the templates directory; do not edit */\n\n", base_name);
+    buffer_printf(&header, "#ifndef %s\n#define %s\n", guard, guard);
+    buffer_printf(&source, "/* %s.c - Generated by tplc from the templates directory; do not edit */\n\n", base_name);
+    buffer_printf(&source, "#include \"family_tree.h\"\n#include \"%s.h\"\n", base_name);
+
+    for (int i = 0; i < template_count; i++) write_template(&header, &source, &templates[i]);
+    buffer_printf(&header, "\n#endif\n");
+
+    // Header first, so the source is never older than it
+    char path[1024];
+    snprintf(path, sizeof(path), "%s.h", base);
+    write_file(path, &header);
+    snprintf(path, sizeof(path), "%s.c", base);
+    write_file(path, &source);
+    return 0;
+}
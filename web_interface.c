@@ -1,46 +1,103 @@
 /* web_interface.c - Web interface functions for family tree application */
 
 #include "family_tree.h"
+#include "templates_gen.h"
 void generate_tree_json(sqlite3 *db, int person_id, int levels);
 char* html_escape(const char *str);
 void render_person_card(Person *person);
 
 
 
+/*
+ * Page shell: the document markup around each page body never changes
+ * within a process. A CGI process renders one page and exits, so caching
+ * there only adds a copy; serve mode renders the shell once in the parent
+ * (page_shell_preload) and every forked child replays it as a single span.
+ * The footer only depends on the year; the parent re-renders it when the
+ * year turns (page_shell_maintain), and a child that outlives the year
+ * renders its own.
+ */
+static char *shell_prefix = NULL;
+static size_t shell_prefix_len = 0;
+static char *shell_footer = NULL;
+static size_t shell_footer_len = 0;
+static time_t shell_footer_expires = 0;
+
+static void write_page_shell(const char *data, size_t len) {
+    TemplateOutput output;
+    tpl_begin(&output);
+    tpl_span(&output, data, len);
+    tpl_flush(&output);
+}
+
+static int render_shell_footer(time_t now) {
+    struct tm tm = *localtime(&now);
+    size_t len;
+    tpl_capture_begin();
+    tpl_page_footer(&(TplPageFooter){ .year = tm.tm_year + 1900 });
+    char *data = tpl_capture_end(&len);
+    if (!data) return 1;
+    free(shell_footer);
+    shell_footer = data;
+    shell_footer_len = len;
+
+    // Valid until local midnight on 1 January
+    struct tm new_year = { .tm_year = tm.tm_year + 1, .tm_mon = 0, .tm_mday = 1, .tm_isdst = -1 };
+    shell_footer_expires = mktime(&new_year);
+    return 0;
+}
+
+// Render the page shell for PAGE_TITLE once, before serve mode starts forking
+int page_shell_preload(void) {
+    size_t len;
+    tpl_capture_begin();
+    tpl_page_header(&(TplPageHeader){ .title = PAGE_TITLE });
+    char *data = tpl_capture_end(&len);
+    if (!data || render_shell_footer(time(NULL)) != 0) {
+        free(data);
+        fprintf(stderr, "Out of memory rendering the page shell\n");
+        return 1;
+    }
+    free(shell_prefix);
+    shell_prefix = data;
+    shell_prefix_len = len;
+    return 0;
+}
+
+// Serve mode's parent re-renders the footer when the year turns
+void page_shell_maintain(void) {
+    time_t now = time(NULL);
+    if (shell_footer && now >= shell_footer_expires) render_shell_footer(now);
+}
+
 void print_html_header(const char *title) {
-    printf("Content-Type: text/html\n\n");
-    printf("<!DOCTYPE html>\n");
-    printf("<html lang=\"en\">\n");
-    printf("<head>\n");
-    printf("  <meta charset=\"UTF-8\">\n");
-    printf("  <meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n");
-    printf("  <title>%s</title>\n", title);
-    printf("  <link rel=\"stylesheet\" href=\"/styles.css\">\n");
-    printf("  <script src=\"https://cdnjs.cloudflare.com/ajax/libs/d3/7.8.5/d3.min.js\"></script>\n");
-    printf("  <script src=\"/family-tree.js\"></script>\n");
-    printf("</head>\n");
-    printf("<body>\n");
-    printf("  <header>\n");
-    printf("    <h1>%s</h1>\n", title);
-    printf("    <nav>\n");
-    printf("      <ul>\n");
-    printf("        <li><a href=\"/\">Home</a></li>\n");
-    printf("        <li><a href=\"/tree\">Family Tree</a></li>\n");
-    printf("        <li><a href=\"/login\">Login</a></li>\n");
-    printf("      </ul>\n");
-    printf("    </nav>\n");
-    printf("  </header>\n");
-    printf("  <main>\n");
+    fputs("Content-Type: text/html\n"
+          "Vary: Accept-Encoding\n\n", stdout);
+
+    if (shell_prefix && strcmp(title, PAGE_TITLE) == 0) {
+        write_page_shell(shell_prefix, shell_prefix_len);
+        return;
+    }
+    tpl_page_header(&(TplPageHeader){ .title = title });
 }
 
 void print_html_footer() {
-    printf("  </main>\n");
-    printf("  <footer>\n");
-    printf("    <p>&copy; %d Family Tree Project</p>\n", 
-           localtime(&(time_t){time(NULL)})->tm_year + 1900);
-    printf("  </footer>\n");
-    printf("</body>\n");
-    printf("</html>\n");
+    time_t now = time(NULL);
+
+    if (shell_footer && now < shell_footer_expires) {
+        write_page_shell(shell_footer, shell_footer_len);
+        return;
+    }
+    struct tm tm = *localtime(&now);
+    tpl_page_footer(&(TplPageFooter){ .year = tm.tm_year + 1900 });
+}
+
+static void render_person_link(const Person *person) {
+    tpl_person_link(&(TplPersonLink){
+        .id = person->id,
+        .first_name = interned_string(person->first_name_id),
+        .last_name = interned_string(person->last_name_id),
+    });
 }
 
 void render_person_profile(sqlite3 *db, int person_id) {
@@ -51,34 +108,14 @@ void render_person_profile(sqlite3 *db, int person_id) {
     }
 
     // Person info
-    printf("<div class=\"person-profile\">\n");
-    printf("  <h2>%s %s</h2>\n", 
-           html_escape(person.first_name), 
-           html_escape(person.last_name));
-    
-    if (person.photo_url) {
-        printf("  <img src=\"%s\" alt=\"%s %s\" class=\"profile-photo\">\n", 
-               html_escape(person.photo_url),
-               html_escape(person.first_name),
-               html_escape(person.last_name));
-    }
-    
-    printf("  <div class=\"person-details\">\n");
-    printf("    <p><strong>Birth:</strong> %s</p>\n", 
-           person.birth_date ? html_escape(person.birth_date) : "Unknown");
-    
-    if (person.death_date) {
-        printf("    <p><strong>Death:</strong> %s</p>\n", 
-               html_escape(person.death_date));
-    }
-    
-    if (person.bio) {
-        printf("    <div class=\"bio\">\n");
-        printf("      <h3>Biography</h3>\n");
-        printf("      <p>%s</p>\n", html_escape(person.bio));
-        printf("    </div>\n");
-    }
-    printf("  </div>\n");
+    tpl_person_profile_head(&(TplPersonProfileHead){
+        .first_name = interned_string(person.first_name_id),
+        .last_name = interned_string(person.last_name_id),
+        .photo_url = person.photo_url,
+        .birth_date = person.birth_date,
+        .death_date = person.death_date,
+        .bio = person.bio,
+    });
     
     // Parents
     Person father, mother;
@@ -86,28 +123,19 @@ void render_person_profile(sqlite3 *db, int person_id) {
     int has_mother = (mother.id > 0);
     
     if (has_father || has_mother) {
-        printf("  <div class=\"family-section parents\">\n");
-        printf("    <h3>Parents</h3>\n");
-        printf("    <ul>\n");
+        tpl_family_section_begin(&(TplFamilySectionBegin){ .section_class = "parents", .heading = "Parents" });
         
         if (has_father) {
-            printf("      <li><a href=\"/person?id=%d\">%s %s</a></li>\n", 
-                   father.id, 
-                   html_escape(father.first_name), 
-                   html_escape(father.last_name));
+            render_person_link(&father);
             free_person(&father);
         }
         
         if (has_mother) {
-            printf("      <li><a href=\"/person?id=%d\">%s %s</a></li>\n", 
-                   mother.id, 
-                   html_escape(mother.first_name), 
-                   html_escape(mother.last_name));
+            render_person_link(&mother);
             free_person(&mother);
         }
         
-        printf("    </ul>\n");
-        printf("  </div>\n");
+        tpl_family_section_end();
     }
     
     // Spouse
@@ -115,15 +143,9 @@ void render_person_profile(sqlite3 *db, int person_id) {
     int has_spouse = (get_spouse(db, person_id, &spouse) == 0 && spouse.id > 0);
     
     if (has_spouse) {
-        printf("  <div class=\"family-section spouse\">\n");
-        printf("    <h3>Spouse</h3>\n");
-        printf("    <ul>\n");
-        printf("      <li><a href=\"/person?id=%d\">%s %s</a></li>\n", 
-               spouse.id, 
-               html_escape(spouse.first_name), 
-               html_escape(spouse.last_name));
-        printf("    </ul>\n");
-        printf("  </div>\n");
+        tpl_family_section_begin(&(TplFamilySectionBegin){ .section_class = "spouse", .heading = "Spouse" });
+        render_person_link(&spouse);
+        tpl_family_section_end();
         free_person(&spouse);
     }
     
@@ -132,32 +154,19 @@ void render_person_profile(sqlite3 *db, int person_id) {
     int child_count = 0;
     
     if (get_children(db, person_id, &children, &child_count) == 0 && child_count > 0) {
-        printf("  <div class=\"family-section children\">\n");
-        printf("    <h3>Children</h3>\n");
-        printf("    <ul>\n");
+        tpl_family_section_begin(&(TplFamilySectionBegin){ .section_class = "children", .heading = "Children" });
         
         for (int i = 0; i < child_count; i++) {
-            printf("      <li><a href=\"/person?id=%d\">%s %s</a></li>\n", 
-                   children[i].id, 
-                   html_escape(children[i].first_name), 
-                   html_escape(children[i].last_name));
+            render_person_link(&children[i]);
             free_person(&children[i]);
         }
         
-        printf("    </ul>\n");
-        printf("  </div>\n");
+        tpl_family_section_end();
         free(children);
     }
     
     // Edit button for authenticated users
-    printf("  <div class=\"edit-section\">\n");
-    printf("    <form action=\"/edit_person\" method=\"get\">\n");
-    printf("      <input type=\"hidden\" name=\"id\" value=\"%d\">\n", person_id);
-    printf("      <button type=\"submit\" class=\"edit-button\">Edit Information</button>\n");
-    printf("    </form>\n");
-    printf("  </div>\n");
-    
-    printf("</div>\n");
+    tpl_person_profile_end(&(TplPersonProfileEnd){ .id = person_id });
     
     free_person(&person);
 }
@@ -180,6 +189,7 @@ void render_family_tree(sqlite3 *db, int root_id, int levels) {
         render_person_card(&spouse);
         free_person(&spouse);
     }
+    output_stream_flush();
     
     // Get parents and render them recursively
     if (levels > 1) {
@@ -216,8 +226,8 @@ void render_family_tree(sqlite3 *db, int root_id, int levels) {
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             Person child;
             child.id = sqlite3_column_int(stmt, 0);
-            child.first_name = sqlite3_column_text(stmt, 1) ? strdup((const char*)sqlite3_column_text(stmt, 1)) : NULL;
-            child.last_name = sqlite3_column_text(stmt, 2) ? strdup((const char*)sqlite3_column_text(stmt, 2)) : NULL;
+            child.first_name_id = intern_column(stmt, 1);
+            child.last_name_id = intern_column(stmt, 2);
             child.gender = sqlite3_column_text(stmt, 3) ? *((const char*)sqlite3_column_text(stmt, 3)) : '\0';
             child.birth_date = sqlite3_column_text(stmt, 4) ? strdup((const char*)sqlite3_column_text(stmt, 4)) : NULL;
             child.death_date = sqlite3_column_text(stmt, 5) ? strdup((const char*)sqlite3_column_text(stmt, 5)) : NULL;
@@ -237,6 +247,191 @@ void render_family_tree(sqlite3 *db, int root_id, int levels) {
     free_person(&person);
 }
 
+/*
+ * Births, deaths, marriages and divorces of a person, or of a person and
+ * all their descendants, in date order. Each kind of event is one
+ * statement walking its day-number index in order, restricted to the
+ * people in temp.timeline_people, and the page is a k-way merge of those
+ * streams: nothing is loaded or sorted up front, so the first events go
+ * out as soon as each stream has its first row. Events on the same day
+ * come in stream order. Columns: day, date text, then id, first and last
+ * name of one or two people.
+ *
+ * Walking a whole index costs the same however few people are in scope,
+ * so below TIMELINE_STREAM_MIN people the index hints are left out and
+ * SQLite starts from the people instead, sorting their handful of events.
+ */
+#define TIMELINE_STREAM_MIN 1000
+
+typedef struct {
+    const char *sql;        // %s takes the INDEXED BY clause
+    const char *index;
+    const char *css_class;
+    const char *label;
+} TimelineStreamDef;
+
+static const TimelineStreamDef timeline_streams[] = {
+    { "SELECT p.birth_day, p.birth_date, p.id, p.first_name, p.last_name, NULL, NULL, NULL "
+      "FROM people p %s "
+      "WHERE p.birth_day IS NOT NULL AND p.id IN temp.timeline_people "
+      "ORDER BY p.birth_day, p.id;", "idx_people_birth_span", "timeline-birth", "Born" },
+    { "SELECT r.marriage_day, r.marriage_date, a.id, a.first_name, a.last_name, b.id, b.first_name, b.last_name "
+      "FROM relationships r %s "
+      "JOIN people a ON a.id = r.person1_id JOIN people b ON b.id = r.person2_id "
+      "WHERE r.marriage_day IS NOT NULL AND r.relationship_type = 'spouse' "
+      "AND (r.person1_id IN temp.timeline_people OR r.person2_id IN temp.timeline_people) "
+      "ORDER BY r.marriage_day, r.person1_id, r.person2_id;", "idx_relationships_marriage", "timeline-marriage", "Married" },
+    { "SELECT r.divorce_day, r.divorce_date, a.id, a.first_name, a.last_name, b.id, b.first_name, b.last_name "
+      "FROM relationships r %s "
+      "JOIN people a ON a.id = r.person1_id JOIN people b ON b.id = r.person2_id "
+      "WHERE r.divorce_day IS NOT NULL AND r.relationship_type = 'spouse' "
+      "AND (r.person1_id IN temp.timeline_people OR r.person2_id IN temp.timeline_people) "
+      "ORDER BY r.divorce_day, r.person1_id, r.person2_id;", "idx_relationships_divorce", "timeline-divorce", "Divorced" },
+    { "SELECT p.death_day, p.death_date, p.id, p.first_name, p.last_name, NULL, NULL, NULL "
+      "FROM people p %s "
+      "WHERE p.death_day IS NOT NULL AND p.id IN temp.timeline_people "
+      "ORDER BY p.death_day, p.id;", "idx_people_death_span", "timeline-death", "Died" },
+};
+
+#define TIMELINE_STREAMS (int)(sizeof(timeline_streams) / sizeof(timeline_streams[0]))
+
+/*
+ * Fill temp.timeline_people with the person and, if asked, their
+ * descendants: walked in serve mode's resident person table while it is
+ * current, otherwise inside SQLite. Returns how many, -1 on error
+ */
+static int timeline_load_people(sqlite3 *db, int person_id, int descendants) {
+    sqlite3_stmt *stmt;
+    PersonTable *table = descendants ? person_table_current(db) : NULL;
+    int *ids = NULL, count = 0;
+    if (table && person_table_descendants(table, person_id, &ids, &count) != 0) table = NULL;
+    const char *sql =
+        !descendants || table ? "INSERT INTO temp.timeline_people (id) VALUES (?1);"
+        : closure_enabled(db)
+            ? "INSERT OR IGNORE INTO temp.timeline_people (id) "
+              "SELECT ?1 UNION SELECT descendant_id FROM ancestry WHERE ancestor_id = ?1;"
+            : "INSERT OR IGNORE INTO temp.timeline_people (id) "
+              "WITH RECURSIVE subtree(id) AS ("
+              "  SELECT ?1 "
+              "  UNION "
+              "  SELECT r.person2_id FROM relationships r "
+              "  JOIN subtree s ON r.person1_id = s.id AND r.relationship_type = 'parent-child'"
+              ") SELECT id FROM subtree;";
+    
+    if (sqlite3_exec(db, "CREATE TEMP TABLE IF NOT EXISTS timeline_people (id INTEGER PRIMARY KEY);"
+                         "DELETE FROM temp.timeline_people;", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        free(ids);
+        return -1;
+    }
+    if (table) sqlite3_exec(db, "SAVEPOINT timeline_load;", NULL, NULL, NULL);
+    sqlite3_bind_int(stmt, 1, person_id);
+    int rc = sqlite3_step(stmt);
+    int changes = sqlite3_changes(db);
+    
+    // The subtree from the resident records, one row each, in place of the query
+    for (int i = 0; rc == SQLITE_DONE && i < count; i++) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, ids[i]);
+        rc = sqlite3_step(stmt);
+        changes += sqlite3_changes(db);
+    }
+    sqlite3_finalize(stmt);
+    if (table) sqlite3_exec(db, "RELEASE timeline_load;", NULL, NULL, NULL);
+    free(ids);
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return changes;
+}
+
+static void render_timeline_name(sqlite3_stmt *stmt, int column) {
+    char *first = html_escape((const char*)sqlite3_column_text(stmt, column + 1));
+    char *last = html_escape((const char*)sqlite3_column_text(stmt, column + 2));
+    printf("<a href=\"?action=view_profile&id=%d\">%s %s</a>", sqlite3_column_int(stmt, column),
+           first ? first : "", last ? last : "");
+    free(first);
+    free(last);
+}
+
+void render_timeline(sqlite3 *db, int person_id, int descendants) {
+    Person person;
+    if (get_person_by_id(db, person_id, &person) != 0) {
+        printf("<p>Person not found.</p>\n");
+        return;
+    }
+    char *first = html_escape(interned_string(person.first_name_id));
+    char *last = html_escape(interned_string(person.last_name_id));
+    printf("<h2>Timeline: %s %s%s</h2>\n", first, last, descendants ? " and descendants" : "");
+    printf("<div class=\"timeline-scope\">\n");
+    printf("<a href=\"?action=timeline&id=%d\" class=\"%s\">%s %s only</a>\n", person_id,
+           descendants ? "btn-secondary" : "btn-primary", first, last);
+    printf("<a href=\"?action=timeline&id=%d&scope=descendants\" class=\"%s\">With descendants</a>\n", person_id,
+           descendants ? "btn-primary" : "btn-secondary");
+    printf("</div>\n");
+    free(first);
+    free(last);
+    free_person(&person);
+    output_stream_flush();
+    
+    int people = timeline_load_people(db, person_id, descendants);
+    if (people < 0) {
+        printf("<p>Could not load the timeline.</p>\n");
+        return;
+    }
+    
+    sqlite3_stmt *streams[TIMELINE_STREAMS];
+    int has_row[TIMELINE_STREAMS];
+    for (int i = 0; i < TIMELINE_STREAMS; i++) {
+        char hint[64] = "";
+        if (people >= TIMELINE_STREAM_MIN) snprintf(hint, sizeof(hint), "INDEXED BY %s", timeline_streams[i].index);
+        char sql[1024];
+        snprintf(sql, sizeof(sql), timeline_streams[i].sql, hint);
+        if (sqlite3_prepare_v2(db, sql, -1, &streams[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+            streams[i] = NULL;
+        }
+        has_row[i] = streams[i] && sqlite3_step(streams[i]) == SQLITE_ROW;
+    }
+    
+    printf("<ol class=\"timeline\">\n");
+    int events = 0;
+    for (;;) {
+        // Four streams: a linear pick of the earliest head beats a heap
+        int next = -1;
+        for (int i = 0; i < TIMELINE_STREAMS; i++) {
+            if (has_row[i] && (next < 0 || sqlite3_column_int(streams[i], 0) < sqlite3_column_int(streams[next], 0))) {
+                next = i;
+            }
+        }
+        if (next < 0) break;
+        
+        sqlite3_stmt *stmt = streams[next];
+        char *date = html_escape((const char*)sqlite3_column_text(stmt, 1));
+        printf("<li class=\"%s\"><span class=\"timeline-date\">%s</span> %s: ",
+               timeline_streams[next].css_class, date ? date : "", timeline_streams[next].label);
+        render_timeline_name(stmt, 2);
+        if (sqlite3_column_type(stmt, 5) != SQLITE_NULL) {
+            printf(" and ");
+            render_timeline_name(stmt, 5);
+        }
+        printf("</li>\n");
+        free(date);
+        events++;
+        output_stream_flush();
+        
+        has_row[next] = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    printf("</ol>\n");
+    
+    for (int i = 0; i < TIMELINE_STREAMS; i++) sqlite3_finalize(streams[i]);
+    if (events == 0) {
+        printf("<p>No dated events.</p>\n");
+    }
+}
+
 void generate_tree_json(sqlite3 *db, int person_id, int levels) {
     if (levels <= 0) {
         printf("null");
@@ -253,8 +448,8 @@ void generate_tree_json(sqlite3 *db, int person_id, int levels) {
     printf("  \"id\": %d,\n", person.id);
     
     // For name
-    char *escaped_first_name = html_escape(person.first_name);
-    char *escaped_last_name = html_escape(person.last_name);
+    char *escaped_first_name = html_escape(interned_string(person.first_name_id));
+    char *escaped_last_name = html_escape(interned_string(person.last_name_id));
     printf("  \"name\": \"%s %s\",\n", escaped_first_name, escaped_last_name);
     free(escaped_first_name);
     free(escaped_last_name);
@@ -281,8 +476,8 @@ void generate_tree_json(sqlite3 *db, int person_id, int levels) {
         printf("  \"spouse\": {\n");
         printf("    \"id\": %d,\n", spouse.id);
         
-        char *escaped_spouse_first = html_escape(spouse.first_name);
-        char *escaped_spouse_last = html_escape(spouse.last_name);
+        char *escaped_spouse_first = html_escape(interned_string(spouse.first_name_id));
+        char *escaped_spouse_last = html_escape(interned_string(spouse.last_name_id));
         printf("    \"name\": \"%s %s\"\n", escaped_spouse_first, escaped_spouse_last);
         free(escaped_spouse_first);
         free(escaped_spouse_last);